@@ -0,0 +1,31 @@
+/**************************************************************************************************
+  Filename:       bsp.h
+
+  Description:    Host stand-in for the BSP so firmware sources can be built into
+                  the benchmarks (see xtea_fw.c). Only what those sources use:
+                  the critical section macros, which do nothing on the host, and
+                  the little endian byte order macros of the MSP430 BSP.
+**************************************************************************************************/
+
+#ifndef BSP_H
+#define BSP_H
+
+#include <stdint.h>
+
+typedef uint16_t bspIState_t;
+
+#define BSP_ENTER_CRITICAL_SECTION(x)   st( (x) = 0; )
+#define BSP_EXIT_CRITICAL_SECTION(x)    st( (void)(x); )
+#define BSP_CRITICAL_STATEMENT(x)       st( x; )
+#define BSP_ASSERT(expr)                /* empty */
+#define BSP_STATIC_ASSERT(expr)         typedef char bspStaticAssert[1/((expr)!=0)]
+
+#define st(x)      do { x } while (__LINE__ == -1)
+
+/* Network order for encryption is little endian, as on the MSP430 */
+#define ntohs(x)   (x)
+#define htons(x)   (x)
+#define ntohl(x)   (x)
+#define htonl(x)   (x)
+
+#endif
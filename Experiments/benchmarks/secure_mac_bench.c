@@ -0,0 +1,329 @@
+/**************************************************************************************************
+  Filename:       secure_mac_bench.c
+
+  Description:    Host benchmark of the cost of securing and checking a frame
+                  with the legacy SMPL_SECURE check (constant MAC byte and XOR
+                  FCS, both enciphered) and with the SMPL_SECURE_MAC_SIZE
+                  CBC-MAC tag. The framing follows nwk_security.c; the cipher
+                  is the scalar kernel from xtea_host.h, which gives the same
+                  output as the firmware.
+
+                  For 10 and 50 byte payloads the benchmark reports:
+                    - bytes added to the frame by security,
+                    - XTEA blocks to send, to accept and to reject a frame,
+                    - host cycles per frame (TSC on x86, ns elsewhere) for the
+                      same three cases.
+                  The reject case is a frame with one payload bit flipped.
+                  Every such frame must be rejected, and in CBC-MAC mode it
+                  must be rejected without any of it being deciphered.
+
+                  XTEA blocks dominate the cost on the MSP430, so the block
+                  counts multiplied by the per-block cycles from the IAR
+                  simulator give the target cost.
+
+  Build:          gcc -O2 -o secure_mac_bench secure_mac_bench.c
+  Run:            ./secure_mac_bench [frames] [tagBytes]
+**************************************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "xtea_host.h"
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define SEC_BLOCK_SIZE  8
+#define MAX_PAYLOAD     64
+#define PORT            0x20
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+/* The parts of an mrfiPacket_t the security code looks at. 'sec' holds the
+ * counter hint and the check bytes, 'pay' the application payload.
+ */
+typedef struct
+{
+  uint8_t src[4], dst[4];
+  uint8_t port;
+  uint8_t sec[1 + SEC_BLOCK_SIZE];
+  uint8_t pay[MAX_PAYLOAD];
+} frame_t;
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+static const uint32_t sIV = 0x87654321;
+static uint32_t       sRk[XTEA_RK_WORDS];
+static uint8_t        sTagSize = 4;
+static long           sBlocks;
+static long           sDeciphered;
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static void encipher(uint32_t *v)
+{
+  xtea_encipher_rk(sRk, v);
+  sBlocks++;
+}
+
+/* msg_encipher() */
+static void ctr_xor(uint8_t *msg, uint8_t len, uint32_t *ctr)
+{
+  uint32_t blk[2];
+  uint8_t  i, idx = 0;
+
+  while (idx < len)
+  {
+    blk[0] = sIV;
+    blk[1] = (*ctr)++;
+    encipher(blk);
+    for (i=0; i<SEC_BLOCK_SIZE && idx<len; ++i, ++idx)
+    {
+      msg[idx] ^= ((uint8_t *)blk)[i];
+    }
+  }
+}
+
+/* calcMAC() */
+static void cbc_mac(const frame_t *f, uint8_t len, uint32_t ctr, uint8_t *tag)
+{
+  uint32_t blk[2];
+  uint8_t  i, idx;
+
+  blk[0] = ((uint32_t)len << 24) | ((uint32_t)(f->port & 0x3F) << 16) |
+           ((uint32_t)(f->src[0] ^ f->src[1] ^ f->src[2] ^ f->src[3]) << 8) |
+            (uint32_t)(f->dst[0] ^ f->dst[1] ^ f->dst[2] ^ f->dst[3]);
+  blk[1] = ctr;
+  encipher(blk);
+  for (idx=0; idx<len; )
+  {
+    for (i=0; i<SEC_BLOCK_SIZE && idx<len; ++i, ++idx)
+    {
+      ((uint8_t *)blk)[i] ^= f->pay[idx];
+    }
+    encipher(blk);
+  }
+  memcpy(tag, blk, sTagSize);
+}
+
+/* nwk_setSecureFrame(), legacy: [hint][FCS][MAC][payload], all but the hint enciphered */
+static void set_legacy(frame_t *f, uint8_t len, uint32_t *ctr)
+{
+  uint8_t buf[2 + MAX_PAYLOAD], i, fcs = 0;
+
+  f->sec[0] = (uint8_t)*ctr;
+  buf[1] = 0xA5;
+  memcpy(buf + 2, f->pay, len);
+  for (i=1; i<len+2; ++i)
+  {
+    fcs ^= buf[i];
+  }
+  buf[0] = fcs;
+  ctr_xor(buf, len + 2, ctr);
+  memcpy(f->sec + 1, buf, 2);
+  memcpy(f->pay, buf + 2, len);
+}
+
+/* nwk_getSecureFrame(), legacy, counters in sync */
+static int get_legacy(frame_t *f, uint8_t len, uint32_t *ctr)
+{
+  uint8_t buf[2 + MAX_PAYLOAD], i, fcs = 0;
+
+  memcpy(buf, f->sec + 1, 2);
+  memcpy(buf + 2, f->pay, len);
+  sDeciphered++;
+  ctr_xor(buf, len + 2, ctr);
+  for (i=1; i<len+2; ++i)
+  {
+    fcs ^= buf[i];
+  }
+  memcpy(f->pay, buf + 2, len);
+  return (0xA5 == buf[1]) && (fcs == buf[0]);
+}
+
+/* nwk_setSecureFrame(), CBC-MAC: [hint][tag][payload], payload enciphered */
+static void set_mac(frame_t *f, uint8_t len, uint32_t *ctr)
+{
+  uint32_t macCnt = *ctr;
+
+  f->sec[0] = (uint8_t)*ctr;
+  ctr_xor(f->pay, len, ctr);
+  if (!len)
+  {
+    (*ctr)++;
+  }
+  cbc_mac(f, len, macCnt, f->sec + 1);
+}
+
+/* nwk_getSecureFrame(), CBC-MAC, counters in sync */
+static int get_mac(frame_t *f, uint8_t len, uint32_t *ctr)
+{
+  uint8_t tag[SEC_BLOCK_SIZE], i, diff = 0;
+
+  cbc_mac(f, len, *ctr, tag);
+  for (i=0; i<sTagSize; ++i)
+  {
+    diff |= tag[i] ^ f->sec[1 + i];
+  }
+  if (diff)
+  {
+    return 0;
+  }
+  sDeciphered++;
+  ctr_xor(f->pay, len, ctr);
+  if (!len)
+  {
+    (*ctr)++;
+  }
+  return 1;
+}
+
+static double now(void)
+{
+#if defined(HAVE_TSC)
+  return (double)__rdtsc();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+#endif
+}
+
+static int run(const char *name, uint8_t overhead, uint8_t len, long frames,
+               void (*set)(frame_t *, uint8_t, uint32_t *),
+               int (*get)(frame_t *, uint8_t, uint32_t *))
+{
+  uint32_t txCtr = 0x1000, rxCtr = txCtr;
+  long     bSet = 0, bOk = 0, bBad = 0, decBad = 0, n;
+  double   tSet = 0, tOk = 0, tBad = 0, t0;
+
+  for (n=0; n<frames; ++n)
+  {
+    frame_t  f, forged;
+    uint8_t  plain[MAX_PAYLOAD];
+    uint32_t badCtr = rxCtr;
+    int      i;
+
+    memset(&f, 0, sizeof(f));
+    memcpy(f.src, "\x11\x22\x33\x44", 4);
+    memcpy(f.dst, "\x78\x56\x34\x12", 4);
+    f.port = PORT;
+    for (i=0; i<len; ++i)
+    {
+      plain[i] = f.pay[i] = (uint8_t)(n + i);
+    }
+
+    sBlocks = 0;
+    t0 = now();
+    set(&f, len, &txCtr);
+    tSet += now() - t0;
+    bSet += sBlocks;
+
+    /* forged copy: one payload bit flipped */
+    forged = f;
+    if (len)
+    {
+      forged.pay[n % len] ^= (uint8_t)(1 << (n & 7));
+    }
+    else
+    {
+      forged.sec[1] ^= 1;
+    }
+    sBlocks     = 0;
+    sDeciphered = 0;
+    t0 = now();
+    if (get(&forged, len, &badCtr))
+    {
+      fprintf(stderr, "%s: forged frame %ld accepted\n", name, n);
+      return 1;
+    }
+    tBad   += now() - t0;
+    bBad   += sBlocks;
+    decBad += sDeciphered;
+
+    sBlocks = 0;
+    t0 = now();
+    if (!get(&f, len, &rxCtr) || memcmp(f.pay, plain, len) || (rxCtr != txCtr))
+    {
+      fprintf(stderr, "%s: frame %ld not recovered\n", name, n);
+      return 1;
+    }
+    tOk += now() - t0;
+    bOk += sBlocks;
+  }
+
+  printf("%-10s %4u  %8u  %5.1f %5.1f %5.1f  %8.0f %8.0f %8.0f  %s\n",
+         name, len, overhead,
+         (double)bSet / frames, (double)bOk / frames, (double)bBad / frames,
+         tSet / frames, tOk / frames, tBad / frames,
+         decBad ? "after decipher" : "before decipher");
+  return 0;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  long     frames = argc > 1 ? atol(argv[1]) : 200000;
+  uint32_t key[4];
+  char     name[16];
+  int      i;
+  static const uint8_t lens[] = { 10, 50 };
+
+  if (argc > 2)
+  {
+    sTagSize = (uint8_t)atoi(argv[2]);
+  }
+  if ((sTagSize < 2) || (sTagSize > SEC_BLOCK_SIZE) || (frames < 1))
+  {
+    fprintf(stderr, "tagBytes must be 2..%d\n", SEC_BLOCK_SIZE);
+    return 1;
+  }
+
+  /* "SimpliciTI's Key" in network order, as nwk_securityInit() leaves it */
+  for (i=0; i<4; ++i)
+  {
+    const char *k = "SimpliciTI's Key" + 4*i;
+
+    key[i] = ((uint32_t)(uint8_t)k[0] << 24) | ((uint32_t)(uint8_t)k[1] << 16) |
+             ((uint32_t)(uint8_t)k[2] << 8)  |  (uint32_t)(uint8_t)k[3];
+  }
+  xtea_schedule(key, sRk);
+
+  printf("%ld frames, cost per frame in %s\n", frames,
+#if defined(HAVE_TSC)
+         "TSC cycles"
+#else
+         "ns"
+#endif
+         );
+  printf("                            XTEA blocks            cost\n");
+  printf("mode        len  overhead     tx    ok   bad        tx       ok      bad  forgery rejected\n");
+  snprintf(name, sizeof(name), "mac%u", sTagSize);
+  for (i=0; i<(int)sizeof(lens); ++i)
+  {
+    if (run("legacy", 3, lens[i], frames, set_legacy, get_legacy) ||
+        run(name, 1 + sTagSize, lens[i], frames, set_mac, get_mac))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,222 @@
+/**************************************************************************************************
+  Filename:       security_bench.c
+
+  Description:    Host benchmark of the per-frame cost of SMPL_SECURE with and
+                  without the NWK_KS_BLOCKS keystream cache. The XTEA core, the
+                  CTR framing and the MAC/FCS bytes follow nwk_security.c so the
+                  block counts are the ones the MSP430 sees. Times are host
+                  times, include one clock read each, and only show the
+                  ratio between the two paths.
+
+                  For every payload length the benchmark reports:
+                    - cipher blocks per frame,
+                    - ns per frame when every block is enciphered at send
+                      time (NWK_KS_BLOCKS=0),
+                    - ns per frame on the send path when the blocks come from
+                      the cache, and the ns spent refilling it afterwards.
+                  Each cached frame is also checked against the uncached one.
+
+  Build:          gcc -O2 -o security_bench security_bench.c
+  Run:            ./security_bench [frames]
+**************************************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define NUM_ROUNDS         32
+#define SEC_BLOCK_SIZE     8
+#define MAX_APP_PAYLOAD    10
+#define SEC_OVERHEAD       2       /* MAC and FCS bytes, both enciphered */
+#define NWK_KS_BLOCKS      ((MAX_APP_PAYLOAD + SEC_OVERHEAD + SEC_BLOCK_SIZE - 1) / SEC_BLOCK_SIZE)
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+typedef struct
+{
+  uint32_t ctr;
+  uint8_t  num;
+  uint8_t  ks[NWK_KS_BLOCKS][SEC_BLOCK_SIZE];
+} ksCache_t;
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+static const uint32_t sIV = 0x87654321;
+static uint32_t sKey[4];
+static uint32_t sBlocks;
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static void xtea_encipher(uint32_t *v)
+{
+  uint32_t v0 = v[0], v1 = v[1], sum = 0, delta = 0x9E3779B9;
+  int      i;
+
+  for (i=0; i<NUM_ROUNDS; i++)
+  {
+    v0  += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + sKey[sum & 3]);
+    sum += delta;
+    v1  += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + sKey[(sum>>11) & 3]);
+  }
+  v[0] = v0;
+  v[1] = v1;
+  sBlocks++;
+}
+
+/* msg_encipher() with the optional cache lookup */
+static void msg_encipher(uint8_t *msg, uint8_t len, uint32_t *cntStart, const ksCache_t *ks)
+{
+  uint32_t ctr = *cntStart, blk[2];
+  uint8_t  i, idx = 0;
+
+  while (idx < len)
+  {
+    const uint8_t *mptr;
+
+    if (ks && ((ctr - ks->ctr) < ks->num))
+    {
+      mptr = ks->ks[ctr - ks->ctr];
+    }
+    else
+    {
+      blk[0] = sIV;
+      blk[1] = ctr;
+      xtea_encipher(blk);
+      mptr = (const uint8_t *)blk;
+    }
+    ctr++;
+    for (i=0; i<SEC_BLOCK_SIZE && idx<len; ++i, ++idx)
+    {
+      msg[idx] ^= mptr[i];
+    }
+  }
+  *cntStart = ctr;
+}
+
+/* nwk_setSecureFrame(): MAC and FCS then encipher. 'frame' holds FCS, MAC, payload. */
+static void secure(uint8_t *frame, uint8_t len, uint32_t *ctr, const ksCache_t *ks)
+{
+  uint8_t i, fcs = 0;
+
+  frame[1] = 0xA5;
+  for (i=1; i<len+2; ++i)
+  {
+    fcs ^= frame[i];
+  }
+  frame[0] = fcs;
+  msg_encipher(frame, len + SEC_OVERHEAD, ctr, ks);
+}
+
+/* nwk_fillKeystream() */
+static void fill(ksCache_t *ks, uint32_t ctr)
+{
+  uint32_t skip = ctr - ks->ctr, blk[2];
+  uint8_t  i, keep = 0;
+
+  if (!skip && (NWK_KS_BLOCKS == ks->num))
+  {
+    return;
+  }
+  if (skip < ks->num)
+  {
+    keep = ks->num - (uint8_t)skip;
+    memmove(ks->ks[0], ks->ks[skip], keep * SEC_BLOCK_SIZE);
+  }
+  ks->ctr = ctr;
+  for (i=keep; i<NWK_KS_BLOCKS; ++i)
+  {
+    blk[0] = sIV;
+    blk[1] = ctr + i;
+    xtea_encipher(blk);
+    memcpy(ks->ks[i], blk, SEC_BLOCK_SIZE);
+  }
+  ks->num = NWK_KS_BLOCKS;
+}
+
+static double now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  long     frames = argc > 1 ? atol(argv[1]) : 200000;
+  uint8_t  len;
+  long     n;
+  int      i;
+
+  /* "SimpliciTI's Key" in network order, as nwk_securityInit() leaves it */
+  for (i=0; i<4; ++i)
+  {
+    const char *k = "SimpliciTI's Key" + 4*i;
+
+    sKey[i] = ((uint32_t)(uint8_t)k[0] << 24) | ((uint32_t)(uint8_t)k[1] << 16) |
+              ((uint32_t)(uint8_t)k[2] << 8)  |  (uint32_t)(uint8_t)k[3];
+  }
+
+  printf("%ld frames per length, NWK_KS_BLOCKS %d\n", frames, NWK_KS_BLOCKS);
+  printf("payload  blocks  uncached ns  cached send ns  refill ns  speedup\n");
+
+  for (len=0; len<=MAX_APP_PAYLOAD; len+=2)
+  {
+    uint8_t   a[MAX_APP_PAYLOAD + SEC_OVERHEAD], b[sizeof(a)];
+    uint32_t  ca = 0x12345678, cb = ca;
+    ksCache_t ks = { 0 };
+    double    t0, tPlain = 0, tSend = 0, tFill = 0;
+    uint32_t  blocks;
+
+    sBlocks = 0;
+    secure(memset(a, 0, sizeof(a)), len, &ca, NULL);
+    blocks = sBlocks;
+    ca = cb;
+    fill(&ks, cb);
+
+    for (n=0; n<frames; ++n)
+    {
+      memset(a, (int)n, sizeof(a));
+      memcpy(b, a, sizeof(b));
+
+      t0 = now_ns();
+      secure(a, len, &ca, NULL);
+      tPlain += now_ns() - t0;
+
+      t0 = now_ns();
+      secure(b, len, &cb, &ks);
+      tSend += now_ns() - t0;
+
+      t0 = now_ns();
+      fill(&ks, cb);
+      tFill += now_ns() - t0;
+
+      if (memcmp(a, b, len + SEC_OVERHEAD) || (ca != cb))
+      {
+        fprintf(stderr, "mismatch at frame %ld, payload %u\n", n, len);
+        return 1;
+      }
+    }
+
+    printf("%5u  %6u  %11.1f  %14.1f  %9.1f  %6.1fx\n", len, blocks,
+           tPlain / frames, tSend / frames, tFill / frames,
+           tSend > 0 ? tPlain / tSend : 0.0);
+  }
+  return 0;
+}
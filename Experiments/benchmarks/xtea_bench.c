@@ -0,0 +1,288 @@
+/**************************************************************************************************
+  Filename:       xtea_bench.c
+
+  Description:    Host check and benchmark of the XTEA kernels in xtea_host.h
+                  and of the firmware xtea_encipher() against the original
+                  xtea_encipher() loop from nwk_security.c, kept here verbatim
+                  as the reference.
+
+                  The reference must give the published XTEA test vectors.
+                  Every kernel is then run on random keys and blocks and must
+                  match the reference bit for bit, including CTR keystream in
+                  the byte order msg_encipher() uses. The firmware kernel is
+                  nwk_security.c itself, built in by xtea_fw.c: the key index
+                  table by default, the round-key schedule when built with
+                  -DSMPL_XTEA_SCHEDULE. Build both. Then each kernel is timed
+                  on the SimpliciTI key and the cost per 64-bit block is
+                  reported in TSC cycles (x86) or ns (other hosts).
+
+                  Host times say nothing about the MSP430, where the two
+                  firmware variants differ in RAM and in 16-bit register
+                  pressure. Target cycle counts come from the IAR simulator,
+                  not from this program.
+
+  Build:          C=../../IARworkspace/ez430-rf2500_wsm/Components
+                  F="-Ihost -I$C/mrfi -I$C/simpliciti/nwk -I$C/simpliciti/nwk_applications"
+                  gcc -O2 -march=native $F -o xtea_bench xtea_bench.c xtea_fw.c
+                  gcc -O2 -march=native $F -DSMPL_XTEA_SCHEDULE -o xtea_bench_rk xtea_bench.c xtea_fw.c
+  Run:            ./xtea_bench [blocks] [seed]
+**************************************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "xtea_host.h"
+#include "xtea_fw.h"
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define NUM_ROUNDS    32
+#define CHECK_BLOCKS  100000
+#define CHECK_KEYS    64
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+static const uint32_t sIV = 0x87654321;
+static uint32_t       sKey[4];
+static uint32_t       sRand;
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* xtea_encipher() as it was in nwk_security.c, key passed in */
+static void xtea_ref(const uint32_t *key, uint32_t *v)
+{
+  uint32_t v0=v[0], v1=v[1];
+  uint16_t i;
+  uint32_t sum=0, delta=0x9E3779B9;
+
+  for(i=0; i<NUM_ROUNDS; i++)
+  {
+    v0  += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + key[sum & 3]);
+    sum += delta;
+    v1  += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + key[(sum>>11) & 3]);
+  }
+
+  v[0]=v0;
+  v[1]=v1;
+}
+
+static uint32_t rnd(void)
+{
+  sRand ^= sRand << 13;
+  sRand ^= sRand >> 17;
+  sRand ^= sRand << 5;
+  return sRand;
+}
+
+static double now(void)
+{
+#if defined(HAVE_TSC)
+  return (double)__rdtsc();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+#endif
+}
+
+/* Published XTEA vectors (32 cycles, words big endian): key, plaintext,
+ * ciphertext. Checks the reference itself. Returns the number of mismatches.
+ */
+static long checkVectors(void)
+{
+  static const uint32_t vec[][8] = {
+    {0x00010203, 0x04050607, 0x08090A0B, 0x0C0D0E0F,
+     0x41424344, 0x45464748, 0x497DF3D0, 0x72612CB5},
+    {0x00000000, 0x00000000, 0x00000000, 0x00000000,
+     0x00000000, 0x00000000, 0xDEE9D4D8, 0xF7131ED9}
+  };
+  long     bad = 0;
+  unsigned i;
+
+  for (i=0; i<sizeof(vec)/sizeof(vec[0]); ++i)
+  {
+    uint32_t v[2] = { vec[i][4], vec[i][5] };
+
+    xtea_ref(vec[i], v);
+    bad += (v[0] != vec[i][6]) || (v[1] != vec[i][7]);
+  }
+  return bad;
+}
+
+/* Compare every kernel with the reference. Returns the number of mismatches. */
+static long check(void)
+{
+  uint32_t key[4], fwKey[4], rk[XTEA_RK_WORDS];
+  long     bad = 0;
+  int      k, n, j;
+
+  for (k=0; k<CHECK_KEYS; ++k)
+  {
+    for (j=0; j<4; ++j)
+    {
+      key[j] = k ? rnd() : sKey[j];
+    }
+    xtea_schedule(key, rk);
+    xtea_fw_set_key(key, fwKey);
+    bad += memcmp(key, fwKey, sizeof(key)) != 0;
+
+    for (n=0; n<CHECK_BLOCKS/CHECK_KEYS; n+=XTEA_LANES)
+    {
+      uint32_t v0[XTEA_LANES], v1[XTEA_LANES], ref[XTEA_LANES][2];
+      uint8_t  ks[8 * XTEA_LANES];
+      uint32_t ctr = rnd();
+
+      for (j=0; j<XTEA_LANES; ++j)
+      {
+        uint32_t v[2];
+
+        ref[j][0] = v0[j] = rnd();
+        ref[j][1] = v1[j] = rnd();
+        xtea_ref(key, ref[j]);
+
+        v[0] = v0[j];
+        v[1] = v1[j];
+        xtea_encipher_rk(rk, v);
+        bad += (v[0] != ref[j][0]) || (v[1] != ref[j][1]);
+
+        v[0] = v0[j];
+        v[1] = v1[j];
+        xtea_fw_encipher(v);
+        bad += (v[0] != ref[j][0]) || (v[1] != ref[j][1]);
+      }
+      xtea_encipher_lanes(rk, v0, v1);
+      for (j=0; j<XTEA_LANES; ++j)
+      {
+        bad += (v0[j] != ref[j][0]) || (v1[j] != ref[j][1]);
+      }
+
+      /* keystream, including a partial last group */
+      xtea_ctr_keystream(rk, sIV, ctr, XTEA_LANES - (n & 3), ks);
+      for (j=0; j<XTEA_LANES - (n & 3); ++j)
+      {
+        uint32_t v[2] = { sIV, ctr + j };
+        uint8_t  b[8];
+        int      i;
+
+        xtea_ref(key, v);
+        for (i=0; i<4; ++i)
+        {
+          b[i]   = (uint8_t)(v[0] >> (8*i));
+          b[i+4] = (uint8_t)(v[1] >> (8*i));
+        }
+        bad += memcmp(b, &ks[8*j], 8) != 0;
+      }
+    }
+  }
+  return bad;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  long     blocks = argc > 1 ? atol(argv[1]) : 2000000;
+  uint32_t seed   = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 1;
+  uint32_t rk[XTEA_RK_WORDS], v[2], v0[XTEA_LANES], v1[XTEA_LANES], sink = 0;
+  uint8_t *ks;
+  double   t0, tRef, tFw, tLanes, tKs;
+  long     bad, n;
+  int      i;
+
+  /* "SimpliciTI's Key" as nwk_securityInit() leaves it. Network order is
+   * little endian (see bsp.h).
+   */
+  xtea_fw_set_key(NULL, sKey);
+  sRand = seed ? seed : 1;
+
+  bad = checkVectors();
+  printf("test vectors: %s\n", bad ? "FAIL" : "ok");
+  if (bad)
+  {
+    return 1;
+  }
+
+  bad = check();
+  printf("bit-exact check: %d blocks, %d keys, lanes %d, firmware %s: %s (%ld mismatches)\n",
+         CHECK_BLOCKS, CHECK_KEYS, XTEA_LANES, xtea_fw_variant(), bad ? "FAIL" : "ok", bad);
+  if (bad)
+  {
+    return 1;
+  }
+
+  blocks -= blocks % XTEA_LANES;
+  if (blocks <= 0 || !(ks = malloc(8 * (size_t)blocks)))
+  {
+    return 1;
+  }
+  xtea_schedule(sKey, rk);
+
+  /* Chain each block into the next so the loops cannot be folded away. */
+  v[0] = sIV;
+  v[1] = 0;
+  t0 = now();
+  for (n=0; n<blocks; ++n)
+  {
+    xtea_ref(sKey, v);
+  }
+  tRef = now() - t0;
+  sink ^= v[0];
+
+  xtea_fw_set_key(sKey, v0);
+  t0 = now();
+  for (n=0; n<blocks; ++n)
+  {
+    xtea_fw_encipher(v);
+  }
+  tFw = now() - t0;
+  sink ^= v[0];
+
+  for (i=0; i<XTEA_LANES; ++i)
+  {
+    v0[i] = sIV;
+    v1[i] = (uint32_t)i;
+  }
+  t0 = now();
+  for (n=0; n<blocks; n+=XTEA_LANES)
+  {
+    xtea_encipher_lanes(rk, v0, v1);
+  }
+  tLanes = now() - t0;
+  sink ^= v0[0];
+
+  t0 = now();
+  xtea_ctr_keystream(rk, sIV, 0, (uint32_t)blocks, ks);
+  tKs = now() - t0;
+  sink ^= ks[blocks * 8 - 1];
+
+  printf("%ld blocks, %s per block (sink %08x)\n", blocks,
+#if defined(HAVE_TSC)
+         "TSC cycles",
+#else
+         "ns",
+#endif
+         sink);
+  printf("  reference loop          %8.1f\n", tRef / blocks);
+  printf("  firmware, %-13s %8.1f  %5.2fx\n", xtea_fw_variant(), tFw / blocks, tRef / tFw);
+  printf("  %2d lanes                %8.1f  %5.2fx\n", XTEA_LANES, tLanes / blocks, tRef / tLanes);
+  printf("  CTR keystream, %2d lanes %8.1f  %5.2fx\n", XTEA_LANES, tKs / blocks, tRef / tKs);
+
+  free(ks);
+  return 0;
+}
@@ -0,0 +1,84 @@
+/**************************************************************************************************
+  Filename:       xtea_fw.c
+
+  Description:    The firmware nwk_security.c built for the host so xtea_bench
+                  can check and time the xtea_encipher() that ships, with the
+                  key index table or, with -DSMPL_XTEA_SCHEDULE, the round-key
+                  schedule. Only the cipher is used; the NWK and MRFI calls
+                  nwk_security.c makes elsewhere are stubbed below.
+
+  Build:          see xtea_bench.c
+**************************************************************************************************/
+
+/* sensor demo End Device settings, enough for nwk_security.c */
+#define MRFI_CC2500
+#define END_DEVICE
+#define SMPL_SECURE
+#define MAX_HOPS              3
+#define MAX_HOPS_FROM_AP      1
+#define MAX_NWK_PAYLOAD       9
+#define MAX_APP_PAYLOAD       10
+#define NUM_CONNECTIONS       2
+#define SIZE_INFRAME_Q        2
+#define SIZE_OUTFRAME_Q       2
+#define THIS_DEVICE_ADDRESS   {0x78, 0x56, 0x34, 0x12}
+#define DEFAULT_JOIN_TOKEN    0x05060708
+#define DEFAULT_LINK_TOKEN    0x01020304
+#define STARTUP_JOINCONTEXT_ON
+
+#include "nwk_security.c"
+
+#include "xtea_fw.h"
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+const char *xtea_fw_variant(void)
+{
+#if defined(SMPL_XTEA_SCHEDULE)
+  return "schedule";
+#else
+  return "key index";
+#endif
+}
+
+/* Key words as nwk_securityInit() leaves them. Returns the default key if
+ * 'key' is NULL.
+ */
+void xtea_fw_set_key(const uint32_t *key, uint32_t *out)
+{
+  static key_t const def = {"SimpliciTI's Key"};
+  uint8_t i;
+
+  for (i=0; i<4; ++i)
+  {
+    sKey.keyL[i] = key ? htonl(key[i]) : def.keyL[i];
+  }
+  nwk_securityInit();
+  for (i=0; i<4; ++i)
+  {
+    out[i] = sKey.keyL[i];
+  }
+}
+
+void xtea_fw_encipher(uint32_t *v)
+{
+  xtea_encipher(v);
+}
+
+/* not reached from xtea_encipher() */
+uint8_t MRFI_RandomByte(void)
+{
+  return 0;
+}
+
+void nwk_putNumObjectIntoMsg(void *src, void *dest, uint8_t len)
+{
+  memcpy(dest, src, len);
+}
+
+void nwk_getNumObjectFromMsg(void *src, void *dest, uint8_t len)
+{
+  memcpy(dest, src, len);
+}
@@ -0,0 +1,16 @@
+/**************************************************************************************************
+  Filename:       xtea_fw.h
+
+  Description:    Entry points into the firmware XTEA built by xtea_fw.c.
+**************************************************************************************************/
+
+#ifndef XTEA_FW_H
+#define XTEA_FW_H
+
+#include <stdint.h>
+
+const char *xtea_fw_variant(void);
+void        xtea_fw_set_key(const uint32_t *key, uint32_t *out);
+void        xtea_fw_encipher(uint32_t *v);
+
+#endif
@@ -0,0 +1,131 @@
+/**************************************************************************************************
+  Filename:       xtea_host.h
+
+  Description:    Host XTEA kernels matching xtea_encipher() in nwk_security.c.
+                  A round-key schedule folds the running sum and the key word
+                  of each half round into one value. The scalar kernel does
+                  two rounds per pass with the block in registers. The
+                  multi-block kernel enciphers XTEA_LANES blocks at once with
+                  GCC vector extensions so a gateway can generate CTR
+                  keystream for captured traffic in bulk.
+
+                  Keys are the 4 words in the order nwk_securityInit() leaves
+                  them (network order of "SimpliciTI's Key").
+**************************************************************************************************/
+
+#ifndef XTEA_HOST_H
+#define XTEA_HOST_H
+
+#include <stdint.h>
+#include <string.h>
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define XTEA_ROUNDS      32
+#define XTEA_DELTA       0x9E3779B9u
+#define XTEA_RK_WORDS    (2 * XTEA_ROUNDS)
+
+/* Blocks per call of the multi-block kernel. 8 fills two SSE registers per
+ * half block or one AVX2 register.
+ */
+#ifndef XTEA_LANES
+#define XTEA_LANES       8
+#endif
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+typedef uint32_t xteaVec_t __attribute__((vector_size(4 * XTEA_LANES)));
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+/* Build the round-key schedule. Entry 2i is used by the first half of round
+ * i and entry 2i+1 by the second half.
+ */
+static inline void xtea_schedule(const uint32_t key[4], uint32_t rk[XTEA_RK_WORDS])
+{
+  uint32_t sum = 0;
+  int      i;
+
+  for (i=0; i<XTEA_ROUNDS; ++i)
+  {
+    rk[2*i] = sum + key[sum & 3];
+    sum    += XTEA_DELTA;
+    rk[2*i+1] = sum + key[(sum >> 11) & 3];
+  }
+}
+
+/* Encipher one block in place */
+static inline void xtea_encipher_rk(const uint32_t rk[XTEA_RK_WORDS], uint32_t v[2])
+{
+  uint32_t v0 = v[0], v1 = v[1];
+  int      i;
+
+  for (i=0; i<XTEA_RK_WORDS; i+=4)
+  {
+    v0 += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ rk[i];
+    v1 += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ rk[i+1];
+    v0 += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ rk[i+2];
+    v1 += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ rk[i+3];
+  }
+  v[0] = v0;
+  v[1] = v1;
+}
+
+/* Encipher XTEA_LANES blocks. v0[] holds the first word of every block and
+ * v1[] the second, each in native order as xtea_encipher() sees them.
+ */
+static inline void xtea_encipher_lanes(const uint32_t rk[XTEA_RK_WORDS],
+                                       uint32_t v0[XTEA_LANES], uint32_t v1[XTEA_LANES])
+{
+  xteaVec_t a, b;
+  int       i;
+
+  memcpy(&a, v0, sizeof(a));
+  memcpy(&b, v1, sizeof(b));
+  for (i=0; i<XTEA_RK_WORDS; i+=2)
+  {
+    a += (((b << 4) ^ (b >> 5)) + b) ^ rk[i];
+    b += (((a << 4) ^ (a >> 5)) + a) ^ rk[i+1];
+  }
+  memcpy(v0, &a, sizeof(a));
+  memcpy(v1, &b, sizeof(b));
+}
+
+/* CTR keystream for 'num' consecutive counter values starting at 'ctr'. Each
+ * 8-byte block is written as the MSP430 would leave it in memory (little
+ * endian words), which is the byte order msg_encipher() XORs with the frame.
+ */
+static inline void xtea_ctr_keystream(const uint32_t rk[XTEA_RK_WORDS], uint32_t iv,
+                                      uint32_t ctr, uint32_t num, uint8_t *out)
+{
+  uint32_t v0[XTEA_LANES], v1[XTEA_LANES];
+  uint32_t i, j, n;
+
+  for (i=0; i<num; i+=n)
+  {
+    n = (num - i < XTEA_LANES) ? num - i : XTEA_LANES;
+    for (j=0; j<XTEA_LANES; ++j)
+    {
+      v0[j] = iv;
+      v1[j] = ctr + i + j;
+    }
+    xtea_encipher_lanes(rk, v0, v1);
+    for (j=0; j<n; ++j)
+    {
+      uint8_t *p = out + 8 * (i + j);
+
+      p[0] = (uint8_t)v0[j]; p[1] = (uint8_t)(v0[j] >> 8);
+      p[2] = (uint8_t)(v0[j] >> 16); p[3] = (uint8_t)(v0[j] >> 24);
+      p[4] = (uint8_t)v1[j]; p[5] = (uint8_t)(v1[j] >> 8);
+      p[6] = (uint8_t)(v1[j] >> 16); p[7] = (uint8_t)(v1[j] >> 24);
+    }
+  }
+}
+
+#endif /* XTEA_HOST_H */
@@ -0,0 +1,697 @@
+/**************************************************************************************************
+  Filename:       join_link_sim.c
+
+  Description:    Host simulation of a mass startup: many End Devices power up
+                  at about the same time next to an Access Point that is a data
+                  hub. Two startups are compared:
+                    - legacy: SMPL_Init() joins, then SMPL_Link() links. The AP
+                      only answers Link frames while its main loop sits in
+                      SMPL_LinkListen(), which it enters once per new join.
+                    - join+link (NWK_JOIN_LINK): one request and one reply. The
+                      AP sets the connection up in the Join handler and its
+                      SMPL_LinkListen() returns at once.
+
+                  The timing follows the firmware:
+                    - EDs retry SMPL_Init() and SMPL_Link() on the 1 s Timer A
+                      wakeup (main_ED.c). Each ED's period is off by up to
+                      ED_CLOCK_TOL; without that two EDs that collide once
+                      would collide on every retry.
+                    - a request waits the MRFI reply delay for its reply.
+                    - requests are sent with CCA: up to MRFI_CCA_RETRIES random
+                      backoffs of 1 to 16 periods, then the call fails.
+                    - the AP replies from the ISR, forced (no CCA).
+                    - SMPL_LinkListen() polls every 10 ms for up to 5 s and
+                      main_AP.c calls it once per join callback.
+                  All nodes hear each other. Overlapping frames are lost for
+                  every receiver (no capture) and a node cannot receive while
+                  it transmits. The AP connection table is assumed large enough
+                  for every ED; the firmware NUM_CONNECTIONS is much smaller.
+
+                  Each mode is run with the plain retry on every wakeup and
+                  with the NWK_RETRY_MAX_EXP / NWK_RETRY_JITTER_MS retry
+                  schedule of nwk_api.c: after the n-th failure in a row a
+                  random 0 to 2^min(n, maxExp) - 1 wakeups skipped without
+                  transmitting, and the LPM3 sleep of main_ED.c of up to the
+                  jitter before every SMPL_Init() and SMPL_Link() retry. First
+                  attempts go out on the wakeup.
+
+                  Reported per mode: time until every ED is linked and the AP
+                  has accepted it, frames and airtime put on the channel, and
+                  frames lost to collisions.
+
+                  A second table resets every ED of a network that is already
+                  linked (brown-out) while the AP keeps its connections, and
+                  reports the time from each ED's reset until the AP gets its
+                  first data frame. EDs send one best-effort data frame on each
+                  wakeup once linked (selfMeasure()). Legacy and join+link EDs
+                  join and link again with the retry schedule; the AP answers
+                  them as duplicates. NWK_PERSIST EDs restore the context from
+                  flash: SMPL_Init() and SMPL_Link() return at once and the
+                  first data goes out on the first wakeup.
+
+  Build:          gcc -O2 -o join_link_sim join_link_sim.c
+  Run:            ./join_link_sim [numEDs] [powerUpSpreadMs] [runs] [seed]
+                                  [maxExp] [jitterMs]
+**************************************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define MAX_EDS               1000
+#define TICK_US               50
+#define SIM_LIMIT_US          (600LL * 1000000)
+
+/* MRFI, as in mrfi_defs.h and mrfi.h with MAX_HOPS 3 at 250 kbps */
+#define MRFI_CCA_RETRIES      4
+#define BACKOFF_US            1250      /* sBackoffHelper */
+#define REPLY_DELAY_US        52000     /* sReplyDelayScalar */
+#define AP_TURNAROUND_US      300       /* Rx ISR to start of reply */
+
+/* applications */
+#define ED_RETRY_US           1000000   /* Timer A wakeup in main_ED.c */
+#define ED_CLOCK_TOL          0.01      /* +/- fraction, timer clock tolerance */
+#define LISTEN_POLL_US        10000     /* LINKLISTEN_POLL_PERIOD_MS */
+#define LISTEN_POLLS          500       /* LINKLISTEN_POLL_COUNT */
+
+/* airtime at 250 kbps: preamble 4, sync 4, length 1, addresses 8, NWK header 3, CRC 2 */
+#define FRAME_OVERHEAD_BYTES  22
+#define BIT_US                4
+
+/* frame kinds and their application payload sizes (nwk_join.h, nwk_link.h) */
+#define F_JOIN                0
+#define F_JOIN_REPLY          1
+#define F_LINK                2
+#define F_LINK_REPLY          3
+#define F_JOIN_LINK           4
+#define F_JOIN_LINK_REPLY     5
+#define F_DATA                6
+#define NUM_KINDS             7
+
+#define AP                    MAX_EDS   /* node number of the AP */
+
+/* ED states */
+#define ED_OFF                0
+#define ED_SEND               1         /* about to sample CCA */
+#define ED_TX                 2
+#define ED_WAIT               3         /* waiting for the reply */
+#define ED_SLEEP              4
+#define ED_DONE               5
+#define ED_RUN                6         /* linked, data on every wakeup */
+#define ED_DATA               7         /* about to sample CCA for data */
+
+/* startups */
+#define START_LEGACY          0
+#define START_JOIN_LINK       1
+#define START_RESTORED        2
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+typedef struct
+{
+  int       state;
+  int       phase;            /* F_JOIN, F_LINK or F_JOIN_LINK: request to send */
+  int       cca;              /* backoffs used on this attempt */
+  long long at;               /* time of next action */
+  long long powerUp;
+  long long period;           /* this ED's Timer A period */
+  int       joined;           /* AP has saved us (legacy) */
+  int       accepted;         /* AP holds a connection for us */
+  int       popped;           /* AP application got our Link ID */
+  int       fails;            /* failed calls in a row */
+  int       skip;             /* wakeups left to skip */
+  long long firstData;        /* AP got our first data frame, -1 before */
+} ed_t;
+
+typedef struct
+{
+  int       src, dst, kind;
+  long long start, end;
+  int       lost;
+} tx_t;
+
+typedef struct
+{
+  long long doneUs;
+  long      frames[NUM_KINDS];
+  long      lost;
+  long long airUs;
+  double    sumFirstUs;       /* reset runs: time to first data, all EDs */
+  long long worstFirstUs;
+} result_t;
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+static const int  sPayload[NUM_KINDS] = { 8, 6, 9, 4, 9, 8, 9 };
+static const char *sKindName[NUM_KINDS] =
+{
+  "join", "join reply", "link", "link reply", "join+link", "join+link reply", "data"
+};
+
+static ed_t     sEd[MAX_EDS];
+static int      sNumEDs;
+static tx_t     sAir[2 * MAX_EDS + 8];
+static int      sNumAir;
+static uint32_t sRand;
+static int      sMaxExp;              /* retry policy, 0/0 is off */
+static long long sJitterUs;
+static int      sReset;               /* EDs were linked before power-up */
+
+/* AP */
+static int       sListen;             /* Link Listen context */
+static int       sJoinSem;
+static int       sLinkers[MAX_EDS];   /* sServiceLinkID[] */
+static int       sNumLinkers;
+static int       sNumPeers;
+static int       sPolls;
+static long long sApAt;               /* next main loop action */
+static int       sReplyQ[2 * MAX_EDS][2];
+static int       sReplyHead, sReplyTail;
+static long long sReplyAt;
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static uint32_t rnd(void)
+{
+  sRand ^= sRand << 13;
+  sRand ^= sRand >> 17;
+  sRand ^= sRand << 5;
+  return sRand;
+}
+
+static long long airtime(int kind)
+{
+  return (long long)(FRAME_OVERHEAD_BYTES + sPayload[kind]) * 8 * BIT_US;
+}
+
+static int channelBusy(long long now)
+{
+  int i;
+
+  for (i=0; i<sNumAir; ++i)
+  {
+    if (sAir[i].start <= now && now < sAir[i].end)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int transmitting(int node, long long now)
+{
+  int i;
+
+  for (i=0; i<sNumAir; ++i)
+  {
+    if ((sAir[i].src == node) && (sAir[i].start <= now) && (now < sAir[i].end))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void startTx(int src, int dst, int kind, long long now, result_t *r)
+{
+  tx_t *t = &sAir[sNumAir++];
+  int   i;
+
+  t->src   = src;
+  t->dst   = dst;
+  t->kind  = kind;
+  t->start = now;
+  t->end   = now + airtime(kind);
+  t->lost  = 0;
+  for (i=0; i<sNumAir-1; ++i)
+  {
+    if (sAir[i].end > now)
+    {
+      sAir[i].lost = 1;
+      t->lost      = 1;
+    }
+  }
+  r->frames[kind]++;
+  r->airUs += t->end - t->start;
+}
+
+static void queueReply(int ed, int kind, long long now)
+{
+  if (sReplyHead == sReplyTail)
+  {
+    sReplyAt = now + AP_TURNAROUND_US;
+  }
+  sReplyQ[sReplyTail][0] = ed;
+  sReplyQ[sReplyTail][1] = kind;
+  sReplyTail = (sReplyTail + 1) % (2 * MAX_EDS);
+}
+
+/* nwk_processJoin() / nwk_processLink() on the AP */
+static void apReceive(const tx_t *t, long long now)
+{
+  ed_t *e = &sEd[t->src];
+
+  switch (t->kind)
+  {
+    case F_JOIN:
+      /* nwk_saveJoinedDevice(): a new device triggers the join callback */
+      if (!e->joined)
+      {
+        e->joined = 1;
+        sJoinSem++;
+      }
+      queueReply(t->src, F_JOIN_REPLY, now);
+      break;
+
+    case F_LINK:
+      if (e->accepted)
+      {
+        /* duplicate: the reply is sent again whether or not we listen */
+        queueReply(t->src, F_LINK_REPLY, now);
+      }
+      else if (sListen)
+      {
+        e->accepted = 1;
+        sLinkers[sNumLinkers++] = t->src;
+        queueReply(t->src, F_LINK_REPLY, now);
+      }
+      break;
+
+    case F_JOIN_LINK:
+      /* nwk_joinLinkAccept() */
+      if (!e->accepted)
+      {
+        e->joined   = 1;
+        e->accepted = 1;
+        sLinkers[sNumLinkers++] = t->src;
+        sJoinSem++;
+      }
+      queueReply(t->src, F_JOIN_LINK_REPLY, now);
+      break;
+
+    case F_DATA:
+      if (e->firstData < 0)
+      {
+        e->firstData = now;
+      }
+      break;
+  }
+}
+
+/* next Timer A wakeup after 'now' */
+static long long nextWakeup(const ed_t *e, long long now)
+{
+  return now + e->period - (now - e->powerUp) % e->period;
+}
+
+/* retryResult() after a failed call */
+static void retryFailed(ed_t *e, long long now)
+{
+  int exp;
+
+  if (e->fails < 0xFF)
+  {
+    e->fails++;
+  }
+  exp      = e->fails < sMaxExp ? e->fails : sMaxExp;
+  e->skip  = (int)(rnd() & ((1u << exp) - 1));
+  e->state = ED_SLEEP;
+  e->at    = nextWakeup(e, now);
+}
+
+static void edStep(int n, long long now, result_t *r)
+{
+  ed_t *e = &sEd[n];
+
+  if (now < e->at)
+  {
+    return;
+  }
+  switch (e->state)
+  {
+    case ED_OFF:
+    case ED_SLEEP:
+      /* SMPL_Init() or SMPL_Link() called: retryIsDue() */
+      if (e->skip)
+      {
+        e->skip--;
+        e->at = nextWakeup(e, now);
+        break;
+      }
+      e->state = ED_SEND;
+      e->cca   = 0;
+      if (sJitterUs && e->fails)
+      {
+        e->at = now + (long long)(rnd() % (uint32_t)(sJitterUs / TICK_US + 1)) * TICK_US;
+        break;
+      }
+      /* fall through */
+
+    case ED_SEND:
+      if (!channelBusy(now))
+      {
+        startTx(n, AP, e->phase, now, r);
+        e->state = ED_TX;
+        e->at    = now + airtime(e->phase);
+      }
+      else if (e->cca++ < MRFI_CCA_RETRIES)
+      {
+        e->at = now + BACKOFF_US * (long long)((rnd() & 0x0F) + 1);
+      }
+      else
+      {
+        /* CCA failed: the call returns an error, retry on the next wakeup */
+        retryFailed(e, now);
+      }
+      break;
+
+    case ED_TX:
+      e->state = ED_WAIT;
+      e->at    = now + REPLY_DELAY_US;
+      break;
+
+    case ED_WAIT:
+      /* the reply window closed without a reply */
+      retryFailed(e, now);
+      break;
+
+    case ED_RUN:
+      e->state = ED_DATA;
+      e->cca   = 0;
+      /* fall through */
+
+    case ED_DATA:
+      /* SMPL_SendOpt() best effort: a CCA failure drops the sample */
+      if (!channelBusy(now))
+      {
+        startTx(n, AP, F_DATA, now, r);
+      }
+      else if (e->cca++ < MRFI_CCA_RETRIES)
+      {
+        e->at = now + BACKOFF_US * (long long)((rnd() & 0x0F) + 1);
+        break;
+      }
+      e->state = ED_RUN;
+      e->at    = nextWakeup(e, now);
+      break;
+  }
+}
+
+static void edReceive(const tx_t *t, long long now)
+{
+  ed_t *e = &sEd[t->dst];
+
+  if (ED_WAIT != e->state)
+  {
+    return;
+  }
+  if (F_JOIN == e->phase && F_JOIN_REPLY == t->kind)
+  {
+    /* main_ED.c links straight after joining */
+    e->phase = F_LINK;
+    e->state = ED_SEND;
+    e->cca   = 0;
+    e->fails = 0;
+    e->at    = now;
+  }
+  else if ((F_LINK == e->phase && F_LINK_REPLY == t->kind) ||
+           (F_JOIN_LINK == e->phase && F_JOIN_LINK_REPLY == t->kind))
+  {
+    /* main_ED.c sends its first sample on the next wakeup */
+    e->state = sReset ? ED_RUN : ED_DONE;
+    e->at    = nextWakeup(e, now);
+  }
+}
+
+/* main_AP.c main loop around SMPL_LinkListen() */
+static void apStep(long long now)
+{
+  if (now < sApAt)
+  {
+    return;
+  }
+  if (!sListen && !sPolls)
+  {
+    if (!sJoinSem || (sNumPeers >= sNumEDs))
+    {
+      return;
+    }
+    sListen = 1;
+  }
+
+  /* nwk_getLocalLinkID() */
+  if (sNumLinkers)
+  {
+    sEd[sLinkers[0]].popped = 1;
+    memmove(sLinkers, sLinkers + 1, --sNumLinkers * sizeof(sLinkers[0]));
+    sListen = 0;
+    sPolls  = 0;
+    sNumPeers++;
+    sJoinSem--;
+    return;
+  }
+  if (++sPolls >= LISTEN_POLLS)
+  {
+    /* timeout: main_AP.c listens again */
+    sListen = 0;
+    sPolls  = 0;
+    return;
+  }
+  sListen = 1;
+  sApAt   = now + LISTEN_POLL_US;
+}
+
+/* per-ED time from power-up to the first data frame at the AP */
+static void firstData(result_t *r)
+{
+  int i;
+
+  for (i=0; i<sNumEDs; ++i)
+  {
+    long long t = (sEd[i].firstData < 0 ? SIM_LIMIT_US : sEd[i].firstData) - sEd[i].powerUp;
+
+    r->sumFirstUs += t;
+    if (t > r->worstFirstUs)
+    {
+      r->worstFirstUs = t;
+    }
+  }
+}
+
+static int run(int start, long long spreadUs, result_t *r)
+{
+  long long now;
+  int       i, done;
+
+  memset(r, 0, sizeof(*r));
+  memset(sEd, 0, sizeof(sEd));
+  sNumAir  = 0;
+  sListen  = sJoinSem = sNumLinkers = sNumPeers = sPolls = 0;
+  sApAt    = 0;
+  sReplyHead = sReplyTail = 0;
+
+  for (i=0; i<sNumEDs; ++i)
+  {
+    sEd[i].powerUp = spreadUs ? (long long)(rnd() % (uint32_t)spreadUs) : 0;
+    sEd[i].at      = sEd[i].powerUp;
+    sEd[i].period  = (long long)(ED_RETRY_US * (1.0 + ED_CLOCK_TOL * (rnd() / 2147483648.0 - 1.0)));
+    sEd[i].phase   = (START_JOIN_LINK == start) ? F_JOIN_LINK : F_JOIN;
+    sEd[i].firstData = -1;
+    if (sReset)
+    {
+      /* the AP still holds the connection from before the reset */
+      sEd[i].joined = sEd[i].accepted = sEd[i].popped = 1;
+    }
+    if (START_RESTORED == start)
+    {
+      sEd[i].state = ED_RUN;
+      sEd[i].at    = sEd[i].powerUp + sEd[i].period;
+    }
+  }
+  if (sReset)
+  {
+    sNumPeers = sNumEDs;
+  }
+
+  for (now=0; now<SIM_LIMIT_US; now+=TICK_US)
+  {
+    /* frames that finish now */
+    for (i=0; i<sNumAir; )
+    {
+      tx_t *t = &sAir[i];
+
+      if (t->end > now)
+      {
+        ++i;
+        continue;
+      }
+      if (t->lost)
+      {
+        r->lost++;
+      }
+      else if (!transmitting(t->dst, t->start))
+      {
+        if (AP == t->dst)
+        {
+          apReceive(t, now);
+        }
+        else
+        {
+          edReceive(t, now);
+        }
+      }
+      *t = sAir[--sNumAir];
+    }
+
+    /* AP replies, one at a time, forced */
+    if ((sReplyHead != sReplyTail) && (now >= sReplyAt) && !transmitting(AP, now))
+    {
+      startTx(AP, sReplyQ[sReplyHead][0], sReplyQ[sReplyHead][1], now, r);
+      sReplyHead = (sReplyHead + 1) % (2 * MAX_EDS);
+      sReplyAt   = now + AP_TURNAROUND_US;
+    }
+
+    apStep(now);
+
+    done = 1;
+    for (i=0; i<sNumEDs; ++i)
+    {
+      edStep(i, now, r);
+      if (sReset)
+      {
+        done &= sEd[i].firstData >= 0;
+      }
+      else
+      {
+        done &= (ED_DONE == sEd[i].state) && sEd[i].popped;
+      }
+    }
+    if (done)
+    {
+      r->doneUs = now;
+      firstData(r);
+      return 0;
+    }
+  }
+  r->doneUs = SIM_LIMIT_US;
+  firstData(r);
+  return 1;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  int       numEDs   = argc > 1 ? atoi(argv[1]) : 100;
+  long long spreadUs = (argc > 2 ? atoll(argv[2]) : 50) * 1000;
+  int       runs     = argc > 3 ? atoi(argv[3]) : 20;
+  uint32_t  seed     = argc > 4 ? (uint32_t)strtoul(argv[4], NULL, 0) : 1;
+  int       maxExp   = argc > 5 ? atoi(argv[5]) : 2;
+  long long jitterUs = (argc > 6 ? atoll(argv[6]) : 500) * 1000;
+  int       mode, i, k;
+
+  if ((numEDs < 1) || (numEDs > MAX_EDS) || (runs < 1) || (spreadUs < 0) ||
+      (maxExp < 0) || (maxExp > 8) || (jitterUs < 0) || (jitterUs > 65535000))
+  {
+    fprintf(stderr, "numEDs must be 1..%d, maxExp 0..8, jitterMs 0..65535\n", MAX_EDS);
+    return 1;
+  }
+  sNumEDs = numEDs;
+
+  printf("%d EDs powered up within %lld ms, %d runs, backoff maxExp %d jitter %lld ms\n",
+         numEDs, spreadUs / 1000, runs, maxExp, jitterUs / 1000);
+  printf("mode                 full network s (mean/worst)  frames  airtime ms  collided\n");
+  for (mode=0; mode<4; ++mode)
+  {
+    double    sumDone = 0, sumAir = 0, sumFrames = 0, sumLost = 0;
+    long long worst = 0;
+    long      kinds[NUM_KINDS] = { 0 };
+    int       stuck = 0;
+
+    sMaxExp   = (mode & 2) ? maxExp : 0;
+    sJitterUs = (mode & 2) ? jitterUs : 0;
+    sRand     = seed ? seed : 1;
+    for (k=0; k<runs; ++k)
+    {
+      result_t r;
+
+      stuck += run(mode & 1, spreadUs, &r);
+      sumDone += r.doneUs / 1e6;
+      sumAir  += r.airUs / 1e3;
+      sumLost += r.lost;
+      if (r.doneUs > worst)
+      {
+        worst = r.doneUs;
+      }
+      for (i=0; i<NUM_KINDS; ++i)
+      {
+        sumFrames += r.frames[i];
+        kinds[i]  += r.frames[i];
+      }
+    }
+    printf("%-9s %-9s  %10.2f / %-10.2f        %7.0f  %10.1f  %8.0f%s\n",
+           (mode & 1) ? "join+link" : "legacy", (mode & 2) ? "backoff" : "",
+           sumDone / runs, worst / 1e6,
+           sumFrames / runs, sumAir / runs, sumLost / runs,
+           stuck ? "  (some runs hit the time limit)" : "");
+    for (i=0; i<NUM_KINDS; ++i)
+    {
+      if (kinds[i])
+      {
+        printf("                     %-16s %8.1f per run\n", sKindName[i], (double)kinds[i] / runs);
+      }
+    }
+  }
+
+  /* reset of a linked network, with the retry schedule given */
+  printf("\nreset of a linked network, time from reset to first data at the AP\n");
+  printf("mode          per ED s (mean/worst)   all EDs s  frames  airtime ms  collided\n");
+  sReset    = 1;
+  sMaxExp   = maxExp;
+  sJitterUs = jitterUs;
+  for (mode=START_LEGACY; mode<=START_RESTORED; ++mode)
+  {
+    static const char *name[] = { "legacy", "join+link", "restored" };
+    double    sumFirst = 0, sumDone = 0, sumAir = 0, sumFrames = 0, sumLost = 0;
+    long long worst = 0;
+    int       stuck = 0;
+
+    sRand = seed ? seed : 1;
+    for (k=0; k<runs; ++k)
+    {
+      result_t r;
+
+      stuck    += run(mode, spreadUs, &r);
+      sumFirst += r.sumFirstUs / 1e6 / numEDs;
+      sumDone  += r.doneUs / 1e6;
+      sumAir   += r.airUs / 1e3;
+      sumLost  += r.lost;
+      if (r.worstFirstUs > worst)
+      {
+        worst = r.worstFirstUs;
+      }
+      for (i=0; i<NUM_KINDS; ++i)
+      {
+        sumFrames += r.frames[i];
+      }
+    }
+    printf("%-10s  %8.2f / %-8.2f       %9.2f  %6.0f  %10.1f  %8.0f%s\n", name[mode],
+           sumFirst / runs, worst / 1e6, sumDone / runs,
+           sumFrames / runs, sumAir / runs, sumLost / runs,
+           stuck ? "  (some runs hit the time limit)" : "");
+  }
+  return 0;
+}
@@ -0,0 +1,411 @@
+/**************************************************************************************************
+  Filename:       re_routing_sim.c
+
+  Description:    Host simulation of Range Extender replay with and without the
+                  NWK_ROUTING route table (nwk_route.c). An AP, a number of REs
+                  and a field of End Devices exchange uplink data frames and
+                  AP acknowledgements. Every transmission is counted so the
+                  airtime of flooding and routing can be compared, together with
+                  the fraction of exchanges that complete (data and ack both
+                  delivered).
+
+                  The replay rules follow nwk_frame.c:
+                    - EDs never replay.
+                    - an RE replays frames not for it unless an RE sent them.
+                    - the AP replays frames not for it unless the AP sent them.
+                    - a replay decrements the hop count; zero means drop.
+                    - with routing, every frame sent by an RE or the AP has its
+                      hop count lowered to the learned distance of the target.
+                  The route table uses the same learning, ageing and RSSI
+                  rules as nwk_route.c.
+
+                  The radio model is log-distance path loss with per-link
+                  shadowing and a soft sensitivity threshold. Collisions are
+                  not modelled; CCA spreads replays in the real network.
+
+  Build:          gcc -O2 -o re_routing_sim re_routing_sim.c -lm
+                  (add -DNUM_ROUTES=n to try other table sizes)
+  Run:            ./re_routing_sim [numEDs] [rounds] [seed]
+**************************************************************************************************/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+/* network configuration, as in smpl_nwk_config.dat */
+#define MAX_HOPS              3
+#ifndef NUM_ROUTES
+#define NUM_ROUTES            8
+#endif
+#define NWK_ROUTE_MIN_RSSI    (-85)
+#define NWK_ROUTE_MAX_AGE     200
+#define NWK_ROUTE_NONE        0xFF
+
+#define TX_ED  0
+#define TX_RE  1
+#define TX_AP  2
+
+#define MAX_NODES     64
+#define MAX_RES       8
+#define FIELD_M       80.0    /* EDs placed in a square of this side, AP in the middle */
+#define RE_RING_M     25.0    /* REs on a ring around the AP */
+
+/* radio */
+#define TX_POWER_DBM  0.0
+#define PL_D0_DB      40.0    /* path loss at 1 m */
+#define PL_EXPONENT   3.3
+#define SHADOW_DB     4.0
+#define SENS_DBM      (-92.0)
+#define SENS_SLOPE_DB 2.0
+
+/* airtime at 250 kbps: preamble 4, sync 4, length 1, addresses 8, NWK header 3, CRC 2 */
+#define FRAME_OVERHEAD_BYTES  22
+#define DATA_PAYLOAD_BYTES    10
+#define BIT_US                4.0
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+typedef struct
+{
+  uint8_t addr;
+  uint8_t hops;
+  int8_t  rssi;
+  uint8_t age;
+} route_t;
+
+typedef struct
+{
+  double  x, y;
+  uint8_t type;
+  route_t route[NUM_ROUTES];
+} node_t;
+
+typedef struct
+{
+  uint8_t src, dst, tx, sender, hc;
+  uint8_t len;
+} frame_t;
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+static node_t   sNode[MAX_NODES];
+static int      sNumNodes;
+static double   sShadow[MAX_NODES][MAX_NODES];
+static uint32_t sRand;
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static double rnd(void)
+{
+  sRand ^= sRand << 13;
+  sRand ^= sRand >> 17;
+  sRand ^= sRand << 5;
+  return (sRand >> 8) / 16777216.0;
+}
+
+static double gauss(void)
+{
+  double u = rnd() + 1e-12, v = rnd();
+
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static double rssi(int a, int b)
+{
+  double dx = sNode[a].x - sNode[b].x, dy = sNode[a].y - sNode[b].y;
+  double d  = sqrt(dx*dx + dy*dy);
+
+  if (d < 1.0)
+  {
+    d = 1.0;
+  }
+  return TX_POWER_DBM - PL_D0_DB - 10.0 * PL_EXPONENT * log10(d) + sShadow[a][b];
+}
+
+static int heard(int a, int b, double *pRssi)
+{
+  double r = rssi(a, b);
+
+  *pRssi = r;
+  return rnd() < 1.0 / (1.0 + exp(-(r - SENS_DBM) / SENS_SLOPE_DB));
+}
+
+/* nwk_routeLearn() */
+static void routeLearn(node_t *n, const frame_t *f, double r)
+{
+  route_t *pRoute = NULL;
+  uint8_t  hops;
+  int      i;
+
+  if ((TX_ED == f->tx) || ((TX_AP == f->tx) && (0 == f->src)))
+  {
+    hops = 0;
+  }
+  else if (TX_RE == f->tx)
+  {
+    hops = 1;
+  }
+  else
+  {
+    return;
+  }
+
+  for (i=0; i<NUM_ROUTES; ++i)
+  {
+    if (n->route[i].age < 0xFF)
+    {
+      n->route[i].age++;
+    }
+    if ((NWK_ROUTE_NONE != n->route[i].hops) && (n->route[i].addr == f->src))
+    {
+      pRoute = &n->route[i];
+    }
+  }
+
+  if (pRoute)
+  {
+    if ((hops > pRoute->hops) && (pRoute->age <= NWK_ROUTE_MAX_AGE))
+    {
+      return;
+    }
+  }
+  else
+  {
+    pRoute = n->route;
+    for (i=0; i<NUM_ROUTES; ++i)
+    {
+      if (NWK_ROUTE_NONE == n->route[i].hops)
+      {
+        pRoute = &n->route[i];
+        break;
+      }
+      if (n->route[i].age > pRoute->age)
+      {
+        pRoute = &n->route[i];
+      }
+    }
+    pRoute->addr = f->src;
+  }
+  pRoute->hops = hops;
+  pRoute->rssi = (int8_t)(r < -128 ? -128 : r);
+  pRoute->age  = 0;
+}
+
+/* nwk_routeHops() */
+static uint8_t routeHops(const node_t *n, uint8_t addr)
+{
+  int i;
+
+  for (i=0; i<NUM_ROUTES; ++i)
+  {
+    const route_t *p = &n->route[i];
+
+    if ((NWK_ROUTE_NONE != p->hops) && (p->addr == addr))
+    {
+      if ((p->age > NWK_ROUTE_MAX_AGE) || (!p->hops && (p->rssi < NWK_ROUTE_MIN_RSSI)))
+      {
+        return NWK_ROUTE_NONE;
+      }
+      return p->hops;
+    }
+  }
+  return NWK_ROUTE_NONE;
+}
+
+/* Send a frame and everything it triggers. Returns 1 if 'dst' got a copy.
+ * Adds the number of bytes put on the air to *pAir.
+ */
+static int deliver(frame_t f, int routing, long *pAir, long *pTx)
+{
+  frame_t q[256];
+  int     head = 0, tail = 0, got = 0, i;
+
+  q[tail++] = f;
+  while (head < tail)
+  {
+    frame_t cur = q[head++];
+
+    /* nwk_sendFrame(): set tx type and trim */
+    cur.tx = sNode[cur.sender].type;
+    if (routing && (TX_ED != cur.tx))
+    {
+      uint8_t route = routeHops(&sNode[cur.sender], cur.dst);
+
+      if (route < cur.hc)
+      {
+        cur.hc = route;
+      }
+    }
+    *pAir += cur.len;
+    (*pTx)++;
+
+    for (i=0; i<sNumNodes; ++i)
+    {
+      double r;
+
+      if ((i == cur.sender) || !heard(cur.sender, i, &r))
+      {
+        continue;
+      }
+      /* echo */
+      if (i == cur.src)
+      {
+        continue;
+      }
+      if (routing && (TX_ED != sNode[i].type))
+      {
+        routeLearn(&sNode[i], &cur, r);
+      }
+      if (i == cur.dst)
+      {
+        got = 1;
+        continue;
+      }
+      if (TX_ED == sNode[i].type)
+      {
+        continue;
+      }
+      if ((TX_RE == sNode[i].type) && (TX_RE == cur.tx))
+      {
+        continue;
+      }
+      if ((TX_AP == sNode[i].type) && (TX_AP == cur.tx))
+      {
+        continue;
+      }
+      /* nwk_replayFrame() */
+      if (cur.hc && (tail < (int)(sizeof(q)/sizeof(q[0]))))
+      {
+        frame_t rep = cur;
+
+        rep.hc--;
+        rep.sender = (uint8_t)i;
+        q[tail++]  = rep;
+      }
+    }
+  }
+  return got;
+}
+
+static void build(int numREs, int numEDs, uint32_t seed)
+{
+  int i, j;
+
+  sRand = seed ? seed : 1;
+  memset(sNode, 0, sizeof(sNode));
+  sNumNodes = 1 + numREs + numEDs;
+
+  sNode[0].type = TX_AP;
+  for (i=1; i<=numREs; ++i)
+  {
+    double a = 2.0 * M_PI * (i - 1) / numREs;
+
+    sNode[i].type = TX_RE;
+    sNode[i].x    = RE_RING_M * cos(a);
+    sNode[i].y    = RE_RING_M * sin(a);
+  }
+  for (; i<sNumNodes; ++i)
+  {
+    sNode[i].type = TX_ED;
+    sNode[i].x    = (rnd() - 0.5) * FIELD_M;
+    sNode[i].y    = (rnd() - 0.5) * FIELD_M;
+  }
+  for (i=0; i<sNumNodes; ++i)
+  {
+    for (j=0; j<NUM_ROUTES; ++j)
+    {
+      sNode[i].route[j].hops = NWK_ROUTE_NONE;
+    }
+  }
+  /* symmetric shadowing */
+  for (i=0; i<sNumNodes; ++i)
+  {
+    for (j=i+1; j<sNumNodes; ++j)
+    {
+      sShadow[i][j] = sShadow[j][i] = SHADOW_DB * gauss();
+    }
+  }
+}
+
+static void run(int numREs, int numEDs, int rounds, uint32_t seed, int routing)
+{
+  long   air = 0, tx = 0, sent = 0, ok = 0;
+  int    r, i;
+  double us;
+
+  build(numREs, numEDs, seed);
+  /* same RNG stream for both policies after the topology is built */
+  sRand = seed * 2654435761u + 1;
+
+  for (r=0; r<rounds; ++r)
+  {
+    for (i=1+numREs; i<sNumNodes; ++i)
+    {
+      frame_t data = { 0 }, ack = { 0 };
+
+      data.src = data.sender = (uint8_t)i;
+      data.dst = 0;
+      data.hc  = MAX_HOPS;
+      data.len = FRAME_OVERHEAD_BYTES + DATA_PAYLOAD_BYTES;
+
+      sent++;
+      if (!deliver(data, routing, &air, &tx))
+      {
+        continue;
+      }
+      /* nwk_sendAckReply() */
+      ack.src = ack.sender = 0;
+      ack.dst = (uint8_t)i;
+      ack.hc  = MAX_HOPS;
+      ack.len = FRAME_OVERHEAD_BYTES;
+      if (deliver(ack, routing, &air, &tx))
+      {
+        ok++;
+      }
+    }
+  }
+
+  us = air * 8.0 * BIT_US;
+  printf("  %-8s REs=%d  tx/exchange=%5.2f  airtime/exchange=%6.0f us  delivery=%5.1f%%\n",
+         routing ? "routing" : "flood", numREs,
+         (double)tx / sent, us / sent, 100.0 * ok / sent);
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  int      numEDs = argc > 1 ? atoi(argv[1]) : 20;
+  int      rounds = argc > 2 ? atoi(argv[2]) : 500;
+  uint32_t seed   = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 0) : 1;
+  int      res;
+
+  if ((numEDs < 1) || (numEDs > MAX_NODES - 1 - MAX_RES))
+  {
+    fprintf(stderr, "numEDs must be 1..%d\n", MAX_NODES - 1 - MAX_RES);
+    return 1;
+  }
+
+  printf("%d EDs, %d rounds, seed %u, MAX_HOPS %d, NUM_ROUTES %d\n",
+         numEDs, rounds, seed, MAX_HOPS, NUM_ROUTES);
+  for (res=1; res<=MAX_RES; res*=2)
+  {
+    run(res, numEDs, rounds, seed, 0);
+    run(res, numEDs, rounds, seed, 1);
+  }
+  return 0;
+}
@@ -1,7 +1,7 @@
 ##
 ## These may need to be set
 ##
-set baudrate   57600
+set baudrate   9600
 set parity     n
 set databits   8
 set stopbits   1
@@ -46,6 +46,27 @@ set height [expr [lindex $screensize 1] - 200]
 # Expected length of string read from serial port.
 set recordstringlength 32
 
+# The AP sends framed binary records (Host/com_frame.h): COBS encoded,
+# each ending with a 0 byte, holding
+#     | version | type | length | body | CRC-16 LSB,MSB |
+# Samples come in batches: the AP time in msec, then for each sample
+#     | msec after AP time | index | address | rssi | length | ED payload |
+# The ED payload has a 16 msec network time stamp at offset 9 when the
+# network is built with NWK_TIME_SYNC.
+set frameversion 1
+set rec_sample 1
+set rec_text 2
+set rec_batch 3
+set rec_stats 4
+# Commands go to the AP the same way, answered by a response record:
+#     | command | tag | arguments |  ->  | command | tag | status | data |
+# (command codes in virtual_com_cmds.h).
+set rec_cmd 5
+set rec_resp 6
+set cmdtag 0
+# Bytes read from the port that do not make a whole frame yet.
+set rxbuf ""
+
 # map for the defaults array
 set defaultsmap [list "ymin" "ymax" "ytick" "ylolim" "yhilim" "title" "ylabel"]
 # Defaults for each graph
@@ -205,30 +226,227 @@ proc create_graph {} {
 ##
 proc read_port {comfd logfd} {
     global state
-    global data
-    global timestamp
-    global xmin xmax xspan
-    global recordstringlength
+    global rxbuf
+    global rec_sample rec_text rec_batch rec_stats rec_resp
 
     if {[string match $state "stop"]} {
         return
     }
 
-    # Get a record from the com port.
-    # The first token should be the start-of-record symbol.
-    set retval [read $comfd 14]
-    binary scan $retval c sor
+    append rxbuf [read $comfd]
 
-    while {$sor != -1} {
-        puts "WARNING: Unsynchronized read: sor = $sor"
-	return
+    # Handle every complete frame. A bad one is dropped and decoding
+    # picks up again after the next 0.
+    while {[set end [string first "\x00" $rxbuf]] >= 0} {
+        set frame [string range $rxbuf 0 [expr {$end - 1}]]
+        set rxbuf [string range $rxbuf [expr {$end + 1}] end]
+        if {[string length $frame] == 0} {
+            continue
+        }
+        if {[catch {decode_frame $frame} record]} {
+            puts "WARNING: Bad frame: $record"
+            continue
+        }
+        set type [lindex $record 0]
+        set body [lindex $record 1]
+        if {$type == $rec_sample} {
+            read_sample $body
+        } elseif {$type == $rec_batch} {
+            read_batch $body
+        } elseif {$type == $rec_stats} {
+            read_stats $body
+        } elseif {$type == $rec_resp} {
+            read_resp $body
+        } elseif {$type == $rec_text} {
+            puts -nonewline $body
+        }
     }
 
-    set args [binary scan $retval ccccssssuc sor node id rssi temp volt pres seqno missedacks]
-    if {$args != 9} {
+    # No delimiter for far longer than any frame: not our stream.
+    if {[string length $rxbuf] > 1024} {
+        set rxbuf ""
+    }
+}
+
+##
+## Undo the COBS encoding of one frame (without the 0 delimiter).
+##
+proc cobs_decode {data} {
+    set out ""
+    set n [string length $data]
+    set i 0
+    while {$i < $n} {
+        binary scan [string index $data $i] cu code
+        if {$code == 0 || $i + $code > $n} {
+            error "bad COBS code"
+        }
+        append out [string range $data [expr {$i + 1}] [expr {$i + $code - 1}]]
+        incr i $code
+        if {$code < 255 && $i < $n} {
+            append out "\x00"
+        }
+    }
+    return $out
+}
+
+##
+## CRC-16/CCITT (poly 0x1021, initial 0xFFFF), as the AP computes it.
+##
+proc crc16 {data} {
+    set crc 0xFFFF
+    binary scan $data cu* bytes
+    foreach b $bytes {
+        set crc [expr {(($crc >> 8) | ($crc << 8)) & 0xFFFF}]
+        set crc [expr {$crc ^ $b}]
+        set crc [expr {$crc ^ (($crc & 0xFF) >> 4)}]
+        set crc [expr {($crc ^ ($crc << 12)) & 0xFFFF}]
+        set crc [expr {$crc ^ (($crc & 0xFF) << 5)}]
+    }
+    return $crc
+}
+
+##
+## Decode and check a frame. Returns {type body}, raises an error if
+## the frame is bad.
+##
+proc decode_frame {frame} {
+    global frameversion
+
+    set raw [cobs_decode $frame]
+    set len [string length $raw]
+    if {$len < 5} {
+        error "short frame"
+    }
+    binary scan $raw cucucu version type bodylen
+    binary scan [string range $raw end-1 end] su crc
+    if {$bodylen != $len - 5} {
+        error "length $bodylen in a frame of $len bytes"
+    }
+    if {$crc != [crc16 [string range $raw 0 end-2]]} {
+        error "CRC"
+    }
+    if {$version != $frameversion} {
+        error "version $version"
+    }
+    return [list $type [string range $raw 3 end-2]]
+}
+
+##
+## COBS encode one frame, delimiter not included.
+##
+proc cobs_encode {data} {
+    set out ""
+    set block ""
+    foreach c [split $data ""] {
+        if {$c eq "\x00"} {
+            append out [binary format cu [expr {[string length $block] + 1}]] $block
+            set block ""
+            continue
+        }
+        append block $c
+        if {[string length $block] == 254} {
+            append out "\xff" $block
+            set block ""
+        }
+    }
+    append out [binary format cu [expr {[string length $block] + 1}]] $block
+    return $out
+}
+
+##
+## Send a command to the AP: the command code and a list of argument
+## bytes. Returns the tag the response will carry.
+##
+proc send_command {cmd {argbytes {}}} {
+    global comfd frameversion rec_cmd cmdtag
+
+    set cmdtag [expr {($cmdtag + 1) & 0xFF}]
+    set body [binary format cucu $cmd $cmdtag]
+    foreach b $argbytes {
+        append body [binary format cu $b]
+    }
+    set raw [binary format cucucu $frameversion $rec_cmd [string length $body]]
+    append raw $body
+    append raw [binary format su [crc16 $raw]]
+    puts -nonewline $comfd "[cobs_encode $raw]\x00"
+    flush $comfd
+    return $cmdtag
+}
+
+##
+## Answer to a command from send_command.
+##
+proc read_resp {body} {
+    if {[binary scan $body cucucu cmd tag status] != 3} {
+        puts "WARNING: Short response record"
+        return
+    }
+    binary scan [string range $body 3 end] cu* data
+    puts "resp $cmd $tag $status $data"
+}
+
+##
+## Split a batch from the AP into samples.
+##
+proc read_batch {body} {
+    if {[binary scan $body iu aptime] != 1} {
+        puts "WARNING: Short batch"
+        return
+    }
+    set n [string length $body]
+    set off 4
+    while {$off + 5 <= $n} {
+        binary scan $body x${off}cucucucucu dt node id rssi len
+        if {$off + 5 + $len > $n} {
+            break
+        }
+        set payload [string range $body [expr {$off + 5}] [expr {$off + 4 + $len}]]
+        read_sample "[binary format ccc $node $id $rssi]$payload" [expr {$aptime + $dt}]
+        incr off [expr {5 + $len}]
+    }
+    if {$off != $n} {
+        puts "WARNING: Bad batch record at $off"
+    }
+}
+
+##
+## Link statistics the AP keeps for one node (see link_stats.h). Kept in
+## linkstats(<id>) as a list of name value pairs and printed.
+##
+proc read_stats {body} {
+    global linkstats
+
+    set args [binary scan $body "iu cu cu su su su cu su cu c c c cu cu cu su su" \
+      aptime node id frames gaps dups restarts edacksmissed period \
+      rssimin rssimean rssimax lqimin lqimean lqimax interval jitter]
+    if {$args != 17} {
+        puts "WARNING: Short statistics record"
+        return
+    }
+    set linkstats($id) [list frames $frames gaps $gaps dups $dups \
+      restarts $restarts edacksmissed $edacksmissed rssi "$rssimin/$rssimean/$rssimax" \
+      lqi "$lqimin/$lqimean/$lqimax" interval $interval jitter $jitter]
+    puts "stats $node $id $linkstats($id)"
+}
+
+##
+## Handle a sample: index, address and rssi, then the ED payload.
+## aptime is when the AP received it, in AP msec.
+##
+proc read_sample {body {aptime 0}} {
+    global data
+    global timestamp
+    global xmin xmax xspan
+
+    set args [binary scan $body cccssssuc node id rssi temp volt pres seqno missedacks]
+    if {$args != 8} {
         puts "WARNING: Incorrect number of arguments: $args"
         return
     }
+    set nettime 0
+    if {[string length $body] >= 14} {
+        binary scan $body x12su nettime
+    }
 
 ## Fix this error checking code
 #    if {$id > 0} {
@@ -280,6 +498,8 @@ proc read_port {comfd logfd} {
     set data(pressure) $pres
     set data(seqno) $seqno
     set data(missedacks) $missedacks
+    set data(nettime) $nettime
+    set data(aptime) $aptime
 
     plot_point $node $id
 }
@@ -374,7 +594,7 @@ proc open_com {} {
     }
 
     fconfigure $comfd -mode $baudrate,$parity,$databits,$stopbits \
-      -blocking 1 -encoding binary -translation binary -buffering none \
+      -blocking 0 -encoding binary -translation binary -buffering none \
       -buffersize 1024
 
     fconfigure $comfd -translation binary
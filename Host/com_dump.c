@@ -0,0 +1,233 @@
+/**************************************************************************************************
+  Filename:       com_dump.c
+
+  Description:    Reference user of the com_frame decoder. Reads the Access
+                  Point serial stream from a serial port, a capture file or
+                  stdin and prints one line per record:
+
+                    sample <index> <id> <temp> <volt> <rssi> <pres> <seqno> <missedacks> [<nettime>]
+                    at <AP msec> sample ...     (samples from a batch)
+                    stats <AP msec> <index> <id> frames <n> gaps <n> dups <n> ...
+                    resp <command> <tag> <status> <hex data>
+                    text   "<text>"
+                    type <t> <hex body>    (record types it does not know)
+
+                  The sample fields are raw values, scaled as gui_unified.tcl
+                  scales them. Decoder statistics go to stderr at the end.
+
+                  With -c the command given (code and arguments, comma
+                  separated, see com_frame.h) is sent to the AP first, e.g.
+                  -c 6 to list the peers or -c 4,1 to open the join window.
+
+  Build:          gcc -O2 -o com_dump com_dump.c com_frame.c
+  Run:            ./com_dump [-b baud] [-c cmd[,arg...]] [/dev/ttyACM0 | capture.bin | -]
+**************************************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "com_frame.h"
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static int16_t s16(const uint8_t *p)
+{
+  return (int16_t)(p[0] | (p[1] << 8));
+}
+
+/* idx, id and rssi from the record header, 'p' the ED payload */
+static void print_sample(uint8_t idx, uint8_t id, uint8_t rssi, const uint8_t *p, uint8_t len)
+{
+  if (len < 9)
+  {
+    printf("sample %u %u short\n", idx, id);
+    return;
+  }
+  printf("sample %u %u %.2f %.3f %u %d %u %u",
+         idx, id, (s16(p) * 1.8 + 320) / 10, s16(p + 2) / 1024.0 * 2.5 * 2,
+         rssi, s16(p + 4), (uint16_t)s16(p + 6), p[8]);
+  if (len >= 11)
+  {
+    printf(" %u", (uint16_t)s16(p + 9));
+  }
+  printf("\n");
+}
+
+static void print_frame(const comFrame_t *f, void *arg)
+{
+  const uint8_t *b = f->body;
+  int            i;
+
+  (void)arg;
+  if ((COM_REC_SAMPLE == f->type) && (f->len >= 3))
+  {
+    print_sample(b[0], b[1], b[2], b + 3, (uint8_t)(f->len - 3));
+  }
+  else if ((COM_REC_BATCH == f->type) && (f->len >= 4))
+  {
+    uint32_t ms = b[0] | (b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+
+    /* records: | dt | index | address | rssi | len | payload | */
+    for (i=4; i+5<=f->len && i+5+b[i+4]<=f->len; i+=5+b[i+4])
+    {
+      printf("at %lu ", (unsigned long)(ms + b[i]));
+      print_sample(b[i+1], b[i+2], b[i+3], b + i + 5, b[i+4]);
+    }
+    if (i != f->len)
+    {
+      printf("batch: %d bytes left over\n", f->len - i);
+    }
+  }
+  else if ((COM_REC_STATS == f->type) && (f->len >= 26))
+  {
+    printf("stats %lu %u %u frames %u gaps %u dups %u restarts %u edacksmissed %u "
+           "period %u rssi %d/%d/%d lqi %u/%u/%u interval %u jitter %u\n",
+           (unsigned long)(b[0] | (b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24)),
+           b[4], b[5], (uint16_t)s16(b + 6), (uint16_t)s16(b + 8), (uint16_t)s16(b + 10),
+           b[12], (uint16_t)s16(b + 13), b[15], (int8_t)b[16], (int8_t)b[17], (int8_t)b[18],
+           b[19], b[20], b[21], (uint16_t)s16(b + 22), (uint16_t)s16(b + 24));
+  }
+  else if ((COM_REC_RESP == f->type) && (f->len >= 3))
+  {
+    printf("resp %u %u %u", b[0], b[1], b[2]);
+    for (i=3; i<f->len; ++i)
+    {
+      printf(" %02x", b[i]);
+    }
+    printf("\n");
+  }
+  else if (COM_REC_TEXT == f->type)
+  {
+    printf("text   \"");
+    for (i=0; i<f->len; ++i)
+    {
+      printf((b[i] >= ' ' && b[i] < 0x7F) ? "%c" : "\\x%02x", b[i]);
+    }
+    printf("\"\n");
+  }
+  else
+  {
+    printf("type %u", f->type);
+    for (i=0; i<f->len; ++i)
+    {
+      printf(" %02x", b[i]);
+    }
+    printf("\n");
+  }
+  fflush(stdout);
+}
+
+static speed_t baud_code(long baud)
+{
+  switch (baud)
+  {
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default:     return 0;
+  }
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  static comDecoder_t dec;
+  const char         *path = "-";
+  long                baud = 9600;
+  uint8_t             buf[256];
+  uint8_t             cmd[COM_CMD_MAX_LEN];
+  uint8_t             cmdLen = 0;
+  ssize_t             n;
+  int                 fd, opt;
+
+  while ((opt = getopt(argc, argv, "b:c:")) != -1)
+  {
+    if ('b' == opt)
+    {
+      baud = atol(optarg);
+    }
+    else if ('c' == opt)
+    {
+      char *p = optarg;
+
+      /* | code | tag | arguments |, tag 1 */
+      cmd[0] = (uint8_t)strtoul(p, &p, 0);
+      cmd[1] = 1;
+      for (cmdLen=2; (',' == *p) && (cmdLen < sizeof(cmd)); ++cmdLen)
+      {
+        cmd[cmdLen] = (uint8_t)strtoul(p + 1, &p, 0);
+      }
+      if (*p)
+      {
+        fprintf(stderr, "%s: bad command\n", optarg);
+        return 1;
+      }
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-b baud] [-c cmd[,arg...]] [device | file | -]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (optind < argc)
+  {
+    path = argv[optind];
+  }
+
+  fd = strcmp(path, "-") ? open(path, (cmdLen ? O_RDWR : O_RDONLY) | O_NOCTTY) : 0;
+  if (fd < 0)
+  {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  if (isatty(fd))
+  {
+    struct termios tio;
+
+    if (!baud_code(baud) || tcgetattr(fd, &tio))
+    {
+      fprintf(stderr, "%s: cannot set %ld baud\n", path, baud);
+      return 1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud_code(baud));
+    cfsetospeed(&tio, baud_code(baud));
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  if (cmdLen)
+  {
+    uint8_t wire[COM_FRAME_MAX_WIRE];
+    size_t  len = com_frame_encode(COM_REC_CMD, cmd, cmdLen, wire);
+
+    if (write(fd, wire, len) != (ssize_t)len)
+    {
+      fprintf(stderr, "%s: cannot send command: %s\n", path, strerror(errno));
+      return 1;
+    }
+  }
+
+  com_decoder_init(&dec);
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+  {
+    com_decoder_feed(&dec, buf, (size_t)n, print_frame, NULL);
+  }
+
+  fprintf(stderr, "frames %lu, cobs errors %lu, length errors %lu, crc errors %lu, "
+          "version errors %lu, bytes skipped %lu\n",
+          dec.stats.frames, dec.stats.cobsErrors, dec.stats.lengthErrors,
+          dec.stats.crcErrors, dec.stats.versionErrors, dec.stats.bytesSkipped);
+  return 0;
+}
@@ -0,0 +1,197 @@
+/**************************************************************************************************
+  Filename:       com_frame.c
+
+  Description:    Encoder and stream decoder for the Access Point serial
+                  frames described in com_frame.h. The encoder is the same
+                  framing sendFrame() in virtual_com_cmds.c produces; hosts use
+                  it for emulators and replays.
+
+  Build:          compile with the program that uses it, e.g.
+                  gcc -O2 -o com_dump com_dump.c com_frame.c
+**************************************************************************************************/
+
+#include <string.h>
+
+#include "com_frame.h"
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+/* CRC-16/CCITT, poly 0x1021, MSB first. Start with 0xFFFF. */
+uint16_t com_crc16(uint16_t crc, const uint8_t *p, size_t n)
+{
+  while (n--)
+  {
+    crc  = (uint16_t)((crc >> 8) | (crc << 8));
+    crc ^= *p++;
+    crc ^= (crc & 0xFF) >> 4;
+    crc ^= (uint16_t)(crc << 12);
+    crc ^= (uint16_t)((crc & 0xFF) << 5);
+  }
+  return crc;
+}
+
+/* Build and COBS encode a frame into 'out' (COM_FRAME_MAX_WIRE bytes),
+ * delimiter included. Returns the number of bytes.
+ */
+size_t com_frame_encode(uint8_t type, const uint8_t *body, uint8_t len, uint8_t *out)
+{
+  uint8_t  raw[COM_FRAME_MAX_BODY + COM_FRAME_OVERHEAD];
+  uint16_t crc;
+  size_t   i, code = 0, n = 1;
+
+  raw[0] = COM_FRAME_VERSION;
+  raw[1] = type;
+  raw[2] = len;
+  memcpy(raw + 3, body, len);
+  crc = com_crc16(0xFFFF, raw, len + 3u);
+  raw[len + 3] = (uint8_t)crc;
+  raw[len + 4] = (uint8_t)(crc >> 8);
+
+  for (i=0; i<len + (size_t)COM_FRAME_OVERHEAD; ++i)
+  {
+    if (raw[i])
+    {
+      out[n++] = raw[i];
+      if (n - code < 0xFF)
+      {
+        continue;
+      }
+    }
+    /* a 0, or a full block of 254 non-zero bytes */
+    out[code] = (uint8_t)(n - code);
+    code = n++;
+  }
+  out[code] = (uint8_t)(n - code);
+  out[n++] = 0;
+  return n;
+}
+
+/* Decode one frame, 'n' bytes of 'wire' without the delimiter, into 'dec'
+ * (at least n bytes) and check it. Returns COM_FRAME_OK or an error.
+ */
+int com_frame_parse(const uint8_t *wire, size_t n, uint8_t *dec, comFrame_t *frame)
+{
+  size_t   i = 0, m = 0;
+  uint16_t crc;
+
+  while (i < n)
+  {
+    uint8_t code = wire[i++];
+
+    if (!code || (i + code - 1 > n))
+    {
+      return COM_FRAME_ECOBS;
+    }
+    memcpy(dec + m, wire + i, code - 1u);
+    m += code - 1u;
+    i += code - 1u;
+    /* every block but a full one, and the last, stands for a 0 */
+    if ((code < 0xFF) && (i < n))
+    {
+      dec[m++] = 0;
+    }
+  }
+
+  if (m < COM_FRAME_OVERHEAD)
+  {
+    return n ? COM_FRAME_ESHORT : COM_FRAME_ECOBS;
+  }
+  if (dec[2] != m - COM_FRAME_OVERHEAD)
+  {
+    return COM_FRAME_ELENGTH;
+  }
+  crc = com_crc16(0xFFFF, dec, m - 2);
+  if ((dec[m-2] != (uint8_t)crc) || (dec[m-1] != (uint8_t)(crc >> 8)))
+  {
+    return COM_FRAME_ECRC;
+  }
+  if (dec[0] != COM_FRAME_VERSION)
+  {
+    return COM_FRAME_EVERSION;
+  }
+  frame->version = dec[0];
+  frame->type    = dec[1];
+  frame->len     = dec[2];
+  frame->body    = dec + 3;
+  return COM_FRAME_OK;
+}
+
+void com_decoder_init(comDecoder_t *d)
+{
+  memset(d, 0, sizeof(*d));
+}
+
+/* Feed received bytes. 'cb' is called for each good frame; the frame is
+ * only valid during the call. Returns the number of frames delivered.
+ */
+size_t com_decoder_feed(comDecoder_t *d, const uint8_t *data, size_t len,
+                        comFrameCB_t cb, void *arg)
+{
+  size_t delivered = 0;
+
+  while (len--)
+  {
+    uint8_t    b = *data++;
+    comFrame_t f;
+    int        rc;
+
+    if (b)
+    {
+      if (d->n < sizeof(d->wire))
+      {
+        d->wire[d->n++] = b;
+      }
+      else
+      {
+        d->overflow = 1;
+        d->stats.bytesSkipped++;
+      }
+      continue;
+    }
+
+    /* delimiter: a frame ends here */
+    if (d->overflow)
+    {
+      d->stats.lengthErrors++;
+      d->stats.bytesSkipped += d->n;
+    }
+    else if (d->n)
+    {
+      rc = com_frame_parse(d->wire, d->n, d->dec, &f);
+      if (COM_FRAME_OK == rc)
+      {
+        d->stats.frames++;
+        delivered++;
+        if (cb)
+        {
+          cb(&f, arg);
+        }
+      }
+      else
+      {
+        if (COM_FRAME_ECOBS == rc)
+        {
+          d->stats.cobsErrors++;
+        }
+        else if (COM_FRAME_ECRC == rc)
+        {
+          d->stats.crcErrors++;
+        }
+        else if (COM_FRAME_EVERSION == rc)
+        {
+          d->stats.versionErrors++;
+        }
+        else
+        {
+          d->stats.lengthErrors++;
+        }
+        d->stats.bytesSkipped += d->n;
+      }
+    }
+    d->n = 0;
+    d->overflow = 0;
+  }
+  return delivered;
+}
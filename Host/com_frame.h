@@ -0,0 +1,120 @@
+/**************************************************************************************************
+  Filename:       com_frame.h
+
+  Description:    Host side of the framed binary serial protocol the sensor
+                  demo Access Point sends (see virtual_com_cmds.h in
+                  IARworkspace/ez430-rf2500_wsm/Applications). A frame is
+
+                    | version | type | length | body | CRC-16 LSB,MSB |
+
+                  COBS encoded and followed by a 0 byte. The CRC is
+                  CRC-16/CCITT (poly 0x1021, initial 0xFFFF) over version to
+                  body. The constants here must match the firmware ones.
+**************************************************************************************************/
+
+#ifndef COM_FRAME_H
+#define COM_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define COM_FRAME_VERSION   1
+#define COM_FRAME_OVERHEAD  5       /* version, type, length, CRC */
+#define COM_FRAME_MAX_BODY  255
+/* longest encoded frame, delimiter included */
+#define COM_FRAME_MAX_WIRE  (COM_FRAME_MAX_BODY + COM_FRAME_OVERHEAD + 3)
+
+/* Record types */
+#define COM_REC_SAMPLE      1       /* | peer index | address | rssi | ED payload | */
+#define COM_REC_TEXT        2       /* text for a terminal */
+#define COM_REC_BATCH       3       /* | AP msec (4) | { | dt | index | address | rssi | len | payload | } | */
+#define COM_REC_STATS       4       /* link statistics for one peer, see link_stats.h */
+#define COM_REC_CMD         5       /* host to AP: | command | tag | arguments | */
+#define COM_REC_RESP        6       /* AP to host: | command | tag | status | data | */
+
+/* Host commands, see virtual_com_cmds.h for the arguments */
+#define COM_CMD_MAX_LEN       8     /* longest command body the AP takes */
+#define COM_CMD_GET_STATS     1
+#define COM_CMD_SET_CHANNEL   2
+#define COM_CMD_SET_TX_POWER  3
+#define COM_CMD_JOIN          4
+#define COM_CMD_UNLINK        5
+#define COM_CMD_DUMP_CONNS    6
+#define COM_CMD_SNAPSHOT      7
+#define COM_CMD_DOWNLINK      8
+
+/* Response status */
+#define COM_ST_OK             0
+#define COM_ST_UNKNOWN        1
+#define COM_ST_BAD_ARG        2
+#define COM_ST_UNSUPPORTED    3
+#define COM_ST_FAILED         4
+
+/* com_frame_parse() results */
+#define COM_FRAME_OK        0
+#define COM_FRAME_ECOBS     -1      /* bad COBS code or empty frame */
+#define COM_FRAME_ESHORT    -2      /* shorter than the header and CRC */
+#define COM_FRAME_ELENGTH   -3      /* length field does not match */
+#define COM_FRAME_ECRC      -4
+#define COM_FRAME_EVERSION  -5
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+typedef struct
+{
+  uint8_t        version;
+  uint8_t        type;
+  uint8_t        len;
+  const uint8_t *body;              /* points into the decoder's buffer */
+} comFrame_t;
+
+typedef struct
+{
+  unsigned long frames;             /* good frames delivered */
+  unsigned long cobsErrors;
+  unsigned long lengthErrors;       /* short, oversize or length mismatch */
+  unsigned long crcErrors;
+  unsigned long versionErrors;
+  unsigned long bytesSkipped;       /* bytes in frames that were rejected */
+} comStats_t;
+
+typedef void (*comFrameCB_t)(const comFrame_t *frame, void *arg);
+
+/* Stream decoder. Feed it bytes as they come; it delivers every good frame
+ * and resynchronises at the next 0 after anything bad.
+ */
+typedef struct
+{
+  uint8_t    wire[COM_FRAME_MAX_WIRE];
+  uint8_t    dec[COM_FRAME_MAX_WIRE];
+  size_t     n;
+  int        overflow;              /* current frame is too long, skip it */
+  comStats_t stats;
+} comDecoder_t;
+
+/******************************************************************************
+ * PROTOTYPES
+ */
+
+uint16_t com_crc16(uint16_t crc, const uint8_t *p, size_t n);
+size_t   com_frame_encode(uint8_t type, const uint8_t *body, uint8_t len, uint8_t *out);
+int      com_frame_parse(const uint8_t *wire, size_t n, uint8_t *dec, comFrame_t *frame);
+void     com_decoder_init(comDecoder_t *d);
+size_t   com_decoder_feed(comDecoder_t *d, const uint8_t *data, size_t len,
+                          comFrameCB_t cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,478 @@
+/**************************************************************************************************
+  Filename:       ap_emu.cpp
+
+  Description:    Access Point emulator for testing and load-testing the host
+                  side without boards. It writes what main_AP.c sends: samples
+                  in COM_REC_BATCH frames no longer than the AP's, each batch
+                  closed when full or 250 msec (BATCH_MAX_MS) after its first
+                  sample. It also writes an AP self-measurement (index 0,
+                  address 0) every AP second and impact alarms (seqno 0).
+
+                  Two sources:
+                    - synthetic: -n End Devices, each sending -r samples per
+                      second, with -L percent of their frames lost on the air
+                      (seqno skips, missed acks counted as main_ED.c does),
+                      -I impacts per thousand samples and -C percent of the
+                      serial frames corrupted (a byte changed, dropped or
+                      doubled), running -t AP seconds;
+                    - replay: a GUI log (log_gui.txt, or the older
+                      log_demo.txt), one log timestamp per AP second. Logs
+                      without sequence numbers get one counted per node.
+
+                  AP time runs -x times faster than real time, or as fast as
+                  the reader takes it with -x 0. Output goes to a pty linked
+                  at -p (default /tmp/ap_pty), or to a file with -o. The pty
+                  is opened raw, kept open so nothing is lost before the
+                  reader opens it, and closed after the last frame; playing
+                  starts after -d seconds.
+
+  Build:          g++ -O2 -std=c++17 -o ap_emu ap_emu.cpp record.cpp ../com_frame.c
+  Run:            ./ap_emu [-n nodes] [-r rate] [-t secs] [-L loss%] [-C corrupt%] [-I impacts]
+                           [-S seed] [-x speedup] [-p link | -o file] [-d delay] [log.txt]
+**************************************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <queue>
+#include <vector>
+
+#include "record.h"
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define AP_FRAME_MAX_LEN  64        /* COM_FRAME_MAX_LEN in virtual_com_cmds.h */
+#define AP_SAMPLE_LEN     9
+#define BATCH_MAX_MS      250       /* main_AP.c */
+#define MISSES_IN_A_ROW   2         /* main_ED.c */
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+/* An End Device of the synthetic network */
+struct Node
+{
+  uint8_t  id;
+  uint16_t seqno;
+  uint8_t  missedAcks;
+  double   temp;                    /* degC */
+  double   volt;
+  double   pres;
+  double   rssi;
+};
+
+/* Next thing to happen in AP time: a sample from node 'node', or the AP
+ * measuring itself (node -1)
+ */
+struct Event
+{
+  double ms;
+  int    node;
+
+  bool operator>(const Event &e) const
+  {
+    return ms > e.ms;
+  }
+};
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+static int      sOut;
+static double   sSpeed = 1;
+static double   sStart;
+static double   sCorrupt;           /* percent of frames */
+static uint8_t  sBatch[AP_FRAME_MAX_LEN - COM_FRAME_OVERHEAD];
+static uint8_t  sBatchLen;
+static uint32_t sBatchMs;
+
+static unsigned long sFrames, sBytes, sSamples, sCorrupted;
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static double uniform(void)
+{
+  return rand() / (RAND_MAX + 1.0);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t)
+{
+  double d = t - now();
+
+  if (d > 0)
+  {
+    struct timespec ts;
+
+    ts.tv_sec  = (time_t)d;
+    ts.tv_nsec = (long)((d - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+  }
+}
+
+/* Wait for AP time 'ms' to come round */
+static void pace(double ms)
+{
+  if (sSpeed > 0)
+  {
+    sleep_until(sStart + ms / 1000 / sSpeed);
+  }
+}
+
+static void put(const uint8_t *p, size_t n)
+{
+  while (n)
+  {
+    ssize_t w = write(sOut, p, n);
+
+    if (w < 0)
+    {
+      if (EINTR == errno)
+      {
+        continue;
+      }
+      perror("write");
+      exit(1);
+    }
+    p += w;
+    n -= (size_t)w;
+  }
+}
+
+static void flush_batch(void)
+{
+  uint8_t wire[COM_FRAME_MAX_WIRE + 1];
+  size_t  n;
+
+  if (!sBatchLen)
+  {
+    return;
+  }
+  n = com_frame_encode(COM_REC_BATCH, sBatch, sBatchLen, wire);
+  sBatchLen = 0;
+
+  /* A byte changed, lost or doubled on the wire. The delimiter is left
+   * alone so the damage stays in this frame, as a UART error would.
+   */
+  if (uniform() * 100 < sCorrupt)
+  {
+    size_t at = (size_t)(uniform() * (n - 1));
+
+    switch (rand() % 3)
+    {
+      case 0:
+        wire[at] ^= (uint8_t)(1 + rand() % 255);
+        break;
+      case 1:
+        memmove(&wire[at], &wire[at+1], n - at - 1);
+        n--;
+        break;
+      default:
+        memmove(&wire[at+1], &wire[at], n - at);
+        n++;
+        break;
+    }
+    sCorrupted++;
+  }
+  put(wire, n);
+  sFrames++;
+  sBytes += n;
+}
+
+/* batchRecord() in main_AP.c */
+static void batch_record(const Record &r, uint32_t ms)
+{
+  uint8_t *rec;
+
+  if (sBatchLen &&
+      ((sBatchLen + 5 + AP_SAMPLE_LEN > (int)sizeof(sBatch)) || (ms - sBatchMs > 0xFF)))
+  {
+    flush_batch();
+  }
+  if (!sBatchLen)
+  {
+    sBatchMs  = ms;
+    sBatch[0] = ms & 0xFF;
+    sBatch[1] = (ms >> 8) & 0xFF;
+    sBatch[2] = (ms >> 16) & 0xFF;
+    sBatch[3] = (ms >> 24) & 0xFF;
+    sBatchLen = 4;
+  }
+  rec     = &sBatch[sBatchLen];
+  rec[0]  = (uint8_t)(ms - sBatchMs);
+  rec[1]  = r.node;
+  rec[2]  = r.id;
+  rec[3]  = r.rssi;
+  rec[4]  = AP_SAMPLE_LEN;
+  rec[5]  = r.temp & 0xFF;
+  rec[6]  = (r.temp >> 8) & 0xFF;
+  rec[7]  = r.volt & 0xFF;
+  rec[8]  = r.volt >> 8;
+  rec[9]  = r.pres & 0xFF;
+  rec[10] = (r.pres >> 8) & 0xFF;
+  rec[11] = r.seqno & 0xFF;
+  rec[12] = r.seqno >> 8;
+  rec[13] = r.missedAcks;
+  sBatchLen += 5 + AP_SAMPLE_LEN;
+  sSamples++;
+}
+
+/* Send the batch if its first sample has waited BATCH_MAX_MS by 'ms' */
+static void batch_due(double ms)
+{
+  if (sBatchLen && (ms >= sBatchMs + BATCH_MAX_MS))
+  {
+    pace(sBatchMs + BATCH_MAX_MS);
+    flush_batch();
+  }
+}
+
+static Record ap_sample(void)
+{
+  Record ap;
+
+  /* index 0, address 0, voltage only (main_AP.c) */
+  memset(&ap, 0, sizeof(ap));
+  ap.volt = 700;
+  return ap;
+}
+
+static void replay(const std::vector<Record> &log)
+{
+  uint32_t tick;
+  size_t   i;
+
+  for (i=0, tick=log.empty() ? 0 : log[0].tick; i<log.size(); ++tick)
+  {
+    uint32_t ms = (tick - log[0].tick) * 1000;
+
+    pace(ms);
+    batch_record(ap_sample(), ms);
+    for (; (i<log.size()) && (log[i].tick <= tick); ++i)
+    {
+      batch_record(log[i], ms);
+    }
+    flush_batch();
+  }
+}
+
+static void synthetic(unsigned nodes, double rate, double secs, double loss, double impacts)
+{
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+  std::vector<Node> node(nodes);
+  double            period = 1000 / rate;
+  unsigned          i;
+
+  for (i=0; i<nodes; ++i)
+  {
+    node[i].id    = (uint8_t)(i + 1);
+    node[i].seqno = 0;
+    node[i].temp  = 20 + uniform() * 8;
+    node[i].volt  = 2.8 + uniform() * 0.6;
+    node[i].pres  = 100 + uniform() * 300;
+    node[i].rssi  = 15 + uniform() * 30;
+    events.push({uniform() * period, (int)i});
+  }
+  events.push({0, -1});
+
+  while (!events.empty() && (events.top().ms < secs * 1000))
+  {
+    Event  e = events.top();
+    Record r;
+
+    events.pop();
+    batch_due(e.ms);
+    pace(e.ms);
+
+    if (e.node < 0)
+    {
+      batch_record(ap_sample(), (uint32_t)e.ms);
+      events.push({e.ms + 1000, -1});
+      continue;
+    }
+
+    Node &n = node[e.node];
+
+    events.push({e.ms + period * (0.95 + uniform() * 0.1), e.node});
+    if (!++n.seqno)
+    {
+      n.seqno = 1;                  // 0 is an impact
+    }
+    n.temp += (uniform() - 0.5) * 0.2;
+    n.volt += (uniform() - 0.5) * 0.002;
+    n.pres += (uniform() - 0.5) * 4;
+    n.rssi += (uniform() - 0.5) * 2;
+    n.rssi  = n.rssi < 1 ? 1 : n.rssi > 99 ? 99 : n.rssi;
+
+    /* lost on the air: the ED retries and counts the missing acks */
+    if (uniform() * 100 < loss)
+    {
+      n.missedAcks = (uint8_t)(n.missedAcks + MISSES_IN_A_ROW);
+      continue;
+    }
+
+    r.kind       = Record::SAMPLE;
+    r.node       = (uint8_t)e.node;
+    r.id         = n.id;
+    r.rssi       = (uint8_t)n.rssi;
+    r.temp       = (int16_t)lround(n.temp * 10);
+    r.volt       = (uint16_t)lround(n.volt / 5 * 1024);
+    r.pres       = (int16_t)lround(n.pres);
+    r.seqno      = uniform() * 1000 < impacts ? 0 : n.seqno;
+    r.missedAcks = n.missedAcks;
+    batch_record(r, (uint32_t)e.ms);
+    n.missedAcks = 0;
+  }
+  flush_batch();
+}
+
+/* Raw pty linked at 'link'. Returns the master; '*slave' is kept open. */
+static int open_pty(const char *link, int *slave)
+{
+  struct termios tio;
+  int            fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if ((fd < 0) || grantpt(fd) || unlockpt(fd) ||
+      ((*slave = open(ptsname(fd), O_RDWR | O_NOCTTY)) < 0))
+  {
+    perror("pty");
+    exit(1);
+  }
+  tcgetattr(*slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(*slave, TCSANOW, &tio);
+  unlink(link);
+  if (symlink(ptsname(fd), link))
+  {
+    perror(link);
+    exit(1);
+  }
+  return fd;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  const char         *link = "/tmp/ap_pty", *file = NULL;
+  double              rate = 1, secs = 3600, loss = 0, impacts = 0, delay = 1, t;
+  unsigned            nodes = 8, seed = 1;
+  std::vector<Record> log;
+  uint16_t            seq[256] = {0};
+  char                line[256];
+  FILE               *fp;
+  int                 opt, slave = -1;
+
+  while ((opt = getopt(argc, argv, "n:r:t:L:C:I:S:x:p:o:d:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': nodes    = (unsigned)atoi(optarg); break;
+      case 'r': rate     = atof(optarg);           break;
+      case 't': secs     = atof(optarg);           break;
+      case 'L': loss     = atof(optarg);           break;
+      case 'C': sCorrupt = atof(optarg);           break;
+      case 'I': impacts  = atof(optarg);           break;
+      case 'S': seed     = (unsigned)atoi(optarg); break;
+      case 'x': sSpeed   = atof(optarg);           break;
+      case 'p': link     = optarg;                 break;
+      case 'o': file     = optarg;                 break;
+      case 'd': delay    = atof(optarg);           break;
+      default:
+        fprintf(stderr, "usage: %s [-n nodes] [-r rate] [-t secs] [-L loss%%] [-C corrupt%%] "
+                "[-I impacts] [-S seed] [-x speedup] [-p link | -o file] [-d delay] [log.txt]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  /* node addresses are one byte, 0 is the AP */
+  if ((nodes < 1) || (nodes > 255) || (rate <= 0))
+  {
+    fprintf(stderr, "%s: 1 to 255 nodes, rate above 0\n", argv[0]);
+    return 1;
+  }
+  srand(seed);
+
+  if (optind < argc)
+  {
+    if (!(fp = fopen(argv[optind], "r")))
+    {
+      fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+      return 1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+      Record r;
+
+      if (record_parse_line(line, &r))
+      {
+        if (!r.seqno)
+        {
+          r.seqno = ++seq[r.id] ? seq[r.id] : ++seq[r.id];
+        }
+        log.push_back(r);
+      }
+    }
+    fclose(fp);
+  }
+
+  if (file)
+  {
+    sOut = strcmp(file, "-") ? open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644) : 1;
+    if (sOut < 0)
+    {
+      fprintf(stderr, "%s: %s\n", file, strerror(errno));
+      return 1;
+    }
+  }
+  else
+  {
+    sOut = open_pty(link, &slave);
+    fprintf(stderr, "%s -> %s\n", link, ptsname(sOut));
+    sleep_until(now() + delay);
+  }
+
+  sStart = now();
+  if (optind < argc)
+  {
+    replay(log);
+  }
+  else
+  {
+    synthetic(nodes, rate, secs, loss, impacts);
+  }
+  t = now() - sStart;
+
+  if (slave >= 0)
+  {
+    /* let the reader drain the pty before closing it */
+    sleep_until(now() + 0.5);
+    close(slave);
+    unlink(link);
+  }
+  close(sOut);
+  fprintf(stderr, "%lu samples in %lu frames (%lu corrupted), %lu bytes in %.2f s, "
+          "%.0f samples/s\n", sSamples, sFrames, sCorrupted, sBytes, t, t > 0 ? sSamples / t : 0);
+  return 0;
+}
@@ -0,0 +1,472 @@
+/**************************************************************************************************
+  Filename:       colog.cpp
+
+  Description:    Columnar log writer and mmap reader. See colog.h.
+**************************************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "colog.h"
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static size_t chunk_bytes(uint32_t count)
+{
+  return (sizeof(CologChunkHeader) + (size_t)COLOG_ROW_BYTES * count + 7) & ~(size_t)7;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Column of 'n' values of type T at 'at' in 'buf', filled from the rows */
+template <typename T, typename F>
+static uint8_t *column(uint8_t *at, const std::vector<Record> &rows, F get)
+{
+  for (const Record &r : rows)
+  {
+    T v = (T)get(r);
+
+    memcpy(at, &v, sizeof(v));
+    at += sizeof(v);
+  }
+  return at;
+}
+
+/******************************************************************************
+ * ColumnLogWriter
+ */
+
+ColumnLogWriter::~ColumnLogWriter()
+{
+  close();
+}
+
+bool ColumnLogWriter::open(const char *path, uint32_t chunkRecords, unsigned flushSecs)
+{
+  CologHeader h;
+
+  mFd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (mFd < 0)
+  {
+    return false;
+  }
+  mChunkRecords = chunkRecords ? chunkRecords : 1;
+  mFlushSecs    = flushSecs;
+  mLastFlush    = now();
+
+  memset(&h, 0, sizeof(h));
+  h.magic        = COLOG_MAGIC;
+  h.version      = COLOG_VERSION;
+  h.chunkRecords = mChunkRecords;
+  return put(&h, sizeof(h));
+}
+
+void ColumnLogWriter::append(const Record &r)
+{
+  Pending             &p    = mPending[r.id];
+  std::vector<Record> &rows = p.rows;
+  int                  id;
+
+  if (mFd < 0)
+  {
+    return;
+  }
+  if (p.seen && (p.session == mSession) && (r.tick < p.lastTick) &&
+      (mSession < COLOG_MAX_SESSION))
+  {
+    /* a new gateway run: no chunk may hold records of two */
+    for (id=0; id<256; ++id)
+    {
+      if (!mPending[id].rows.empty())
+      {
+        writeChunk((uint8_t)id);
+      }
+    }
+    mSession++;
+  }
+  p.lastTick = r.tick;
+  p.session  = mSession;
+  p.seen     = true;
+  if (rows.empty())
+  {
+    rows.reserve(mChunkRecords < 256 ? mChunkRecords : 256);
+  }
+  rows.push_back(r);
+  mRecords++;
+  if (rows.size() >= mChunkRecords)
+  {
+    writeChunk(r.id);
+  }
+}
+
+void ColumnLogWriter::flush(bool force)
+{
+  int id;
+
+  if ((mFd < 0) || (!force && (now() - mLastFlush < mFlushSecs)))
+  {
+    return;
+  }
+  for (id=0; id<256; ++id)
+  {
+    if (!mPending[id].rows.empty())
+    {
+      writeChunk((uint8_t)id);
+    }
+  }
+  fdatasync(mFd);
+  mLastFlush = now();
+}
+
+bool ColumnLogWriter::close()
+{
+  CologFooter f;
+  bool        ok;
+
+  if (mFd < 0)
+  {
+    return !mFailed;
+  }
+  flush(true);
+
+  memset(&f, 0, sizeof(f));
+  f.magic       = COLOG_FOOTER_MAGIC;
+  f.version     = COLOG_VERSION;
+  f.indexOffset = mOffset;
+  f.indexCount  = mIndex.size();
+  f.records     = mRecords;
+  put(mIndex.data(), mIndex.size() * sizeof(CologIndexEntry));
+  put(&f, sizeof(f));
+
+  ok = !mFailed && !fdatasync(mFd);
+  ok = !::close(mFd) && ok;
+  mFd = -1;
+  return ok;
+}
+
+/* One chunk of node 'id' from its pending rows */
+void ColumnLogWriter::writeChunk(uint8_t id)
+{
+  std::vector<Record> &rows = mPending[id].rows;
+  CologChunkHeader     h;
+  CologIndexEntry      e;
+  uint8_t             *p;
+  uint32_t             n = (uint32_t)rows.size();
+
+  memset(&h, 0, sizeof(h));
+  h.magic     = COLOG_CHUNK_MAGIC;
+  h.bytes     = (uint32_t)chunk_bytes(n);
+  h.count     = n;
+  h.tickFirst = rows.front().tick;
+  h.tickLast  = rows.back().tick;
+  h.id        = id;
+  h.session   = mSession;
+  h.seq       = mIndex.size();
+
+  mBuf.assign(h.bytes, 0);
+  memcpy(mBuf.data(), &h, sizeof(h));
+  p = mBuf.data() + sizeof(h);
+  p = column<uint32_t>(p, rows, [](const Record &r) { return r.tick; });
+  p = column<uint32_t>(p, rows, [](const Record &r) { return r.apMs; });
+  p = column<int16_t>(p, rows, [](const Record &r) { return r.temp; });
+  p = column<uint16_t>(p, rows, [](const Record &r) { return r.volt; });
+  p = column<int16_t>(p, rows, [](const Record &r) { return r.pres; });
+  p = column<uint16_t>(p, rows, [](const Record &r) { return r.seqno; });
+  p = column<uint8_t>(p, rows, [](const Record &r) { return r.node; });
+  p = column<uint8_t>(p, rows, [](const Record &r) { return r.rssi; });
+  p = column<uint8_t>(p, rows, [](const Record &r) { return r.missedAcks; });
+  column<uint8_t>(p, rows, [](const Record &r) { return r.kind; });
+
+  memset(&e, 0, sizeof(e));
+  e.offset    = mOffset;
+  e.tickFirst = h.tickFirst;
+  e.tickLast  = h.tickLast;
+  e.count     = n;
+  e.id        = id;
+  e.session   = mSession;
+  if (put(mBuf.data(), mBuf.size()))
+  {
+    mIndex.push_back(e);
+  }
+  rows.clear();
+}
+
+bool ColumnLogWriter::put(const void *p, size_t n)
+{
+  const uint8_t *b = (const uint8_t *)p;
+
+  while (n && !mFailed)
+  {
+    ssize_t w = write(mFd, b, n);
+
+    if (w < 0)
+    {
+      if (EINTR != errno)
+      {
+        mFailed = true;
+      }
+      continue;
+    }
+    b       += w;
+    n       -= (size_t)w;
+    mOffset += (uint64_t)w;
+  }
+  return !mFailed;
+}
+
+/******************************************************************************
+ * ColumnLogReader
+ */
+
+ColumnLogReader::~ColumnLogReader()
+{
+  if (mMap)
+  {
+    munmap((void *)mMap, mSize);
+  }
+}
+
+bool ColumnLogReader::open(const char *path)
+{
+  struct stat        st;
+  const CologHeader *h;
+  CologFooter        f;
+  bool               indexed = false;
+  int                fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+  if ((fd < 0) || fstat(fd, &st))
+  {
+    mError = strerror(errno);
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+    return false;
+  }
+  mSize = (size_t)st.st_size;
+  if (mSize < sizeof(CologHeader))
+  {
+    ::close(fd);
+    mError = "too short";
+    return false;
+  }
+  mMap = (const uint8_t *)mmap(NULL, mSize, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (MAP_FAILED == (const void *)mMap)
+  {
+    mMap   = NULL;
+    mError = strerror(errno);
+    return false;
+  }
+  h = (const CologHeader *)mMap;
+  if ((COLOG_MAGIC != h->magic) || (COLOG_VERSION != h->version))
+  {
+    mError = "not a column log";
+    return false;
+  }
+
+  /* footer, if the writer closed the file */
+  if (mSize >= sizeof(CologHeader) + sizeof(CologFooter))
+  {
+    memcpy(&f, mMap + mSize - sizeof(f), sizeof(f));
+  }
+  else
+  {
+    memset(&f, 0, sizeof(f));
+  }
+  if ((COLOG_FOOTER_MAGIC == f.magic) &&
+      (f.indexCount <= mSize / sizeof(CologIndexEntry)) &&
+      (f.indexOffset + f.indexCount * sizeof(CologIndexEntry) + sizeof(f) == mSize))
+  {
+    mIndex.resize(f.indexCount);
+    memcpy(mIndex.data(), mMap + f.indexOffset, f.indexCount * sizeof(CologIndexEntry));
+    mRecords = f.records;
+    indexed  = checkIndex(f.indexOffset);
+  }
+  if (!indexed)
+  {
+    /* no footer, or an index that does not match the chunks */
+    mIndex.clear();
+    mRecords = 0;
+    if (!rebuild(mSize))
+    {
+      return false;
+    }
+  }
+
+  for (size_t c=0; c<mIndex.size(); ++c)
+  {
+    mById[mIndex[c].id].push_back((uint32_t)c);
+    mSessions = std::max(mSessions, mIndex[c].session + 1u);
+  }
+  return true;
+}
+
+/* Index from the footer against the chunks it points to, all ahead of
+ * 'dataEnd'. A file patched or damaged after it was closed fails this.
+ */
+bool ColumnLogReader::checkIndex(uint64_t dataEnd) const
+{
+  uint64_t records = 0;
+
+  for (const CologIndexEntry &e : mIndex)
+  {
+    CologChunkHeader h;
+
+    if ((e.offset < sizeof(CologHeader)) || (e.offset & 7) ||
+        (e.offset > dataEnd) || (chunk_bytes(e.count) > dataEnd - e.offset))
+    {
+      return false;
+    }
+    memcpy(&h, mMap + e.offset, sizeof(h));
+    if ((COLOG_CHUNK_MAGIC != h.magic) || (h.bytes != chunk_bytes(e.count)) ||
+        (h.count != e.count) || (h.id != e.id) || (h.session != e.session) ||
+        (h.tickFirst != e.tickFirst) || (h.tickLast != e.tickLast))
+    {
+      return false;
+    }
+    records += e.count;
+  }
+  return records == mRecords;
+}
+
+/* No footer: walk the chunks up to the first one that is not whole */
+bool ColumnLogReader::rebuild(size_t dataEnd)
+{
+  size_t off = sizeof(CologHeader);
+
+  mRecovered = true;
+  while (off + sizeof(CologChunkHeader) <= dataEnd)
+  {
+    CologChunkHeader h;
+    CologIndexEntry  e;
+
+    memcpy(&h, mMap + off, sizeof(h));
+    if ((COLOG_CHUNK_MAGIC != h.magic) || (h.bytes != chunk_bytes(h.count)) ||
+        (off + h.bytes > dataEnd))
+    {
+      break;
+    }
+    memset(&e, 0, sizeof(e));
+    e.offset    = off;
+    e.tickFirst = h.tickFirst;
+    e.tickLast  = h.tickLast;
+    e.count     = h.count;
+    e.id        = h.id;
+    e.session   = h.session;
+    mIndex.push_back(e);
+    mRecords += h.count;
+    off      += h.bytes;
+  }
+  return true;
+}
+
+ColumnLogReader::Chunk ColumnLogReader::chunk(size_t c) const
+{
+  const uint8_t *p = mMap + mIndex[c].offset;
+  uint32_t       n = mIndex[c].count;
+  Chunk          k;
+
+  k.hdr        = (const CologChunkHeader *)p;
+  p           += sizeof(CologChunkHeader);
+  k.tick       = (const uint32_t *)p;
+  k.apMs       = (const uint32_t *)(p + 4 * n);
+  k.temp       = (const int16_t *)(p + 8 * n);
+  k.volt       = (const uint16_t *)(p + 10 * n);
+  k.pres       = (const int16_t *)(p + 12 * n);
+  k.seqno      = (const uint16_t *)(p + 14 * n);
+  k.node       = p + 16 * n;
+  k.rssi       = p + 17 * n;
+  k.missedAcks = p + 18 * n;
+  k.kind       = p + 19 * n;
+  return k;
+}
+
+Record ColumnLogReader::record(size_t c, size_t row) const
+{
+  Chunk  k = chunk(c);
+  Record r;
+
+  r.tick       = k.tick[row];
+  r.apMs       = k.apMs[row];
+  r.node       = k.node[row];
+  r.id         = mIndex[c].id;
+  r.rssi       = k.rssi[row];
+  r.temp       = k.temp[row];
+  r.volt       = k.volt[row];
+  r.pres       = k.pres[row];
+  r.seqno      = k.seqno[row];
+  r.missedAcks = k.missedAcks[row];
+  r.netTime    = 0;
+  r.kind       = k.kind[row];
+  return r;
+}
+
+bool ColumnLogReader::seek(uint8_t id, uint16_t session, uint32_t tick, size_t *c,
+                           size_t *row) const
+{
+  const std::vector<uint32_t> &list = mById[id];
+  std::vector<uint32_t>::const_iterator it;
+
+  it = std::partition_point(list.begin(), list.end(), [&](uint32_t i) {
+    return (mIndex[i].session < session) ||
+           ((mIndex[i].session == session) && (mIndex[i].tickLast < tick));
+  });
+  if (it == list.end())
+  {
+    return false;
+  }
+
+  Chunk k = chunk(*it);
+
+  *c   = *it;
+  *row = mIndex[*it].session > session ? 0 :
+         (size_t)(std::lower_bound(k.tick, k.tick + mIndex[*it].count, tick) - k.tick);
+  return true;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+bool colog_parse_pos(const char *s, uint16_t *session, uint32_t *tick)
+{
+  unsigned long a, b;
+  char         *end;
+
+  a = strtoul(s, &end, 0);
+  if (end == s)
+  {
+    return false;
+  }
+  if (':' != *end)
+  {
+    *session = 0;
+    *tick    = (uint32_t)a;
+    return !*end && (a <= UINT32_MAX);
+  }
+  s = end + 1;
+  b = strtoul(s, &end, 0);
+  if ((end == s) || *end || (a > COLOG_MAX_SESSION) || (b > UINT32_MAX))
+  {
+    return false;
+  }
+  *session = (uint16_t)a;
+  *tick    = (uint32_t)b;
+  return true;
+}
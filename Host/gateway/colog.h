@@ -0,0 +1,249 @@
+/**************************************************************************************************
+  Filename:       colog.h
+
+  Description:    Columnar log of AP records, the binary counterpart of
+                  log_gui.txt. Written append-only by the gateway (or
+                  converted from text logs) and read through mmap.
+
+                    | header | chunk | chunk | ... | index | footer |
+
+                  A chunk holds up to 'chunkRecords' records of one node
+                  (address byte; 0 is the AP's own measurements) as
+                  columns:
+
+                    tick u32 | AP msec u32 | temp i16 | volt u16 | pres i16 |
+                    seqno u16 | node u8 | rssi u8 | missedAcks u8 | kind u8
+
+                  so a reader that wants one value over time touches only
+                  that column. Values are raw, as in record.h.
+
+                  Ticks restart at 0 with each gateway run, and a
+                  log_gui.txt may span several runs. So records are kept
+                  in sessions: when a node's tick goes back the writer
+                  ends every node's chunk and starts the next session.
+                  Within one session and node the ticks never decrease, so
+                  a point in the log is a session and a tick ("2:500").
+
+                  The index has one entry per chunk (node, session, first
+                  and last tick, offset): a sparse time index small enough
+                  to search in memory. The footer points to it. A file without a
+                  footer (the writer did not close it), or whose index
+                  does not match the chunk headers, is still readable:
+                  every chunk starts with a header that gives its size, and
+                  the reader rebuilds the index from them.
+
+                  All fields are little-endian, chunks 8 byte aligned.
+**************************************************************************************************/
+
+#ifndef GATEWAY_COLOG_H
+#define GATEWAY_COLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "consumers.h"
+#include "record.h"
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define COLOG_MAGIC         0x4C435041u     /* "APCL" */
+#define COLOG_CHUNK_MAGIC   0x4B4E4843u     /* "CHNK" */
+#define COLOG_FOOTER_MAGIC  0x46435041u     /* "APCF" */
+#define COLOG_VERSION       1
+
+/* bytes per record over all columns */
+#define COLOG_ROW_BYTES     20
+
+/* sessions are numbered from 0 up to this */
+#define COLOG_MAX_SESSION   0xFFFF
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+struct CologHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t chunkRecords;
+  uint32_t reserved;
+};
+
+struct CologChunkHeader
+{
+  uint32_t magic;
+  uint32_t bytes;                   /* whole chunk, header and padding included */
+  uint32_t count;
+  uint32_t tickFirst;
+  uint32_t tickLast;
+  uint8_t  id;
+  uint8_t  reserved;
+  uint16_t session;
+  uint64_t seq;                     /* chunks written before this one */
+};
+
+struct CologIndexEntry
+{
+  uint64_t offset;
+  uint32_t tickFirst;
+  uint32_t tickLast;
+  uint32_t count;
+  uint8_t  id;
+  uint8_t  reserved;
+  uint16_t session;
+};
+
+struct CologFooter
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t indexOffset;
+  uint64_t indexCount;
+  uint64_t records;
+};
+
+/* Append-only writer. Records collect per node and go out a chunk at a
+ * time. Partial chunks are written every 'flushSecs' (so a crash loses
+ * at most that much) and the file is fdatasync()ed then, not per write.
+ * A record whose tick is below its node's last one starts a session; the
+ * last session (COLOG_MAX_SESSION) takes everything after it.
+ */
+class ColumnLogWriter
+{
+public:
+  ColumnLogWriter() {}
+  ~ColumnLogWriter();
+
+  bool open(const char *path, uint32_t chunkRecords = 4096, unsigned flushSecs = 60);
+  void append(const Record &r);
+  /* Write partial chunks and sync if 'flushSecs' have passed, or now */
+  void flush(bool now = false);
+  /* Write everything, the index and the footer */
+  bool close();
+
+  uint64_t records() const { return mRecords; }
+  uint64_t bytes() const { return mOffset; }
+  uint32_t sessions() const { return mSession + 1u; }
+
+private:
+  struct Pending
+  {
+    std::vector<Record> rows;
+    uint32_t            lastTick = 0;
+    uint16_t            session = 0;        /* of lastTick */
+    bool                seen = false;
+  };
+
+  void writeChunk(uint8_t id);
+  bool put(const void *p, size_t n);
+
+  int                          mFd = -1;
+  uint32_t                     mChunkRecords = 4096;
+  unsigned                     mFlushSecs = 60;
+  double                       mLastFlush = 0;
+  uint64_t                     mOffset = 0;
+  uint64_t                     mRecords = 0;
+  uint16_t                     mSession = 0;
+  std::vector<Pending>         mPending = std::vector<Pending>(256);
+  std::vector<CologIndexEntry> mIndex;
+  std::vector<uint8_t>         mBuf;
+  bool                         mFailed = false;
+};
+
+/* Gateway consumer around the writer */
+class ColumnLogConsumer : public Consumer
+{
+public:
+  explicit ColumnLogConsumer(ColumnLogWriter *w) : mWriter(w) {}
+
+  void consume(const Record *r, size_t n) override
+  {
+    for (; n; --n, ++r)
+    {
+      mWriter->append(*r);
+    }
+  }
+
+  void idle(bool final) override
+  {
+    if (final)
+    {
+      mWriter->close();
+    }
+    else
+    {
+      mWriter->flush();
+    }
+  }
+
+private:
+  ColumnLogWriter *mWriter;
+};
+
+/* Read side: the file mapped, one view per chunk */
+class ColumnLogReader
+{
+public:
+  struct Chunk
+  {
+    const CologChunkHeader *hdr;
+    const uint32_t         *tick;
+    const uint32_t         *apMs;
+    const int16_t          *temp;
+    const uint16_t         *volt;
+    const int16_t          *pres;
+    const uint16_t         *seqno;
+    const uint8_t          *node;
+    const uint8_t          *rssi;
+    const uint8_t          *missedAcks;
+    const uint8_t          *kind;
+  };
+
+  ColumnLogReader() {}
+  ~ColumnLogReader();
+
+  /* Map 'path'. Returns false (and why in error()) if it is not a log. */
+  bool open(const char *path);
+
+  const std::string &error() const { return mError; }
+  bool recovered() const { return mRecovered; }      /* no usable footer, index rebuilt */
+  size_t chunks() const { return mIndex.size(); }
+  const CologIndexEntry &entry(size_t c) const { return mIndex[c]; }
+  Chunk chunk(size_t c) const;
+  Record record(size_t c, size_t row) const;
+  uint64_t records() const { return mRecords; }
+  uint32_t sessions() const { return mSessions; }
+
+  /* Chunks of node 'id', in time order: by session, then tick */
+  const std::vector<uint32_t> &chunksOf(uint8_t id) const { return mById[id]; }
+
+  /* First record of node 'id' at or after 'tick' of 'session' (which may
+   * be in a later session): binary search of the node's chunks, then of
+   * the tick column. Returns false if there is none.
+   */
+  bool seek(uint8_t id, uint16_t session, uint32_t tick, size_t *c, size_t *row) const;
+
+private:
+  bool checkIndex(uint64_t dataEnd) const;
+  bool rebuild(size_t dataEnd);
+
+  const uint8_t                 *mMap = NULL;
+  size_t                         mSize = 0;
+  std::vector<CologIndexEntry>   mIndex;
+  std::vector<uint32_t>          mById[256];
+  uint64_t                       mRecords = 0;
+  uint32_t                       mSessions = 0;
+  bool                           mRecovered = false;
+  std::string                    mError;
+};
+
+/* Parse a point in a log, "session:tick" or just "tick" (session 0).
+ * Returns false if 's' is neither.
+ */
+bool colog_parse_pos(const char *s, uint16_t *session, uint32_t *tick);
+
+#endif
@@ -0,0 +1,338 @@
+/**************************************************************************************************
+  Filename:       colog_bench.cpp
+
+  Description:    Benchmark of the column log (colog.h) against the text log
+                  that gui_unified.tcl writes (one line per sample, flushed
+                  each time, as plot_point does).
+
+                  The records are a GUI log given on the command line or,
+                  without one, -n nodes sending one sample per tick for -t
+                  ticks. The benchmark reports:
+                    - write throughput and file size of both formats, each
+                      synced once at the end,
+                    - random seek latency: -q lookups of the first sample
+                      of a random node at or after a random tick. In the
+                      column log that is ColumnLogReader::seek(); the text
+                      log has no index, so a lookup reads from the start as
+                      gui_unified_replay.tcl would (only -Q of them are
+                      timed),
+                    - a full pass over one value of one node (mean
+                      temperature) in both formats.
+                  Every column log lookup is checked against the records it
+                  was written from.
+
+  Build:          g++ -O2 -march=native -std=c++17 -o colog_bench colog_bench.cpp colog.cpp record.cpp
+                      ../com_frame.c
+  Run:            ./colog_bench [-n nodes] [-t ticks] [-q lookups] [-Q textlookups] [-d dir] [log.txt]
+**************************************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "colog.h"
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+static uint32_t sRand = 1;
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static uint32_t rnd(void)
+{
+  sRand ^= sRand << 13;
+  sRand ^= sRand >> 17;
+  sRand ^= sRand << 5;
+  return sRand;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double file_mb(const std::string &path)
+{
+  struct stat st;
+
+  return stat(path.c_str(), &st) ? 0 : st.st_size / 1e6;
+}
+
+static void synthetic(std::vector<Record> *out, unsigned nodes, unsigned ticks)
+{
+  unsigned t, i;
+
+  for (t=1; t<=ticks; ++t)
+  {
+    for (i=0; i<nodes; ++i)
+    {
+      Record r;
+
+      memset(&r, 0, sizeof(r));
+      r.kind       = Record::SAMPLE;
+      r.tick       = t;
+      r.apMs       = t * 1000 + i;
+      r.node       = (uint8_t)(i + 1);
+      r.id         = (uint8_t)(i + 1);
+      r.rssi       = (uint8_t)(20 + rnd() % 30);
+      r.temp       = (int16_t)(200 + rnd() % 100);
+      r.volt       = (uint16_t)(600 + rnd() % 40);
+      r.pres       = (int16_t)(100 + rnd() % 300);
+      r.seqno      = (uint16_t)(t ? t : 1);
+      r.missedAcks = (uint8_t)(rnd() % 4 ? 0 : 1);
+      out->push_back(r);
+    }
+  }
+}
+
+/* First record of 'id' at or after 'tick' reading the text log from the
+ * start. Returns the tick found, 0 if none.
+ */
+static uint32_t text_seek(const std::string &path, uint8_t id, uint32_t tick)
+{
+  FILE    *fp = fopen(path.c_str(), "r");
+  char     line[256];
+  Record   r;
+  uint32_t found = 0;
+
+  while (fp && fgets(line, sizeof(line), fp))
+  {
+    if (record_parse_line(line, &r) && (r.id == id) && (r.tick >= tick))
+    {
+      found = r.tick;
+      break;
+    }
+  }
+  if (fp)
+  {
+    fclose(fp);
+  }
+  return found;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  unsigned            nodes = 100, ticks = 36000, lookups = 100000, textLookups = 20;
+  std::string         dir = "/tmp";
+  std::vector<Record> recs;
+  std::vector<Record> byId[256];
+  std::vector<uint8_t> ids;
+  double              t0, tText, tCol, tSeek, tTextSeek, tScanCol, tScanText;
+  long                bad = 0, sumCol = 0, sumText = 0, nCol = 0, nText = 0;
+  int                 opt;
+  unsigned            q;
+
+  while ((opt = getopt(argc, argv, "n:t:q:Q:d:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': nodes       = (unsigned)atoi(optarg);    break;
+      case 't': ticks       = (unsigned)atoi(optarg);    break;
+      case 'q': lookups     = (unsigned)atoi(optarg);    break;
+      case 'Q': textLookups = (unsigned)atoi(optarg);    break;
+      case 'd': dir         = optarg;                    break;
+      default:
+        fprintf(stderr, "usage: %s [-n nodes] [-t ticks] [-q lookups] [-Q textlookups] "
+                "[-d dir] [log.txt]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind < argc)
+  {
+    FILE  *fp = fopen(argv[optind], "r");
+    char   line[256];
+    Record r;
+
+    if (!fp)
+    {
+      fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+      return 1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+      if (record_parse_line(line, &r))
+      {
+        recs.push_back(r);
+      }
+    }
+    fclose(fp);
+  }
+  else
+  {
+    synthetic(&recs, nodes < 255 ? nodes : 255, ticks);
+  }
+  if (recs.empty() || !lookups)
+  {
+    return 1;
+  }
+  for (const Record &r : recs)
+  {
+    if (byId[r.id].empty())
+    {
+      ids.push_back(r.id);
+    }
+    byId[r.id].push_back(r);
+  }
+
+  std::string textPath = dir + "/colog_bench.txt", colPath = dir + "/colog_bench.apcl";
+
+  /* writes */
+  {
+    FILE *fp = fopen(textPath.c_str(), "w");
+
+    if (!fp)
+    {
+      fprintf(stderr, "%s: %s\n", textPath.c_str(), strerror(errno));
+      return 1;
+    }
+    t0 = now();
+    for (const Record &r : recs)
+    {
+      fputs(record_line(r).c_str(), fp);
+      fflush(fp);
+    }
+    fsync(fileno(fp));
+    fclose(fp);
+    tText = now() - t0;
+  }
+  {
+    ColumnLogWriter w;
+
+    t0 = now();
+    if (!w.open(colPath.c_str()))
+    {
+      fprintf(stderr, "%s: %s\n", colPath.c_str(), strerror(errno));
+      return 1;
+    }
+    for (const Record &r : recs)
+    {
+      w.append(r);
+    }
+    if (!w.close())
+    {
+      fprintf(stderr, "%s: write failed\n", colPath.c_str());
+      return 1;
+    }
+    tCol = now() - t0;
+  }
+
+  ColumnLogReader log;
+
+  if (!log.open(colPath.c_str()) || (log.records() != recs.size()))
+  {
+    fprintf(stderr, "%s: %s\n", colPath.c_str(), log.error().c_str());
+    return 1;
+  }
+
+  /* random seeks, checked against the records */
+  uint32_t tickMax = recs.back().tick + 1;
+
+  t0 = now();
+  for (q=0; q<lookups; ++q)
+  {
+    uint8_t  id   = ids[rnd() % ids.size()];
+    uint32_t tick = rnd() % tickMax;
+    size_t   c, row;
+    const std::vector<Record> &v = byId[id];
+    auto     it = std::lower_bound(v.begin(), v.end(), tick,
+                                   [](const Record &r, uint32_t t) { return r.tick < t; });
+
+    if (!log.seek(id, 0, tick, &c, &row))
+    {
+      bad += it != v.end();
+    }
+    else
+    {
+      Record r = log.record(c, row);
+
+      bad += (it == v.end()) || (r.tick != it->tick) || (r.apMs != it->apMs) ||
+             (r.temp != it->temp) || (r.seqno != it->seqno);
+    }
+  }
+  tSeek = now() - t0;
+
+  t0 = now();
+  for (q=0; q<textLookups; ++q)
+  {
+    uint8_t  id   = ids[rnd() % ids.size()];
+    uint32_t tick = rnd() % tickMax;
+    const std::vector<Record> &v = byId[id];
+    auto     it = std::lower_bound(v.begin(), v.end(), tick,
+                                   [](const Record &r, uint32_t t) { return r.tick < t; });
+
+    bad += text_seek(textPath, id, tick) != (it == v.end() ? 0 : it->tick);
+  }
+  tTextSeek = now() - t0;
+
+  /* one value of one node over the whole log */
+  {
+    uint8_t id = ids[0];
+    FILE   *fp;
+    char    line[256];
+    Record  r;
+
+    t0 = now();
+    for (uint32_t c : log.chunksOf(id))
+    {
+      ColumnLogReader::Chunk k = log.chunk(c);
+      uint32_t               i;
+
+      for (i=0; i<log.entry(c).count; ++i)
+      {
+        sumCol += k.temp[i];
+      }
+      nCol += log.entry(c).count;
+    }
+    tScanCol = now() - t0;
+
+    t0 = now();
+    fp = fopen(textPath.c_str(), "r");
+    while (fp && fgets(line, sizeof(line), fp))
+    {
+      if (record_parse_line(line, &r) && (r.id == id))
+      {
+        sumText += r.temp;
+        nText++;
+      }
+    }
+    if (fp)
+    {
+      fclose(fp);
+    }
+    tScanText = now() - t0;
+  }
+
+  printf("%zu records, %zu nodes, %zu chunks, lookups %s (%ld bad)\n", recs.size(), ids.size(),
+         log.chunks(), bad ? "FAIL" : "ok", bad);
+  printf("                      text log    column log\n");
+  printf("  size MB             %9.2f     %9.2f\n", file_mb(textPath), file_mb(colPath));
+  printf("  write krec/s        %9.0f     %9.0f\n", recs.size() / tText / 1e3,
+         recs.size() / tCol / 1e3);
+  printf("  seek usec           %9.0f     %9.3f\n",
+         textLookups ? tTextSeek / textLookups * 1e6 : 0.0, tSeek / lookups * 1e6);
+  printf("  node %3u mean degC  %9.2f     %9.2f\n", ids[0],
+         nText ? sumText / 10.0 / nText : 0.0, nCol ? sumCol / 10.0 / nCol : 0.0);
+  printf("  ... pass msec       %9.2f     %9.3f\n", tScanText * 1e3, tScanCol * 1e3);
+
+  unlink(textPath.c_str());
+  unlink(colPath.c_str());
+  return bad ? 1 : 0;
+}
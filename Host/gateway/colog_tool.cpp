@@ -0,0 +1,272 @@
+/**************************************************************************************************
+  Filename:       colog_tool.cpp
+
+  Description:    Converter and inspector for column logs (colog.h).
+
+                    convert in out    text log (log_gui.txt, or the older
+                                      log_demo.txt) to a column log; with -c
+                                      the input is a serial capture (from
+                                      the AP or ap_emu -o) instead, AP ticks
+                                      included
+                    info file         chunks, records and range per node,
+                                      as session:tick (colog.h)
+                    dump file         records as gui_unified.tcl logs them,
+                                      one node (-i) from a point (-f
+                                      [session:]tick) on, or every chunk in
+                                      file order
+
+                  -r sets the records per chunk when converting.
+
+  Build:          g++ -O2 -march=native -std=c++17 -o colog_tool colog_tool.cpp colog.cpp
+                      frame_scan.cpp record.cpp ../com_frame.c
+  Run:            ./colog_tool convert [-c] [-r records] in out
+                  ./colog_tool info file
+                  ./colog_tool dump [-i id] [-f [session:]tick] file
+**************************************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "colog.h"
+#include "frame_scan.h"
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define READ_SIZE   65536
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+struct Capture
+{
+  ColumnLogWriter *out;
+  uint32_t         tick;
+};
+
+static void on_frame(const comFrame_t *f, void *arg)
+{
+  Capture *c = (Capture *)arg;
+  Record   r[COM_FRAME_MAX_BODY / 14 + 1];
+  size_t   i, n;
+
+  n = records_from_frame(f, &c->tick, r, sizeof(r) / sizeof(r[0]));
+  for (i=0; i<n; ++i)
+  {
+    c->out->append(r[i]);
+  }
+}
+
+static int convert(const char *in, const char *out, bool capture, uint32_t chunkRecords)
+{
+  ColumnLogWriter w;
+  unsigned long   skipped = 0;
+
+  if (!w.open(out, chunkRecords, 0))
+  {
+    fprintf(stderr, "%s: %s\n", out, strerror(errno));
+    return 1;
+  }
+  if (capture)
+  {
+    FrameScanner scan;
+    Capture      c = { &w, 0 };
+    uint8_t     *buf = new uint8_t[READ_SIZE];
+    ssize_t      n;
+    int          fd = open(in, O_RDONLY);
+
+    if (fd < 0)
+    {
+      fprintf(stderr, "%s: %s\n", in, strerror(errno));
+      return 1;
+    }
+    while ((n = read(fd, buf, READ_SIZE)) > 0)
+    {
+      scan.feed(buf, (size_t)n, on_frame, &c);
+    }
+    close(fd);
+    delete[] buf;
+    skipped = scan.stats.frame.cobsErrors + scan.stats.frame.lengthErrors +
+              scan.stats.frame.crcErrors + scan.stats.frame.versionErrors;
+  }
+  else
+  {
+    FILE  *fp = fopen(in, "r");
+    char   line[256];
+    Record r;
+
+    if (!fp)
+    {
+      fprintf(stderr, "%s: %s\n", in, strerror(errno));
+      return 1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+      if (record_parse_line(line, &r))
+      {
+        w.append(r);
+      }
+      else
+      {
+        skipped++;
+      }
+    }
+    fclose(fp);
+  }
+
+  uint64_t records = w.records();
+  uint32_t sessions = w.sessions();
+
+  if (!w.close())
+  {
+    fprintf(stderr, "%s: write failed\n", out);
+    return 1;
+  }
+  printf("%llu records in %u sessions, %llu bytes, %lu %s skipped\n",
+         (unsigned long long)records, sessions, (unsigned long long)w.bytes(), skipped,
+         capture ? "bad frames" : "lines");
+  return 0;
+}
+
+static int info(const ColumnLogReader &log)
+{
+  int id;
+
+  printf("%zu chunks, %llu records, %u sessions%s\n", log.chunks(),
+         (unsigned long long)log.records(), log.sessions(),
+         log.recovered() ? ", no usable footer: index rebuilt" : "");
+  printf(" id  chunks   records          first           last\n");
+  for (id=0; id<256; ++id)
+  {
+    const std::vector<uint32_t> &list = log.chunksOf((uint8_t)id);
+    uint64_t n = 0;
+
+    if (list.empty())
+    {
+      continue;
+    }
+    for (uint32_t c : list)
+    {
+      n += log.entry(c).count;
+    }
+    const CologIndexEntry &first = log.entry(list.front()), &last = log.entry(list.back());
+    char                   a[24], b[24];
+
+    snprintf(a, sizeof(a), "%u:%u", first.session, first.tickFirst);
+    snprintf(b, sizeof(b), "%u:%u", last.session, last.tickLast);
+    printf("%3d  %6zu  %8llu  %13s  %13s\n", id, list.size(), (unsigned long long)n, a, b);
+  }
+  return 0;
+}
+
+static void dump_chunk(const ColumnLogReader &log, size_t c, size_t row)
+{
+  for (; row<log.entry(c).count; ++row)
+  {
+    Record r = log.record(c, row);
+
+    if (Record::AP_TICK == r.kind)
+    {
+      printf("# tick %u ap %u\n", r.tick, r.apMs);
+    }
+    else
+    {
+      fputs(record_line(r).c_str(), stdout);
+    }
+  }
+}
+
+static int dump(const ColumnLogReader &log, int id, uint16_t session, uint32_t from)
+{
+  size_t c, row;
+
+  if (id < 0)
+  {
+    for (c=0; c<log.chunks(); ++c)
+    {
+      dump_chunk(log, c, 0);
+    }
+    return 0;
+  }
+  if (!log.seek((uint8_t)id, session, from, &c, &row))
+  {
+    return 0;
+  }
+
+  const std::vector<uint32_t> &list = log.chunksOf((uint8_t)id);
+
+  for (auto it = std::find(list.begin(), list.end(), (uint32_t)c); it != list.end(); ++it)
+  {
+    dump_chunk(log, *it, row);
+    row = 0;
+  }
+  return 0;
+}
+
+static int usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s convert [-c] [-r records] in out\n"
+                  "       %s info file\n"
+                  "       %s dump [-i id] [-f [session:]tick] file\n", prog, prog, prog);
+  return 1;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  const char     *prog = argv[0], *cmd;
+  bool            capture = false;
+  uint32_t        chunkRecords = 4096, from = 0;
+  uint16_t        session = 0;
+  int             opt, id = -1;
+  ColumnLogReader log;
+
+  if (argc < 2)
+  {
+    return usage(prog);
+  }
+  cmd = argv[1];
+  argc--;
+  argv++;
+  while ((opt = getopt(argc, argv, "cr:i:f:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'c': capture      = true;                           break;
+      case 'r': chunkRecords = (uint32_t)atol(optarg);         break;
+      case 'i': id           = atoi(optarg) & 0xFF;            break;
+      case 'f':
+        if (!colog_parse_pos(optarg, &session, &from))
+        {
+          return usage(prog);
+        }
+        break;
+      default:  return usage(prog);
+    }
+  }
+
+  if (!strcmp(cmd, "convert") && (argc - optind == 2))
+  {
+    return convert(argv[optind], argv[optind + 1], capture, chunkRecords);
+  }
+  if ((strcmp(cmd, "info") && strcmp(cmd, "dump")) || (argc - optind != 1))
+  {
+    return usage(prog);
+  }
+  if (!log.open(argv[optind]))
+  {
+    fprintf(stderr, "%s: %s\n", argv[optind], log.error().c_str());
+    return 1;
+  }
+  return !strcmp(cmd, "info") ? info(log) : dump(log, id, session, from);
+}
@@ -0,0 +1,412 @@
+/**************************************************************************************************
+  Filename:       consumers.cpp
+
+  Description:    Fan-out, log writer, alarm engine and socket server of the
+                  gateway. See consumers.h.
+**************************************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "consumers.h"
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define LOG_BLOCK       65536       /* bytes of log lines written at a time */
+#define CLIENT_BACKLOG  262144      /* bytes queued for a client before lines are dropped */
+
+/******************************************************************************
+ * Fanout
+ */
+
+void Fanout::pump()
+{
+  for (Tap &t : mTaps)
+  {
+    const Record *r;
+    size_t        n;
+
+    while ((n = mRing.read(&t.cursor, &r)))
+    {
+      t.consumer->consume(r, n);
+    }
+  }
+}
+
+void Fanout::idle(bool final)
+{
+  pump();
+  for (Tap &t : mTaps)
+  {
+    t.consumer->idle(final);
+  }
+}
+
+unsigned long Fanout::overruns() const
+{
+  unsigned long n = 0;
+
+  for (const Tap &t : mTaps)
+  {
+    n += t.cursor.overruns;
+  }
+  return n;
+}
+
+/******************************************************************************
+ * LogWriter
+ */
+
+void LogWriter::consume(const Record *r, size_t n)
+{
+  for (; n; --n, ++r)
+  {
+    if ((Record::SAMPLE == r->kind) && !(r->tick % mLogmod))
+    {
+      mBuf += record_line(*r);
+      lines++;
+    }
+  }
+  if (mBuf.size() >= LOG_BLOCK)
+  {
+    write();
+  }
+}
+
+void LogWriter::idle(bool final)
+{
+  write();
+  if (final)
+  {
+    fflush(mFp);
+  }
+}
+
+void LogWriter::write()
+{
+  if (!mBuf.empty())
+  {
+    fwrite(mBuf.data(), 1, mBuf.size(), mFp);
+    fflush(mFp);
+    mBuf.clear();
+  }
+}
+
+/******************************************************************************
+ * AlarmEngine
+ */
+
+static const char *const sParamName[AlarmEngine::NUM_PARAMS] =
+{
+  "temperature", "voltage", "pressure", "rssi"
+};
+
+AlarmEngine::AlarmEngine(std::function<void(const std::string &)> notify, unsigned timeout)
+  : mNotify(notify), mTimeout(timeout)
+{
+  /* ylolim and yhilim from gui_unified.tcl */
+  mLimit[TEMPERATURE] = {32, 100};
+  mLimit[VOLTAGE]     = {2.5, 4.0};
+  mLimit[PRESSURE]    = {50, 500};
+  mLimit[RSSI]        = {10, 50};
+}
+
+void AlarmEngine::consume(const Record *r, size_t n)
+{
+  char line[96];
+
+  for (; n; --n, ++r)
+  {
+    switch (r->kind)
+    {
+      case Record::SAMPLE:
+        check(*r);
+        break;
+
+      case Record::IMPACT:
+        snprintf(line, sizeof(line), "impact %u %u", r->tick, r->id);
+        mNotify(line);
+        raised++;
+        break;
+
+      case Record::AP_TICK:
+        timeouts(r->tick);
+        break;
+    }
+  }
+}
+
+void AlarmEngine::check(const Record &r)
+{
+  Node  &node = mNode[r.id];
+  double value[NUM_PARAMS];
+  char   line[128];
+  int    p;
+
+  value[TEMPERATURE] = record_temp_f(r);
+  value[VOLTAGE]     = record_volt(r);
+  value[PRESSURE]    = r.pres;
+  value[RSSI]        = r.rssi;
+
+  node.connected = true;
+  node.lastTick  = r.tick;
+  for (p=0; p<NUM_PARAMS; ++p)
+  {
+    int8_t state = value[p] > mLimit[p].hi ? 1 : value[p] < mLimit[p].lo ? -1 : 0;
+
+    if (state == node.state[p])
+    {
+      continue;
+    }
+    node.state[p] = state;
+    if (state)
+    {
+      snprintf(line, sizeof(line), "alarm %u %u %s %s %g %g", r.tick, r.id, sParamName[p],
+               state > 0 ? "over" : "under", value[p], state > 0 ? mLimit[p].hi : mLimit[p].lo);
+      raised++;
+    }
+    else
+    {
+      snprintf(line, sizeof(line), "alarm %u %u %s clear", r.tick, r.id, sParamName[p]);
+    }
+    mNotify(line);
+  }
+}
+
+void AlarmEngine::timeouts(uint32_t tick)
+{
+  char line[64];
+  int  id;
+
+  for (id=1; id<256; ++id)
+  {
+    Node &node = mNode[id];
+
+    /* a replay went back in time: count from here */
+    if (tick < node.lastTick)
+    {
+      node.lastTick = tick;
+    }
+    if (node.connected && (tick - node.lastTick > mTimeout))
+    {
+      node = Node();
+      snprintf(line, sizeof(line), "timeout %u %d", tick, id);
+      mNotify(line);
+    }
+  }
+}
+
+/******************************************************************************
+ * SocketServer
+ */
+
+SocketServer::SocketServer(int epfd, const std::string &path)
+  : mEpfd(epfd), mFd(-1), mPath(path)
+{
+  struct sockaddr_un sa;
+  struct epoll_event ev;
+  int                fd;
+
+  if (path.size() >= sizeof(sa.sun_path))
+  {
+    fprintf(stderr, "%s: socket path too long\n", path.c_str());
+    return;
+  }
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  memcpy(sa.sun_path, path.c_str(), path.size());
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  unlink(path.c_str());
+  if ((fd < 0) || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || listen(fd, 8))
+  {
+    fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return;
+  }
+  ev.events   = EPOLLIN;
+  ev.data.ptr = static_cast<Pollable *>(this);
+  epoll_ctl(mEpfd, EPOLL_CTL_ADD, fd, &ev);
+  mFd = fd;
+}
+
+SocketServer::~SocketServer()
+{
+  for (Client *c : mClients)
+  {
+    close(c->mFd);
+    delete c;
+  }
+  if (mFd >= 0)
+  {
+    close(mFd);
+    unlink(mPath.c_str());
+  }
+}
+
+void SocketServer::ready(uint32_t events)
+{
+  struct epoll_event ev;
+  int                fd;
+
+  (void)events;
+  while ((fd = accept4(mFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+  {
+    Client *c = new Client(this, fd);
+
+    ev.events   = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = static_cast<Pollable *>(c);
+    epoll_ctl(mEpfd, EPOLL_CTL_ADD, fd, &ev);
+    mClients.push_back(c);
+    fprintf(stderr, "client %d connected\n", fd);
+  }
+}
+
+void SocketServer::consume(const Record *r, size_t n)
+{
+  std::string out;
+  char        line[48];
+
+  if (mClients.empty())
+  {
+    return;
+  }
+  for (; n; --n, ++r)
+  {
+    if (Record::SAMPLE == r->kind)
+    {
+      out += "sample ";
+      out += record_line(*r);
+    }
+    else if (Record::AP_TICK == r->kind)
+    {
+      snprintf(line, sizeof(line), "tick %u %u\n", r->tick, r->apMs);
+      out += line;
+    }
+  }
+  for (Client *c : mClients)
+  {
+    c->send(out);
+  }
+}
+
+void SocketServer::broadcast(const std::string &line)
+{
+  for (Client *c : mClients)
+  {
+    c->send(line + "\n");
+  }
+}
+
+/* Close clients that hung up or failed. Not from inside an event: the
+ * epoll batch being handled may still name them.
+ */
+void SocketServer::reap()
+{
+  size_t i, j;
+
+  for (i=j=0; i<mClients.size(); ++i)
+  {
+    Client *c = mClients[i];
+
+    if (c->mGone)
+    {
+      fprintf(stderr, "client %d gone, %lu lines dropped\n", c->mFd, c->mDropped);
+      close(c->mFd);
+      delete c;
+      continue;
+    }
+    mClients[j++] = c;
+  }
+  mClients.resize(j);
+}
+
+void SocketServer::Client::ready(uint32_t events)
+{
+  char buf[256];
+
+  if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+  {
+    ssize_t n;
+    size_t  eol;
+
+    while ((n = ::read(mFd, buf, sizeof(buf))) > 0)
+    {
+      if (!mServer->onCommand)
+      {
+        continue;
+      }
+      mIn.append(buf, (size_t)n);
+      while ((eol = mIn.find('\n')) != std::string::npos)
+      {
+        mServer->onCommand(mIn.substr(0, eol));
+        mIn.erase(0, eol + 1);
+      }
+      if (mIn.size() > sizeof(buf))
+      {
+        mIn.clear();
+      }
+    }
+    if (!n || ((n < 0) && (errno != EAGAIN)) || (events & (EPOLLHUP | EPOLLERR)))
+    {
+      mGone = true;
+    }
+  }
+  if (!mGone && (events & EPOLLOUT))
+  {
+    flush();
+  }
+}
+
+void SocketServer::Client::send(const std::string &line)
+{
+  if (mGone || line.empty())
+  {
+    return;
+  }
+  if (mOut.size() + line.size() > CLIENT_BACKLOG)
+  {
+    mDropped++;
+    return;
+  }
+  mOut += line;
+  if (!mWaiting)
+  {
+    flush();
+  }
+}
+
+bool SocketServer::Client::flush()
+{
+  struct epoll_event ev;
+  ssize_t            n = 0;
+
+  while (!mOut.empty() && ((n = ::send(mFd, mOut.data(), mOut.size(), MSG_NOSIGNAL)) > 0))
+  {
+    mOut.erase(0, (size_t)n);
+  }
+  if ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+  {
+    mGone = true;
+    return false;
+  }
+
+  /* wait for room only while something is queued */
+  if (mOut.empty() == mWaiting)
+  {
+    mWaiting    = !mOut.empty();
+    ev.events   = EPOLLIN | EPOLLRDHUP | (mWaiting ? (uint32_t)EPOLLOUT : 0);
+    ev.data.ptr = static_cast<Pollable *>(this);
+    epoll_ctl(mServer->mEpfd, EPOLL_CTL_MOD, mFd, &ev);
+  }
+  return true;
+}
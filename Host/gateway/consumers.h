@@ -0,0 +1,204 @@
+/**************************************************************************************************
+  Filename:       consumers.h
+
+  Description:    The gateway's consumers of records and the fan-out that
+                  feeds them from the ring:
+
+                    LogWriter    - log_gui.txt lines, written in blocks
+                    AlarmEngine  - limit, impact and timeout alarms, raised
+                                   and cleared on change only
+                    SocketServer - a Unix socket a visualisation client
+                                   connects to for records and alarms
+
+                  Everything runs on one epoll thread (see gateway.cpp).
+**************************************************************************************************/
+
+#ifndef GATEWAY_CONSUMERS_H
+#define GATEWAY_CONSUMERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "record.h"
+#include "ring.h"
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+/* Something on the gateway's epoll set. The epoll data pointer is the
+ * object; ready() gets the events.
+ */
+class Pollable
+{
+public:
+  virtual ~Pollable() {}
+  virtual void ready(uint32_t events) = 0;
+};
+
+class Consumer
+{
+public:
+  virtual ~Consumer() {}
+  /* The next records, in order */
+  virtual void consume(const Record *r, size_t n) = 0;
+  /* About once a second, and with 'final' set before the gateway exits */
+  virtual void idle(bool final) { (void)final; }
+};
+
+/* The ring and a cursor per consumer */
+class Fanout
+{
+public:
+  explicit Fanout(unsigned order = 14) : mRing(order) {}
+
+  void add(Consumer *c)
+  {
+    mTaps.push_back({c, mRing.attach()});
+  }
+
+  void publish(const Record &r)
+  {
+    mRing.push(r);
+  }
+
+  /* Give every consumer what it has not had yet */
+  void pump();
+  void idle(bool final);
+
+  uint64_t      published() const { return mRing.written(); }
+  unsigned long overruns() const;
+
+private:
+  struct Tap
+  {
+    Consumer             *consumer;
+    Ring<Record>::Cursor  cursor;
+  };
+
+  Ring<Record>     mRing;
+  std::vector<Tap> mTaps;
+};
+
+/* Samples as gui_unified.tcl logs them, one line each on ticks that are a
+ * multiple of 'logmod'. Lines collect in memory and go out in blocks of
+ * about 64 KiB or once a second, not with a flush per sample.
+ */
+class LogWriter : public Consumer
+{
+public:
+  LogWriter(FILE *fp, unsigned logmod) : mFp(fp), mLogmod(logmod ? logmod : 1) {}
+
+  void consume(const Record *r, size_t n) override;
+  void idle(bool final) override;
+
+  unsigned long lines = 0;
+
+private:
+  void write();
+
+  FILE       *mFp;
+  unsigned    mLogmod;
+  std::string mBuf;
+};
+
+/* Alarms on the GUI's limits (see the defaults array in gui_unified.tcl).
+ * Each alarm is reported when it is raised and when it clears, one line:
+ *   alarm <tick> <id> <param> over|under <value> <limit>
+ *   alarm <tick> <id> <param> clear
+ *   impact <tick> <id>
+ *   timeout <tick> <id>
+ * A node that has sent nothing for 'timeout' ticks is reported and its
+ * alarms dropped, as check_timeout does.
+ */
+class AlarmEngine : public Consumer
+{
+public:
+  enum Param { TEMPERATURE, VOLTAGE, PRESSURE, RSSI, NUM_PARAMS };
+
+  struct Limit
+  {
+    double lo, hi;
+  };
+
+  AlarmEngine(std::function<void(const std::string &)> notify, unsigned timeout);
+
+  void setLimit(Param p, double lo, double hi)
+  {
+    mLimit[p] = {lo, hi};
+  }
+
+  void consume(const Record *r, size_t n) override;
+
+  unsigned long raised = 0;
+
+private:
+  struct Node
+  {
+    bool     connected = false;
+    uint32_t lastTick  = 0;
+    int8_t   state[NUM_PARAMS] = {0};   // -1 under, 1 over
+  };
+
+  void check(const Record &r);
+  void timeouts(uint32_t tick);
+
+  std::function<void(const std::string &)> mNotify;
+  unsigned mTimeout;
+  Limit    mLimit[NUM_PARAMS];
+  Node     mNode[256];
+};
+
+/* Unix stream socket for visualisation clients. Each client gets
+ *   sample <log line>
+ *   tick <tick> <AP msec>
+ * for every record, and the alarm lines. Lines clients send go to
+ * 'onCommand' if it is set (the replay controls), else are ignored. A
+ * client that does not keep up loses lines rather than holding up the
+ * gateway; its count of dropped lines is logged when it goes.
+ */
+class SocketServer : public Consumer, public Pollable
+{
+public:
+  SocketServer(int epfd, const std::string &path);
+  ~SocketServer();
+
+  bool ok() const { return mFd >= 0; }
+
+  void consume(const Record *r, size_t n) override;
+  void ready(uint32_t events) override;           // new connection
+
+  void broadcast(const std::string &line);
+  void reap();
+
+  std::function<void(const std::string &)> onCommand;
+
+private:
+  class Client : public Pollable
+  {
+  public:
+    Client(SocketServer *server, int fd) : mServer(server), mFd(fd) {}
+
+    void ready(uint32_t events) override;
+    void send(const std::string &line);
+    bool flush();                  // false when the client is gone
+
+    SocketServer  *mServer;
+    int            mFd;
+    std::string    mIn;
+    std::string    mOut;
+    bool           mWaiting = false;  // EPOLLOUT armed
+    bool           mGone    = false;
+    unsigned long  mDropped = 0;
+  };
+
+  int                   mEpfd;
+  int                   mFd;
+  std::string           mPath;
+  std::vector<Client *> mClients;
+};
+
+#endif
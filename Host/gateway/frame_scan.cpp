@@ -0,0 +1,274 @@
+/**************************************************************************************************
+  Filename:       frame_scan.cpp
+
+  Description:    Block scanner for AP serial streams. See frame_scan.h.
+**************************************************************************************************/
+
+#include <string.h>
+#include <time.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "frame_scan.h"
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+/* sCrcTable[k][x]: CRC-16 of byte x followed by k zero bytes, from 0. A
+ * 16 bit MSB first CRC folds into the next two message bytes, so eight
+ * bytes are eight independent lookups instead of a chain of eight.
+ */
+static uint16_t sCrcTable[8][256];
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static void crc_table_init(void)
+{
+  int i, k;
+
+  for (i=0; i<256; ++i)
+  {
+    uint8_t b = (uint8_t)i;
+
+    sCrcTable[0][i] = com_crc16(0, &b, 1);
+  }
+  for (k=1; k<8; ++k)
+  {
+    for (i=0; i<256; ++i)
+    {
+      uint16_t c = sCrcTable[k-1][i];
+
+      sCrcTable[k][i] = (uint16_t)((c << 8) ^ sCrcTable[0][c >> 8]);
+    }
+  }
+}
+
+/* First 0 byte in [p, end), or end */
+static const uint8_t *find_zero_memchr(const uint8_t *p, const uint8_t *end)
+{
+  const uint8_t *z = (const uint8_t *)memchr(p, 0, (size_t)(end - p));
+
+  return z ? z : end;
+}
+
+static const uint8_t *find_zero_simd(const uint8_t *p, const uint8_t *end)
+{
+#if defined(__AVX2__)
+  const __m256i zero = _mm256_setzero_si256();
+
+  for (; end - p >= 32; p += 32)
+  {
+    unsigned m = (unsigned)_mm256_movemask_epi8(
+                   _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), zero));
+
+    if (m)
+    {
+      return p + __builtin_ctz(m);
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i zero16 = _mm_setzero_si128();
+
+  for (; end - p >= 16; p += 16)
+  {
+    unsigned m = (unsigned)_mm_movemask_epi8(
+                   _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), zero16));
+
+    if (m)
+    {
+      return p + __builtin_ctz(m);
+    }
+  }
+#endif
+  for (; p < end; ++p)
+  {
+    if (!*p)
+    {
+      break;
+    }
+  }
+  return p;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+uint16_t frame_crc16(uint16_t crc, const uint8_t *p, size_t n)
+{
+  for (; n >= 8; n -= 8, p += 8)
+  {
+    crc = sCrcTable[7][p[0] ^ (crc >> 8)] ^ sCrcTable[6][p[1] ^ (crc & 0xFF)] ^
+          sCrcTable[5][p[2]] ^ sCrcTable[4][p[3]] ^ sCrcTable[3][p[4]] ^
+          sCrcTable[2][p[5]] ^ sCrcTable[1][p[6]] ^ sCrcTable[0][p[7]];
+  }
+  while (n--)
+  {
+    crc = (uint16_t)((crc << 8) ^ sCrcTable[0][(crc >> 8) ^ *p++]);
+  }
+  return crc;
+}
+
+FrameScanner::FrameScanner(Kernel k) : stats(), mKernel(k), mPartLen(0), mOverflow(false)
+{
+  if (!sCrcTable[0][1])
+  {
+    crc_table_init();
+  }
+}
+
+const char *FrameScanner::kernel() const
+{
+#if defined(__AVX2__)
+  return (BEST == mKernel) ? "avx2" : "memchr";
+#elif defined(__SSE2__)
+  return (BEST == mKernel) ? "sse2" : "memchr";
+#else
+  return (BEST == mKernel) ? "bytewise" : "memchr";
+#endif
+}
+
+size_t FrameScanner::feed(const uint8_t *data, size_t len, comFrameCB_t cb, void *arg)
+{
+  const uint8_t *p = data, *end = data + len, *z;
+  size_t         delivered = 0;
+  double         t0 = now();
+
+  while (p < end)
+  {
+    z = (BEST == mKernel) ? find_zero_simd(p, end) : find_zero_memchr(p, end);
+
+    /* no delimiter: keep the start of the frame for the next feed */
+    if (z == end)
+    {
+      if (mOverflow || (mPartLen + (size_t)(end - p) > sizeof(mPart)))
+      {
+        stats.frame.bytesSkipped += mPartLen + (size_t)(end - p);
+        mPartLen  = 0;
+        mOverflow = true;
+      }
+      else
+      {
+        memcpy(mPart + mPartLen, p, (size_t)(end - p));
+        mPartLen += (size_t)(end - p);
+      }
+      break;
+    }
+
+    if (mOverflow)
+    {
+      stats.frame.lengthErrors++;
+      stats.frame.bytesSkipped += (size_t)(z - p);
+      mOverflow = false;
+    }
+    else if (mPartLen)
+    {
+      if (mPartLen + (size_t)(z - p) > sizeof(mPart))
+      {
+        stats.frame.lengthErrors++;
+        stats.frame.bytesSkipped += mPartLen + (size_t)(z - p);
+      }
+      else
+      {
+        memcpy(mPart + mPartLen, p, (size_t)(z - p));
+        delivered += deliver(mPart, mPartLen + (size_t)(z - p), cb, arg);
+      }
+      mPartLen = 0;
+    }
+    else if (z > p)
+    {
+      delivered += deliver(p, (size_t)(z - p), cb, arg);
+    }
+    p = z + 1;
+  }
+
+  stats.bytes   += len;
+  stats.seconds += now() - t0;
+  return delivered;
+}
+
+/* One frame between delimiters: undo COBS, check, hand over. The checks and
+ * their order are com_frame_parse()'s, so the counts agree with it.
+ */
+bool FrameScanner::deliver(const uint8_t *wire, size_t n, comFrameCB_t cb, void *arg)
+{
+  comFrame_t f;
+  size_t     i = 0, m = 0;
+  uint16_t   crc;
+
+  if (n > sizeof(mPart))
+  {
+    stats.frame.lengthErrors++;
+    stats.frame.bytesSkipped += n;
+    return false;
+  }
+  while (i < n)
+  {
+    uint8_t code = wire[i++];
+
+    if (i + code - 1 > n)
+    {
+      stats.frame.cobsErrors++;
+      stats.frame.bytesSkipped += n;
+      return false;
+    }
+    /* blocks are short; a fixed 16 byte copy beats a sized one */
+    if ((code <= 17) && (i + 16 <= n))
+    {
+      memcpy(mDec + m, wire + i, 16);
+    }
+    else
+    {
+      memcpy(mDec + m, wire + i, code - 1u);
+    }
+    m += code - 1u;
+    i += code - 1u;
+    if ((code < 0xFF) && (i < n))
+    {
+      mDec[m++] = 0;
+    }
+  }
+
+  if ((m < COM_FRAME_OVERHEAD) || (mDec[2] != m - COM_FRAME_OVERHEAD))
+  {
+    stats.frame.lengthErrors++;
+    stats.frame.bytesSkipped += n;
+    return false;
+  }
+  crc = frame_crc16(0xFFFF, mDec, m - 2);
+  if ((mDec[m-2] != (uint8_t)crc) || (mDec[m-1] != (uint8_t)(crc >> 8)))
+  {
+    stats.frame.crcErrors++;
+    stats.frame.bytesSkipped += n;
+    return false;
+  }
+  if (mDec[0] != COM_FRAME_VERSION)
+  {
+    stats.frame.versionErrors++;
+    stats.frame.bytesSkipped += n;
+    return false;
+  }
+  f.version = mDec[0];
+  f.type    = mDec[1];
+  f.len     = mDec[2];
+  f.body    = mDec + 3;
+  stats.frame.frames++;
+  if (cb)
+  {
+    cb(&f, arg);
+  }
+  return true;
+}
@@ -0,0 +1,76 @@
+/**************************************************************************************************
+  Filename:       frame_scan.h
+
+  Description:    Block scanner for AP serial streams, for re-reading long
+                  captures and for the gateway. Same frames and checks as
+                  com_decoder_feed() in com_frame.c, but it works on whole
+                  read buffers instead of byte by byte:
+
+                    - frame delimiters (0 bytes) are found 32 or 16 bytes at
+                      a time with AVX2 or SSE2 compares, memchr() elsewhere;
+                    - a frame that lies wholly in the buffer is decoded from
+                      there, only frames split across reads are copied;
+                    - the CRC is table driven, eight bytes at a time.
+
+                  Alignment comes back at the first delimiter after damage:
+                  a changed or lost byte costs the frame it is in, a lost
+                  delimiter the two frames it separated, and nothing after.
+                  Counters give the errors and the throughput.
+**************************************************************************************************/
+
+#ifndef GATEWAY_FRAME_SCAN_H
+#define GATEWAY_FRAME_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../com_frame.h"
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+struct ScanStats
+{
+  comStats_t         frame;         /* frames and errors, as com_decoder_feed() counts them */
+  unsigned long long bytes;         /* bytes scanned */
+  double             seconds;       /* time spent in feed() */
+
+  double mbPerSec() const
+  {
+    return seconds > 0 ? bytes / seconds / 1e6 : 0;
+  }
+};
+
+class FrameScanner
+{
+public:
+  /* Search kernel: the best the CPU was built for, or memchr() */
+  enum Kernel { BEST, MEMCHR };
+
+  explicit FrameScanner(Kernel k = BEST);
+
+  /* Feed received bytes. 'cb' is called for each good frame, which is only
+   * valid during the call. Returns the number of frames delivered.
+   */
+  size_t feed(const uint8_t *data, size_t len, comFrameCB_t cb, void *arg);
+
+  /* Kernel in use, for reports */
+  const char *kernel() const;
+
+  ScanStats stats;
+
+private:
+  bool deliver(const uint8_t *wire, size_t n, comFrameCB_t cb, void *arg);
+
+  Kernel  mKernel;
+  uint8_t mPart[COM_FRAME_MAX_WIRE];    /* start of a frame split across feeds */
+  size_t  mPartLen;
+  bool    mOverflow;                    /* current frame is too long, skip it */
+  uint8_t mDec[COM_FRAME_MAX_WIRE + 16];
+};
+
+/* CRC-16/CCITT as com_crc16(), from a table */
+uint16_t frame_crc16(uint16_t crc, const uint8_t *p, size_t n);
+
+#endif
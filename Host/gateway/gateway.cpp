@@ -0,0 +1,431 @@
+/**************************************************************************************************
+  Filename:       gateway.cpp
+
+  Description:    Host gateway for the sensor demo Access Point. Replaces
+                  the serial reading of gui_unified.tcl for networks larger
+                  than the GUI can follow.
+
+                  One epoll thread reads the AP serial port non-blocking,
+                  decodes the frames (frame_scan.h) into records and puts
+                  them in a ring (ring.h). From there they go to:
+                    - a log writer, log_gui.txt format (-l, -m),
+                    - a column log writer (-c), colog.h, every record kept
+                      and synced every 60 seconds,
+                    - an alarm engine that reports alarms as they are raised
+                      and cleared, on stderr and to socket clients,
+                    - a Unix socket for a visualisation client (-s).
+                  See consumers.h for what each one writes.
+
+                  The port can be a tty, a pty or a capture file. The
+                  gateway stops at the end of the input (or when the pty
+                  closes), or on SIGINT/SIGTERM. For a test without boards,
+                  ap_emu plays a GUI log or a synthetic network to it on a
+                  pty:
+                    ./ap_emu -x 100 ../../GUIs/log_demo.txt &
+                    ./gateway -l log.txt -s gw.sock /tmp/ap_pty
+
+                  With -r the records come from a column log instead of a
+                  device (replay.h): from -f on ("session:tick", or a tick
+                  of the first session; colog.h), at -x times the
+                  recorded speed (1 to 10000, or 0 for as fast as the
+                  consumers go). Socket clients can steer it with lines
+                    seek [session:]tick | rate <x> | pause | play
+                  each answered with
+                    "replay <session>:<tick> <rate> playing|paused|end".
+                  With a socket the gateway waits at the end of the log for
+                  a seek; without one it stops there.
+
+  Build:          g++ -O2 -march=native -std=c++17 -o gateway gateway.cpp consumers.cpp colog.cpp
+                      replay.cpp frame_scan.cpp record.cpp ../com_frame.c
+  Run:            ./gateway [-b baud] [-c colog] [-l log] [-m logmod] [-s socket] [-t timeout] [-v]
+                            device
+                  ./gateway [-c colog] [-l log] [-m logmod] [-s socket] [-t timeout] [-v]
+                            -r colog [-f [session:]tick] [-x rate]
+**************************************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "colog.h"
+#include "consumers.h"
+#include "frame_scan.h"
+#include "replay.h"
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define READ_SIZE       65536
+#define MAX_EVENTS      16
+#define MAX_RATE        10000
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+/* The AP serial port: frames in, records out to the fan-out */
+class SerialSource : public Pollable
+{
+public:
+  SerialSource(int fd, Fanout *out) : mFd(fd), mOut(out) {}
+
+  void ready(uint32_t events) override
+  {
+    uint8_t buf[READ_SIZE];
+    ssize_t n;
+
+    (void)events;
+    while ((n = read(mFd, buf, sizeof(buf))) > 0)
+    {
+      bytes += (unsigned long)n;
+      scan.feed(buf, (size_t)n, frame, this);
+      mOut->pump();
+    }
+    /* EIO: the other end of a pty closed, or the tty went away */
+    if (!n || ((n < 0) && (errno != EAGAIN) && (errno != EINTR)))
+    {
+      done = true;
+    }
+  }
+
+  FrameScanner  scan;
+  uint32_t      tick  = 0;
+  unsigned long bytes = 0;
+  bool          done  = false;
+
+private:
+  static void frame(const comFrame_t *f, void *arg)
+  {
+    SerialSource *s = static_cast<SerialSource *>(arg);
+    Record        r[COM_FRAME_MAX_BODY / 14 + 1];
+    size_t        i, n;
+
+    n = records_from_frame(f, &s->tick, r, sizeof(r) / sizeof(r[0]));
+    for (i=0; i<n; ++i)
+    {
+      s->mOut->publish(r[i]);
+    }
+    if (COM_REC_TEXT == f->type)
+    {
+      fwrite(f->body, 1, f->len, stderr);
+    }
+  }
+
+  int     mFd;
+  Fanout *mOut;
+};
+
+/* timerfd or signalfd: just note that it fired */
+class Flag : public Pollable
+{
+public:
+  explicit Flag(int fd) : fd(fd) {}
+
+  void ready(uint32_t events) override
+  {
+    uint64_t v[16];
+
+    (void)events;
+    fired = read(fd, v, sizeof(v)) > 0;
+  }
+
+  int  fd;
+  bool fired = false;
+};
+
+static speed_t baud_code(long baud)
+{
+  switch (baud)
+  {
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+  }
+  return 0;
+}
+
+static void watch(int epfd, int fd, Pollable *p)
+{
+  struct epoll_event ev;
+
+  ev.events   = EPOLLIN;
+  ev.data.ptr = p;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* A control line from a socket client to the replay */
+static void replay_command(ReplaySource *replay, SocketServer *server, const std::string &line)
+{
+  char     cmd[16], pos[32], status[80];
+  double   arg = 0;
+  uint16_t session;
+  uint32_t tick;
+
+  if (sscanf(line.c_str(), "%15s %31s", cmd, pos) < 1)
+  {
+    return;
+  }
+  if (!strcmp(cmd, "seek"))
+  {
+    if (colog_parse_pos(pos, &session, &tick))
+    {
+      replay->seek(session, tick);
+    }
+  }
+  else if (!strcmp(cmd, "rate") && (sscanf(line.c_str(), "%*s %lf", &arg) == 1) &&
+           (arg >= 0) && (arg <= MAX_RATE))
+  {
+    replay->setRate(arg);
+  }
+  else if (!strcmp(cmd, "pause") || !strcmp(cmd, "play"))
+  {
+    replay->pause(!strcmp(cmd, "pause"));
+  }
+  snprintf(status, sizeof(status), "replay %u:%u %g %s", replay->session(), replay->tick(),
+           replay->rate(), replay->done ? "end" : replay->paused() ? "paused" : "playing");
+  server->broadcast(status);
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  const char        *logPath = NULL, *sockPath = NULL, *colPath = NULL, *replayPath = NULL;
+  long               baud = 9600;
+  double             rate = 1;
+  uint32_t           from = 0;
+  uint16_t           fromSession = 0;
+  unsigned           logmod = 1, timeout = 300;
+  bool               verbose = false;
+  FILE              *logFp = NULL;
+  struct epoll_event ev[MAX_EVENTS];
+  struct itimerspec  its;
+  sigset_t           sigs;
+  int                fd = -1, epfd, opt, i, n;
+
+  while ((opt = getopt(argc, argv, "b:c:f:l:m:r:s:t:vx:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'b': baud     = atol(optarg);                 break;
+      case 'c': colPath  = optarg;                       break;
+      case 'f':
+        if (!colog_parse_pos(optarg, &fromSession, &from))
+        {
+          fprintf(stderr, "%s: bad -f %s\n", argv[0], optarg);
+          return 1;
+        }
+        break;
+      case 'l': logPath  = optarg;                       break;
+      case 'm': logmod   = (unsigned)atoi(optarg);       break;
+      case 'r': replayPath = optarg;                     break;
+      case 's': sockPath = optarg;                       break;
+      case 't': timeout  = (unsigned)atoi(optarg);       break;
+      case 'v': verbose  = true;                         break;
+      case 'x': rate     = atof(optarg);                 break;
+      default:
+        fprintf(stderr, "usage: %s [-b baud] [-c colog] [-l log] [-m logmod] [-s socket] "
+                "[-t timeout] [-v] {device | -r colog [-f [session:]tick] [-x rate]}\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if ((rate < 0) || (rate > MAX_RATE))
+  {
+    fprintf(stderr, "%s: rate is 1 to %d, or 0\n", argv[0], MAX_RATE);
+    return 1;
+  }
+  if (!replayPath && (optind >= argc))
+  {
+    fprintf(stderr, "%s: no device\n", argv[0]);
+    return 1;
+  }
+
+  ColumnLogReader replayLog;
+
+  if (replayPath && !replayLog.open(replayPath))
+  {
+    fprintf(stderr, "%s: %s\n", replayPath, replayLog.error().c_str());
+    return 1;
+  }
+  if (!replayPath)
+  {
+    fd = open(argv[optind], O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+      fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+      return 1;
+    }
+  }
+  if ((fd >= 0) && isatty(fd))
+  {
+    struct termios tio;
+
+    if (!baud_code(baud) || tcgetattr(fd, &tio))
+    {
+      fprintf(stderr, "%s: cannot set %ld baud\n", argv[optind], baud);
+      return 1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baud_code(baud));
+    cfsetospeed(&tio, baud_code(baud));
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  if (logPath && !(logFp = fopen(logPath, "a")))
+  {
+    fprintf(stderr, "%s: %s\n", logPath, strerror(errno));
+    return 1;
+  }
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGTERM);
+  sigprocmask(SIG_BLOCK, &sigs, NULL);
+  Flag stop(signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC));
+  Flag second(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+  its.it_interval.tv_sec  = 1;
+  its.it_interval.tv_nsec = 0;
+  its.it_value            = its.it_interval;
+  timerfd_settime(second.fd, 0, &its, NULL);
+  watch(epfd, stop.fd, &stop);
+  watch(epfd, second.fd, &second);
+
+  Fanout            fanout;
+  SerialSource      serial(fd, &fanout);
+  SocketServer      *server = NULL;
+  LogWriter         *log    = NULL;
+  ColumnLogWriter   colWriter;
+  ColumnLogConsumer colLog(&colWriter);
+
+  if (colPath && !colWriter.open(colPath))
+  {
+    fprintf(stderr, "%s: %s\n", colPath, strerror(errno));
+    return 1;
+  }
+
+  if (sockPath)
+  {
+    server = new SocketServer(epfd, sockPath);
+    if (!server->ok())
+    {
+      return 1;
+    }
+  }
+  AlarmEngine alarms([server](const std::string &line)
+                     {
+                       fprintf(stderr, "%s\n", line.c_str());
+                       if (server)
+                       {
+                         server->broadcast(line);
+                       }
+                     }, timeout);
+
+  if (logFp)
+  {
+    log = new LogWriter(logFp, logmod);
+    fanout.add(log);
+  }
+  if (colPath)
+  {
+    fanout.add(&colLog);
+  }
+  fanout.add(&alarms);
+  if (server)
+  {
+    fanout.add(server);
+  }
+  ReplaySource *replay = NULL;
+
+  if (replayPath)
+  {
+    replay = new ReplaySource(&replayLog, &fanout);
+    replay->setRate(rate);
+    replay->seek(fromSession, from);
+    watch(epfd, replay->fd(), replay);
+    if (server)
+    {
+      server->onCommand = [replay, server](const std::string &line)
+                          {
+                            replay_command(replay, server, line);
+                          };
+    }
+  }
+  else
+  {
+    watch(epfd, fd, &serial);
+    serial.ready(EPOLLIN);          // a capture file never signals
+  }
+
+  while (!stop.fired && (replay ? !replay->done || server : !serial.done))
+  {
+    n = epoll_wait(epfd, ev, MAX_EVENTS, -1);
+    for (i=0; i<n; ++i)
+    {
+      static_cast<Pollable *>(ev[i].data.ptr)->ready(ev[i].events);
+    }
+    fanout.pump();
+    if (second.fired)
+    {
+      second.fired = false;
+      fanout.idle(false);
+      if (verbose && replay)
+      {
+        fprintf(stderr, "records %llu tick %u\n", (unsigned long long)fanout.published(),
+                replay->tick());
+      }
+      else if (verbose)
+      {
+        fprintf(stderr, "bytes %lu frames %lu records %llu tick %u\n", serial.bytes,
+                serial.scan.stats.frame.frames, (unsigned long long)fanout.published(),
+                serial.tick);
+      }
+    }
+    if (server)
+    {
+      server->reap();
+    }
+  }
+  fanout.idle(true);
+
+  if (replay)
+  {
+    fprintf(stderr, "replayed %llu, last tick %u, alarms %lu, logged %lu, overruns %lu\n",
+            (unsigned long long)replay->played, replay->tick(), alarms.raised,
+            log ? log->lines : 0UL, fanout.overruns());
+  }
+  else
+  {
+    fprintf(stderr, "bytes %lu, frames %lu, cobs errors %lu, length errors %lu, crc errors %lu, "
+            "version errors %lu, records %llu, ticks %u, alarms %lu, logged %lu, overruns %lu\n",
+            serial.bytes, serial.scan.stats.frame.frames, serial.scan.stats.frame.cobsErrors,
+            serial.scan.stats.frame.lengthErrors, serial.scan.stats.frame.crcErrors,
+            serial.scan.stats.frame.versionErrors, (unsigned long long)fanout.published(),
+            serial.tick,
+            alarms.raised, log ? log->lines : 0UL, fanout.overruns());
+  }
+
+  delete replay;
+  delete server;
+  delete log;
+  if (logFp)
+  {
+    fclose(logFp);
+  }
+  return 0;
+}
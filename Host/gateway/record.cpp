@@ -0,0 +1,141 @@
+/**************************************************************************************************
+  Filename:       record.cpp
+
+  Description:    Conversion of AP frames and GUI log lines to Records.
+**************************************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "record.h"
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static uint16_t u16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/* One sample: idx, id and rssi from the record header, 'p' the ED payload.
+ * Same layout com_dump.c prints.
+ */
+static bool sample(uint8_t idx, uint8_t id, uint8_t rssi, const uint8_t *p, uint8_t len,
+                   uint32_t apMs, uint32_t *tick, Record *r)
+{
+  if (len < 9)
+  {
+    return false;
+  }
+  r->apMs       = apMs;
+  r->node       = idx;
+  r->id         = id;
+  r->rssi       = rssi;
+  r->temp       = (int16_t)u16(p);
+  r->volt       = u16(p + 2);
+  r->pres       = (int16_t)u16(p + 4);
+  r->seqno      = u16(p + 6);
+  r->missedAcks = p[8];
+  r->netTime    = len >= 11 ? u16(p + 9) : 0;
+
+  /* as read_sample in gui_unified.tcl */
+  if (0 == id)
+  {
+    r->kind = Record::AP_TICK;
+    ++*tick;
+  }
+  else if (0 == r->seqno)
+  {
+    r->kind = Record::IMPACT;
+  }
+  else
+  {
+    r->kind = Record::SAMPLE;
+  }
+  r->tick = *tick;
+  return true;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+size_t records_from_frame(const comFrame_t *f, uint32_t *tick, Record *out, size_t max)
+{
+  const uint8_t *b = f->body;
+  size_t         n = 0;
+  int            i;
+
+  if ((COM_REC_SAMPLE == f->type) && (f->len >= 3) && max)
+  {
+    n += sample(b[0], b[1], b[2], b + 3, (uint8_t)(f->len - 3), 0, tick, out);
+  }
+  else if ((COM_REC_BATCH == f->type) && (f->len >= 4))
+  {
+    uint32_t ms = b[0] | (b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+
+    /* records: | dt | index | address | rssi | len | payload | */
+    for (i=4; i+5<=f->len && i+5+b[i+4]<=f->len && n<max; i+=5+b[i+4])
+    {
+      n += sample(b[i+1], b[i+2], b[i+3], b + i + 5, b[i+4], ms + b[i], tick, out + n);
+    }
+  }
+  return n;
+}
+
+double record_temp_f(const Record &r)
+{
+  return (r.temp * 1.8 + 320) / 10;
+}
+
+double record_volt(const Record &r)
+{
+  return r.volt / 1024.0 * 2.5 * 2;
+}
+
+std::string record_line(const Record &r)
+{
+  char line[96];
+
+  snprintf(line, sizeof(line), "%u %u %u %.2f %.3f %u %d %u %u\n",
+           r.tick, r.node, r.id, record_temp_f(r), record_volt(r),
+           r.rssi, r.pres, r.seqno, r.missedAcks);
+  return line;
+}
+
+bool record_parse_line(const char *line, Record *r)
+{
+  unsigned tick, node, id, rssi, seqno = 0, missed = 0;
+  double   degF, volt;
+  int      pres, n;
+
+  n = sscanf(line, "%u %u %u %lf %lf %u %d %u %u",
+             &tick, &node, &id, &degF, &volt, &rssi, &pres, &seqno, &missed);
+  if (n < 7)
+  {
+    n = sscanf(line, "%u $%x %u %lf %lf %u %d", &tick, &node, &id, &degF, &volt, &rssi, &pres);
+    if (n < 7)
+    {
+      return false;
+    }
+  }
+  if (!id)
+  {
+    return false;
+  }
+  r->kind       = Record::SAMPLE;
+  r->tick       = tick;
+  r->apMs       = 0;
+  r->node       = (uint8_t)node;
+  r->id         = (uint8_t)id;
+  r->rssi       = (uint8_t)rssi;
+  r->temp       = (int16_t)lround((degF * 10 - 320) / 1.8);
+  r->volt       = (uint16_t)lround(volt / 5 * 1024);
+  r->pres       = (int16_t)pres;
+  r->seqno      = (uint16_t)seqno;
+  r->missedAcks = (uint8_t)missed;
+  r->netTime    = 0;
+  return true;
+}
@@ -0,0 +1,75 @@
+/**************************************************************************************************
+  Filename:       record.h
+
+  Description:    Typed form of the sensor records the Access Point sends,
+                  as the gateway passes them between its parts. Samples come
+                  from COM_REC_SAMPLE and COM_REC_BATCH frames (com_frame.h)
+                  or from the text logs the GUIs write.
+
+                  Values are kept raw, as the ED sends them, and scaled to
+                  the units the GUIs show only when printed.
+**************************************************************************************************/
+
+#ifndef GATEWAY_RECORD_H
+#define GATEWAY_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "../com_frame.h"
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+struct Record
+{
+  enum Kind : uint8_t
+  {
+    SAMPLE,                         // sensor reading from an ED
+    AP_TICK,                        // AP self-measurement (id 0): one tick of GUI time
+    IMPACT                          // impact alarm from an ED (seqno 0)
+  };
+
+  uint32_t tick;                    // GUI timestamp: AP self-measurements so far
+  uint32_t apMs;                    // AP time the AP read it, msec (0 if not known)
+  uint8_t  kind;
+  uint8_t  node;                    // peer index on the AP
+  uint8_t  id;                      // first byte of the ED address
+  uint8_t  rssi;                    // as the AP scales it, 0..99
+  int16_t  temp;                    // 0.1 degC
+  uint16_t volt;                    // ADC10 counts of VCC/2 against 2.5 V
+  int16_t  pres;
+  uint16_t seqno;
+  uint8_t  missedAcks;
+  uint16_t netTime;                 // 16 msec network time, 0 without NWK_TIME_SYNC
+};
+
+/******************************************************************************
+ * PROTOTYPES
+ */
+
+/* Records in a frame, appended to 'out' (room for 'max'). Returns how many,
+ * 0 for frames that carry no samples. 'tick' is the GUI time, advanced by
+ * AP self-measurements.
+ */
+size_t records_from_frame(const comFrame_t *f, uint32_t *tick, Record *out, size_t max);
+
+/* Units the GUIs use */
+double record_temp_f(const Record &r);
+double record_volt(const Record &r);
+
+/* One line as gui_unified.tcl logs it:
+ *   <tick> <node> <id> <degF> <volt> <rssi> <pres> <seqno> <missedacks>
+ * newline included.
+ */
+std::string record_line(const Record &r);
+
+/* Parse a line of log_gui.txt, or of the older 7 column logs such as
+ * log_demo.txt (node written $000n, no seqno or missed acks). Returns false
+ * for lines that are not samples.
+ */
+bool record_parse_line(const char *line, Record *r);
+
+#endif
@@ -0,0 +1,205 @@
+/**************************************************************************************************
+  Filename:       replay.cpp
+
+  Description:    Replay of a column log into the gateway. See replay.h.
+**************************************************************************************************/
+
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <functional>
+
+#include "replay.h"
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+/* Records published between pumps: well inside the fan-out ring, so no
+ * consumer is overrun however fast the replay goes.
+ */
+#define REPLAY_BATCH    4096
+
+/* Records per wakeup before the epoll loop gets a turn */
+#define REPLAY_MAX      (4 * REPLAY_BATCH)
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/******************************************************************************
+ * ReplaySource
+ */
+
+ReplaySource::ReplaySource(const ColumnLogReader *log, Fanout *out)
+  : mLog(log), mOut(out)
+{
+  size_t c;
+
+  mTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  for (c=0; c<mLog->chunks() && !mUseApMs; ++c)
+  {
+    mUseApMs = mLog->chunk(c).apMs[0] != 0;
+  }
+  seek(0, 0);
+}
+
+ReplaySource::~ReplaySource()
+{
+  close(mTimer);
+}
+
+void ReplaySource::seek(uint16_t session, uint32_t tick)
+{
+  int id;
+
+  mHeap.clear();
+  for (id=0; id<256; ++id)
+  {
+    const std::vector<uint32_t> &list = mLog->chunksOf((uint8_t)id);
+    size_t                       c, row;
+
+    if (!mLog->seek((uint8_t)id, session, tick, &c, &row))
+    {
+      continue;
+    }
+    mPos[id].chunk = (size_t)(std::lower_bound(list.begin(), list.end(), (uint32_t)c) -
+                              list.begin());
+    mPos[id].row   = row;
+    push((uint8_t)id);
+  }
+  done     = mHeap.empty();
+  mSession = session;
+  mTick    = tick;
+  anchor();
+  arm();
+}
+
+void ReplaySource::setRate(double rate)
+{
+  mRate = rate > 0 ? rate : 0;
+  anchor();
+  arm();
+}
+
+void ReplaySource::pause(bool on)
+{
+  mPaused = on;
+  anchor();
+  arm();
+}
+
+void ReplaySource::ready(uint32_t events)
+{
+  uint64_t expired;
+  double   wall = now();
+  unsigned n = 0;
+
+  (void)events;
+  while (read(mTimer, &expired, sizeof(expired)) > 0)
+  {
+  }
+  if (mPaused)
+  {
+    return;
+  }
+
+  while (!mHeap.empty() && (n < REPLAY_MAX))
+  {
+    Head h = mHeap.front();
+
+    if (mRate > 0)
+    {
+      /* AP time went back (the AP was reset, or a new session): carry on
+       * from here
+       */
+      if (msecOf(h) < mAnchorMs)
+      {
+        anchor();
+      }
+      if (mAnchorWall + (msecOf(h) - mAnchorMs) / 1000.0 / mRate > wall)
+      {
+        break;
+      }
+    }
+    std::pop_heap(mHeap.begin(), mHeap.end(), std::greater<Head>());
+    mHeap.pop_back();
+
+    Pos &p = mPos[h.id];
+
+    mOut->publish(mLog->record(mLog->chunksOf(h.id)[p.chunk], p.row));
+    mSession = h.session;
+    mTick    = h.tick;
+    played++;
+    if (++p.row == mLog->entry(mLog->chunksOf(h.id)[p.chunk]).count)
+    {
+      p.chunk++;
+      p.row = 0;
+    }
+    push(h.id);
+    if (!(++n % REPLAY_BATCH))
+    {
+      mOut->pump();
+    }
+  }
+  mOut->pump();
+  done = mHeap.empty();
+  arm();
+}
+
+/* Node 'id' into the heap at its position, if it has anything left */
+void ReplaySource::push(uint8_t id)
+{
+  const std::vector<uint32_t> &list = mLog->chunksOf(id);
+  Pos                         &p    = mPos[id];
+  Head                         h;
+
+  if (p.chunk >= list.size())
+  {
+    return;
+  }
+
+  ColumnLogReader::Chunk k = mLog->chunk(list[p.chunk]);
+
+  h.session = mLog->entry(list[p.chunk]).session;
+  h.tick    = k.tick[p.row];
+  h.apMs    = k.apMs[p.row];
+  h.id      = id;
+  mHeap.push_back(h);
+  std::push_heap(mHeap.begin(), mHeap.end(), std::greater<Head>());
+}
+
+/* Play the next record now and time the rest from it */
+void ReplaySource::anchor()
+{
+  mAnchorWall = now();
+  mAnchorMs   = mHeap.empty() ? 0 : msecOf(mHeap.front());
+}
+
+/* Wake up when the next record is due; at once if it already is */
+void ReplaySource::arm()
+{
+  struct itimerspec its = {};
+  double            due;
+
+  if (!mPaused && !mHeap.empty())
+  {
+    due = mRate > 0 ? mAnchorWall + (msecOf(mHeap.front()) - mAnchorMs) / 1000.0 / mRate : 0;
+    its.it_value.tv_sec  = (time_t)due;
+    its.it_value.tv_nsec = (long)((due - (double)its.it_value.tv_sec) * 1e9);
+    if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+    {
+      its.it_value.tv_nsec = 1;
+    }
+  }
+  timerfd_settime(mTimer, TFD_TIMER_ABSTIME, &its, NULL);
+}
@@ -0,0 +1,105 @@
+/**************************************************************************************************
+  Filename:       replay.h
+
+  Description:    Replay of a column log (colog.h) into the gateway's
+                  fan-out, in place of the AP serial port. The consumers see
+                  the records as they came live, in tick order across all
+                  nodes.
+
+                  seek() puts every node at its first record at or after a
+                  point (session and tick, see colog.h), a binary search in
+                  each node's chunks (no reading of what comes before).
+                  From there the nodes' chunks are merged by session, tick
+                  and AP time. Each node's records keep their order;
+                  records of several nodes with the same tick and AP msec
+                  go out in address order.
+
+                  Records go out at 'rate' times the speed they were
+                  recorded (AP msec, or one second per tick for logs
+                  converted from text), or as fast as the consumers take
+                  them with rate 0. Pacing is on a timerfd in the gateway's
+                  epoll set, so clients and signals are served while it
+                  plays.
+**************************************************************************************************/
+
+#ifndef GATEWAY_REPLAY_H
+#define GATEWAY_REPLAY_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "colog.h"
+#include "consumers.h"
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+class ReplaySource : public Pollable
+{
+public:
+  ReplaySource(const ColumnLogReader *log, Fanout *out);
+  ~ReplaySource();
+
+  /* The timerfd to watch */
+  int fd() const { return mTimer; }
+
+  /* Play from the first records at or after 'tick' of 'session' */
+  void seek(uint16_t session, uint32_t tick);
+  /* Times the recorded speed, 0 for as fast as possible */
+  void setRate(double rate);
+  void pause(bool on);
+
+  void ready(uint32_t events) override;
+
+  double   rate() const { return mRate; }
+  bool     paused() const { return mPaused; }
+  uint16_t session() const { return mSession; } // of the last tick played
+  uint32_t tick() const { return mTick; }       // last tick played
+
+  uint64_t played = 0;
+  bool     done   = false;                      // nothing left to play
+
+private:
+  /* Next record of a node, in the merge heap */
+  struct Head
+  {
+    uint16_t session;
+    uint32_t tick;
+    uint32_t apMs;
+    uint8_t  id;
+
+    bool operator>(const Head &h) const
+    {
+      return session != h.session ? session > h.session :
+             tick != h.tick ? tick > h.tick : apMs != h.apMs ? apMs > h.apMs : id > h.id;
+    }
+  };
+
+  /* Where a node is: which of its chunks, which row */
+  struct Pos
+  {
+    size_t chunk;
+    size_t row;
+  };
+
+  void push(uint8_t id);
+  double msecOf(const Head &h) const { return mUseApMs ? h.apMs : h.tick * 1000.0; }
+  void anchor();
+  void arm();
+
+  const ColumnLogReader *mLog;
+  Fanout                *mOut;
+  int                    mTimer;
+  bool                   mUseApMs = false;
+  double                 mRate    = 1;
+  bool                   mPaused  = false;
+  uint16_t               mSession = 0;
+  uint32_t               mTick    = 0;
+  double                 mAnchorMs   = 0;       // record time played at mAnchorWall
+  double                 mAnchorWall = 0;
+  Pos                    mPos[256];
+  std::vector<Head>      mHeap;                 // min-heap on Head::operator>
+};
+
+#endif
@@ -0,0 +1,84 @@
+/**************************************************************************************************
+  Filename:       ring.h
+
+  Description:    Ring of records between the gateway's source (the AP serial
+                  port or a replay) and its consumers. One writer; each
+                  consumer reads at its own cursor, so a consumer that is
+                  slow to take its records does not hold up the others. The
+                  writer never waits: a consumer that falls a whole ring
+                  behind loses the oldest records and its count of overruns
+                  grows.
+
+                  All of it runs on the gateway's one thread.
+**************************************************************************************************/
+
+#ifndef GATEWAY_RING_H
+#define GATEWAY_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+template <typename T>
+class Ring
+{
+public:
+  struct Cursor
+  {
+    uint64_t      next     = 0;     // sequence number of the next record to read
+    unsigned long overruns = 0;     // records lost by falling behind
+  };
+
+  /* 'order': the ring holds 2^order records */
+  explicit Ring(unsigned order) : mBuf(size_t(1) << order), mMask((size_t(1) << order) - 1) {}
+
+  void push(const T &r)
+  {
+    mBuf[mHead & mMask] = r;
+    mHead++;
+  }
+
+  /* Cursor for a consumer that starts with the next record written. */
+  Cursor attach() const
+  {
+    Cursor c;
+
+    c.next = mHead;
+    return c;
+  }
+
+  /* The records 'c' has not read, as one contiguous run (call again for
+   * the rest after a wrap). Returns the number, 0 when up to date. Marks
+   * them read.
+   */
+  size_t read(Cursor *c, const T **p)
+  {
+    size_t n;
+
+    if (mHead - c->next > mBuf.size())
+    {
+      c->overruns += mHead - c->next - mBuf.size();
+      c->next      = mHead - mBuf.size();
+    }
+    n = (size_t)(mHead - c->next);
+    if (n > mBuf.size() - (c->next & mMask))
+    {
+      n = mBuf.size() - (c->next & mMask);
+    }
+    *p       = &mBuf[c->next & mMask];
+    c->next += n;
+    return n;
+  }
+
+  uint64_t written() const
+  {
+    return mHead;
+  }
+
+private:
+  std::vector<T> mBuf;
+  size_t         mMask;
+  uint64_t       mHead = 0;         // records ever written
+};
+
+#endif
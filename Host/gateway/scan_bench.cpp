@@ -0,0 +1,288 @@
+/**************************************************************************************************
+  Filename:       scan_bench.cpp
+
+  Description:    Check and benchmark of FrameScanner (frame_scan.h) against
+                  com_decoder_feed() from com_frame.c.
+
+                  The stream is a capture file (from the AP, or ap_emu -o)
+                  or, without one, -m MB of random frames with -C percent of
+                  them damaged. It is fed in -b byte reads to the reference
+                  decoder and to the scanner with each search kernel. All of
+                  them must deliver the same frames and count the same
+                  errors; then the throughput of each is reported.
+
+                  A resync check follows: single bytes of a clean stream are
+                  changed, dropped or doubled, and each time the frames
+                  delivered must be the clean ones less the one that was
+                  hit (two if the byte was a delimiter).
+
+  Build:          g++ -O2 -march=native -std=c++17 -o scan_bench scan_bench.cpp frame_scan.cpp ../com_frame.c
+  Run:            ./scan_bench [-m MB] [-C corrupt%] [-b readsize] [-S seed] [capture.bin]
+**************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "frame_scan.h"
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+#define RESYNC_TRIALS   20000
+#define RESYNC_FRAMES   8
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static uint64_t fnv(uint64_t h, const uint8_t *p, size_t n)
+{
+  while (n--)
+  {
+    h = (h ^ *p++) * 0x100000001B3ULL;
+  }
+  return h;
+}
+
+/* Hash of every frame delivered, and each frame's own hash if asked */
+struct Sink
+{
+  uint64_t              hash = 0xCBF29CE484222325ULL;
+  std::vector<uint64_t> *each = NULL;
+};
+
+/* what a consumer that only looks at the header costs */
+static void on_frame_count(const comFrame_t *f, void *arg)
+{
+  *(unsigned long *)arg += f->type;
+}
+
+static void on_frame(const comFrame_t *f, void *arg)
+{
+  Sink    *s = (Sink *)arg;
+  uint8_t  hdr[2] = { f->type, f->len };
+  uint64_t h = fnv(fnv(0xCBF29CE484222325ULL, hdr, 2), f->body, f->len);
+
+  s->hash = fnv(s->hash, (const uint8_t *)&h, sizeof(h));
+  if (s->each)
+  {
+    s->each->push_back(h);
+  }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void random_frames(std::vector<uint8_t> *out, size_t bytes, double corrupt)
+{
+  uint8_t body[COM_FRAME_MAX_BODY], wire[COM_FRAME_MAX_WIRE + 1];
+
+  while (out->size() < bytes)
+  {
+    /* mostly AP sized batches, now and then a long one */
+    uint8_t len = (uint8_t)(rand() % 8 ? rand() % 60 : rand() % 256);
+    size_t  n, i;
+
+    for (i=0; i<len; ++i)
+    {
+      body[i] = (uint8_t)(rand() % 4 ? rand() : 0);
+    }
+    n = com_frame_encode((uint8_t)(1 + rand() % 6), body, len, wire);
+    if (rand() / (RAND_MAX + 1.0) * 100 < corrupt)
+    {
+      wire[rand() % n] = (uint8_t)rand();
+    }
+    out->insert(out->end(), wire, wire + n);
+  }
+}
+
+static bool same(const comStats_t &a, const comStats_t &b)
+{
+  return (a.frames == b.frames) && (a.cobsErrors == b.cobsErrors) &&
+         (a.lengthErrors == b.lengthErrors) && (a.crcErrors == b.crcErrors) &&
+         (a.versionErrors == b.versionErrors) && (a.bytesSkipped == b.bytesSkipped);
+}
+
+/* Frames delivered after one byte at 'at' was damaged must be the clean
+ * ones with one or two in a row missing.
+ */
+static bool resync_ok(const std::vector<uint64_t> &clean, const std::vector<uint64_t> &got)
+{
+  size_t i, k;
+
+  for (i=0; (i<got.size()) && (got[i] == clean[i]); ++i)
+  {
+  }
+  if (i == got.size())
+  {
+    return clean.size() - got.size() <= 2;
+  }
+  for (k=1; k<=2; ++k)
+  {
+    if ((got.size() + k == clean.size()) &&
+        std::equal(got.begin() + i, got.end(), clean.begin() + i + k))
+    {
+      return true;
+    }
+  }
+  /* a changed byte can make a longer good frame of two, only by CRC luck */
+  return false;
+}
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+int main(int argc, char **argv)
+{
+  std::vector<uint8_t> stream;
+  double               mb = 64, corrupt = 1;
+  size_t               chunk = 65536, pos, n;
+  unsigned             seed = 1;
+  int                  opt, k, bad = 0;
+  static comDecoder_t  ref;
+  Sink                 refSink;
+  double               t0, tRef;
+  unsigned long        sum = 0;
+
+  while ((opt = getopt(argc, argv, "m:C:b:S:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'm': mb      = atof(optarg);           break;
+      case 'C': corrupt = atof(optarg);           break;
+      case 'b': chunk   = (size_t)atol(optarg);   break;
+      case 'S': seed    = (unsigned)atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-m MB] [-C corrupt%%] [-b readsize] [-S seed] [capture.bin]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  srand(seed);
+  if (optind < argc)
+  {
+    FILE   *fp = fopen(argv[optind], "rb");
+    uint8_t buf[65536];
+
+    if (!fp)
+    {
+      perror(argv[optind]);
+      return 1;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+      stream.insert(stream.end(), buf, buf + n);
+    }
+    fclose(fp);
+  }
+  else
+  {
+    random_frames(&stream, (size_t)(mb * 1e6), corrupt);
+  }
+  if (!chunk || stream.empty())
+  {
+    return 1;
+  }
+
+  /* timed with a callback that costs next to nothing, checked with one
+   * that hashes every frame
+   */
+  com_decoder_init(&ref);
+  t0 = now();
+  for (pos=0; pos<stream.size(); pos+=n)
+  {
+    n = stream.size() - pos < chunk ? stream.size() - pos : chunk;
+    com_decoder_feed(&ref, &stream[pos], n, on_frame_count, &sum);
+  }
+  tRef = now() - t0;
+  com_decoder_init(&ref);
+  for (pos=0; pos<stream.size(); pos+=n)
+  {
+    n = stream.size() - pos < chunk ? stream.size() - pos : chunk;
+    com_decoder_feed(&ref, &stream[pos], n, on_frame, &refSink);
+  }
+
+  printf("%zu bytes, %zu byte reads: %lu frames, %lu cobs, %lu length, %lu crc errors\n",
+         stream.size(), chunk, ref.stats.frames, ref.stats.cobsErrors,
+         ref.stats.lengthErrors, ref.stats.crcErrors);
+  printf("  com_decoder_feed  %8.1f MB/s\n", stream.size() / tRef / 1e6);
+
+  for (k=0; k<2; ++k)
+  {
+    FrameScanner scan(k ? FrameScanner::MEMCHR : FrameScanner::BEST);
+    FrameScanner check(k ? FrameScanner::MEMCHR : FrameScanner::BEST);
+    Sink         sink;
+
+    for (pos=0; pos<stream.size(); pos+=n)
+    {
+      n = stream.size() - pos < chunk ? stream.size() - pos : chunk;
+      scan.feed(&stream[pos], n, on_frame_count, &sum);
+      check.feed(&stream[pos], n, on_frame, &sink);
+    }
+    if ((sink.hash != refSink.hash) || !same(check.stats.frame, ref.stats))
+    {
+      printf("  %-8s differs from the reference\n", scan.kernel());
+      bad++;
+    }
+    printf("  scanner, %-8s %8.1f MB/s  %5.1fx\n", scan.kernel(), scan.stats.mbPerSec(),
+           scan.stats.mbPerSec() / (stream.size() / tRef / 1e6));
+  }
+
+  /* resync: one damaged byte in a short clean stream */
+  {
+    int fails = 0, trial;
+
+    for (trial=0; trial<RESYNC_TRIALS; ++trial)
+    {
+      std::vector<uint8_t>  clean, hit;
+      std::vector<uint64_t> want, got;
+      Sink                  a, b;
+      size_t                at;
+
+      random_frames(&clean, 1, 0);
+      while (want.size() < RESYNC_FRAMES)
+      {
+        FrameScanner s;
+
+        want.clear();
+        random_frames(&clean, clean.size() + 1, 0);
+        a.each = &want;
+        s.feed(clean.data(), clean.size(), on_frame, &a);
+      }
+      hit = clean;
+      at  = (size_t)rand() % hit.size();
+      switch (trial % 3)
+      {
+        case 0:  hit[at] ^= (uint8_t)(1 + rand() % 255);    break;
+        case 1:  hit.erase(hit.begin() + (long)at);         break;
+        default: hit.insert(hit.begin() + (long)at, hit[at]); break;
+      }
+
+      FrameScanner s;
+
+      b.each = &got;
+      for (pos=0; pos<hit.size(); pos+=n)
+      {
+        n = 1 + (size_t)rand() % 64;
+        n = hit.size() - pos < n ? hit.size() - pos : n;
+        s.feed(&hit[pos], n, on_frame, &b);
+      }
+      fails += !resync_ok(want, got);
+    }
+    printf("resync: %d single byte errors, %d not recovered within one frame\n",
+           RESYNC_TRIALS, fails);
+    bad += fails;
+  }
+  return bad ? 1 : 0;
+}
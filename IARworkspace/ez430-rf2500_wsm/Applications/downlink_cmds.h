@@ -0,0 +1,32 @@
+#ifndef DOWNLINK_CMDS_H
+#define DOWNLINK_CMDS_H
+
+/* ------------------------------------------------------------------------------------------------
+ *                                          Defines
+ * ------------------------------------------------------------------------------------------------
+ */
+
+/* Downlink command, AP to End Device (NWK_DOWNLINK). The AP hands it out in
+ * the ack to the device's next ack-requested sample, and again in every ack
+ * after that until the device's samples report its sequence number.
+
+   ---------------------------------------
+  | seq | cmd | value LSB,MSB |
+   ---------------------------------------
+     0     1        2,3
+
+ * seq 0 is never used so a device that has applied nothing reports 0.
+ */
+#define DL_MSG_LEN          4
+
+#define DL_SEQ_OS           0
+#define DL_CMD_OS           1
+#define DL_VALUE_OS         2
+
+/* commands */
+#define DL_CMD_PERIOD       1   /* seconds between samples, 1..255 */
+#define DL_CMD_ACK_EVERY    2   /* ask for an ack on every n-th sample, 1..255 */
+#define DL_CMD_TX_POWER     3   /* transmit power, IOCTL_LEVEL_0..2 */
+#define DL_CMD_DEADBAND     4   /* skip samples that moved less than this many ADC counts, 0 is off */
+
+#endif
@@ -0,0 +1,233 @@
+#ifdef ACCESS_POINT
+#ifdef LINK_STATS
+
+#include <string.h>
+#include "link_stats.h"
+
+/* ------------------------------------------------------------------------------------------------
+ *                                          Typedefs
+ * ------------------------------------------------------------------------------------------------
+ */
+typedef struct
+{
+  uint8_t  addr;
+  uint16_t frames;
+  uint16_t gaps;
+  uint16_t dups;
+  uint8_t  restarts;
+  uint16_t edAcksMissed;   /* as the ED reports them, see link_stats.h */
+  uint16_t lastSeq;
+  uint16_t lastMs;         /* low 16 bits of the AP time of the last frame */
+  uint16_t interval;
+  uint16_t jitter16;       /* jitter * 16 */
+  /* since the last report */
+  uint8_t  n;
+  int8_t   rssiMin, rssiMax;
+  int16_t  rssiSum;
+  uint8_t  lqiMin, lqiMax;
+  uint16_t lqiSum;
+} linkStats_t;
+
+/* ------------------------------------------------------------------------------------------------
+ *                                       Local Variables
+ * ------------------------------------------------------------------------------------------------
+ */
+static linkStats_t sLinkStats[NUM_CONNECTIONS];
+
+/**************************************************************************************************
+ * @fn          linkStatsUpdate
+ *
+ * @brief       Count a frame received from a peer. Called from the main loop for each
+ *              frame read.
+ *
+ * @param       idx     - peer index
+ *              addr    - first byte of the peer address
+ *              msg     - ED sample
+ *              len     - sample length
+ *              sigInfo - RSSI and LQI of the frame
+ *              ms      - AP time the frame was read, msec
+ *
+ * @return      none
+ **************************************************************************************************
+ */
+void linkStatsUpdate(uint8_t idx, uint8_t addr, uint8_t *msg, uint8_t len,
+                     rxMetrics_t *sigInfo, uint32_t ms)
+{
+  linkStats_t *s;
+  uint16_t     seq, diff;
+
+  if (idx >= NUM_CONNECTIONS)
+  {
+    return;
+  }
+  s = &sLinkStats[idx];
+
+  /* a different peer in this slot: start again */
+  if (s->addr != addr)
+  {
+    memset(s, 0, sizeof(*s));
+    s->addr = addr;
+  }
+
+  /* sequence number, 0 for accelerometer alarms */
+  seq = (len >= 9) ? (msg[6] | (msg[7] << 8)) : 0;
+  if (seq)
+  {
+    diff = seq - s->lastSeq;
+    if (!s->lastSeq)
+    {
+      s->lastSeq = seq;
+    }
+    else if (!diff ||
+             ((seq != 1) && ((uint16_t)(s->lastSeq - seq) < LINK_STATS_DUP_WINDOW)))
+    {
+      s->dups++;
+      seq = 0;                               /* not new: do not count its acks */
+    }
+    else if (diff < 0x8000)
+    {
+      s->gaps   += diff - 1;
+      s->lastSeq = seq;
+    }
+    else
+    {
+      s->restarts++;
+      s->lastSeq = seq;
+    }
+    if (seq)
+    {
+      s->edAcksMissed += msg[8];
+    }
+  }
+
+  /* arrival time */
+  if (s->frames)
+  {
+    uint16_t interval = (uint16_t)ms - s->lastMs;
+    uint16_t d = (interval > s->interval) ? (interval - s->interval) : (s->interval - interval);
+
+    if (d > 0x0FFF)
+    {
+      d = 0x0FFF;                            /* keep jitter16 in range */
+    }
+    if (s->frames > 1)
+    {
+      s->jitter16 += d - (s->jitter16 >> 4);
+    }
+    s->interval = interval;
+  }
+  s->lastMs = (uint16_t)ms;
+  s->frames++;
+
+  /* signal */
+  if (!s->n || (sigInfo->rssi < s->rssiMin))
+  {
+    s->rssiMin = sigInfo->rssi;
+  }
+  if (!s->n || (sigInfo->rssi > s->rssiMax))
+  {
+    s->rssiMax = sigInfo->rssi;
+  }
+  if (!s->n || (sigInfo->lqi < s->lqiMin))
+  {
+    s->lqiMin = sigInfo->lqi;
+  }
+  if (!s->n || (sigInfo->lqi > s->lqiMax))
+  {
+    s->lqiMax = sigInfo->lqi;
+  }
+  if (s->n < 0xFF)
+  {
+    s->n++;
+    s->rssiSum += sigInfo->rssi;
+    s->lqiSum  += sigInfo->lqi;
+  }
+}
+
+/**************************************************************************************************
+ * @fn          linkStatsReport
+ *
+ * @brief       Fill in the statistics record for a peer (see link_stats.h) and start a new
+ *              period for the signal figures.
+ *
+ * @param       idx - peer index
+ *              ms  - AP time, msec
+ *              rec - LINK_STATS_LEN bytes for the record
+ *
+ * @return      record length, 0 if nothing has been heard from the peer
+ **************************************************************************************************
+ */
+uint8_t linkStatsReport(uint8_t idx, uint32_t ms, uint8_t *rec)
+{
+  linkStats_t *s;
+  uint16_t     jitter;
+
+  if (idx >= NUM_CONNECTIONS)
+  {
+    return 0;
+  }
+  s = &sLinkStats[idx];
+  if (!s->frames)
+  {
+    return 0;
+  }
+
+  rec[0]  = ms & 0xFF;
+  rec[1]  = (ms >> 8) & 0xFF;
+  rec[2]  = (ms >> 16) & 0xFF;
+  rec[3]  = (ms >> 24) & 0xFF;
+  rec[4]  = idx;
+  rec[5]  = s->addr;
+  rec[6]  = s->frames & 0xFF;
+  rec[7]  = s->frames >> 8;
+  rec[8]  = s->gaps & 0xFF;
+  rec[9]  = s->gaps >> 8;
+  rec[10] = s->dups & 0xFF;
+  rec[11] = s->dups >> 8;
+  rec[12] = s->restarts;
+  rec[13] = s->edAcksMissed & 0xFF;
+  rec[14] = s->edAcksMissed >> 8;
+  rec[15] = s->n;
+  rec[16] = s->n ? s->rssiMin : 0;
+  rec[17] = s->n ? s->rssiSum / s->n : 0;
+  rec[18] = s->n ? s->rssiMax : 0;
+  rec[19] = s->n ? s->lqiMin : 0;
+  rec[20] = s->n ? s->lqiSum / s->n : 0;
+  rec[21] = s->n ? s->lqiMax : 0;
+  rec[22] = s->interval & 0xFF;
+  rec[23] = s->interval >> 8;
+  jitter  = s->jitter16 >> 4;
+  rec[24] = jitter & 0xFF;
+  rec[25] = jitter >> 8;
+
+  s->n = 0;
+  s->rssiSum = 0;
+  s->lqiSum  = 0;
+
+  return LINK_STATS_LEN;
+}
+
+/**************************************************************************************************
+ * @fn          linkStatsRemove
+ *
+ * @brief       Forget a peer that was unlinked. The peers after it move down one index,
+ *              as they do in the AP's link table.
+ *
+ * @param       idx - index of the peer removed
+ *              num - number of peers before it was removed
+ *
+ * @return      none
+ **************************************************************************************************
+ */
+void linkStatsRemove(uint8_t idx, uint8_t num)
+{
+  if ((idx >= num) || (num > NUM_CONNECTIONS))
+  {
+    return;
+  }
+  memmove(&sLinkStats[idx], &sLinkStats[idx+1], (num - idx - 1) * sizeof(linkStats_t));
+  memset(&sLinkStats[num-1], 0, sizeof(linkStats_t));
+}
+
+#endif // LINK_STATS
+#endif // access point
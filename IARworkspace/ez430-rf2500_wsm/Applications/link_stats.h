@@ -0,0 +1,48 @@
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+/* ------------------------------------------------------------------------------------------------
+ *                                         Includes
+ * ------------------------------------------------------------------------------------------------
+ */
+#include "bsp.h"
+#include "mrfi.h"
+#include "nwk_types.h"
+
+/* ------------------------------------------------------------------------------------------------
+ *                                          Defines
+ * ------------------------------------------------------------------------------------------------
+ */
+
+/* Per peer link statistics kept by the Access Point and sent to the host as
+ * a COM_REC_STATS record:
+ *
+ *   | AP msec (4) | index | address | frames (2) | gaps (2) | duplicates (2) |
+ *   | restarts | ED acks missed (2) | frames this period |
+ *   | RSSI min | mean | max | LQI min | mean | max | interval (2) | jitter (2) |
+ *
+ * The counters run from start-up and wrap; the host takes differences.
+ * RSSI (dBm) and LQI cover the frames since the last report. Gaps,
+ * duplicates and restarts come from the sequence number in the ED sample.
+ * ED acks missed is not counted by the AP, which sends its acks without CCA
+ * and cannot see them lost: it is the sum of the missed-ack counts the ED
+ * puts in each new sample (byte 8). Interval is the last time between frames
+ * and jitter its smoothed variation (RFC 3550), msec.
+ */
+#define LINK_STATS_LEN      26
+
+/* a sequence number this far behind the last one, or 1 (the first an ED
+ * sends), is a restarted ED, not a late copy
+ */
+#define LINK_STATS_DUP_WINDOW 16
+
+/* ------------------------------------------------------------------------------------------------
+ *                                         Prototypes
+ * ------------------------------------------------------------------------------------------------
+ */
+void    linkStatsUpdate(uint8_t idx, uint8_t addr, uint8_t *msg, uint8_t len,
+                        rxMetrics_t *sigInfo, uint32_t ms);
+uint8_t linkStatsReport(uint8_t idx, uint32_t ms, uint8_t *rec);
+void    linkStatsRemove(uint8_t idx, uint8_t num);
+
+#endif
@@ -101,7 +101,15 @@
 #include "nwk_api.h"
 #include "nwk_frame.h"
 #include "nwk.h"
+#include "nwk_QMgmt.h"
 #include "virtual_com_cmds.h"
+#include "bsp_clock.h"
+#ifdef NWK_DOWNLINK
+#include "downlink_cmds.h"
+#endif
+#ifdef LINK_STATS
+#include "link_stats.h"
+#endif
 #include "bsp_external/mrfi_board_defs.h"
 
 /****************** COMMENTS ON ASYNC LISTEN APPLICATION ***********************
@@ -159,8 +167,38 @@ Solution overview:
 /*------------------------------------------------------------------------------
  * Defines
  *----------------------------------------------------------------------------*/
-/* Number of seconds between timestamps (unused at present) */
-#define TIMESTAMP_PERIOD_SECS 60
+/* Longest a record waits in the serial batch, msec (less than 256: records
+ * carry their time as an 8 bit offset from the batch time)
+ */
+#define BATCH_MAX_MS 250
+/* Sample the AP sends for itself, laid out like an ED's: temperature,
+ * voltage, pressure, sequence number, missed acks, network time stamp
+ */
+#ifdef NWK_TIME_SYNC
+#define AP_SAMPLE_LEN 11
+#else
+#define AP_SAMPLE_LEN 9
+#endif
+#ifdef NWK_DOWNLINK
+/* Sample from an ED: the same, then the sequence number of the last
+ * downlink command it applied
+ */
+#define ED_SAMPLE_LEN (AP_SAMPLE_LEN + 1)
+#endif
+#if (4 + 5 + MAX_APP_PAYLOAD > COM_FRAME_MAX_LEN)
+#error ERROR: COM_FRAME_MAX_LEN too small for a batch of one record.
+#endif
+/* Number of seconds between VLO calibrations */
+#define VLO_CAL_PERIOD_SECS 60
+/* Number of seconds between link statistics reports */
+#define LINK_STATS_PERIOD_SECS 10
+
+#ifdef NWK_TIME_SYNC
+/* the ED puts its 2 byte network time stamp after the 9 byte sample */
+#if MAX_APP_PAYLOAD < 11
+#error ERROR: NWK_TIME_SYNC needs MAX_APP_PAYLOAD of at least 11.
+#endif
+#endif
 
 /*------------------------------------------------------------------------------
  * Prototypes
@@ -168,6 +206,14 @@ Solution overview:
 /* Frequency Agility helper functions */
 static void    checkChangeChannel(void);
 static void    changeChannel(void);
+static void    calibrateVLO(void);
+static uint32_t apTimeMs(void);
+static void    batchRecord(uint8_t, uint8_t, uint8_t, uint8_t *, uint8_t);
+static void    batchFlush(void);
+#ifdef NWK_DOWNLINK
+static void    queueDownlink(char *);
+#endif
+static void    doCommand(char *, uint8_t);
 
 __interrupt void ADC10_ISR(void);
 __interrupt void Timer_A (void);
@@ -178,6 +224,12 @@ __interrupt void Timer_A (void);
 /* reserve space for the maximum possible peer Link IDs */
 static linkID_t sLID[NUM_CONNECTIONS] = {0};
 static uint8_t  sNumCurrentPeers = 0;
+#ifdef NWK_DOWNLINK
+/* sequence number of the last downlink command for each peer. While none is
+ * waiting it follows what the peer reports.
+ */
+static uint8_t  sDlSeq[NUM_CONNECTIONS] = {0};
+#endif
 
 /* callback handler */
 static uint8_t sCB(linkID_t);
@@ -189,6 +241,31 @@ static void processMessage(linkID_t, uint8_t *, uint8_t);
 static volatile uint8_t sPeerFrameSem = 0;
 static volatile uint8_t sJoinSem = 0;
 static volatile uint8_t sSelfMeasureSem = 0;
+static volatile uint8_t sCalSem = 0;
+#ifdef LINK_STATS
+/* seconds since the last statistics report, and the next peer to report */
+static volatile uint8_t sStatsSem = 0;
+static uint8_t          sStatsNext = NUM_CONNECTIONS;
+#endif
+#ifdef NWK_TDMA
+/* start of a TDMA superframe: time to send the beacon */
+static volatile uint8_t sBeaconSem = 0;
+#endif
+#ifdef NWK_TIME_SYNC
+/* time to broadcast the network time */
+static volatile uint8_t sTimeSem = 0;
+#endif
+
+/* calibrated VLO rate, for AP time */
+static uint16_t sVloTicksPerSec = 12000;
+
+/* Serial batch: | AP time, msec (4 bytes) | record | record | ...
+ * See batchRecord() for the record layout.
+ */
+static uint8_t  sBatch[COM_FRAME_MAX_LEN];
+static uint8_t  sBatchLen = 0;
+static uint32_t sBatchMs;
+static uint32_t sBatchDue;                  // VLO count to send it by
 
 /* blink LEDs when channel changes... */
 static volatile uint8_t sBlinky = 0;
@@ -238,17 +315,32 @@ void main (void)
   TACCR0 = 12000;                           // ~ 1 sec
   TACTL = TASSEL_1 + MC_1;                  // ACLK, upmode
 
+  /* Make the second a real one */
+  calibrateVLO();
+
   /* Initialize serial port */
   COM_Init();
 
   //Transmit splash screen and network init notification
-  TXString( (char*)splash, sizeof splash);
-  TXString( "\r\nInitializing Network....", 26 );
+  COM_SendText(splash, sizeof splash - 1);
+  COM_SendText("\r\nInitializing Network....", 26);
 
   SMPL_Init(sCB);
 
+#ifdef NWK_PERSIST
+  /* Warm restart: take back the links restored from flash. Frames from the
+   * End Devices linked before the reset are accepted at once, no new Join or
+   * Link is needed.
+   */
+  while ((sNumCurrentPeers < NUM_CONNECTIONS) &&
+         (SMPL_SUCCESS == SMPL_Ioctl(IOCTL_OBJ_CONNOBJ, IOCTL_ACT_READ, &sLID[sNumCurrentPeers])))
+  {
+    sNumCurrentPeers++;
+  }
+#endif
+
   // network initialized
-  TXString( "Done\r\n", 6);
+  COM_SendText("Done\r\n", 6);
 
   /* green and red LEDs on solid to indicate waiting for a Join. */
   BSP_TURN_ON_LED1();
@@ -257,6 +349,64 @@ void main (void)
   /* main work loop */
   while (1)
   {
+    /* Send the serial batch once its oldest record has waited long enough */
+    if (sBatchLen && ((int32_t)(BSP_ClockTicks() - sBatchDue) >= 0))
+    {
+      batchFlush();
+    }
+
+    /* Follow the VLO as the temperature changes */
+    if (sCalSem >= VLO_CAL_PERIOD_SECS)
+    {
+      sCalSem = 0;
+      calibrateVLO();
+    }
+
+#ifdef LINK_STATS
+    /* Link statistics, periodically or when the host asks (doCommand()
+     * sets sStatsNext to 0). One peer's
+     * record at a time, as the UART queue makes room, so they are not
+     * dropped and do not push out data.
+     */
+    if (sStatsSem >= LINK_STATS_PERIOD_SECS)
+    {
+      sStatsSem  = 0;
+      sStatsNext = 0;
+    }
+    if ((sStatsNext < sNumCurrentPeers) &&
+        (COM_TxRoom() >= LINK_STATS_LEN + COM_FRAME_OVERHEAD + 2))
+    {
+      uint8_t rec[LINK_STATS_LEN], len;
+
+      len = linkStatsReport(sStatsNext++, apTimeMs(), rec);
+      if (len)
+      {
+        COM_SendFrame(COM_REC_STATS, (char *)rec, len);
+      }
+    }
+#endif
+
+#ifdef NWK_TDMA
+    /* Beacon first so that the EDs see as little jitter as possible. The
+     * guard time on the EDs absorbs the main loop latency.
+     */
+    if (sBeaconSem)
+    {
+      sBeaconSem = 0;
+      SMPL_Ioctl(IOCTL_OBJ_TDMA, IOCTL_ACT_WRITE, 0);
+    }
+#endif
+#ifdef NWK_TIME_SYNC
+    /* The time is read just before the frame goes out so main loop latency
+     * only moves the sync, it does not skew it.
+     */
+    if (sTimeSem)
+    {
+      sTimeSem = 0;
+      SMPL_Ioctl(IOCTL_OBJ_TIME, IOCTL_ACT_WRITE, 0);
+    }
+#endif
+
     /* Wait for the Join semaphore to be set by the receipt of a Join frame from
      * a device that supports an End Device.
      *
@@ -291,6 +441,14 @@ void main (void)
       volatile long temp;
       int results[2];
 
+#ifdef NWK_PERSIST
+      /* Checkpoint the Connection Table once a second. Joins, store-and-forward
+       * clients and unlinks by a peer change it from the receive ISR. Only the
+       * entries that changed are written, usually none.
+       */
+      SMPL_Ioctl(IOCTL_OBJ_NVOBJ, IOCTL_ACT_WRITE, 0);
+#endif
+
       /* Get temperature */
       ADC10CTL1 = INCH_10 + ADC10DIV_4;       // Temp Sensor ADC10CLK/5
       ADC10CTL0 = SREF_1 + ADC10SHT_3 + REFON + ADC10ON + ADC10IE + ADC10SR;
@@ -334,32 +492,38 @@ void main (void)
 
 #define INTEGER_PLD
 #ifdef INTEGER_PLD
-      uint8_t pld[MAX_APP_PAYLOAD+4];
+      uint8_t pld[AP_SAMPLE_LEN];
 
       memset((char *) pld, 0, sizeof(pld));
 
-      // start of frame
-      pld[0] = -1;
-
-      // address of peer (AP has unique addr 0)
-      pld[2] = 0;
-
       // temperature
 // Something wrong with temp - high byte sometimes 0xff.  Disable for now.
-      pld[4] = 0;
-      pld[5] = 0;
-//      pld[4] = deg & 0xFF;
-//      pld[5] = (deg >> 8) & 0xFF;
+      pld[0] = 0;
+      pld[1] = 0;
+//      pld[0] = deg & 0xFF;
+//      pld[1] = (deg >> 8) & 0xFF;
 
       // voltage
-      pld[6] = volt & 0xFF;
-      pld[7] = (volt >> 8) & 0xFF;
+      pld[2] = volt & 0xFF;
+      pld[3] = (volt >> 8) & 0xFF;
+
+#ifdef NWK_TIME_SYNC
+      // network time stamp, where the ED puts it
+      {
+        ioctlTime_t t;
+        uint16_t    stamp;
+
+        SMPL_Ioctl(IOCTL_OBJ_TIME, IOCTL_ACT_GET, &t);
+        stamp = NWK_TIME_STAMP(t.netMs);
+        pld[9] = stamp & 0xFF;
+        pld[10] = (stamp >> 8) & 0xFF;
+      }
+#endif
 
       // everything else is zero
 
-      // message from AP - payload is 14 bytes, like the ED
-      // (sof: 1, index:1, address:1, rssi: 1, MAX_APP_PAYLOAD: 10)
-      TXString((char *) pld, sizeof(pld));
+      // sample from AP: index 0, address 0 (AP has unique addr 0), no RSSI
+      batchRecord(0, 0, 0, pld, sizeof(pld));
 
 #else // string payload
       char msg[6];
@@ -385,6 +549,17 @@ void main (void)
     /* Have we received a frame on one of the ED connections?
      * No critical section -- it doesn't really matter much if we miss a poll
      */
+    /* Command from the host */
+    {
+      char    cmd[COM_CMD_MAX_LEN];
+      uint8_t len = COM_GetCommand(cmd);
+
+      if (len)
+      {
+        doCommand(cmd, len);
+      }
+    }
+
     if (sPeerFrameSem)
     {
       uint8_t  msg[MAX_APP_PAYLOAD], len, i;
@@ -400,34 +575,21 @@ void main (void)
 
           sigInfo.lid = sLID[i];
           SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_SIGINFO, (void *)&sigInfo);
+#ifdef LINK_STATS
+          linkStatsUpdate(i, peeraddr.addr[0], msg, len, &sigInfo.sigInfo, apTimeMs());
+#endif
 
 #define INTEGER_PLD
 #ifdef INTEGER_PLD
-          uint8_t pld[MAX_APP_PAYLOAD+4];
           volatile signed int rssi_int;
 
-          memset((char *) pld, 0, sizeof(pld));
-
-          // start of frame
-          pld[0] = -1;
-
-          // device index
-          pld[1] = i;
-
-          // address of peer
-          pld[2] = peeraddr.addr[0];
-
           // RSSI for peer
           rssi_int = (signed int) sigInfo.sigInfo.rssi;
           rssi_int = rssi_int+128;
           rssi_int = (rssi_int*100)/256;
-          pld[3] = rssi_int;
 
-          memcpy((char *) &(pld[4]), (char *) msg, len);
-
-          // message from peer - payload is 14 bytes
-          // (sof: 1, index:1, address:1, rssi: 1, MAX_APP_PAYLOAD: 10)
-          TXString((char *) pld, sizeof(pld));
+          // message from peer: device index, address of peer, RSSI, payload
+          batchRecord(i, peeraddr.addr[0], rssi_int, msg, len);
 
 #else // string payload
           memcpy((char *) &msg[len], (char *) &peeraddr, NET_ADDR_SIZE);
@@ -440,6 +602,10 @@ void main (void)
           BSP_EXIT_CRITICAL_SECTION(intState);
         }
       }
+#if defined(SMPL_SECURE) && NWK_KS_BLOCKS > 0
+      /* Frames handled. Get the keystream for the next ones ready. */
+      SMPL_Ioctl(IOCTL_OBJ_KEYSTREAM, IOCTL_ACT_SET, 0);
+#endif
     }
     if (BSP_BUTTON1())
     {
@@ -488,10 +654,243 @@ static void processMessage(linkID_t lid, uint8_t *msg, uint8_t len)
   /* do something useful */
   if (len)
   {
+#ifdef NWK_DOWNLINK
+    ioctlDownlink_t dl;
+    uint8_t         i;
+
+    /* The last byte of a sample is the sequence number of the last command
+     * the peer applied. Once it is the one waiting, stop sending it. Only
+     * samples carry it: alarms have seqno 0, and other frames may end in
+     * anything.
+     */
+    if ((ED_SAMPLE_LEN != len) || !(msg[6] | msg[7]))
+    {
+      return;
+    }
+    for (i=0; i<sNumCurrentPeers; ++i)
+    {
+      if (sLID[i] == lid)
+      {
+        dl.lid = lid;
+        SMPL_Ioctl(IOCTL_OBJ_DOWNLINK, IOCTL_ACT_GET, &dl);
+        if (!dl.len)
+        {
+          sDlSeq[i] = msg[ED_SAMPLE_LEN-1];
+        }
+        else if (msg[ED_SAMPLE_LEN-1] == sDlSeq[i])
+        {
+          SMPL_Ioctl(IOCTL_OBJ_DOWNLINK, IOCTL_ACT_DELETE, &dl);
+        }
+        break;
+      }
+    }
+#endif
   }
   return;
 }
 
+#ifdef NWK_DOWNLINK
+/* Queue a host command for a peer. It goes out with the peer's next ack
+ * and every one after until the peer reports it applied.
+ */
+static void queueDownlink(char *cmd)
+{
+  uint8_t         idx = cmd[0], msg[DL_MSG_LEN];
+  ioctlDownlink_t dl;
+
+  if (idx >= sNumCurrentPeers)
+  {
+    return;
+  }
+
+  /* 0 means nothing applied */
+  if (!++sDlSeq[idx])
+  {
+    sDlSeq[idx] = 1;
+  }
+  msg[DL_SEQ_OS]     = sDlSeq[idx];
+  msg[DL_CMD_OS]     = cmd[1];
+  msg[DL_VALUE_OS]   = cmd[2];
+  msg[DL_VALUE_OS+1] = cmd[3];
+
+  dl.lid = sLID[idx];
+  dl.msg = msg;
+  dl.len = sizeof(msg);
+  SMPL_Ioctl(IOCTL_OBJ_DOWNLINK, IOCTL_ACT_WRITE, &dl);
+}
+#endif
+
+/* Carry out a command from the host and answer it. A command is
+ * | code | tag | arguments |, the answer | code | tag | status | data |,
+ * so the host can match them up. See virtual_com_cmds.h for the codes.
+ */
+static void doCommand(char *cmd, uint8_t len)
+{
+  char    rsp[COM_FRAME_MAX_LEN - COM_FRAME_OVERHEAD];
+  uint8_t n = 3, idx;
+
+  rsp[0] = cmd[0];
+  rsp[1] = len > 1 ? cmd[1] : 0;
+  rsp[2] = COM_ST_OK;
+
+  switch (cmd[0])
+  {
+    case COM_CMD_GET_STATS:
+#ifdef LINK_STATS
+      sStatsNext = 0;
+#else
+      rsp[2] = COM_ST_UNSUPPORTED;
+#endif
+      break;
+
+    case COM_CMD_SET_CHANNEL:
+#ifdef FREQUENCY_AGILITY
+      if ((len < 3) || ((uint8_t)cmd[2] >= NWK_FREQ_TBL_SIZE))
+      {
+        rsp[2] = COM_ST_BAD_ARG;
+      }
+      else
+      {
+        freqEntry_t freq;
+
+        sChannel = cmd[2];
+        freq.logicalChan = sChannel;
+        if (SMPL_SUCCESS != SMPL_Ioctl(IOCTL_OBJ_FREQ, IOCTL_ACT_SET, &freq))
+        {
+          rsp[2] = COM_ST_FAILED;
+        }
+      }
+#else
+      rsp[2] = COM_ST_UNSUPPORTED;
+#endif
+      break;
+
+    case COM_CMD_SET_TX_POWER:
+#ifdef EXTENDED_API
+      {
+        ioctlLevel_t level = (ioctlLevel_t)cmd[2];
+
+        if ((len < 3) ||
+            (SMPL_SUCCESS != SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_SETPWR, &level)))
+        {
+          rsp[2] = COM_ST_BAD_ARG;
+        }
+      }
+#else
+      rsp[2] = COM_ST_UNSUPPORTED;
+#endif
+      break;
+
+    case COM_CMD_JOIN:
+      if (len < 3)
+      {
+        rsp[2] = COM_ST_BAD_ARG;
+      }
+      else if (SMPL_SUCCESS != SMPL_Ioctl(IOCTL_OBJ_AP_JOIN,
+                                          cmd[2] ? IOCTL_ACT_ON : IOCTL_ACT_OFF, 0))
+      {
+        rsp[2] = COM_ST_FAILED;
+      }
+      break;
+
+    case COM_CMD_UNLINK:
+#ifdef EXTENDED_API
+      idx = cmd[2];
+      if ((len < 3) || (idx >= sNumCurrentPeers))
+      {
+        rsp[2] = COM_ST_BAD_ARG;
+        break;
+      }
+      /* Later peers move down one index, like a peer that never joined */
+      rsp[n++] = SMPL_Unlink(sLID[idx]);
+      memmove(&sLID[idx], &sLID[idx+1], (sNumCurrentPeers - idx - 1) * sizeof(linkID_t));
+#ifdef NWK_DOWNLINK
+      memmove(&sDlSeq[idx], &sDlSeq[idx+1], sNumCurrentPeers - idx - 1);
+#endif
+#ifdef LINK_STATS
+      linkStatsRemove(idx, sNumCurrentPeers);
+#endif
+      sNumCurrentPeers--;
+#else
+      rsp[2] = COM_ST_UNSUPPORTED;
+#endif
+      break;
+
+    case COM_CMD_DUMP_CONNS:
+      /* one answer per peer: | idx | lid | state | address | hops | rssi | lqi |
+       * then the usual one with the number of peers
+       */
+      for (idx=0; idx<sNumCurrentPeers; ++idx)
+      {
+        connInfo_t *pCInfo = nwk_getConnInfo(sLID[idx]);
+
+        if (!pCInfo)
+        {
+          continue;
+        }
+        rsp[3]  = idx;
+        rsp[4]  = sLID[idx];
+        rsp[5]  = pCInfo->connState;
+        memcpy(&rsp[6], pCInfo->peerAddr, NET_ADDR_SIZE);
+        rsp[10] = pCInfo->hops2target;
+        rsp[11] = pCInfo->sigInfo.rssi;
+        rsp[12] = pCInfo->sigInfo.lqi;
+        COM_SendResponse(rsp, 13);
+      }
+      rsp[n++] = sNumCurrentPeers;
+      break;
+
+    case COM_CMD_SNAPSHOT:
+      /* AP reading and link statistics now, the serial counters, the
+       * number of peers and the store-and-forward frames lost in the answer
+       */
+      {
+        comStats_t stats;
+        uint16_t   lost;
+
+        sSelfMeasureSem = 1;
+#ifdef LINK_STATS
+        sStatsNext = 0;
+#endif
+        COM_GetStats(&stats);
+        rsp[n++] = stats.maxUsed;
+        rsp[n++] = stats.dropped & 0xFF;
+        rsp[n++] = stats.dropped >> 8;
+        rsp[n++] = stats.rxDropped & 0xFF;
+        rsp[n++] = stats.rxDropped >> 8;
+        rsp[n++] = stats.rxBad & 0xFF;
+        rsp[n++] = stats.rxBad >> 8;
+        rsp[n++] = sNumCurrentPeers;
+        lost = nwk_QSandFLost();
+        rsp[n++] = lost & 0xFF;
+        rsp[n++] = lost >> 8;
+      }
+      break;
+
+    case COM_CMD_DOWNLINK:
+      /* | code | tag | peer | command | value (2 bytes) | */
+#ifdef NWK_DOWNLINK
+      if ((len < 6) || ((uint8_t)cmd[2] >= sNumCurrentPeers))
+      {
+        rsp[2] = COM_ST_BAD_ARG;
+      }
+      else
+      {
+        queueDownlink(&cmd[2]);
+      }
+#else
+      rsp[2] = COM_ST_UNSUPPORTED;
+#endif
+      break;
+
+    default:
+      rsp[2] = COM_ST_UNKNOWN;
+      break;
+  }
+
+  COM_SendResponse(rsp, n);
+}
+
 static void changeChannel(void)
 {
 #ifdef FREQUENCY_AGILITY
@@ -510,6 +909,106 @@ static void changeChannel(void)
   return;
 }
 
+/* Measure the VLO against the DCO and retime the one second tick to it. The
+ * AP's tick paces the beacons and time syncs, and with NWK_TIME_SYNC the
+ * calibrated rate makes the network time count real milliseconds.
+ * Interrupts are off for about a millisecond; the radio FIFO holds a frame
+ * arriving meanwhile.
+ */
+static void calibrateVLO(void)
+{
+  uint16_t tps = BSP_ClockCalibrate();
+
+  if (!tps)
+  {
+    return;
+  }
+
+  TACTL &= ~MC_1;                           // stop timer
+  TACCR0 = tps - 1;
+  if (TAR >= TACCR0)
+  {
+    TAR = 0;
+  }
+  TACTL |= MC_1;                            // restart in upmode
+
+  apTimeMs();                               // count the old rate up to now
+  sVloTicksPerSec = tps;
+
+#ifdef NWK_TIME_SYNC
+  {
+    ioctlTime_t t;
+
+    t.ticksPerSec = tps;
+    SMPL_Ioctl(IOCTL_OBJ_TIME, IOCTL_ACT_SET, &t);
+  }
+#endif
+}
+
+/* AP time in msec: the free running VLO count scaled by the calibrated rate.
+ * Must be called at least every few minutes, which the self measurement
+ * does, or (ticks * 1000) overflows.
+ */
+static uint32_t apTimeMs(void)
+{
+  static uint32_t sLastTicks = 0;
+  static uint32_t sMs = 0;
+  static uint32_t sRem = 0;                 // msec * ticksPerSec not yet counted
+  uint32_t        now = BSP_ClockTicks();
+
+  sRem      += (now - sLastTicks) * 1000;
+  sLastTicks = now;
+  sMs       += sRem / sVloTicksPerSec;
+  sRem      %= sVloTicksPerSec;
+
+  return sMs;
+}
+
+/* Add a record to the serial batch:
+ *
+ *   | msec after batch time | index | address | rssi | length | payload |
+ *
+ * The batch goes out first if the record does not fit or its time offset
+ * would not fit in 8 bits.
+ */
+static void batchRecord(uint8_t idx, uint8_t addr, uint8_t rssi, uint8_t *msg, uint8_t len)
+{
+  uint32_t now = apTimeMs();
+  uint8_t  *rec;
+
+  if (sBatchLen &&
+      ((sBatchLen + 5 + len > sizeof(sBatch)) || (now - sBatchMs > 0xFF)))
+  {
+    batchFlush();
+  }
+  if (!sBatchLen)
+  {
+    sBatchMs    = now;
+    sBatchDue   = BSP_ClockTicks() + (uint32_t)sVloTicksPerSec * BATCH_MAX_MS / 1000;
+    sBatch[0]   = now & 0xFF;
+    sBatch[1]   = (now >> 8) & 0xFF;
+    sBatch[2]   = (now >> 16) & 0xFF;
+    sBatch[3]   = (now >> 24) & 0xFF;
+    sBatchLen   = 4;
+  }
+
+  rec    = &sBatch[sBatchLen];
+  rec[0] = now - sBatchMs;
+  rec[1] = idx;
+  rec[2] = addr;
+  rec[3] = rssi;
+  rec[4] = len;
+  memcpy(&rec[5], msg, len);
+  sBatchLen += 5 + len;
+}
+
+/* Send the serial batch. If the UART queue has no room it is lost whole. */
+static void batchFlush(void)
+{
+  COM_SendFrame(COM_REC_BATCH, (char *)sBatch, sBatchLen);
+  sBatchLen = 0;
+}
+
 /* implement auto-channel-change policy here... */
 static void checkChangeChannel(void)
 {
@@ -563,6 +1062,24 @@ __interrupt void ADC10_ISR(void)
 __interrupt void Timer_A (void)
 {
   sSelfMeasureSem = 1;
+  sCalSem++;
+#ifdef LINK_STATS
+  sStatsSem++;
+#endif
+#ifdef NWK_TDMA
+  sBeaconSem = 1;
+#endif
+#ifdef NWK_TIME_SYNC
+  {
+    static uint8_t secs = 0;
+
+    if (++secs >= NWK_TIME_SYNC_SECS)
+    {
+      secs     = 0;
+      sTimeSem = 1;
+    }
+  }
+#endif
 }
 
 /*
@@ -102,6 +102,10 @@
 #include "bsp_buttons.h"
 #include "vlo_rand.h"
 #include "accel_spi.h"
+#include "bsp_clock.h"
+#ifdef NWK_DOWNLINK
+#include "downlink_cmds.h"
+#endif
 #include <ti/mcu/msp430/csl/CSL.h>
 
 /*------------------------------------------------------------------------------
@@ -109,8 +113,65 @@
  *----------------------------------------------------------------------------*/
 /* How many times to try a TX and miss an acknowledge before doing a scan */
 #define MISSES_IN_A_ROW  5
+#if defined(NWK_PERSIST) && defined(APP_AUTO_ACK)
+/* Acked sends in a row that miss every ack before the saved context is
+ * taken to be stale (the AP no longer knows us) and we join again.
+ */
+#define FAILS_TO_REJOIN  3
+#endif
 /* Number of seconds between transmissions */
 #define TRANSMIT_PERIOD_SECS 1
+/* Number of seconds between VLO calibrations */
+#define VLO_CAL_PERIOD_SECS 60
+/* VLO (ACLK) ticks in ms milliseconds at the last calibrated rate */
+#define VLO_MS_TO_TICKS(ms) ((uint16_t)((uint32_t)(ms) * sVloTicksPerSec / 1000))
+
+#ifdef NWK_TDMA
+/* Wake this long before the expected beacon to absorb VLO drift. Keep in
+ * step with NWK_TDMA_GUARD_MS in nwk_mgmt.h.
+ */
+#define BEACON_GUARD_MS  10
+/* The superframe is the transmit period */
+#define SUPERFRAME_MS    (TRANSMIT_PERIOD_SECS * 1000UL)
+/* How long to listen for the beacon once awake */
+#define BEACON_WAIT_MS   (2*BEACON_GUARD_MS)
+/* Initial acquisition: listen for a little more than one superframe */
+#define BEACON_ACQUIRE_MS 1100
+#endif
+
+#ifdef NWK_TIME_SYNC
+/* the sample grows by a 2 byte network time stamp */
+#define SAMPLE_TIME_LEN 2
+/* Wake at least this long before the expected time sync; armTimeSync() adds
+ * the VLO drift. Doubled for each sync missed in a row, up to
+ * TIME_GUARD_MAX_MS.
+ */
+#define TIME_GUARD_MS       20
+#define TIME_GUARD_MAX_MS   500
+/* Acquisition: listen for a little more than one sync period */
+#define TIME_ACQUIRE_MS     (NWK_TIME_SYNC_SECS*1000 + 100)
+/* Give up on the schedule after this many misses in a row and reacquire,
+ * at most once every TIME_REACQUIRE_SECS.
+ */
+#define TIME_MAX_MISSES     5
+#define TIME_REACQUIRE_SECS 60
+#else
+#define SAMPLE_TIME_LEN 0
+#endif
+
+#ifdef NWK_DOWNLINK
+/* the sample ends with the sequence number of the last command applied */
+#define SAMPLE_DL_LEN 1
+/* Ask for an ack, and so a chance of a command, on every n-th sample */
+#define DL_ACK_EVERY 10
+#else
+#define SAMPLE_DL_LEN 0
+#endif
+
+#define SAMPLE_LEN (9 + SAMPLE_TIME_LEN + SAMPLE_DL_LEN)
+#if MAX_APP_PAYLOAD < SAMPLE_LEN
+#error ERROR: MAX_APP_PAYLOAD is too small for the sample.
+#endif
 
 /*------------------------------------------------------------------------------
  * Prototypes
@@ -118,9 +179,28 @@
 static void init(void);
 static void join(void);
 static void link(void);
+#if NWK_RETRY_JITTER_MS > 0
+static void retryJitter(void);
+#endif
+#if defined(NWK_PERSIST) && defined(APP_AUTO_ACK)
+static void rejoin(void);
+#endif
 static void run(void);
 static void soundAlarm(void);
-static void selfMeasure(uint32_t seqno);
+static uint8_t selfMeasure(uint32_t seqno);
+static void calibrateVLO(void);
+#ifdef NWK_DOWNLINK
+static void applyDownlink(uint8_t *msg, uint8_t len);
+static uint8_t inDeadband(int now, int last);
+#endif
+#ifdef NWK_TDMA
+static void syncToBeacon(uint16_t waitMs);
+#endif
+#ifdef NWK_TIME_SYNC
+static void acquireTime(void);
+static void armTimeSync(void);
+static uint8_t listenForTime(uint16_t waitMs);
+#endif
 static smplStatus_t sendPacket(uint8_t *msg, int len, int ackreq);
 static smplStatus_t sendBestEffort(uint8_t *mag, int len);
 #ifdef APP_AUTO_ACK
@@ -129,6 +209,9 @@ static smplStatus_t sendWithAckReq(uint8_t *mag, int len);
 void createRandomAddress(void);
 __interrupt void ADC10_ISR(void);
 __interrupt void TimerA_ISR (void);
+#if defined(NWK_TDMA) || NWK_RETRY_JITTER_MS > 0
+__interrupt void TimerA1_ISR (void);
+#endif
 __interrupt void Port2_ISR (void);
 
 /*------------------------------------------------------------------------------
@@ -139,12 +222,51 @@ static linkID_t sLinkID1 = 0;
 volatile int * tempOffset = (int *)0x10F4;
 /* Initialize radio address location */
 char * Flash_Addr = (char *)0x10F0;
+/* VLO rate from the last calibration. Nominally 12KHz, but it varies by
+ * tens of percent between parts and with temperature.
+ */
+static uint16_t sVloTicksPerSec = BSP_CLOCK_TICKS_PER_SEC;
+/* Seconds between samples */
+static uint8_t sTransmitSecs = TRANSMIT_PERIOD_SECS;
+#ifdef NWK_DOWNLINK
+/* Settings the AP can change (see downlink_cmds.h) and the sequence number
+ * of the last command applied.
+ */
+static uint8_t  sAckEvery = DL_ACK_EVERY;
+static uint8_t  sAckCount = 0;
+static uint16_t sDeadband = 0;
+static uint8_t  sDlSeq    = 0;
+/* Readings last sent, for the deadband */
+static int sLastDegC, sLastVolt, sLastPressure;
+#endif
 /* Work loop semaphores */
 static volatile uint8_t sSelfMeasureSem = 0;
+static volatile uint8_t sCalSem = 0;
+#ifdef NWK_TDMA
+/* Beacon is due: wake the radio and resynchronise */
+static volatile uint8_t sBeaconSem = 0;
+#endif
+#ifdef NWK_TIME_SYNC
+/* Time sync schedule: guard used for the armed window, syncs missed in a
+ * row, window armed, and tick count of the last acquisition attempt.
+ */
+static uint16_t sTimeGuardMs = TIME_GUARD_MS;
+static uint8_t  sTimeMisses  = 0;
+static uint8_t  sTimeArmed   = 0;
+static uint32_t sTimeTry     = 0;
+#endif
 /* Accelerometer alarm interrupt flag */
 static volatile uint8_t sAccelAlarm = 0;
 /* Keeps track of missed acknowledgements across calls to selfMeasure() */
 uint8_t missedAcks = 0;
+#if defined(NWK_PERSIST) && defined(APP_AUTO_ACK)
+/* Acked sends in a row that failed outright, and whether the AP has acked
+ * anything on this link. A link restored from flash may be stale, so
+ * samples ask for an ack until one comes back.
+ */
+static uint8_t sLinkFails   = 0;
+static uint8_t sLinkChecked = 0;
+#endif
 
 /*------------------------------------------------------------------------------
  * Main
@@ -192,6 +314,9 @@ static void init()
   TACCR0 = 12000;                           // ~ 1 sec
   TACTL = TASSEL_1 + MC_1;                  // ACLK, upmode
 
+  /* Make the second a real one */
+  calibrateVLO();
+
   /* BEGIN USER INITIALIZATION HERE */
 
   /* PORT USAGE:
@@ -223,6 +348,9 @@ static void join()
      * Timer A0 interrupt will wake CPU up every second to retry initializing
      */
     __bis_SR_register(LPM3_bits+GIE);  // LPM3 with interrupts enabled
+#if NWK_RETRY_JITTER_MS > 0
+    retryJitter();
+#endif
   }
 
   /* LEDs on solid to indicate successful join. */
@@ -241,6 +369,9 @@ static void link()
      * Timer A0 interrupt will wake CPU up every second to retry linking
      */
     __bis_SR_register(LPM3_bits+GIE);
+#if NWK_RETRY_JITTER_MS > 0
+    retryJitter();
+#endif
   }
 
   /* Turn off LEDs. */
@@ -249,7 +380,84 @@ static void link()
 
   /* Put the radio to sleep */
   SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_SLEEP, 0);
+
+#ifdef NWK_TDMA
+  /* Acquire the AP's superframe. If no beacon is heard we transmit
+   * unslotted until one is.
+   */
+  syncToBeacon(BEACON_ACQUIRE_MS);
+#endif
+
+#ifdef NWK_TIME_SYNC
+  /* Get the network time. If the AP is not heard the samples carry our own
+   * time since reset until it is.
+   */
+  acquireTime();
+#endif
+}
+
+#if NWK_RETRY_JITTER_MS > 0
+/* Sleep in LPM3 for a random time of up to the retry jitter so devices on
+ * the same second spread their retries. The stack has no timer to wait on,
+ * so it only reports the jitter. One shot on TACCR2; the wait is cut to one
+ * Timer A period so no retry wakeup is lost.
+ */
+static void retryJitter()
+{
+  ioctlRetry_t retry;
+  uint32_t     at;
+
+  if ((SMPL_SUCCESS != SMPL_Ioctl(IOCTL_OBJ_RETRY, IOCTL_ACT_GET, &retry)) ||
+      !retry.jitterMs)
+  {
+    return;
+  }
+  at = (((uint16_t)MRFI_RandomByte() << 8) | MRFI_RandomByte()) % (retry.jitterMs + 1);
+  at = VLO_MS_TO_TICKS(at);
+  if (!at)
+  {
+    return;
+  }
+  if (at > TACCR0)
+  {
+    at = TACCR0;
+  }
+  at += TAR;
+  if (at > TACCR0)
+  {
+    at -= TACCR0 + 1;
+  }
+
+  TACCR2  = (uint16_t)at;
+  TACCTL2 = CCIE;                           // TACCR2 interrupt enabled
+  /* The Timer A0 second may wake us first. Check and sleep with interrupts
+   * off so the TACCR2 interrupt cannot slip in between.
+   */
+  __disable_interrupt();
+  while (TACCTL2 & CCIE)
+  {
+    __bis_SR_register(LPM3_bits+GIE);
+    __disable_interrupt();
+  }
+  __enable_interrupt();
+}
+#endif
+
+#if defined(NWK_PERSIST) && defined(APP_AUTO_ACK)
+static void rejoin()
+{
+  /* Drop the link and the saved context so SMPL_Init() joins and
+   * SMPL_Link() links afresh instead of restoring them again.
+   */
+  SMPL_Ioctl(IOCTL_OBJ_CONNOBJ, IOCTL_ACT_DELETE, &sLinkID1);
+  SMPL_Ioctl(IOCTL_OBJ_NVOBJ, IOCTL_ACT_DELETE, 0);
+  sLinkFails   = 0;
+  sLinkChecked = 0;
+
+  join();
+  link();
 }
+#endif
 
 static void run()
 {
@@ -260,6 +468,29 @@ static void run()
     /* Go to sleep, waiting for interrupt every second */
     __bis_SR_register(LPM3_bits);
 
+    /* Follow the VLO as the temperature changes */
+    if (sCalSem >= VLO_CAL_PERIOD_SECS) {
+      sCalSem = 0;
+      calibrateVLO();
+    }
+
+#ifdef NWK_TDMA
+    /* Beacon due. Resynchronise the slot timer. */
+    if (sBeaconSem) {
+      sBeaconSem = 0;
+      syncToBeacon(BEACON_WAIT_MS);
+    }
+#endif
+
+#ifdef NWK_TIME_SYNC
+    /* Sync window open: listen. Otherwise see if the next one needs arming. */
+    if (BSP_ClockAlarm()) {
+      listenForTime(2*sTimeGuardMs);
+    } else {
+      armTimeSync();
+    }
+#endif
+
     /* Check accelerometer alarm */
     if (sAccelAlarm) {
       soundAlarm();
@@ -267,17 +498,232 @@ static void run()
     }
 
     /* Time to measure */
-    if (sSelfMeasureSem >= TRANSMIT_PERIOD_SECS) {
-      selfMeasure(seqno++);
+    if (sSelfMeasureSem >= sTransmitSecs) {
+      /* A sample held back by the deadband does not use up a seqno, so
+       * the AP sees a gap only for frames that were lost. Zero marks an
+       * alarm and is skipped when the 16 bits on air wrap.
+       */
+      if (selfMeasure(seqno) && !(++seqno & 0xFFFF)) {
+        seqno++;
+      }
+#if defined(SMPL_SECURE) && NWK_KS_BLOCKS > 0
+      /* Radio is asleep again. Get the keystream for the next sample ready
+       * now so it doesn't sit between the measurement and the air.
+       */
+      SMPL_Ioctl(IOCTL_OBJ_KEYSTREAM, IOCTL_ACT_SET, 0);
+#endif
+#if defined(NWK_PERSIST) && defined(APP_AUTO_ACK)
+      if (sLinkFails >= FAILS_TO_REJOIN) {
+        rejoin();
+      }
+#endif
     }
   }
 }
 
+#ifdef NWK_TDMA
+/* Listen for the AP beacon for up to waitMs milliseconds. On reception
+ * restart Timer A so that CCR0 fires BEACON_GUARD_MS ahead of the next
+ * beacon and CCR1 fires at the start of our uplink slot. Slot 0 begins one
+ * slot width after the beacon so the beacon itself is never overlapped. A
+ * slot that would not end inside the superframe (an AP with more slots than
+ * fit) is not used; we then transmit unslotted on the superframe tick.
+ */
+static void syncToBeacon(uint16_t waitMs)
+{
+  ioctlTDMA_t tdma;
+
+  tdma.lid = sLinkID1;
+  tdma.beaconRcvd = 0;
+
+  SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_AWAKE, 0);
+  SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_RXON, 0);
+
+  /* discard any stale beacon */
+  SMPL_Ioctl(IOCTL_OBJ_TDMA, IOCTL_ACT_GET, &tdma);
+  tdma.beaconRcvd = 0;
+  while (waitMs--)
+  {
+    __delay_cycles(8000);                   // 1 msec at 8MHz
+    SMPL_Ioctl(IOCTL_OBJ_TDMA, IOCTL_ACT_GET, &tdma);
+    if (tdma.beaconRcvd)
+    {
+      break;
+    }
+  }
+
+  SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_SLEEP, 0);
+
+  if (!tdma.beaconRcvd)
+  {
+    /* Missed it. Keep the old schedule and try again next superframe. */
+    return;
+  }
+
+  TACTL &= ~MC_1;                           // stop timer
+  TAR = VLO_MS_TO_TICKS(BEACON_GUARD_MS);
+  if ((NWK_TDMA_NO_SLOT != tdma.slot) &&
+      (BEACON_GUARD_MS + (tdma.slot+2)*(uint32_t)tdma.slotMs < SUPERFRAME_MS))
+  {
+    TACCR1  = VLO_MS_TO_TICKS(BEACON_GUARD_MS + (tdma.slot+1)*tdma.slotMs);
+    TACCTL1 = CCIE;                         // TACCR1 interrupt enabled
+  }
+  else
+  {
+    TACCTL1 = 0;
+  }
+  TACTL |= MC_1;                            // restart in upmode
+}
+#endif  /* NWK_TDMA */
+
+/* Measure the VLO against the DCO and retime the one second tick to it. The
+ * network time, if kept, follows the new rate too.
+ */
+static void calibrateVLO(void)
+{
+  uint16_t tps = BSP_ClockCalibrate();
+
+  if (!tps)
+  {
+    return;
+  }
+  sVloTicksPerSec = tps;
+
+  TACTL &= ~MC_1;                           // stop timer
+  TACCR0 = tps - 1;
+  if (TAR >= TACCR0)
+  {
+    TAR = 0;
+  }
+  TACTL |= MC_1;                            // restart in upmode
+
+#ifdef NWK_TIME_SYNC
+  {
+    ioctlTime_t t;
+
+    t.ticksPerSec = tps;
+    SMPL_Ioctl(IOCTL_OBJ_TIME, IOCTL_ACT_SET, &t);
+  }
+#endif
+}
+
+#ifdef NWK_TIME_SYNC
+/* Listen for two time syncs in a row. The first sets the network time, the
+ * second gives the first measurement of the VLO rate, without which the
+ * guard would have to cover the full VLO tolerance.
+ */
+static void acquireTime(void)
+{
+  sTimeTry    = BSP_ClockTicks();
+  sTimeMisses = 0;
+  if (listenForTime(TIME_ACQUIRE_MS))
+  {
+    listenForTime(TIME_ACQUIRE_MS);
+  }
+}
+
+/* Arm the Timer B alarm to open the listen window sTimeGuardMs ahead of the
+ * next expected sync. Only armed once the window is less than 2 seconds
+ * away so it is always within the alarm's reach. A window already passed
+ * counts as missed.
+ *
+ * The guard covers the main loop latency of the AP plus the rate error
+ * built up since the last sync, taken as the largest step the VLO
+ * calibration has seen.
+ */
+static void armTimeSync(void)
+{
+  ioctlTime_t   t;
+  bspClockCal_t cal;
+  uint32_t      now, wake, secs;
+  uint16_t      guard;
+
+  if (sTimeArmed)
+  {
+    return;
+  }
+
+  SMPL_Ioctl(IOCTL_OBJ_TIME, IOCTL_ACT_GET, &t);
+  now = BSP_ClockTicks();
+
+  if (!t.synced || (sTimeMisses >= TIME_MAX_MISSES))
+  {
+    if ((now - sTimeTry) >= (uint32_t)TIME_REACQUIRE_SECS * t.ticksPerSec)
+    {
+      acquireTime();
+    }
+    return;
+  }
+
+  BSP_ClockCalStats(&cal);
+  secs  = (uint32_t)(sTimeMisses+1) * NWK_TIME_SYNC_SECS;
+  guard = (TIME_GUARD_MS + (uint16_t)(secs * cal.stepPpm / 1000)) << sTimeMisses;
+  if (guard > TIME_GUARD_MAX_MS)
+  {
+    guard = TIME_GUARD_MAX_MS;
+  }
+
+  wake = t.syncTicks + secs * t.ticksPerSec -
+         (uint32_t)guard * t.ticksPerSec / 1000;
+  if ((int32_t)(wake - now) < 0)
+  {
+    sTimeMisses++;
+  }
+  else if ((int32_t)(wake - now) < 2 * (int32_t)t.ticksPerSec)
+  {
+    sTimeGuardMs = guard;
+    sTimeArmed   = 1;
+    BSP_ClockWakeAt(wake);
+  }
+}
+
+/* Listen for a time sync for up to waitMs milliseconds. Returns non-zero if
+ * one was received.
+ */
+static uint8_t listenForTime(uint16_t waitMs)
+{
+  ioctlTime_t t;
+
+  SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_AWAKE, 0);
+  SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_RXON, 0);
+
+  /* discard any stale sync */
+  SMPL_Ioctl(IOCTL_OBJ_TIME, IOCTL_ACT_GET, &t);
+  t.syncRcvd = 0;
+  while (waitMs--)
+  {
+    __delay_cycles(8000);                   // 1 msec at 8MHz
+    SMPL_Ioctl(IOCTL_OBJ_TIME, IOCTL_ACT_GET, &t);
+    if (t.syncRcvd)
+    {
+      break;
+    }
+  }
+
+  SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_SLEEP, 0);
+
+  sTimeArmed = 0;
+  if (t.syncRcvd)
+  {
+    sTimeMisses = 0;
+  }
+  else
+  {
+    sTimeMisses++;
+  }
+
+  return t.syncRcvd;
+}
+#endif  /* NWK_TIME_SYNC */
+
 static void soundAlarm(void)
 {
-  uint8_t msg[9], i;
+  uint8_t msg[SAMPLE_LEN], i;
 
   memset(msg, 0x0, sizeof(msg));
+#ifdef NWK_DOWNLINK
+  msg[SAMPLE_LEN-1] = sDlSeq;
+#endif
 
   // send packet until acknowledged (sendPacket returns SMPL_SUCCESS)
   // but not more than some arbitrary number of times
@@ -293,12 +739,18 @@ static void soundAlarm(void)
   BSP_TURN_OFF_LED2();
 }
 
-static void selfMeasure(uint32_t seqno)
+static uint8_t selfMeasure(uint32_t seqno)
 {
-  uint8_t msg[9];
+  uint8_t msg[SAMPLE_LEN], ackreq = 0;
   volatile long resval;
   int degC, volt, pressure;
   int results[3];
+#ifdef NWK_TIME_SYNC
+  ioctlTime_t t;
+
+  /* time of the sample, not of the send */
+  SMPL_Ioctl(IOCTL_OBJ_TIME, IOCTL_ACT_GET, &t);
+#endif
 
   /* Get temperature */
   ADC10CTL1 = INCH_10 + ADC10DIV_4;       // Temp Sensor ADC10CLK/5
@@ -357,6 +809,16 @@ static void selfMeasure(uint32_t seqno)
   | degC LSB,MSB | volt LSB,MSB | press LSB,MSB | seqno LSB,MSB | missedAcks |
    --------------------------------------------------------------------------
          0,1           2,3            4,5             6,7             8
+
+     with NWK_TIME_SYNC the network time of the sample follows in 16 msec
+     units (NWK_TIME_STAMP()):
+   ------------------------------
+  | ... | nettime LSB,MSB |
+   ------------------------------
+             9,10
+
+     with NWK_DOWNLINK the last byte is the sequence number of the last
+     downlink command applied (downlink_cmds.h).
   */
 
   msg[0] = degC & 0xFF;
@@ -368,9 +830,92 @@ static void selfMeasure(uint32_t seqno)
   msg[6] = seqno & 0xFF;
   msg[7] = (seqno >> 8) & 0xFF;
   msg[8] = 0;  // this is also set below when APP_AUTO_ACK is TRUE and an ack is requested
+#ifdef NWK_TIME_SYNC
+  msg[9]  = NWK_TIME_STAMP(t.netMs) & 0xFF;
+  msg[10] = (NWK_TIME_STAMP(t.netMs) >> 8) & 0xFF;
+#endif
+
+#if defined(NWK_PERSIST) && defined(APP_AUTO_ACK)
+  ackreq = !sLinkChecked;
+#endif
 
-  sendPacket(msg, sizeof(msg), 0);
+#ifdef NWK_DOWNLINK
+  msg[SAMPLE_LEN-1] = sDlSeq;
+
+  /* Every sAckEvery-th sample asks for an ack, which may bring a command.
+   * The others are not sent if no reading moved past the deadband.
+   */
+  if (ackreq || ++sAckCount >= sAckEvery) {
+    sAckCount = 0;
+    ackreq = 1;
+  } else if (sDeadband &&
+             inDeadband(degC, sLastDegC) &&
+             inDeadband(volt, sLastVolt) &&
+             inDeadband(pressure, sLastPressure)) {
+    sSelfMeasureSem = 0;
+    return 0;
+  }
+  sLastDegC     = degC;
+  sLastVolt     = volt;
+  sLastPressure = pressure;
+#endif
+
+  sendPacket(msg, sizeof(msg), ackreq);
+
+  return 1;
+}
+
+#ifdef NWK_DOWNLINK
+static uint8_t inDeadband(int now, int last)
+{
+  return ((now > last) ? now - last : last - now) < sDeadband;
+}
+
+/* Apply a downlink command. The AP repeats a command until our samples
+ * report its sequence number, so one already applied is ignored. Values out
+ * of range are ignored too but the command still counts as applied, or the
+ * AP would never stop sending it.
+ */
+static void applyDownlink(uint8_t *msg, uint8_t len)
+{
+  uint16_t value;
+
+  if ((len < DL_MSG_LEN) || (msg[DL_SEQ_OS] == sDlSeq)) {
+    return;
+  }
+  value = msg[DL_VALUE_OS] | (msg[DL_VALUE_OS+1] << 8);
+
+  switch (msg[DL_CMD_OS])
+  {
+    case DL_CMD_PERIOD:
+      if (value && (value <= 255)) {
+        sTransmitSecs = value;
+      }
+      break;
+
+    case DL_CMD_ACK_EVERY:
+      if (value && (value <= 255)) {
+        sAckEvery = value;
+      }
+      break;
+
+    case DL_CMD_TX_POWER:
+      if (value <= IOCTL_LEVEL_2) {
+        ioctlLevel_t level = (ioctlLevel_t)value;
+
+        /* radio is awake */
+        SMPL_Ioctl(IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_SETPWR, &level);
+      }
+      break;
+
+    case DL_CMD_DEADBAND:
+      sDeadband = value;
+      break;
+  }
+
+  sDlSeq = msg[DL_SEQ_OS];
 }
+#endif
 
 static smplStatus_t sendPacket(uint8_t *msg, int len, int ackflag)
 {
@@ -487,12 +1032,35 @@ static smplStatus_t sendWithAckReq(uint8_t *msg, int len)
     }
   }
 
+#ifdef NWK_DOWNLINK
+  /* An ack that carried a command left it for us to receive */
+  {
+    uint8_t cmd[MAX_APP_PAYLOAD], len;
+
+    while (SMPL_SUCCESS == SMPL_Receive(sLinkID1, cmd, &len)) {
+      applyDownlink(cmd, len);
+    }
+  }
+#endif
+
   /* Put radio back to sleep */
   SMPL_Ioctl( IOCTL_OBJ_RADIO, IOCTL_ACT_RADIO_SLEEP, 0);
 
   /* Done with measurement, disable measure flag */
   sSelfMeasureSem = 0;
 
+#ifdef NWK_PERSIST
+  /* Count sends that got no ack at all. Ones that failed for want of a
+   * clear channel say nothing about the link.
+   */
+  if (SMPL_SUCCESS == rc) {
+    sLinkFails   = 0;
+    sLinkChecked = 1;
+  } else if (MISSES_IN_A_ROW == noAck && sLinkFails < FAILS_TO_REJOIN) {
+    sLinkFails++;
+  }
+#endif
+
   return rc;
 }
 #endif /* APP_AUTO_ACK */
@@ -537,10 +1105,44 @@ __interrupt void ADC10_ISR(void)
 #pragma vector=TIMERA0_VECTOR
 __interrupt void TimerA_ISR (void)
 {
+#ifdef NWK_TDMA
+  sBeaconSem = 1;
+  /* Until a slot is known measure on the superframe tick */
+  if (!(TACCTL1 & CCIE)) {
+    sSelfMeasureSem++;
+  }
+#else
   sSelfMeasureSem++;
+#endif
+  sCalSem++;
   __bic_SR_register_on_exit(LPM3_bits);        // Clear LPM3 bit from 0(SR)
 }
 
+#if defined(NWK_TDMA) || NWK_RETRY_JITTER_MS > 0
+/*------------------------------------------------------------------------------
+ * Timer A1 interrupt service routine (TDMA uplink slot, retry jitter)
+ *----------------------------------------------------------------------------*/
+#pragma vector=TIMERA1_VECTOR
+__interrupt void TimerA1_ISR (void)
+{
+  switch (TAIV) {
+#ifdef NWK_TDMA
+    case TAIV_TACCR1:
+      sSelfMeasureSem++;
+      break;
+#endif
+#if NWK_RETRY_JITTER_MS > 0
+    case TAIV_TACCR2:
+      TACCTL2 = 0;                             // one shot: jitter is over
+      break;
+#endif
+    default:
+      return;
+  }
+  __bic_SR_register_on_exit(LPM3_bits);        // Clear LPM3 bit from 0(SR)
+}
+#endif
+
 /*------------------------------------------------------------------------------
  * Accelerometer interrupt service routine
  *----------------------------------------------------------------------------*/
@@ -37,9 +37,45 @@
 #include "bsp.h"
 #include "virtual_com_cmds.h"
 
+#if (COM_TX_BUF_SIZE & (COM_TX_BUF_SIZE - 1)) || (COM_TX_BUF_SIZE > 128)
+#error "ERROR: COM_TX_BUF_SIZE must be a power of 2 no larger than 128."
+#endif
+#if (COM_RX_BUF_SIZE & (COM_RX_BUF_SIZE - 1)) || (COM_RX_BUF_SIZE > 128)
+#error "ERROR: COM_RX_BUF_SIZE must be a power of 2 no larger than 128."
+#endif
+/* a whole encoded frame must fit in the queue, and in one COBS block */
+#if (COM_FRAME_MAX_LEN + COM_FRAME_OVERHEAD + 2 > COM_TX_BUF_SIZE) || (COM_FRAME_MAX_LEN > 240)
+#error "ERROR: COM_FRAME_MAX_LEN too large for COM_TX_BUF_SIZE."
+#endif
+
+/* Divisor and modulation for rates other than 9600, rounded to 1/8 bit */
+#define COM_SMCLK_HZ   (BSP_CONFIG_CLOCK_MHZ_SELECT * 1000000UL)
+#define COM_BR_EIGHTHS (((COM_SMCLK_HZ * 16) / COM_BAUD + 1) / 2)
+#if (COM_BR_EIGHTHS < 24)
+#error "ERROR: COM_BAUD too high for the SMCLK rate."
+#endif
+
 static char verboseMode = 0;
 static char degCMode = 0;
 
+/* Transmit queue. The indices run freely and are masked on use: only
+ * TXString() moves txHead and only the TX interrupt moves txTail.
+ */
+static char txBuf[COM_TX_BUF_SIZE];
+static volatile unsigned char txHead = 0;
+static volatile unsigned char txTail = 0;
+static comStats_t comStats = {0};
+
+/* Receive queue: only the RX interrupt moves rxHead and only
+ * COM_GetCommand() moves rxTail.
+ */
+static char rxBuf[COM_RX_BUF_SIZE];
+static volatile unsigned char rxHead = 0;
+static volatile unsigned char rxTail = 0;
+
+static char txQueue(const char *string, int length, char wait);
+static uint16_t crc16(uint16_t crc, unsigned char b);
+
 /******************************************************************************/
 // End Virtual Com Port Communication
 /******************************************************************************/
@@ -48,7 +84,11 @@ void COM_Init()
   P3SEL |= 0x30;                            // P3.4,5 = USCI_A0 TXD/RXD
   UCA0CTL1 = UCSSEL_2;                      // SMCLK
 
-#if (BSP_CONFIG_CLOCK_MHZ_SELECT == 1)
+#if (COM_BAUD != 9600)
+  UCA0BR0 = (COM_BR_EIGHTHS / 8) & 0xFF;
+  UCA0BR1 = (COM_BR_EIGHTHS / 8) >> 8;
+  UCA0MCTL = (COM_BR_EIGHTHS % 8) << 1;     // UCBRSx
+#elif (BSP_CONFIG_CLOCK_MHZ_SELECT == 1)
   UCA0BR0 = 104;                            // 9600 from 1Mhz
   UCA0BR1 = 0;
   UCA0MCTL = UCBRS_1;
@@ -89,15 +129,258 @@ void COM_Init()
   __enable_interrupt();
 }
 
+/* Queue a string for the UART. A string that does not fit in the free space
+ * is dropped whole, so the host never sees part of a record, unless
+ * COM_TX_BLOCK_WHEN_FULL is defined, in which case this waits for room.
+ * Strings longer than the whole queue (the splash screen) are always sent
+ * piece by piece, waiting for room.
+ */
 void TXString( char* string, int length )
 {
-  int pointer;
-  for( pointer = 0; pointer < length; pointer++)
+  txQueue(string, length, 0);
+}
+
+/* Put bytes in the transmit queue. Returns 0 if they were dropped. */
+static char txQueue(const char *string, int length, char wait)
+{
+  unsigned char used;
+  int chunk;
+
+#if defined(COM_TX_BLOCK_WHEN_FULL)
+  wait = 1;
+#endif
+  if (length > COM_TX_BUF_SIZE)
+  {
+    wait = 1;
+  }
+
+  while (length > 0)
+  {
+    chunk = (length > COM_TX_BUF_SIZE) ? COM_TX_BUF_SIZE : length;
+    used  = txHead - txTail;
+    if (!wait && (used > COM_TX_BUF_SIZE - chunk))
+    {
+      comStats.dropped++;
+      return 0;
+    }
+    while (used > COM_TX_BUF_SIZE - chunk)
+    {
+      used = txHead - txTail;               // TX interrupt makes room
+    }
+
+    length -= chunk;
+    used   += chunk;
+    while (chunk--)
+    {
+      txBuf[txHead & (COM_TX_BUF_SIZE - 1)] = *string++;
+      txHead++;
+    }
+    if (used > comStats.maxUsed)
+    {
+      comStats.maxUsed = used;
+    }
+    IE2 |= UCA0TXIE;                        // Start (or keep) the TX interrupt
+  }
+  return 1;
+}
+
+/* CRC-16/CCITT, poly 0x1021, of one more byte */
+static uint16_t crc16(uint16_t crc, unsigned char b)
+{
+  crc  = (crc >> 8) | (crc << 8);
+  crc ^= b;
+  crc ^= (crc & 0xFF) >> 4;
+  crc ^= crc << 12;
+  crc ^= (crc & 0xFF) << 5;
+  return crc;
+}
+
+/* Build a frame (see virtual_com_cmds.h), COBS encoding it as it goes, and
+ * queue it. out[code] is the length byte of the current COBS block; frames
+ * are short enough that a block never reaches 254 bytes.
+ */
+static char sendFrame(char type, const char *body, unsigned char len, char wait)
+{
+  char          out[COM_FRAME_MAX_LEN + COM_FRAME_OVERHEAD + 2];
+  unsigned char code = 0, n = 1, i, c;
+  uint16_t      crc = 0xFFFF;
+
+  if (len > COM_FRAME_MAX_LEN)
+  {
+    return 0;
+  }
+  for (i = 0; i < len + COM_FRAME_OVERHEAD; i++)
+  {
+    if (i == 0)
+    {
+      c = COM_FRAME_VERSION;
+    }
+    else if (i == 1)
+    {
+      c = type;
+    }
+    else if (i == 2)
+    {
+      c = len;
+    }
+    else if (i < len + 3)
+    {
+      c = body[i - 3];
+    }
+    else
+    {
+      c = (i == len + 3) ? (crc & 0xFF) : (crc >> 8);
+    }
+    if (i < len + 3)
+    {
+      crc = crc16(crc, c);
+    }
+
+    if (c)
+    {
+      out[n++] = c;
+    }
+    else
+    {
+      out[code] = n - code;
+      code = n++;
+    }
+  }
+  out[code] = n - code;
+  out[n++] = 0;
+
+  return txQueue(out, n, wait);
+}
+
+/* Send a framed record. It is dropped whole, and 0 returned, if the
+ * transmit queue has no room for it (unless COM_TX_BLOCK_WHEN_FULL).
+ */
+char COM_SendFrame(char type, const char *body, unsigned char len)
+{
+  return sendFrame(type, body, len, 0);
+}
+
+/* Send a COM_REC_RESP record, waiting for room. Commands are rare and the
+ * host is waiting for the answer.
+ */
+void COM_SendResponse(const char *body, unsigned char len)
+{
+  sendFrame(COM_REC_RESP, body, len, 1);
+}
+
+/* Send text as COM_REC_TEXT records, waiting for room. For start-up
+ * messages; the main loop should not wait on the UART.
+ */
+void COM_SendText(const char *text, int len)
+{
+  unsigned char chunk;
+
+  while (len > 0)
+  {
+    chunk = (len > COM_FRAME_MAX_LEN) ? COM_FRAME_MAX_LEN : len;
+    sendFrame(COM_REC_TEXT, text, chunk, 1);
+    text += chunk;
+    len  -= chunk;
+  }
+}
+
+/* Copy out the serial queue statistics. */
+void COM_GetStats(comStats_t *stats)
+{
+  *stats = comStats;
+}
+
+/* Free bytes in the transmit queue */
+unsigned char COM_TxRoom(void)
+{
+  return COM_TX_BUF_SIZE - (unsigned char)(txHead - txTail);
+}
+
+/* Undo the COBS encoding of a command frame in place and check it. Returns
+ * the body length, body at frame + 3, or 0 if the frame is not a good
+ * command.
+ */
+static unsigned char checkCommand(unsigned char *frame, unsigned char n)
+{
+  unsigned char i = 0, m = 0, code, k;
+  uint16_t      crc = 0xFFFF;
+
+  while (i < n)
+  {
+    code = frame[i++];
+    if (i + code - 1 > n)
+    {
+      return 0;
+    }
+    for (k = 1; k < code; k++)
+    {
+      frame[m++] = frame[i++];
+    }
+    if ((code < 0xFF) && (i < n))
+    {
+      frame[m++] = 0;
+    }
+  }
+
+  if ((m <= COM_FRAME_OVERHEAD) || (frame[0] != COM_FRAME_VERSION) ||
+      (frame[1] != COM_REC_CMD) || (frame[2] != m - COM_FRAME_OVERHEAD))
+  {
+    return 0;
+  }
+  for (k = 0; k < m - 2; k++)
+  {
+    crc = crc16(crc, frame[k]);
+  }
+  if ((frame[m-2] != (crc & 0xFF)) || (frame[m-1] != (crc >> 8)))
+  {
+    return 0;
+  }
+  return frame[2];
+}
+
+/* Next command from the host: a COM_REC_CMD frame, framed like the ones
+ * going out. Copies the body to 'cmd' (COM_CMD_MAX_LEN bytes) and returns
+ * its length, or 0 if no complete good command has arrived. Bad frames are
+ * dropped and reading picks up after the next 0.
+ */
+unsigned char COM_GetCommand(char *cmd)
+{
+  static unsigned char frame[COM_CMD_MAX_LEN + COM_FRAME_OVERHEAD + 1];
+  static unsigned char n = 0;
+  static char          skip = 0;
+  unsigned char        c, len;
+
+  while (rxTail != rxHead)
   {
-    volatile int i;
-    UCA0TXBUF = string[pointer];
-    while (!(IFG2&UCA0TXIFG));              // USCI_A0 TX buffer ready?
+    c = rxBuf[rxTail & (COM_RX_BUF_SIZE - 1)];
+    rxTail++;
+    if (c)
+    {
+      if (n < sizeof(frame))
+      {
+        frame[n++] = c;
+      }
+      else
+      {
+        skip = 1;                           // too long to be a command
+      }
+      continue;
+    }
+
+    len = (!skip && n) ? checkCommand(frame, n) : 0;
+    if (!len && (skip || n))
+    {
+      comStats.rxBad++;
+    }
+    n    = 0;
+    skip = 0;
+    if (len)
+    {
+      memcpy(cmd, &frame[3], len);
+      return len;
+    }
   }
+  return 0;
 }
 
 void transmitDataString(char data_mode, char addr[4],char rssi[3], char msg[MESSAGE_LENGTH] )
@@ -217,26 +500,41 @@ void transmitData(int addr, signed char rssi,  char msg[MESSAGE_LENGTH] )
 }
 
 /*------------------------------------------------------------------------------
-* USCIA interrupt service routine
+* USCIA transmit interrupt service routine. USCI_B0 (radio SPI) is polled, so
+* only USCI_A0 gets here. The interrupt is turned off when the queue is empty
+* and TXString() turns it back on.
 ------------------------------------------------------------------------------*/
-#pragma vector=USCIAB0RX_VECTOR
-__interrupt void USCI0RX_ISR(void)
+#pragma vector=USCIAB0TX_VECTOR
+__interrupt void USCI0TX_ISR(void)
 {
-  char rx = UCA0RXBUF;
-  if ( rx == 'V' || rx == 'v' )
+  if (txTail != txHead)
   {
-    verboseMode = 1;
+    UCA0TXBUF = txBuf[txTail & (COM_TX_BUF_SIZE - 1)];
+    txTail++;
   }
-  else if ( rx == 'M' || rx == 'm' )
+  if (txTail == txHead)
   {
-    verboseMode = 0;
+    IE2 &= ~UCA0TXIE;
   }
-  else if ( rx == 'F' || rx == 'f' )
+}
+
+/*------------------------------------------------------------------------------
+* USCIA receive interrupt service routine. Bytes go to the receive queue for
+* COM_GetCommand(); when it is full they are lost and the frame they belong
+* to fails its CRC.
+------------------------------------------------------------------------------*/
+#pragma vector=USCIAB0RX_VECTOR
+__interrupt void USCI0RX_ISR(void)
+{
+  char rx = UCA0RXBUF;
+
+  if ((unsigned char)(rxHead - rxTail) < COM_RX_BUF_SIZE)
   {
-    degCMode = 0;
+    rxBuf[rxHead & (COM_RX_BUF_SIZE - 1)] = rx;
+    rxHead++;
   }
-  else if ( rx == 'C' || rx == 'c' )
+  else
   {
-    degCMode = 1;
+    comStats.rxDropped++;
   }
 }
@@ -40,10 +40,90 @@
 /******************************************************************************/
 #define MESSAGE_LENGTH 11
 
+/* Serial transmit queue. TXString() copies the string in and returns, the
+ * USCI_A0 TX interrupt sends it. Size must be a power of 2, 128 at most.
+ */
+#ifndef COM_TX_BUF_SIZE
+#define COM_TX_BUF_SIZE 64
+#endif
+
+/* Receive queue, filled by the USCI_A0 RX interrupt and read by
+ * COM_GetCommand(). Size must be a power of 2, 128 at most.
+ */
+#ifndef COM_RX_BUF_SIZE
+#define COM_RX_BUF_SIZE 32
+#endif
+
+typedef struct
+{
+  unsigned char maxUsed;      /* transmit queue high-water mark, bytes */
+  unsigned int  dropped;      /* strings dropped because the queue was full */
+  unsigned int  rxDropped;    /* bytes lost because the receive queue was full */
+  unsigned int  rxBad;        /* command frames that failed their checks */
+} comStats_t;
+
+/* UART rate. The eZ430 USB interface runs its UART at a fixed 9600 so that
+ * is the default. Through a direct UART on P3.4/P3.5 anything up to SMCLK/3
+ * can be used, e.g. 115200.
+ */
+#ifndef COM_BAUD
+#define COM_BAUD 9600
+#endif
+
+/* Framed binary records. Each frame is
+ *
+ *   | version | type | length | body (length bytes) | CRC-16 LSB,MSB |
+ *
+ * COBS encoded and followed by a 0 byte, so 0 never appears inside a frame
+ * and the host resynchronises at the next 0 after any error. The CRC is
+ * CRC-16/CCITT (poly 0x1021, initial 0xFFFF) over version to body. A host
+ * decoder is in Host/com_frame.c; keep the two in step.
+ */
+#define COM_FRAME_VERSION   1
+#define COM_FRAME_OVERHEAD  5       /* version, type, length, CRC */
+#ifndef COM_FRAME_MAX_LEN
+#define COM_FRAME_MAX_LEN   48      /* longest body */
+#endif
+
+/* Record types */
+#define COM_REC_SAMPLE      1       /* | peer index | address | rssi | ED payload | */
+#define COM_REC_TEXT        2       /* text for a terminal */
+#define COM_REC_BATCH       3       /* | AP msec (4) | { | dt | index | address | rssi | len | payload | } | */
+#define COM_REC_STATS       4       /* link statistics for one peer, see link_stats.h */
+#define COM_REC_CMD         5       /* host to AP: | command | tag | arguments | */
+#define COM_REC_RESP        6       /* AP to host: | command | tag | status | data | */
+
+/* Host commands. The AP answers each with a COM_REC_RESP echoing the
+ * command and tag; some send more records first.
+ */
+#define COM_CMD_MAX_LEN       8
+#define COM_CMD_GET_STATS     1     /* send link statistics for all peers now */
+#define COM_CMD_SET_CHANNEL   2     /* | logical channel |  (FREQUENCY_AGILITY) */
+#define COM_CMD_SET_TX_POWER  3     /* | level 0..2 | */
+#define COM_CMD_JOIN          4     /* | 1 open, 0 close the join window | */
+#define COM_CMD_UNLINK        5     /* | peer index |, data: | SimpliciTI status | */
+#define COM_CMD_DUMP_CONNS    6     /* one response per peer, see main_AP.c, then data: | peers | */
+#define COM_CMD_SNAPSHOT      7     /* sample the AP now and send statistics, data: see main_AP.c */
+#define COM_CMD_DOWNLINK      8     /* | peer index | cmd | value LSB,MSB |  (NWK_DOWNLINK) */
+
+/* Response status */
+#define COM_ST_OK             0
+#define COM_ST_UNKNOWN        1     /* no such command */
+#define COM_ST_BAD_ARG        2
+#define COM_ST_UNSUPPORTED    3     /* not in this build */
+#define COM_ST_FAILED         4
+
 void COM_Init(void);
+void COM_GetStats(comStats_t *stats);
+unsigned char COM_TxRoom(void);
+char COM_SendFrame(char type, const char *body, unsigned char len);
+void COM_SendResponse(const char *body, unsigned char len);
+void COM_SendText(const char *text, int len);
+unsigned char COM_GetCommand(char *cmd);
 void TXString( char* string, int length );
 void transmitData(int addr, signed char rssi,  char msg[MESSAGE_LENGTH] );
 void transmitDataString(char data_mode, char addr[4],char rssi[3], char msg[MESSAGE_LENGTH]);
 __interrupt void USCI0RX_ISR(void);
+__interrupt void USCI0TX_ISR(void);
 
 
@@ -44,6 +44,9 @@
 #include "bsp_driver_defs.h"
 #include "bsp_leds.h"
 #include "bsp_buttons.h"
+#if (!defined BSP_NO_CLOCK)
+#include "bsp_clock.h"
+#endif
 
 
 /**************************************************************************************************
@@ -65,6 +68,10 @@ void BSP_InitDrivers(void)
 #if (!defined BSP_NO_BUTTONS)
   BSP_InitButtons();
 #endif
+
+#if (!defined BSP_NO_CLOCK)
+  BSP_InitClock();
+#endif
 }
 
 
@@ -80,6 +87,14 @@ void BSP_InitDrivers(void)
 #include "drivers/code/bsp_buttons.c"
 #endif
 
+#if (!defined BSP_NO_FLASH)
+#include "drivers/code/bsp_flash.c"
+#endif
+
+#if (!defined BSP_NO_CLOCK)
+#include "drivers/code/bsp_clock.c"
+#endif
+
 
 /**************************************************************************************************
 */
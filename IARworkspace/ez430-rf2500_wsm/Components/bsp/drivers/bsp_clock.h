@@ -0,0 +1,95 @@
+/**************************************************************************************************
+  Filename:       bsp_clock.h
+  Created:        2026-10-19
+  Author:         eZ430-RF2500 project contributors
+
+  Written for this project; not part of the TI SimpliciTI or BSP release.
+**************************************************************************************************/
+
+/* =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *   BSP (Board Support Package)
+ *   Clock driver include file.
+ * =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#ifndef BSP_CLOCK_H
+#define BSP_CLOCK_H
+
+
+/* ------------------------------------------------------------------------------------------------
+ *                                           Includes
+ * ------------------------------------------------------------------------------------------------
+ */
+#include "bsp.h"
+
+
+/* ------------------------------------------------------------------------------------------------
+ *                                             Defines
+ * ------------------------------------------------------------------------------------------------
+ */
+
+/* Timer B counts ACLK without stopping and the overflows extend it to 32
+ * bits. The demo applications run ACLK from the VLO, which is only nominally
+ * 12 kHz; this is the nominal rate.
+ */
+#ifndef BSP_CLOCK_TICKS_PER_SEC
+#define BSP_CLOCK_TICKS_PER_SEC   12000
+#endif
+
+/* BSP_ClockCalibrate() measures the real ACLK rate by counting SMCLK (the
+ * calibrated DCO) over this many ACLK periods. More periods average out more
+ * VLO jitter but keep interrupts off for longer: 16 periods of a 12 kHz VLO
+ * is 1.3 msec.
+ */
+#ifndef BSP_CLOCK_CAL_TICKS
+#define BSP_CLOCK_CAL_TICKS       16
+#endif
+
+/* Give up on an ACLK edge after this many SMCLK cycles */
+#define BSP_CLOCK_CAL_TIMEOUT     0xC000
+
+
+/* ------------------------------------------------------------------------------------------------
+ *                                           Typedefs
+ * ------------------------------------------------------------------------------------------------
+ */
+
+/* Calibration results. stepPpm is the largest change between two
+ * consecutive calibrations: how far the rate may have moved by the time the
+ * next calibration catches it. Scheduling code sizes its guard windows from
+ * it.
+ */
+typedef struct
+{
+  uint16_t ticksPerSec;       /* last measurement */
+  uint16_t minTicksPerSec;
+  uint16_t maxTicksPerSec;
+  uint16_t stepPpm;
+  uint16_t count;             /* calibrations done, saturates */
+} bspClockCal_t;
+
+
+/* ------------------------------------------------------------------------------------------------
+ *                                        Prototypes
+ * ------------------------------------------------------------------------------------------------
+ */
+void     BSP_InitClock(void);
+uint32_t BSP_ClockTicks(void);
+void     BSP_ClockWakeAt(uint32_t ticks);
+uint8_t  BSP_ClockAlarm(void);
+uint16_t BSP_ClockCalibrate(void);
+void     BSP_ClockCalStats(bspClockCal_t *stats);
+
+
+
+/* ************************************************************************************************
+ *                                   Compile Time Integrity Checks
+ * ************************************************************************************************
+ */
+#ifdef BSP_NO_CLOCK
+#error "ERROR: The clock driver is disabled.  This file should not be included."
+#endif
+
+/**************************************************************************************************
+ */
+#endif
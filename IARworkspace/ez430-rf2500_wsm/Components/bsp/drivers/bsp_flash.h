@@ -0,0 +1,59 @@
+/**************************************************************************************************
+  Filename:       bsp_flash.h
+  Created:        2026-10-19
+  Author:         eZ430-RF2500 project contributors
+
+  Written for this project; not part of the TI SimpliciTI or BSP release.
+**************************************************************************************************/
+
+/* =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *   BSP (Board Support Package)
+ *   Flash driver include file.
+ * =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+#ifndef BSP_FLASH_H
+#define BSP_FLASH_H
+
+
+/* ------------------------------------------------------------------------------------------------
+ *                                           Includes
+ * ------------------------------------------------------------------------------------------------
+ */
+#include "bsp.h"
+
+
+/* ------------------------------------------------------------------------------------------------
+ *                                             Defines
+ * ------------------------------------------------------------------------------------------------
+ */
+
+/* The flash timing generator must run between 257 and 476 kHz. MCLK is
+ * divided down to about 350 kHz. The FN field holds the divider minus one.
+ */
+#define BSP_FLASH_FN            ((uint16_t)((BSP_CLOCK_MHZ) * 1000 / 350))
+
+/* erased flash reads as all ones */
+#define BSP_FLASH_ERASED_BYTE   0xFF
+
+
+/* ------------------------------------------------------------------------------------------------
+ *                                        Prototypes
+ * ------------------------------------------------------------------------------------------------
+ */
+void BSP_FlashEraseSegment(void * pSegment);
+void BSP_FlashWrite(void * pDst, const void * pSrc, uint8_t len);
+
+
+
+/* ************************************************************************************************
+ *                                   Compile Time Integrity Checks
+ * ************************************************************************************************
+ */
+#ifdef BSP_NO_FLASH
+#error "ERROR: The flash driver is disabled.  This file should not be included."
+#endif
+
+/**************************************************************************************************
+ */
+#endif
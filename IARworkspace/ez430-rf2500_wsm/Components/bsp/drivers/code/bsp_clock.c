@@ -0,0 +1,318 @@
+/**************************************************************************************************
+  Filename:       bsp_clock.c
+  Created:        2026-10-19
+  Author:         eZ430-RF2500 project contributors
+
+  Written for this project; not part of the TI SimpliciTI or BSP release.
+**************************************************************************************************/
+
+/* =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *   BSP (Board Support Package)
+ *   MSP430 free-running clock driver code file.
+ * =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+/* ------------------------------------------------------------------------------------------------
+ *                                            Includes
+ * ------------------------------------------------------------------------------------------------
+ */
+#include "bsp_clock.h"
+
+
+/* ------------------------------------------------------------------------------------------------
+ *                                          Local Variables
+ * ------------------------------------------------------------------------------------------------
+ */
+static volatile uint16_t sClockHigh  = 0;
+static volatile uint8_t  sClockAlarm = 0;
+static bspClockCal_t     sClockCal   = {BSP_CLOCK_TICKS_PER_SEC, 0, 0, 0, 0};
+
+
+/**************************************************************************************************
+ * @fn          BSP_InitClock
+ *
+ * @brief       Start Timer B from ACLK in continuous mode. Timer A is left to
+ *              the application and to BSP_Delay().
+ *
+ * @param       none
+ *
+ * @return      none
+ **************************************************************************************************
+ */
+void BSP_InitClock(void)
+{
+  TBCTL   = TBCLR;
+  TBCCTL1 = 0;
+  TBCTL   = TBSSEL_1 + MC_2 + TBIE;   /* ACLK, continuous, overflow interrupt */
+}
+
+
+/**************************************************************************************************
+ * @fn          BSP_ClockTicks
+ *
+ * @brief       Read the 32 bit ACLK tick count. Safe to call from an ISR.
+ *
+ * @param       none
+ *
+ * @return      ticks since BSP_InitClock()
+ **************************************************************************************************
+ */
+uint32_t BSP_ClockTicks(void)
+{
+  bspIState_t intState;
+  uint16_t    hi, lo;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  /* ACLK is asynchronous to MCLK: read until two reads agree */
+  do
+  {
+    lo = TBR;
+  } while (lo != TBR);
+  hi = sClockHigh;
+  /* an overflow not yet counted by the ISR */
+  if ((TBCTL & TBIFG) && !(lo & 0x8000))
+  {
+    hi++;
+  }
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  return ((uint32_t)hi << 16) | lo;
+}
+
+
+/**************************************************************************************************
+ * @fn          BSP_ClockWakeAt
+ *
+ * @brief       Arm a one-shot alarm. The ISR leaves LPM3 when it fires and
+ *              BSP_ClockAlarm() reports it. A time already passed fires at
+ *              once. Must be less than 65536 ticks ahead.
+ *
+ * @param       ticks - tick count at which to wake
+ *
+ * @return      none
+ **************************************************************************************************
+ */
+void BSP_ClockWakeAt(uint32_t ticks)
+{
+  bspIState_t intState;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  TBCCTL1     = 0;
+  sClockAlarm = 0;
+  if ((int32_t)(ticks - BSP_ClockTicks()) < 2)
+  {
+    sClockAlarm = 1;
+  }
+  else
+  {
+    TBCCR1  = (uint16_t)ticks;
+    TBCCTL1 = CCIE;
+  }
+  BSP_EXIT_CRITICAL_SECTION(intState);
+}
+
+
+/**************************************************************************************************
+ * @fn          BSP_ClockAlarm
+ *
+ * @brief       Has the alarm fired? Clears the indication.
+ *
+ * @param       none
+ *
+ * @return      non-zero if the alarm fired since the last call
+ **************************************************************************************************
+ */
+uint8_t BSP_ClockAlarm(void)
+{
+  bspIState_t intState;
+  uint8_t     fired;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  fired       = sClockAlarm;
+  sClockAlarm = 0;
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  return fired;
+}
+
+
+/**************************************************************************************************
+ * @fn          BSP_ClockCalibrate
+ *
+ * @brief       Measure the ACLK rate against SMCLK. Timer A captures ACLK on
+ *              CCI2B while it counts SMCLK, so Timer A is borrowed: its
+ *              setup is saved and restored, and its count is moved on by the
+ *              ACLK ticks spent here. A CCR0 or CCR1 match that would have
+ *              happened meanwhile is left pending. Interrupts are off for
+ *              about BSP_CLOCK_CAL_TICKS ACLK periods.
+ *
+ *              The result is only as good as the DCO calibration, a few
+ *              percent, but the DCO drifts far less with temperature than
+ *              the VLO does.
+ *
+ * @param       none
+ *
+ * @return      ACLK ticks per second, or 0 if ACLK is not running.
+ **************************************************************************************************
+ */
+uint16_t BSP_ClockCalibrate(void)
+{
+  bspIState_t intState;
+  uint16_t    ctl, cctl2, ccr2, tar, last, per, i;
+  uint32_t    t0, cycles = 0, ticks;
+  uint16_t    tps = 0;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  t0    = BSP_ClockTicks();
+  ctl   = TACTL;
+  cctl2 = TACCTL2;
+  ccr2  = TACCR2;
+  do
+  {
+    tar = TAR;
+  } while (tar != TAR);
+
+  TACTL   = TASSEL_2 + MC_2 + TACLR;      /* SMCLK, continuous */
+  TACCTL2 = CM_1 + CCIS_1 + CAP;          /* capture ACLK rising edges */
+
+  /* first edge starts the count, one period is summed per edge after it */
+  last = 0;
+  for (i=0; i<=BSP_CLOCK_CAL_TICKS; i++)
+  {
+    while (!(TACCTL2 & CCIFG))
+    {
+      if ((uint16_t)(TAR - last) > BSP_CLOCK_CAL_TIMEOUT)
+      {
+        break;
+      }
+    }
+    if (!(TACCTL2 & CCIFG))
+    {
+      break;
+    }
+    TACCTL2 &= ~CCIFG;
+    per      = TACCR2 - last;
+    last     = TACCR2;
+    if (i)
+    {
+      cycles += per;
+    }
+  }
+
+  /* give Timer A back */
+  TACTL   = ctl & ~(MC_3 + TAIFG);
+  TACCTL2 = cctl2;
+  TACCR2  = ccr2;
+  ticks   = BSP_ClockTicks() - t0;
+  if (MC_1 == (ctl & MC_3))
+  {
+    uint32_t period = (uint32_t)TACCR0 + 1;
+    uint32_t now    = tar + ticks;
+
+    if ((tar < TACCR1) && (now >= TACCR1))
+    {
+      TACCTL1 |= CCIFG;
+    }
+    if (now >= period)
+    {
+      TACCTL0 |= CCIFG;
+      now %= period;
+    }
+    tar = (uint16_t)now;
+  }
+  else if (MC_2 == (ctl & MC_3))
+  {
+    tar += (uint16_t)ticks;
+  }
+  TAR   = tar;
+  TACTL = ctl;
+
+  if (i > BSP_CLOCK_CAL_TICKS)
+  {
+    tps = (uint16_t)(((uint32_t)(BSP_CLOCK_MHZ * 1000000) * BSP_CLOCK_CAL_TICKS + cycles/2) / cycles);
+
+    if (sClockCal.count)
+    {
+      uint32_t step = (tps > sClockCal.ticksPerSec) ? tps - sClockCal.ticksPerSec
+                                                    : sClockCal.ticksPerSec - tps;
+
+      step = step * 1000000 / sClockCal.ticksPerSec;
+      if (step > sClockCal.stepPpm)
+      {
+        sClockCal.stepPpm = (step > 0xFFFF) ? 0xFFFF : (uint16_t)step;
+      }
+      if (tps < sClockCal.minTicksPerSec)
+      {
+        sClockCal.minTicksPerSec = tps;
+      }
+      if (tps > sClockCal.maxTicksPerSec)
+      {
+        sClockCal.maxTicksPerSec = tps;
+      }
+    }
+    else
+    {
+      sClockCal.minTicksPerSec = sClockCal.maxTicksPerSec = tps;
+    }
+    sClockCal.ticksPerSec = tps;
+    if (sClockCal.count < 0xFFFF)
+    {
+      sClockCal.count++;
+    }
+  }
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  return tps;
+}
+
+
+/**************************************************************************************************
+ * @fn          BSP_ClockCalStats
+ *
+ * @brief       Copy out the calibration results. Before the first calibration
+ *              the rate is the nominal BSP_CLOCK_TICKS_PER_SEC and count is 0.
+ *
+ * @param       stats - where to put them
+ *
+ * @return      none
+ **************************************************************************************************
+ */
+void BSP_ClockCalStats(bspClockCal_t *stats)
+{
+  bspIState_t intState;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  *stats = sClockCal;
+  BSP_EXIT_CRITICAL_SECTION(intState);
+}
+
+
+/**************************************************************************************************
+ * @fn          BSP_ClockIsr
+ *
+ * @brief       Timer B overflow and alarm.
+ *
+ * @param       none
+ *
+ * @return      none
+ **************************************************************************************************
+ */
+BSP_ISR_FUNCTION( BSP_ClockIsr, TIMERB1_VECTOR )
+{
+  switch (TBIV)
+  {
+    case TBIV_TBCCR1:
+      TBCCTL1     = 0;
+      sClockAlarm = 1;
+      __bic_SR_register_on_exit(LPM3_bits);
+      break;
+
+    case TBIV_TBIFG:
+      sClockHigh++;
+      break;
+  }
+}
+
+
+/**************************************************************************************************
+*/
@@ -0,0 +1,91 @@
+/**************************************************************************************************
+  Filename:       bsp_flash.c
+  Created:        2026-10-19
+  Author:         eZ430-RF2500 project contributors
+
+  Written for this project; not part of the TI SimpliciTI or BSP release.
+**************************************************************************************************/
+
+/* =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ *   BSP (Board Support Package)
+ *   MSP430 flash driver code file.
+ * =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+ */
+
+/* ------------------------------------------------------------------------------------------------
+ *                                            Includes
+ * ------------------------------------------------------------------------------------------------
+ */
+#include "bsp_flash.h"
+
+
+/* ------------------------------------------------------------------------------------------------
+ *                                             Macros
+ * ------------------------------------------------------------------------------------------------
+ */
+
+/* Segment A holds calibration data and stays locked: LOCKA is a toggle bit
+ * so it is always written as 0 here.
+ */
+#define BSP_FLASH_UNLOCK()   st( FCTL2 = FWKEY + FSSEL_1 + BSP_FLASH_FN; FCTL3 = FWKEY; )
+#define BSP_FLASH_LOCK()     st( FCTL1 = FWKEY; FCTL3 = FWKEY + LOCK; )
+
+
+/**************************************************************************************************
+ * @fn          BSP_FlashEraseSegment
+ *
+ * @brief       Erase the flash segment holding the address. The CPU is held
+ *              by the flash controller for the duration of the erase (about
+ *              15 ms) so interrupts are serviced late, not lost.
+ *
+ * @param       pSegment - any address within the segment to erase
+ *
+ * @return      none
+ **************************************************************************************************
+ */
+void BSP_FlashEraseSegment(void * pSegment)
+{
+  bspIState_t intState;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  BSP_FLASH_UNLOCK();
+  FCTL1 = FWKEY + ERASE;
+  *((volatile uint8_t *)pSegment) = 0;  /* dummy write starts the erase */
+  BSP_FLASH_LOCK();
+  BSP_EXIT_CRITICAL_SECTION(intState);
+}
+
+
+/**************************************************************************************************
+ * @fn          BSP_FlashWrite
+ *
+ * @brief       Program bytes into erased flash. Interrupts are blocked for one
+ *              byte at a time only.
+ *
+ * @param       pDst - flash address to write
+ *              pSrc - bytes to write
+ *              len  - number of bytes
+ *
+ * @return      none
+ **************************************************************************************************
+ */
+void BSP_FlashWrite(void * pDst, const void * pSrc, uint8_t len)
+{
+  volatile uint8_t * pFlash = (volatile uint8_t *)pDst;
+  const uint8_t *    pByte  = (const uint8_t *)pSrc;
+  bspIState_t        intState;
+
+  while (len--)
+  {
+    BSP_ENTER_CRITICAL_SECTION(intState);
+    BSP_FLASH_UNLOCK();
+    FCTL1 = FWKEY + WRT;
+    *pFlash++ = *pByte++;
+    BSP_FLASH_LOCK();
+    BSP_EXIT_CRITICAL_SECTION(intState);
+  }
+}
+
+
+/**************************************************************************************************
+*/
@@ -76,6 +76,9 @@
 #ifndef SMPL_SECURE
 #define  NWK_HDR_SIZE   3
 #define  NWK_PAYLOAD    MAX_NWK_PAYLOAD
+#elif defined(SMPL_SECURE_MAC_SIZE) && SMPL_SECURE_MAC_SIZE > 0
+#define  NWK_HDR_SIZE   (4+SMPL_SECURE_MAC_SIZE)
+#define  NWK_PAYLOAD    (MAX_NWK_PAYLOAD+4)
 #else
 #define  NWK_HDR_SIZE   6
 #define  NWK_PAYLOAD    (MAX_NWK_PAYLOAD+4)
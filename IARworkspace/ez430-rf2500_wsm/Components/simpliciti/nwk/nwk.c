@@ -45,6 +45,13 @@
 #include "nwk_app.h"
 #include "nwk_globals.h"
 #include "nwk_QMgmt.h"
+#include "nwk_route.h"
+#if defined(NWK_PERSIST)
+#include "nwk_persist.h"
+#endif
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+#include "nwk_ioctl.h"
+#endif
 
 /******************************************************************************
  * MACROS
@@ -96,6 +103,13 @@
 #error ERROR: NWK_FREQ_TBL_SIZE must be > 0
 #endif
 
+/* The frame counters are saved only when links change so restored counters
+ * would lag the peer's and its frames would be rejected.
+ */
+#if defined(NWK_PERSIST) && defined(SMPL_SECURE)
+#error ERROR: NWK_PERSIST cannot be used with SMPL_SECURE
+#endif
+
 /************************* END NETWORK MANIFEST CONSTANT SANITY CHECKS ************************/
 
 /******************************************************************************
@@ -107,7 +121,7 @@
  * detect the upgrade context: any saved values will have a version with a
  * lower number.
  */
-#define  CONNTABLEINFO_STRUCTURE_VERSION   1
+#define  CONNTABLEINFO_STRUCTURE_VERSION   2
 
 #define  SIZEOF_NV_OBJ   sizeof(sPersistInfo)
 
@@ -134,6 +148,11 @@ typedef struct
 #ifdef ACCESS_POINT
         sfInfo_t   sSandFContext;
 #endif
+#if defined(NWK_PERSIST) && !defined(ACCESS_POINT)
+/* Join results kept elsewhere. Copied in when the context is saved. */
+        addr_t     apAddr;
+        uint32_t   linkToken;
+#endif
 /* Connection table entries last... */
         connInfo_t connStruct[SYS_NUM_CONNECTIONS];
 } persistentContext_t;
@@ -148,11 +167,48 @@ typedef struct
  */
 static persistentContext_t sPersistInfo = {CONNTABLEINFO_STRUCTURE_VERSION};
 
+#if defined(NWK_PERSIST)
+/* Next Connection Table entry to check for a restored Link ID. */
+static uint8_t sRestoreIdx = NUM_CONNECTIONS;
+
+#ifdef ACCESS_POINT
+/* The Access Point saves the context ahead of the Connection Table and then
+ * each entry as its own part, so a link or unlink rewrites one entry. Parts
+ * are saved from a scratch copy without the fields that change with every
+ * frame, otherwise every check for changes would find one.
+ */
+#define PERSIST_NUM_PARTS   (SYS_NUM_CONNECTIONS + 1)
+#define PERSIST_HDR_SIZE    (sizeof(persistentContext_t) - sizeof(sPersistInfo.connStruct))
+
+static union
+{
+  connInfo_t entry;
+  uint8_t    hdr[PERSIST_HDR_SIZE];
+} sPersistScratch;
+#else
+/* Saved only when links change so the whole context is one part. This keeps
+ * it small enough for information flash.
+ */
+#define PERSIST_NUM_PARTS   1
+#endif
+
+/* The context must fit twice in the flash region or no save ever succeeds.
+ * sizeof cannot be used in #if, so this fails with a negative array size
+ * instead of an #error. Move the region to main flash with NWK_PERSIST_ADDR,
+ * NWK_PERSIST_SEG_SIZE and NWK_PERSIST_NUM_SEGS (see smpl_config_AP.dat) or
+ * lower NUM_CONNECTIONS.
+ */
+BSP_STATIC_ASSERT(NWK_PERSIST_FITS(sizeof(persistentContext_t), PERSIST_NUM_PARTS));
+#endif  /* NWK_PERSIST */
+
 /******************************************************************************
  * LOCAL FUNCTIONS
  */
 static uint8_t map_lid2idx(linkID_t, uint8_t *);
 static void    initializeConnection(connInfo_t *);
+#if defined(NWK_PERSIST)
+static uint8_t *persistPart(uint8_t, uint8_t *, uint8_t);
+#endif
 
 /******************************************************************************
  * GLOBAL VARIABLES
@@ -185,6 +241,9 @@ smplStatus_t nwk_nwkInit(uint8_t (*f)(linkID_t))
   sPersistInfo.curNextLinkPort  = SMPL_PORT_USER_MAX;
   sPersistInfo.curMaxReplyPort  = PORT_BASE_NUMBER;
   sPersistInfo.nextLinkID       = 1;
+#if defined(NWK_PERSIST)
+  sRestoreIdx                   = NUM_CONNECTIONS;
+#endif
 
   /* initialize globals */
   nwk_globalsInit();
@@ -194,6 +253,11 @@ smplStatus_t nwk_nwkInit(uint8_t (*f)(linkID_t))
 
   /* initialize queue manager */
   nwk_QInit();
+
+#if defined(NWK_ROUTING) && !defined(END_DEVICE)
+  /* initialize route table */
+  nwk_routeInit();
+#endif
 	
   /* initialize each network application. */
   nwk_freqInit();
@@ -282,6 +346,15 @@ static void initializeConnection(connInfo_t *pCInfo)
   pCInfo->connState  =  CONNSTATE_CONNECTED;
   pCInfo->thisLinkID = *locLID;
 
+#ifdef NWK_TDMA
+  /* The uplink slot is the Connection Table index. It is unique for as long
+   * as the entry is in use and is already reserved at Join time when the AP
+   * is a data hub. A device that links to its peer gets the slot from the
+   * Link reply instead.
+   */
+  pCInfo->tdmaSlot = pCInfo - sPersistInfo.connStruct;
+#endif
+
   /* Generate the next Link ID. This isn't foolproof. If the count wraps
    * we can end up with confusing duplicates. We can protect aginst using
    * one that is already in use but we can't protect against a stale Link ID
@@ -317,6 +390,15 @@ static void initializeConnection(connInfo_t *pCInfo)
  */
 void nwk_freeConnection(connInfo_t *pCInfo)
 {
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+  {
+    ioctlDownlink_t dl;
+
+    /* drop anything still waiting for the link */
+    dl.lid = pCInfo->thisLinkID;
+    nwk_downlinkControl(IOCTL_ACT_DELETE, &dl);
+  }
+#endif
 #if NUM_CONNECTIONS > 0
   pCInfo->connState = CONNSTATE_FREE;
 #endif
@@ -608,7 +690,7 @@ uint8_t nwk_isConnectionValid(mrfiPacket_t *frame, linkID_t *lid)
             if (GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_ACK_REQ))
             {
               /* Ack requested. Send ack now */
-              nwk_sendAckReply(frame, ptr->portTx);
+              nwk_sendAckReply(frame, ptr->portTx, ptr->thisLinkID);
             }
             else if (GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_ACK_RPLY))
             {
@@ -621,9 +703,13 @@ uint8_t nwk_isConnectionValid(mrfiPacket_t *frame, linkID_t *lid)
               {
                 ptr->ackTID = 0;
               }
-              /* This causes the frame to be dropped. All ack frames are
-               * dropped.
+              /* This causes the frame to be dropped. Ack frames are dropped
+               * unless they carry a downlink message, which is kept for the
+               * application like any other frame from the peer.
                */
+#if defined(NWK_DOWNLINK)
+              if (MRFI_GET_PAYLOAD_LEN(frame) == F_APP_PAYLOAD_OS)
+#endif
               rc = 0;
             }
           }
@@ -1037,12 +1123,30 @@ void nwk_putNumObjectIntoMsg(void *src, void *dest, uint8_t objSize)
  *                          pointer to the connection context memory.
  *                  - (SET) Pointer to the connection context memory.
  *
+ *                    With NWK_PERSIST, WRITE saves the context to flash now
+ *                    and DELETE erases the saved context and any restored
+ *                    Link IDs not yet handed out. val is not used.
+ *
  * @return   SMPL_SUCCESS
  *           SMPL_BAD_PARAM   Object version or size do not conform on a SET call
  *                            or illegal action specified.
+ *           SMPL_NOMEM       (WRITE) Context does not fit the flash region.
  */
 smplStatus_t nwk_NVObj(ioctlAction_t action, ioctlNVObj_t *val)
 {
+#if defined(NWK_PERSIST)
+  if (IOCTL_ACT_WRITE == action)
+  {
+    return nwk_NVSave() ? SMPL_SUCCESS : SMPL_NOMEM;
+  }
+  if (IOCTL_ACT_DELETE == action)
+  {
+    nwk_persistErase();
+    sRestoreIdx = NUM_CONNECTIONS;
+    return SMPL_SUCCESS;
+  }
+#endif  /* NWK_PERSIST */
+
 #ifdef NVOBJECT_SUPPORT
   smplStatus_t rc = SMPL_SUCCESS;
 
@@ -1067,3 +1171,213 @@ smplStatus_t nwk_NVObj(ioctlAction_t action, ioctlNVObj_t *val)
   return SMPL_BAD_PARAM;
 #endif
 }
+
+#if defined(NWK_PERSIST)
+/******************************************************************************
+ * @fn          nwk_NVRestore
+ *
+ * @brief       Restore the connection context saved in flash. Only a context
+ *              saved by a build with the same CONNTABLEINFO_STRUCTURE_VERSION
+ *              and table size is used. Restored Link IDs are then handed out
+ *              by nwk_NVRestoredLink(). Called once from SMPL_Init() after
+ *              nwk_nwkInit().
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return   Non-zero if a context was restored. On End Devices and Range
+ *           Extenders only if it was saved after a successful Join, so the
+ *           Join can be skipped.
+ */
+uint8_t nwk_NVRestore(void)
+{
+  uint8_t i;
+
+  if (!nwk_persistLoad(PERSIST_NUM_PARTS, persistPart))
+  {
+    return 0;
+  }
+
+  /* nothing is in flight after a reset */
+  for (i=0; i<SYS_NUM_CONNECTIONS; ++i)
+  {
+#ifdef APP_AUTO_ACK
+    sPersistInfo.connStruct[i].ackTID = 0;
+#endif
+    memset(&sPersistInfo.connStruct[i].sigInfo, 0x0, sizeof(rxMetrics_t));
+  }
+  sRestoreIdx = 0;
+
+#if !defined(ACCESS_POINT)
+  nwk_setLinkToken(sPersistInfo.linkToken);
+  nwk_setAPAddress(&sPersistInfo.apAddr);
+
+  return nwk_getAPAddress() ? 1 : 0;
+#else
+  return 1;
+#endif
+}
+
+/******************************************************************************
+ * @fn          nwk_NVSave
+ *
+ * @brief       Save the connection context to flash. Only the parts that
+ *              changed since the last save are written, nothing if none did,
+ *              so an Access Point may call this often. Blocks while flash is
+ *              written so call from the user thread, not from an ISR.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return   Non-zero if flash holds the current context, 0 if it does not
+ *           fit the region.
+ */
+uint8_t nwk_NVSave(void)
+{
+#if !defined(ACCESS_POINT)
+  addr_t const *ap = nwk_getAPAddress();
+
+  if (ap)
+  {
+    memcpy(&sPersistInfo.apAddr, ap, sizeof(addr_t));
+  }
+  else
+  {
+    memset(&sPersistInfo.apAddr, 0x0, sizeof(addr_t));
+  }
+  nwk_getLinkToken(&sPersistInfo.linkToken);
+#endif
+
+  return nwk_persistSave(PERSIST_NUM_PARTS, persistPart);
+}
+
+/******************************************************************************
+ * @fn          nwk_NVRestoredLink
+ *
+ * @brief       Hand out the Link IDs of the restored connections one at a
+ *              time, in Connection Table order. SMPL_Link() returns them
+ *              before it links again so an application that links at
+ *              startup gets its old Link IDs back without any traffic.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return   Next restored Link ID, 0 when there are no more.
+ */
+linkID_t nwk_NVRestoredLink(void)
+{
+  connInfo_t *ptr;
+
+  while (sRestoreIdx < NUM_CONNECTIONS)
+  {
+    ptr = &sPersistInfo.connStruct[sRestoreIdx++];
+    if (CONNSTATE_CONNECTED == ptr->connState)
+    {
+      return ptr->thisLinkID;
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ * @fn          persistPart
+ *
+ * @brief       Part callback for nwk_persistLoad() and nwk_persistSave().
+ *
+ * input parameters
+ * @param   key   - part number
+ * @param   save  - non-zero if the part is about to be saved
+ *
+ * output parameters
+ * @param   len   - length of the part
+ *
+ * @return   Address of the part.
+ */
+static uint8_t *persistPart(uint8_t key, uint8_t *len, uint8_t save)
+{
+#ifdef ACCESS_POINT
+  uint8_t i;
+
+  if (key)
+  {
+    *len = sizeof(connInfo_t);
+    if (!save)
+    {
+      return (uint8_t *)&sPersistInfo.connStruct[key-1];
+    }
+    memcpy(&sPersistScratch.entry, &sPersistInfo.connStruct[key-1], sizeof(connInfo_t));
+#ifdef APP_AUTO_ACK
+    sPersistScratch.entry.ackTID = 0;
+#endif
+    memset(&sPersistScratch.entry.sigInfo, 0x0, sizeof(rxMetrics_t));
+  }
+  else
+  {
+    *len = PERSIST_HDR_SIZE;
+    if (!save)
+    {
+      return (uint8_t *)&sPersistInfo;
+    }
+    memcpy(sPersistScratch.hdr, &sPersistInfo, PERSIST_HDR_SIZE);
+    /* resynced from the first poll after a reset anyway */
+    for (i=0; i<NUM_STORE_AND_FWD_CLIENTS; ++i)
+    {
+      ((persistentContext_t *)&sPersistScratch)->sSandFContext.sfClients[i].lastTID = 0;
+    }
+  }
+
+  return (uint8_t *)&sPersistScratch;
+#else
+  *len = sizeof(sPersistInfo);
+
+  return (uint8_t *)&sPersistInfo;
+#endif
+}
+#endif  /* NWK_PERSIST */
+
+#if defined(SMPL_SECURE) && NWK_KS_BLOCKS > 0
+/******************************************************************************
+ * @fn          nwk_keystreamControl
+ *
+ * @brief       Refill the keystream caches of one or all connections so the
+ *              next frames sent or received on them need no cipher work.
+ *              The broadcast connection does not use a counter and has no
+ *              cache. Call from the application when it is otherwise idle.
+ *
+ * input parameters
+ * @param  action  - IOCTL_ACT_SET
+ * @param  lid     - pointer to Link ID of connection to refill. Null means
+ *                   all connections.
+ *
+ * output parameters
+ *
+ * @return   SMPL_SUCCESS
+ *           SMPL_BAD_PARAM   - action not supported or no such connection
+ */
+smplStatus_t nwk_keystreamControl(ioctlAction_t action, linkID_t *lid)
+{
+  connInfo_t *ptr = sPersistInfo.connStruct;
+  uint8_t     i, found = 0;
+
+  if (IOCTL_ACT_SET != action)
+  {
+    return SMPL_BAD_PARAM;
+  }
+
+  for (i=0; i<NUM_CONNECTIONS; ++i, ++ptr)
+  {
+    if ((CONNSTATE_CONNECTED == ptr->connState) && (!lid || (*lid == ptr->thisLinkID)))
+    {
+      nwk_fillKeystream(&ptr->connTxKs, ptr->connTxCTR);
+      nwk_fillKeystream(&ptr->connRxKs, ptr->connRxCTR);
+      found = 1;
+    }
+  }
+
+  return (found || !lid) ? SMPL_SUCCESS : SMPL_BAD_PARAM;
+}
+#endif  /* SMPL_SECURE && NWK_KS_BLOCKS > 0 */
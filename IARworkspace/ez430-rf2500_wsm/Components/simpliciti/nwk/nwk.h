@@ -95,6 +95,13 @@ typedef struct
 #ifdef SMPL_SECURE
            uint32_t    connTxCTR;
            uint32_t    connRxCTR;
+#if NWK_KS_BLOCKS > 0
+           ksCache_t   connTxKs;
+           ksCache_t   connRxKs;
+#endif
+#endif
+#ifdef NWK_TDMA
+           uint8_t     tdmaSlot;
 #endif
 } connInfo_t;
 
@@ -142,6 +149,14 @@ uint8_t       nwk_allocateLocalRxPort(uint8_t, connInfo_t *);
 uint8_t       nwk_isValidReply(mrfiPacket_t *, uint8_t, uint8_t, uint8_t);
 connInfo_t   *nwk_findPeer(addr_t *, uint8_t);
 smplStatus_t  nwk_NVObj(ioctlAction_t, ioctlNVObj_t *);
+#if defined(NWK_PERSIST)
+uint8_t       nwk_NVRestore(void);
+uint8_t       nwk_NVSave(void);
+linkID_t      nwk_NVRestoredLink(void);
+#endif
+#if defined(SMPL_SECURE) && NWK_KS_BLOCKS > 0
+smplStatus_t  nwk_keystreamControl(ioctlAction_t, linkID_t *);
+#endif
 
 
 uint8_t       nwk_checkAppMsgTID(appPTid_t, appPTid_t);
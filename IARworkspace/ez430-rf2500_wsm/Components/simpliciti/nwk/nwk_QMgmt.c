@@ -71,9 +71,23 @@ static frameInfo_t  *sInFrameQ = NULL;
 
 static frameInfo_t   sOutFrameQ[SIZE_OUTFRAME_Q];
 
+#ifdef ACCESS_POINT
+/* Store-and-forward pool. Each client has its own slots and a FIFO of slot
+ * indices, oldest first, so that frames for sleeping devices never compete
+ * with live traffic in the input queue.
+ */
+static frameInfo_t   sSandFQ[NUM_STORE_AND_FWD_CLIENTS][SIZE_SANDF_Q];
+static uint8_t       sSandFOrder[NUM_STORE_AND_FWD_CLIENTS][SIZE_SANDF_Q];
+static uint8_t       sSandFCount[NUM_STORE_AND_FWD_CLIENTS];
+static uint16_t      sSandFLost;    /* frames cast out or refused */
+#endif  /* ACCESS_POINT */
+
 /******************************************************************************
  * LOCAL FUNCTIONS
  */
+#ifdef ACCESS_POINT
+static void sandFRemove(uint8_t, uint8_t);
+#endif
 
 /******************************************************************************
  * GLOBAL VARIABLES
@@ -100,6 +114,11 @@ void nwk_QInit(void)
   memset(sInFrameQ, 0, sizeof(sInFrameQ));
 #endif  // SIZE_INFRAME_Q > 0
   memset(sOutFrameQ, 0, sizeof(sOutFrameQ));
+#ifdef ACCESS_POINT
+  memset(sSandFQ, 0, sizeof(sSandFQ));
+  memset(sSandFCount, 0, sizeof(sSandFCount));
+  sSandFLost = 0;
+#endif
 }
  
 /******************************************************************************
@@ -415,3 +434,225 @@ frameInfo_t *nwk_getQ(uint8_t which)
   return (INQ == which) ? sInFrameQ : sOutFrameQ;
 }
 
+#ifdef ACCESS_POINT
+/******************************************************************************
+ * @fn          nwk_QSandFPut
+ *
+ * @brief       Copy a frame into the store-and-forward queue of a client.
+ *              If the client's queue is full the oldest frame is cast out
+ *              unless SANDF_DROP_NEWEST is defined, in which case the new
+ *              frame is dropped instead. The caller still owns the source
+ *              frame and must release it. A slot handed out by
+ *              nwk_QSandFGet() is never reused before it is sent, so with
+ *              a queue of one the new frame is refused while the old one
+ *              is on its way. Frames lost either way are counted, see
+ *              nwk_QSandFLost().
+ *
+ *              Called from both interrupt and application context. The
+ *              frame is copied with interrupts off so a poll can never
+ *              find a slot that is only partly written.
+ *
+ * input parameters
+ * @param   loc     - index of the store-and-forward client
+ * @param   pFI     - frame to be stored
+ *
+ * output parameters
+ *
+ * @return      Pointer to the stored frame, or 0 if it was not stored.
+ */
+frameInfo_t *nwk_QSandFPut(uint8_t loc, frameInfo_t *pFI)
+{
+  frameInfo_t *pSlot = 0;
+  uint8_t      i;
+  bspIState_t  intState;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+
+  if (SIZE_SANDF_Q == sSandFCount[loc])
+  {
+    sSandFLost++;
+#ifdef SANDF_DROP_NEWEST
+    BSP_EXIT_CRITICAL_SECTION(intState);
+    return 0;
+#else
+    /* cast out the oldest */
+    sSandFQ[loc][sSandFOrder[loc][0]].fi_usage = FI_AVAILABLE;
+    sandFRemove(loc, 0);
+#endif
+  }
+
+  /* A slot handed out by nwk_QSandFGet() stays busy until it is sent. */
+  for (i=0; i<SIZE_SANDF_Q; ++i)
+  {
+    if (FI_AVAILABLE == sSandFQ[loc][i].fi_usage)
+    {
+      pSlot = &sSandFQ[loc][i];
+      memcpy(&pSlot->mrfiPkt, &pFI->mrfiPkt, sizeof(pSlot->mrfiPkt));
+      pSlot->fi_usage = FI_INUSE_UNTIL_FWD;
+      sSandFOrder[loc][sSandFCount[loc]++] = i;
+      break;
+    }
+  }
+
+  if (!pSlot)
+  {
+    /* every free slot is held by nwk_QSandFGet() */
+    sSandFLost++;
+  }
+
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  return pSlot;
+}
+
+/******************************************************************************
+ * @fn          nwk_QSandFLost
+ *
+ * @brief       Number of store-and-forward frames lost since start-up: cast
+ *              out to make room, or refused because the queue was full or
+ *              its only slot was being forwarded.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return      Frames lost (wraps at 65536).
+ */
+uint16_t nwk_QSandFLost(void)
+{
+  bspIState_t intState;
+  uint16_t    lost;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  lost = sSandFLost;
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  return lost;
+}
+
+/******************************************************************************
+ * @fn          nwk_QSandFGet
+ *
+ * @brief       Take the oldest frame waiting for a client on a port. The
+ *              head of the client's FIFO is checked first so the common case
+ *              does not depend on the number of clients or frames held. The
+ *              frame is released when it is sent.
+ *
+ * input parameters
+ * @param   loc     - index of the store-and-forward client
+ * @param   port    - port requested by the client
+ * @param   pSrc    - source address the client is polling on behalf of
+ *
+ * output parameters
+ *
+ * @return      Pointer to frame if there is one, otherwise 0.
+ */
+frameInfo_t *nwk_QSandFGet(uint8_t loc, uint8_t port, uint8_t *pSrc)
+{
+  frameInfo_t *pFI;
+  uint8_t      i;
+  bspIState_t  intState;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+
+  for (i=0; i<sSandFCount[loc]; ++i)
+  {
+    pFI = &sSandFQ[loc][sSandFOrder[loc][i]];
+    if ((GET_FROM_FRAME(MRFI_P_PAYLOAD(&pFI->mrfiPkt), F_PORT_OS) == port) &&
+        !memcmp(MRFI_P_SRC_ADDR(&pFI->mrfiPkt), pSrc, NET_ADDR_SIZE))
+    {
+      pFI->fi_usage = FI_INUSE_TRANSITION;
+      sandFRemove(loc, i);
+      BSP_EXIT_CRITICAL_SECTION(intState);
+      return pFI;
+    }
+  }
+
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  return 0;
+}
+
+/******************************************************************************
+ * @fn          nwk_QSandFPending
+ *
+ * @brief       Count the frames waiting for a client on a port.
+ *
+ * input parameters
+ * @param   loc     - index of the store-and-forward client
+ * @param   port    - port requested by the client
+ * @param   pSrc    - source address the client is polling on behalf of
+ *
+ * output parameters
+ *
+ * @return      Number of frames waiting.
+ */
+uint8_t nwk_QSandFPending(uint8_t loc, uint8_t port, uint8_t *pSrc)
+{
+  frameInfo_t *pFI;
+  uint8_t      i, num = 0;
+  bspIState_t  intState;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+
+  for (i=0; i<sSandFCount[loc]; ++i)
+  {
+    pFI = &sSandFQ[loc][sSandFOrder[loc][i]];
+    if ((GET_FROM_FRAME(MRFI_P_PAYLOAD(&pFI->mrfiPkt), F_PORT_OS) == port) &&
+        !memcmp(MRFI_P_SRC_ADDR(&pFI->mrfiPkt), pSrc, NET_ADDR_SIZE))
+    {
+      num++;
+    }
+  }
+
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  return num;
+}
+
+/******************************************************************************
+ * @fn          nwk_getSandFQ
+ *
+ * @brief       Get location of the store-and-forward slots of a client. There
+ *              are SIZE_SANDF_Q of them.
+ *
+ * input parameters
+ * @param   loc     - index of the store-and-forward client
+ *
+ * output parameters
+ *
+ * @return      Pointer to the client's frame slots
+ */
+frameInfo_t *nwk_getSandFQ(uint8_t loc)
+{
+  return sSandFQ[loc];
+}
+
+/******************************************************************************
+ * @fn          sandFRemove
+ *
+ * @brief       Remove an entry from a client's FIFO. Must be called with
+ *              interrupts disabled.
+ *
+ * input parameters
+ * @param   loc     - index of the store-and-forward client
+ * @param   pos     - position in the FIFO to remove
+ *
+ * output parameters
+ *
+ * @return      void
+ */
+static void sandFRemove(uint8_t loc, uint8_t pos)
+{
+  uint8_t *pOrder = sSandFOrder[loc];
+
+  sSandFCount[loc]--;
+  for (; pos<sSandFCount[loc]; ++pos)
+  {
+    pOrder[pos] = pOrder[pos+1];
+  }
+
+  return;
+}
+#endif  /* ACCESS_POINT */
+
@@ -43,11 +43,23 @@
 #define  USAGE_NORMAL  1
 #define  USAGE_FWD     2
 
+/* Frames held per store-and-forward client (Access Point only) */
+#ifndef SIZE_SANDF_Q
+#define SIZE_SANDF_Q   2
+#endif
+
 /* prototypes */
 void              nwk_QInit(void);
 frameInfo_t *nwk_QfindSlot(uint8_t);
 void              nwk_QadjustOrder(uint8_t, uint8_t);
 frameInfo_t *nwk_QfindOldest(uint8_t, rcvContext_t *, uint8_t);
 frameInfo_t *nwk_getQ(uint8_t);
+#ifdef ACCESS_POINT
+frameInfo_t *nwk_QSandFPut(uint8_t, frameInfo_t *);
+frameInfo_t *nwk_QSandFGet(uint8_t, uint8_t, uint8_t *);
+uint8_t      nwk_QSandFPending(uint8_t, uint8_t, uint8_t *);
+frameInfo_t *nwk_getSandFQ(uint8_t);
+uint16_t     nwk_QSandFLost(void);
+#endif
 
 #endif  /* NWK_QMGMT_H */
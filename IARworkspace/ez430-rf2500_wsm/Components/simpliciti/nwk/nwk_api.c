@@ -49,6 +49,7 @@
 #include "mrfi.h"
 #include "nwk_globals.h"
 #include "nwk_freq.h"
+#include "nwk_QMgmt.h"
 
 /******************************************************************************
  * MACROS
@@ -73,19 +74,63 @@
 #define LINKLISTEN_POLL_PERIOD_MS         (10)
 #define LINKLISTEN_POLL_COUNT             ( (LINKLISTEN_MILLISECONDS_2_WAIT) / (LINKLISTEN_POLL_PERIOD_MS) )
 
+/* Join and Link retry schedule. Applications retry SMPL_Init() and SMPL_Link()
+ * on a fixed period, so devices powered up together retry together. With
+ * NWK_RETRY_MAX_EXP each failure doubles (up to the cap) the window from
+ * which a random number of calls to skip is drawn. NWK_RETRY_JITTER_MS is
+ * only held here for IOCTL_OBJ_RETRY: the stack has no timer to sleep on, so
+ * the application waits the random time in low power before each retry.
+ */
+#if NWK_RETRY_MAX_EXP > 0 || NWK_RETRY_JITTER_MS > 0
+#define NWK_RETRY
+#if !defined(NWK_RETRY_MAX_EXP)
+#define NWK_RETRY_MAX_EXP    0
+#elif NWK_RETRY_MAX_EXP > 8
+#error ERROR: NWK_RETRY_MAX_EXP must be 8 or less.
+#endif
+#if !defined(NWK_RETRY_JITTER_MS)
+#define NWK_RETRY_JITTER_MS  0
+#endif
+#endif
+
 /******************************************************************************
  * TYPEDEFS
  */
 
+#if defined(NWK_RETRY)
+typedef struct
+{
+  uint8_t  fails;   /* failed attempts in a row */
+  uint8_t  skip;    /* calls left to skip before the next attempt */
+} retryState_t;
+#endif
+
 /******************************************************************************
  * LOCAL VARIABLES
  */
 static uint8_t sInit_done = 0;
 
+#if defined(NWK_PERSIST)
+/* Context restored from flash at initialization */
+static uint8_t sRestored = 0;
+#endif
+
+#if defined(NWK_RETRY)
+static retryState_t sJoinRetry = {0};
+static retryState_t sLinkRetry = {0};
+static uint8_t      sRetryMaxExp   = NWK_RETRY_MAX_EXP;
+static uint16_t     sRetryJitterMs = NWK_RETRY_JITTER_MS;
+#endif
+
 /******************************************************************************
  * LOCAL FUNCTIONS
  */
 static uint8_t ioctlPreInitAccessIsOK(ioctlObject_t);
+#if defined(NWK_RETRY)
+static uint8_t      retryIsDue(retryState_t *);
+static void         retryResult(retryState_t *, smplStatus_t);
+static smplStatus_t retryControl(ioctlAction_t, ioctlRetry_t *);
+#endif
 
 /******************************************************************************
  * GLOBAL VARIABLES
@@ -113,9 +158,16 @@ static uint8_t ioctlPreInitAccessIsOK(ioctlObject_t);
  *
  * @return   Status of operation:
  *             SMPL_SUCCESS
- *             SMPL_NO_JOIN     No Join reply. AP possibly not yet up.
+ *             SMPL_NO_JOIN     No Join reply. AP possibly not yet up. Also
+ *                              returned without sending when the retry
+ *                              schedule skips this call.
  *             SMPL_NO_CHANNEL  Only if Frequency Agility enabled. Channel scan
  *                              failed. AP possibly not yet up.
+ *
+ *           With NWK_PERSIST a device whose context was saved after a Join
+ *           restores it and returns SMPL_SUCCESS without joining again.
+ *           Once the application deletes the saved context (IOCTL_OBJ_NVOBJ,
+ *           IOCTL_ACT_DELETE) a further call joins.
  */
 smplStatus_t SMPL_Init(uint8_t (*f)(linkID_t))
 {
@@ -132,6 +184,10 @@ smplStatus_t SMPL_Init(uint8_t (*f)(linkID_t))
       return rc;
     }
 
+#if defined(NWK_PERSIST)
+    sRestored = nwk_NVRestore();
+#endif
+
     MRFI_WakeUp();
 #if defined( FREQUENCY_AGILITY )
     {
@@ -155,9 +211,34 @@ smplStatus_t SMPL_Init(uint8_t (*f)(linkID_t))
   }
   sInit_done = 1;
 
+#if defined(NWK_PERSIST) && !defined(ACCESS_POINT)
+  if (sRestored)
+  {
+    return SMPL_SUCCESS;
+  }
+#endif
+
+#if defined(NWK_RETRY) && !defined(ACCESS_POINT)
+  if (!retryIsDue(&sJoinRetry))
+  {
+    return SMPL_NO_JOIN;
+  }
+#endif
+
   /* Join. if no AP or Join fails that status is returned. */
   rc = nwk_join();
 
+#if defined(NWK_RETRY) && !defined(ACCESS_POINT)
+  retryResult(&sJoinRetry, rc);
+#endif
+
+#if defined(NWK_PERSIST) && !defined(ACCESS_POINT)
+  if (SMPL_SUCCESS == rc)
+  {
+    nwk_NVSave();
+  }
+#endif
+
   return rc;
 }
 
@@ -216,6 +297,10 @@ smplStatus_t SMPL_LinkListen(linkID_t *linkID)
 
   *linkID = locLinkID;
 
+#if defined(NWK_PERSIST)
+  nwk_NVSave();
+#endif
+
   return SMPL_SUCCESS;
 }
 
@@ -336,7 +421,11 @@ smplStatus_t SMPL_SendOpt(linkID_t lid, uint8_t *msg, uint8_t len, txOpt_t optio
     {
       pUL = &pCInfo->connTxCTR;
     }
+#if NWK_KS_BLOCKS > 0
+    nwk_setSecureConnFrame(&pFrameInfo->mrfiPkt, len, pUL, pUL ? &pCInfo->connTxKs : NULL);
+#else
     nwk_setSecureFrame(&pFrameInfo->mrfiPkt, len, pUL);
+#endif
   }
 #endif  /* SMPL_SECURE */
 
@@ -346,8 +435,9 @@ smplStatus_t SMPL_SendOpt(linkID_t lid, uint8_t *msg, uint8_t len, txOpt_t optio
    */
   if (nwk_isSandFClient(MRFI_P_DST_ADDR(&pFrameInfo->mrfiPkt), &loc))
   {
-     pFrameInfo->fi_usage = FI_INUSE_UNTIL_FWD;
-     return SMPL_SUCCESS;
+     rc = nwk_QSandFPut(loc, pFrameInfo) ? SMPL_SUCCESS : SMPL_NOMEM;
+     pFrameInfo->fi_usage = FI_AVAILABLE;
+     return rc;
   }
   else
 #endif  /* ACCESS_POINT */
@@ -461,9 +551,18 @@ smplStatus_t SMPL_ReceiveWithAddr(linkID_t lid, uint8_t *msg, uint8_t *len, addr
     uint8_t     scannedB4 = 0;
 #endif
 
+    /* Frames left over from an earlier batched poll reply are delivered
+     * without going back to the AP.
+     */
+    if ((SMPL_SUCCESS == nwk_retrieveFrame(&rcv, msg, len, 0, 0)) && *len)
+    {
+      return SMPL_SUCCESS;
+    }
+
     do
     {
       uint8_t radioState = MRFI_GetRadioState();
+      uint8_t tries;
 
       /* I'm polling. Do the poll to stimulate the sending of a frame. If the
        * frame has application length of 0 it means there were no frames.  If
@@ -480,14 +579,26 @@ smplStatus_t SMPL_ReceiveWithAddr(linkID_t lid, uint8_t *msg, uint8_t *len, addr
       numChans--;
 
       /* Wait until there's a frame. if the len is 0 then return SMPL_NO_FRAME
-       * to the caller. In the poll case the AP always sends something.
+       * to the caller. In the poll case the AP always sends something. The AP
+       * may stream a batch of frames so hold Rx open until it closes the batch
+       * with the poll done frame. Each frame received cuts a delay short. A
+       * legacy AP sends a single frame, so only one delay is waited for it.
        */
       NWK_CHECK_FOR_SETRX(radioState);
-      NWK_REPLY_DELAY();
+      for (tries=0; !nwk_pollDone(0) && (tries < nwk_pollWaits()); ++tries)
+      {
+        NWK_REPLY_DELAY();
+      }
       NWK_CHECK_FOR_RESTORE_STATE(radioState);
 
-      /* TODO: deal with pending */
       rc = nwk_retrieveFrame(&rcv, msg, len, 0, 0);
+      nwk_pollReplied(SMPL_SUCCESS == rc);
+      if ((SMPL_SUCCESS != rc) && nwk_pollDone(0))
+      {
+        /* AP answered but had nothing for us */
+        rc   = SMPL_SUCCESS;
+        *len = 0;
+      }
 
 #if defined(FREQUENCY_AGILITY)
       if (SMPL_SUCCESS == rc)
@@ -540,12 +651,47 @@ smplStatus_t SMPL_ReceiveWithAddr(linkID_t lid, uint8_t *msg, uint8_t *len, addr
  *             SMPL_NOMEM         No room to allocate local Rx port, no more
  *                                room in Connection Table, or no room in
  *                                output frame queue.
- *             SMPL_NO_LINK       No reply frame during wait window.
+ *             SMPL_NO_LINK       No reply frame during wait window. Also
+ *                                returned without sending when the retry
+ *                                schedule skips this call.
  *             SMPL_TX_CCA_FAIL   Could not send Link frame.
+ *
+ *           With NWK_PERSIST the Link IDs of connections restored from flash
+ *           are returned first, one per call, without sending anything.
  */
 smplStatus_t SMPL_Link(linkID_t *lid)
 {
-  return nwk_link(lid);
+  smplStatus_t rc;
+
+#if defined(NWK_PERSIST)
+  linkID_t restored = nwk_NVRestoredLink();
+
+  if (restored)
+  {
+    *lid = restored;
+    return SMPL_SUCCESS;
+  }
+#endif
+
+#if defined(NWK_RETRY)
+  if (!retryIsDue(&sLinkRetry))
+  {
+    return SMPL_NO_LINK;
+  }
+  rc = nwk_link(lid);
+  retryResult(&sLinkRetry, rc);
+#else
+  rc = nwk_link(lid);
+#endif  /* NWK_RETRY */
+
+#if defined(NWK_PERSIST)
+  if (SMPL_SUCCESS == rc)
+  {
+    nwk_NVSave();
+  }
+#endif
+
+  return rc;
 }
 
 #if defined(EXTENDED_API)
@@ -570,7 +716,16 @@ smplStatus_t SMPL_Link(linkID_t *lid)
  */
 smplStatus_t SMPL_Unlink(linkID_t lid)
 {
+#if defined(NWK_PERSIST)
+  smplStatus_t rc = nwk_unlink(lid);
+
+  /* the local entry is freed whatever the peer said */
+  nwk_NVSave();
+
+  return rc;
+#else
   return nwk_unlink(lid);
+#endif
 }
 
 /**************************************************************************************
@@ -752,6 +907,13 @@ smplStatus_t SMPL_Ioctl(ioctlObject_t object, ioctlAction_t action, void *val)
 
     case IOCTL_OBJ_NVOBJ:
       rc = nwk_NVObj(action, (ioctlNVObj_t *)val);
+#if defined(NWK_PERSIST)
+      /* Saved context is gone. The next SMPL_Init() joins again. */
+      if ((IOCTL_ACT_DELETE == action) && (SMPL_SUCCESS == rc))
+      {
+        sRestored = 0;
+      }
+#endif
       break;
 #endif  /* EXTENDED_API */
 
@@ -789,6 +951,42 @@ smplStatus_t SMPL_Ioctl(ioctlObject_t object, ioctlAction_t action, void *val)
       rc = nwk_radioControl(action, val);
       break;
 
+#if defined(NWK_TDMA)
+    case IOCTL_OBJ_TDMA:
+      rc = nwk_tdmaControl(action, (ioctlTDMA_t *)val);
+      break;
+#endif
+
+#if defined(NWK_TIME_SYNC)
+    case IOCTL_OBJ_TIME:
+      rc = nwk_timeControl(action, (ioctlTime_t *)val);
+      break;
+#endif
+
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+    case IOCTL_OBJ_DOWNLINK:
+      rc = nwk_downlinkControl(action, (ioctlDownlink_t *)val);
+      break;
+#endif
+
+#if SIZE_INFRAME_Q > 0 && NWK_DUP_CACHE_SIZE > 0
+    case IOCTL_OBJ_DUPCACHE:
+      rc = nwk_dupCacheControl(action, (ioctlDupCache_t *)val);
+      break;
+#endif
+
+#if defined(SMPL_SECURE) && NWK_KS_BLOCKS > 0
+    case IOCTL_OBJ_KEYSTREAM:
+      rc = nwk_keystreamControl(action, (linkID_t *)val);
+      break;
+#endif
+
+#if defined(NWK_RETRY)
+    case IOCTL_OBJ_RETRY:
+      rc = retryControl(action, (ioctlRetry_t *)val);
+      break;
+#endif
+
 #if defined(ACCESS_POINT)
     case IOCTL_OBJ_AP_JOIN:
       rc = nwk_joinContext(action);
@@ -853,13 +1051,20 @@ static uint8_t ioctlPreInitAccessIsOK(ioctlObject_t object)
 {
   uint8_t rc;
 
-  /* Currently the only legal pre-init accesses are the address and
-   * the token objects.
+  /* Currently the only legal pre-init accesses are the address, the
+   * token, the retry schedule and the network time objects. The time can be
+   * calibrated before the first Join.
    */
   switch (object)
   {
     case IOCTL_OBJ_ADDR:
     case IOCTL_OBJ_TOKEN:
+#if defined(NWK_RETRY)
+    case IOCTL_OBJ_RETRY:
+#endif
+#if defined(NWK_TIME_SYNC)
+    case IOCTL_OBJ_TIME:
+#endif
       rc = 1;   /* legal */
       break;
 
@@ -870,3 +1075,108 @@ static uint8_t ioctlPreInitAccessIsOK(ioctlObject_t object)
 
   return rc;
 }
+
+#if defined(NWK_RETRY)
+/******************************************************************************
+ * @fn          retryIsDue
+ *
+ * @brief       Decide whether a Join or Link call should go on the air. A call
+ *              that the schedule skips returns at once without waiting.
+ *
+ * input parameters
+ * @param   r      - retry state of the operation
+ *
+ * output parameters
+ *
+ * @return   Non-zero if the attempt should be made, 0 if the call is skipped.
+ */
+static uint8_t retryIsDue(retryState_t *r)
+{
+  if (r->skip)
+  {
+    r->skip--;
+    return 0;
+  }
+
+  return 1;
+}
+
+/******************************************************************************
+ * @fn          retryResult
+ *
+ * @brief       Update the retry state after an attempt. After the n-th failure
+ *              in a row a random number of calls from 0 to 2^min(n,maxExp)-1
+ *              is skipped. Success resets the schedule.
+ *
+ * input parameters
+ * @param   r      - retry state of the operation
+ * @param   rc     - status of the attempt
+ *
+ * output parameters
+ *
+ * @return   void
+ */
+static void retryResult(retryState_t *r, smplStatus_t rc)
+{
+  uint8_t exp;
+
+  if (SMPL_SUCCESS == rc)
+  {
+    r->fails = 0;
+    r->skip  = 0;
+    return;
+  }
+
+  if (r->fails < 0xFF)
+  {
+    r->fails++;
+  }
+  exp     = (r->fails < sRetryMaxExp) ? r->fails : sRetryMaxExp;
+  r->skip = MRFI_RandomByte() & (uint8_t)((1 << exp) - 1);
+
+  return;
+}
+
+/******************************************************************************
+ * @fn          retryControl
+ *
+ * @brief       Set or get the Join/Link retry schedule. Setting it restarts
+ *              both schedules so the next call makes an attempt.
+ *
+ * input parameters
+ * @param   action   - IOCTL_ACT_SET or IOCTL_ACT_GET
+ * @param   val      - policy to set, or where to put policy and failure counts
+ *
+ * output parameters
+ *
+ * @return   SMPL_SUCCESS, or SMPL_BAD_PARAM for another action or a maxExp
+ *           above 8.
+ */
+static smplStatus_t retryControl(ioctlAction_t action, ioctlRetry_t *val)
+{
+  bspIState_t intState;
+
+  if (IOCTL_ACT_GET == action)
+  {
+    val->maxExp    = sRetryMaxExp;
+    val->jitterMs  = sRetryJitterMs;
+    val->joinFails = sJoinRetry.fails;
+    val->linkFails = sLinkRetry.fails;
+    return SMPL_SUCCESS;
+  }
+
+  if ((IOCTL_ACT_SET != action) || (val->maxExp > 8))
+  {
+    return SMPL_BAD_PARAM;
+  }
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  sRetryMaxExp    = val->maxExp;
+  sRetryJitterMs  = val->jitterMs;
+  sJoinRetry.skip = 0;
+  sLinkRetry.skip = 0;
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  return SMPL_SUCCESS;
+}
+#endif  /* NWK_RETRY */
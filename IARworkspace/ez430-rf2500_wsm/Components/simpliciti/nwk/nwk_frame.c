@@ -49,6 +49,10 @@
 #include "nwk_globals.h"
 #include "nwk_mgmt.h"
 #include "nwk_security.h"
+#include "nwk_route.h"
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+#include "nwk_ioctl.h"
+#endif
 
 /******************************************************************************
  * MACROS
@@ -62,6 +66,16 @@
  * TYPEDEFS
  */
 
+#if SIZE_INFRAME_Q > 0 && NWK_DUP_CACHE_SIZE > 0
+typedef struct
+{
+  uint8_t   addr[NET_ADDR_SIZE];
+  uint8_t   port;        /* port with ack reply type in the top bit */
+  uint8_t   tid;
+  uint16_t  stamp;       /* value of sDupClock when last seen. 0 is empty */
+} dupEntry_t;
+#endif
+
 /******************************************************************************
  * LOCAL VARIABLES
  */
@@ -83,6 +97,13 @@ static addr_t const *sMyAddr = NULL;
 
 static uint8_t  sMyRxType = 0, sMyTxType = 0;
 
+#if SIZE_INFRAME_Q > 0 && NWK_DUP_CACHE_SIZE > 0
+static dupEntry_t  sDupCache[NWK_DUP_CACHE_SIZE];
+static uint16_t    sDupClock  = 0;
+static uint16_t    sDupHits   = 0;
+static uint16_t    sDupMisses = 0;
+#endif
+
 #if !defined(RX_POLLS)
 static uint8_t  (*spCallback)(linkID_t) = NULL;
 #endif
@@ -97,9 +118,12 @@ static void  dispatchFrame(frameInfo_t *);
 #if !defined(END_DEVICE)
 #if defined(ACCESS_POINT)
 /* only Access Points need to worry about duplicate S&F frames */
-uint8_t  isDupSandFFrame(mrfiPacket_t *);
+uint8_t  isDupSandFFrame(mrfiPacket_t *, uint8_t);
 #endif /* ACCESS_POINT */
 #endif  /* !END_DEVICE */
+#if NWK_DUP_CACHE_SIZE > 0
+static uint8_t isDupFrame(mrfiPacket_t *);
+#endif
 #endif  /* SIZE_INFRAME_Q > 0 */
 
 /******************************************************************************
@@ -352,7 +376,11 @@ smplStatus_t nwk_retrieveFrame(rcvContext_t *rcv, uint8_t *msg, uint8_t *len, ad
             pctr = NULL;
           }
 #endif
+#if NWK_KS_BLOCKS > 0
+          if (nwk_getSecureConnFrame(&fPtr->mrfiPkt, len, pctr, pctr ? &pCInfo->connRxKs : NULL))
+#else
           if (nwk_getSecureFrame(&fPtr->mrfiPkt, len, pctr))
+#endif
           {
             if (pctr)
             {
@@ -452,6 +480,22 @@ static void dispatchFrame(frameInfo_t *fiPtr)
   }
 #endif  /* SMPL_SECURE */
 
+#if defined(NWK_ROUTING) && !defined(END_DEVICE)
+  /* remember how far away the sender is */
+  nwk_routeLearn(&fiPtr->mrfiPkt);
+#endif
+
+#if NWK_DUP_CACHE_SIZE > 0
+  /* Drop copies of a frame we have already handled. They show up when more
+   * than one device replays the same frame.
+   */
+  if (isDupFrame(&fiPtr->mrfiPkt))
+  {
+    fiPtr->fi_usage = FI_AVAILABLE;
+    return;
+  }
+#endif
+
   /* If it's a network application port dispatch to service routine. Dispose
    * of frame depending on return code.
    */
@@ -589,7 +633,7 @@ static void dispatchFrame(frameInfo_t *fiPtr)
     /* Don't bother if it is a duplicate frame or if it's a forwarded frame
      * echoed back from an RE.
      */
-    if (!isDupSandFFrame(&fiPtr->mrfiPkt) &&
+    if (!isDupSandFFrame(&fiPtr->mrfiPkt, loc) &&
         !(GET_FROM_FRAME(MRFI_P_PAYLOAD(&fiPtr->mrfiPkt), F_FWD_FRAME))
        )
     {
@@ -597,12 +641,12 @@ static void dispatchFrame(frameInfo_t *fiPtr)
       /* Make sure ack request bit is off. Sender will have gone away. */
       PUT_INTO_FRAME(MRFI_P_PAYLOAD(&fiPtr->mrfiPkt), F_ACK_REQ, 0);
 #endif
-      fiPtr->fi_usage = FI_INUSE_UNTIL_FWD;
-    }
-    else
-    {
-      fiPtr->fi_usage = FI_AVAILABLE;
+      /* Move it to the client's store-and-forward queue. If there is no
+       * room the frame is lost; nwk_QSandFPut() counts it.
+       */
+      nwk_QSandFPut(loc, fiPtr);
     }
+    fiPtr->fi_usage = FI_AVAILABLE;
   }
   else if (GET_FROM_FRAME(MRFI_P_PAYLOAD(&fiPtr->mrfiPkt), F_TX_DEVICE) == F_TX_DEVICE_AP)
   {
@@ -650,6 +694,13 @@ smplStatus_t nwk_sendFrame(frameInfo_t *pFrameInfo, uint8_t txOption)
   /* set the type of device sending the frame in the header */
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(&pFrameInfo->mrfiPkt), F_TX_DEVICE, sMyTxType);
 
+#if defined(NWK_ROUTING) && !defined(END_DEVICE)
+  /* don't let the frame travel further than the target is known to be.
+   * this covers replays as well as our own frames.
+   */
+  nwk_routeTrim(&pFrameInfo->mrfiPkt);
+#endif
+
   if (MRFI_TX_RESULT_SUCCESS == MRFI_Transmit(&pFrameInfo->mrfiPkt, txOption))
   {
     rc = SMPL_SUCCESS;
@@ -691,20 +742,23 @@ uint8_t nwk_getMyRxType(void)
 /******************************************************************************
  * @fn          nwk_sendAckReply
  *
- * @brief       Send an acknowledgement reply frame.
+ * @brief       Send an acknowledgement reply frame. With NWK_DOWNLINK an AP
+ *              puts any message waiting for the link in the reply.
  *
  * input parameters
  * @param   frame   - pointer to frame with ack request.
  * @param   port    - port on whcih reply expected.
+ * @param   lid     - Link ID of the connection the frame arrived on.
  *
  * output parameters
  *
  * @return      void
  */
-void nwk_sendAckReply(mrfiPacket_t *frame, uint8_t port)
+void nwk_sendAckReply(mrfiPacket_t *frame, uint8_t port, linkID_t lid)
 {
   mrfiPacket_t dFrame;
   uint8_t      tid = GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_TRACTID_OS);
+  uint8_t      len = 0;
 
   /* set the type of device sending the frame in the header */
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(&dFrame), F_TX_DEVICE, sMyTxType);
@@ -722,13 +776,19 @@ void nwk_sendAckReply(mrfiPacket_t *frame, uint8_t port)
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(&dFrame), F_PORT_OS, port);
 
   /* frame length... */
-  MRFI_SET_PAYLOAD_LEN(&dFrame,F_APP_PAYLOAD_OS);
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+  len = nwk_getDownlink(lid, MRFI_P_PAYLOAD(&dFrame)+F_APP_PAYLOAD_OS);
+#endif
+  MRFI_SET_PAYLOAD_LEN(&dFrame,F_APP_PAYLOAD_OS+len);
 
   /* transaction ID taken from source frame */
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(&dFrame), F_TRACTID_OS, tid);
 
   /* hop count... */
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(&dFrame), F_HOP_COUNT, MAX_HOPS);
+#if defined(NWK_ROUTING) && !defined(END_DEVICE)
+  nwk_routeTrim(&dFrame);
+#endif
 
   /* set ACK field */
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(&dFrame), F_ACK_RPLY, F_ACK_RPLY_TYPE);
@@ -742,7 +802,15 @@ void nwk_sendAckReply(mrfiPacket_t *frame, uint8_t port)
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(&dFrame), F_ENCRYPT_OS, 0);
 #else
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(&dFrame), F_ENCRYPT_OS, F_ENCRYPT_OS_MSK);
-  nwk_setSecureFrame(&dFrame, 0, 0);
+  if (len)
+  {
+    /* an application message: the peer deciphers it with the link counter */
+    nwk_setSecureFrame(&dFrame, len, &nwk_getConnInfo(lid)->connTxCTR);
+  }
+  else
+  {
+    nwk_setSecureFrame(&dFrame, 0, 0);
+  }
 #endif
 
   MRFI_Transmit(&dFrame, MRFI_TX_TYPE_FORCED);
@@ -800,7 +868,9 @@ void nwk_replayFrame(frameInfo_t *pFrameInfo)
  * @fn          nwk_getSandFFrame
  *
  * @brief       Get any frame waiting for the client on the port supplied in
- *              the frame payload.
+ *              the frame payload. Frames from other devices and from this
+ *              AP itself are both held in the client's store-and-forward
+ *              queue so there is a single place to look.
  *              TODO: support returning NWK application frames always. the
  *              port requested in the call should be an user application port.
  *              NWK app ports will never be in the called frame.
@@ -808,44 +878,18 @@ void nwk_replayFrame(frameInfo_t *pFrameInfo)
  *
  * input parameters
  * @param   frame   - pointer to frame in question
+ * @param   osPort  - offset of the requested port in the poll payload
+ * @param   loc     - index of the polling store-and-forward client
  *
  * output parameters
  *
  * @return      pointer to frame if there is one, otherwise 0.
  */
-frameInfo_t *nwk_getSandFFrame(mrfiPacket_t *frame, uint8_t osPort)
+frameInfo_t *nwk_getSandFFrame(mrfiPacket_t *frame, uint8_t osPort, uint8_t loc)
 {
-  uint8_t        i, port = *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+osPort);
-  frameInfo_t *fiPtr;
-  rcvContext_t rcv;
+  uint8_t *pMsg = MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS;
 
-  rcv.type  = RCV_RAW_POLL_FRAME;
-  rcv.t.pkt = frame;
-  /* check the input queue for messages sent by others. */
-  if (fiPtr=nwk_QfindOldest(INQ, &rcv, USAGE_FWD))
-  {
-    return fiPtr;
-  }
-
-  /* Check the output queue to see if we ourselves need to send anything.
-   * TODO: use the cast-out scheme for output queue so this routine finds
-   * the oldest in either queue.
-   */
-  fiPtr = nwk_getQ(OUTQ);
-  for (i=0; i<SIZE_OUTFRAME_Q; ++i, fiPtr++)
-  {
-    if (FI_INUSE_UNTIL_FWD == fiPtr->fi_usage)
-    {
-      if (!memcmp(MRFI_P_DST_ADDR(&fiPtr->mrfiPkt), MRFI_P_SRC_ADDR(frame), NET_ADDR_SIZE))
-      {
-        if (GET_FROM_FRAME(MRFI_P_PAYLOAD(&fiPtr->mrfiPkt), F_PORT_OS) == port)
-        {
-          return fiPtr;
-        }
-      }
-    }
-  }
-  return 0;
+  return nwk_QSandFGet(loc, pMsg[osPort], pMsg+M_POLL_ADDR_OS);
 }
 
 /******************************************************************************
@@ -913,19 +957,20 @@ void nwk_SendEmptyPollRspFrame(mrfiPacket_t *frame)
  *
  * input parameters
  * @param   frame   - pointer to frame in question
+ * @param   loc     - index of the destination store-and-forward client
  *
  * output parameters
  *
  * @return      Returns 1 if the frame is a duplicate, otherwise 0.
  */
-uint8_t  isDupSandFFrame(mrfiPacket_t *frame)
+uint8_t  isDupSandFFrame(mrfiPacket_t *frame, uint8_t loc)
 {
   uint8_t      i, plLen = MRFI_GET_PAYLOAD_LEN(frame);
   frameInfo_t *fiPtr;
 
-  /* check the input queue for duplicate S&F frame. */
-  fiPtr = nwk_getQ(INQ);
-  for (i=0; i<SIZE_INFRAME_Q; ++i, fiPtr++)
+  /* check the client's store-and-forward queue for duplicate frame. */
+  fiPtr = nwk_getSandFQ(loc);
+  for (i=0; i<SIZE_SANDF_Q; ++i, fiPtr++)
   {
     if (FI_INUSE_UNTIL_FWD == fiPtr->fi_usage)
     {
@@ -946,3 +991,125 @@ uint8_t  isDupSandFFrame(mrfiPacket_t *frame)
 #endif  /* ACCESS_POINT */
 
 #endif  /* !END_DEVICE */
+
+#if SIZE_INFRAME_Q > 0 && NWK_DUP_CACHE_SIZE > 0
+/******************************************************************************
+ * @fn          isDupFrame
+ *
+ * @brief       Look the frame up in the duplicate cache and remember it if
+ *              it is new. The cache clock advances once per received frame.
+ *              Called in the Rx ISR thread.
+ *
+ * input parameters
+ * @param   frame   - pointer to received frame
+ *
+ * output parameters
+ *
+ * @return      Returns 1 if the frame was seen within the window, otherwise 0.
+ */
+static uint8_t isDupFrame(mrfiPacket_t *frame)
+{
+  uint8_t    *src  = MRFI_P_SRC_ADDR(frame);
+  uint8_t     tid  = GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_TRACTID_OS);
+  uint8_t     port = GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_PORT_OS);
+  uint8_t     hash = tid, i;
+  dupEntry_t *bucket, *victim;
+
+  /* an ack reply carries the TID of the frame it acknowledges */
+  if (GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_ACK_RPLY))
+  {
+    port |= 0x80;
+  }
+
+  for (i=0; i<NET_ADDR_SIZE; ++i)
+  {
+    hash = (hash << 1 | hash >> 7) ^ src[i];
+  }
+  hash ^= port;
+
+  /* 0 marks an empty entry so the clock skips it */
+  if (!++sDupClock)
+  {
+    sDupClock = 1;
+  }
+
+  bucket = &sDupCache[(hash % (NWK_DUP_CACHE_SIZE / NWK_DUP_CACHE_WAYS)) * NWK_DUP_CACHE_WAYS];
+  victim = bucket;
+  for (i=0; i<NWK_DUP_CACHE_WAYS; ++i, ++bucket)
+  {
+    if (bucket->stamp                &&
+        (tid  == bucket->tid)        &&
+        (port == bucket->port)       &&
+        ((uint16_t)(sDupClock - bucket->stamp) <= NWK_DUP_WINDOW) &&
+        !memcmp(src, bucket->addr, NET_ADDR_SIZE))
+    {
+      bucket->stamp = sDupClock;
+      sDupHits++;
+      return 1;
+    }
+    /* least recently used entry goes. empty entries are oldest of all. */
+    if (!victim->stamp)
+    {
+      continue;
+    }
+    if (!bucket->stamp || ((uint16_t)(sDupClock - bucket->stamp) > (uint16_t)(sDupClock - victim->stamp)))
+    {
+      victim = bucket;
+    }
+  }
+
+  memcpy(victim->addr, src, NET_ADDR_SIZE);
+  victim->tid   = tid;
+  victim->port  = port;
+  victim->stamp = sDupClock;
+  sDupMisses++;
+
+  return 0;
+}
+
+/******************************************************************************
+ * @fn          nwk_dupCacheControl
+ *
+ * @brief       Duplicate frame cache statistics.
+ *
+ * input parameters
+ * @param  action  - IOCTL_ACT_GET or IOCTL_ACT_DELETE
+ * @param  val     - Statistics object. Ignored for IOCTL_ACT_DELETE.
+ *
+ * output parameters
+ * @param  val     - Counters and configuration for IOCTL_ACT_GET.
+ *
+ * @return   SMPL_SUCCESS
+ *           SMPL_BAD_PARAM   - action not supported
+ */
+smplStatus_t nwk_dupCacheControl(ioctlAction_t action, ioctlDupCache_t *val)
+{
+  bspIState_t intState;
+
+  switch (action)
+  {
+    case IOCTL_ACT_GET:
+      BSP_ENTER_CRITICAL_SECTION(intState);
+      val->hits   = sDupHits;
+      val->misses = sDupMisses;
+      BSP_EXIT_CRITICAL_SECTION(intState);
+      val->size   = NWK_DUP_CACHE_SIZE;
+      val->window = NWK_DUP_WINDOW;
+      break;
+
+    case IOCTL_ACT_DELETE:
+      /* clear the counters and forget everything seen so far */
+      BSP_ENTER_CRITICAL_SECTION(intState);
+      memset(sDupCache, 0x0, sizeof(sDupCache));
+      sDupHits   = 0;
+      sDupMisses = 0;
+      BSP_EXIT_CRITICAL_SECTION(intState);
+      break;
+
+    default:
+      return SMPL_BAD_PARAM;
+  }
+
+  return SMPL_SUCCESS;
+}
+#endif  /* SIZE_INFRAME_Q > 0 && NWK_DUP_CACHE_SIZE > 0 */
@@ -63,6 +63,20 @@
 
 #ifdef SMPL_SECURE
 
+#if defined(SMPL_SECURE_MAC_SIZE) && SMPL_SECURE_MAC_SIZE > 0
+
+#if SMPL_SECURE_MAC_SIZE < 2 || SMPL_SECURE_MAC_SIZE > 8
+#error ERROR: SMPL_SECURE_MAC_SIZE must be 0 or 2..8
+#endif
+
+#define F_SECURE_OS       (1+SMPL_SECURE_MAC_SIZE)
+
+#define F_SEC_CTR_OS      3       /* counter hint */
+#define F_SEC_CTR_OS_MSK  (0xFF)
+#define F_SEC_TAG_OS      4       /* truncated CBC-MAC of the enciphered payload */
+
+#else
+
 #define F_SECURE_OS       3
 
 #define F_SEC_CTR_OS      3       /* counter hint */
@@ -72,6 +86,8 @@
 #define F_SEC_MAC_OS      5       /* Message authentication code */
 #define F_SEC_MAC_OS_MSK  (0xFF)
 
+#endif  /* SMPL_SECURE_MAC_SIZE */
+
 #else
 
 #define F_SECURE_OS       0
@@ -125,6 +141,32 @@ typedef struct
            mrfiPacket_t mrfiPkt;
 } frameInfo_t;
 
+/* Duplicate frame cache. Recently received frames are remembered by source
+ * address, port and transaction ID so copies replayed by more than one device
+ * are dropped before they are replayed again or delivered. Entries are kept in
+ * buckets of NWK_DUP_CACHE_WAYS picked by a hash and replaced least recently
+ * used first. The window is counted in received frames since there is no
+ * network clock. A size of 0 removes the cache.
+ */
+#ifndef NWK_DUP_CACHE_SIZE
+#define NWK_DUP_CACHE_SIZE  0
+#endif
+
+#ifndef NWK_DUP_WINDOW
+#define NWK_DUP_WINDOW      64
+#endif
+
+#define NWK_DUP_CACHE_WAYS  2
+
+#if NWK_DUP_CACHE_SIZE > 0
+#if NWK_DUP_CACHE_SIZE % NWK_DUP_CACHE_WAYS
+#error ERROR: NWK_DUP_CACHE_SIZE must be a multiple of NWK_DUP_CACHE_WAYS
+#endif
+#if NWK_DUP_WINDOW > 255
+#error ERROR: NWK_DUP_WINDOW must be less than 256. Transaction IDs repeat after 256 frames.
+#endif
+#endif
+
 
 /* prototypes */
 frameInfo_t  *nwk_buildFrame(uint8_t, uint8_t *msg, uint8_t len, uint8_t hops);
@@ -135,11 +177,14 @@ void          nwk_receiveFrame(void);
 void          nwk_frameInit(uint8_t (*)(linkID_t));
 smplStatus_t  nwk_retrieveFrame(rcvContext_t *, uint8_t *, uint8_t *, addr_t *, uint8_t *);
 smplStatus_t  nwk_sendFrame(frameInfo_t *, uint8_t txOption);
-frameInfo_t  *nwk_getSandFFrame(mrfiPacket_t *, uint8_t);
+frameInfo_t  *nwk_getSandFFrame(mrfiPacket_t *, uint8_t, uint8_t);
 uint8_t       nwk_getMyRxType(void);
 void          nwk_SendEmptyPollRspFrame(mrfiPacket_t *);
 #ifdef APP_AUTO_ACK
-void          nwk_sendAckReply(mrfiPacket_t *, uint8_t);
+void          nwk_sendAckReply(mrfiPacket_t *, uint8_t, linkID_t);
+#endif
+#if SIZE_INFRAME_Q > 0 && NWK_DUP_CACHE_SIZE > 0
+smplStatus_t  nwk_dupCacheControl(ioctlAction_t, ioctlDupCache_t *);
 #endif
 
 #ifndef END_DEVICE
@@ -0,0 +1,545 @@
+/**************************************************************************************************
+  Filename:       nwk_persist.c
+  Created:        2026-10-19
+  Author:         eZ430-RF2500 project contributors
+
+  Description:    This file saves the SimpliciTI connection context in flash
+                  and restores it after a reset. The context is saved as
+                  parts and only the parts that changed are written, so an
+                  Access Point rewrites one Connection Table entry when a
+                  link comes or goes. The flash region is split into banks
+                  of whole segments. Records are appended to the current bank
+                  and when it is full the next bank is erased and every part
+                  is written to it, so erases rotate through the region and
+                  the newest complete save is never erased.
+
+  Written for this project; not part of the TI SimpliciTI or BSP release.
+**************************************************************************************************/
+
+/******************************************************************************
+ * INCLUDES
+ */
+#include <string.h>
+#include "bsp.h"
+#include "bsp_flash.h"
+#include "nwk_persist.h"
+
+/******************************************************************************
+ * MACROS
+ */
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+/* Record: marker, sequence number, part key, payload length, payload, then a
+ * CRC-16 over everything after the marker. The sequence number is little
+ * endian, as is the CRC. All records written by one save share a sequence
+ * number and the last one carries the commit marker. The marker is written
+ * last so a record cut short by a reset is never taken as valid, and records
+ * of a save cut short are never restored.
+ */
+#define REC_MARKER         0x5A
+#define REC_COMMIT         0x5C
+#define REC_MARKER_OS      0
+#define REC_SEQ_OS         1
+#define REC_KEY_OS         3
+#define REC_LEN_OS         4
+#define REC_PAYLOAD_OS     5
+#define REC_OVERHEAD       (REC_PAYLOAD_OS + 2)
+
+#if REC_OVERHEAD != NWK_PERSIST_REC_OVERHEAD
+#error ERROR: NWK_PERSIST_REC_OVERHEAD in nwk_persist.h does not match the record format.
+#endif
+
+#define REGION_PTR         ((uint8_t *)NWK_PERSIST_ADDR)
+#define REGION_SIZE        ((uint16_t)NWK_PERSIST_SEG_SIZE * NWK_PERSIST_NUM_SEGS)
+
+#define REC_SEQ(rec)       ((rec)[REC_SEQ_OS] | ((uint16_t)(rec)[REC_SEQ_OS+1] << 8))
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+/* Last record of the newest complete save, its sequence number, the highest
+ * sequence number seen and where the next record goes. A null sNext means
+ * the next save starts the next bank.
+ */
+static uint8_t  *sCommitRec = 0;
+static uint16_t  sCommit    = 0;
+static uint16_t  sSeq       = 0;
+static uint8_t  *sNext      = 0;
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+static uint16_t bankSize(uint8_t, persistPart_t);
+static uint8_t *bankEnd(const uint8_t *, uint16_t);
+static uint8_t *findPart(uint8_t, uint8_t, uint16_t, uint8_t);
+static uint8_t  isSame(uint8_t, const uint8_t *, uint8_t, uint16_t);
+static uint8_t *writeRec(uint8_t *, uint8_t, uint8_t, const uint8_t *, uint8_t);
+static uint16_t crc16(const uint8_t *, uint16_t);
+static uint8_t  isValid(const uint8_t *, const uint8_t *, uint8_t);
+static uint8_t  isBlank(const uint8_t *, uint16_t);
+
+/******************************************************************************
+ * GLOBAL VARIABLES
+ */
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+/******************************************************************************
+ * @fn          nwk_persistLoad
+ *
+ * @brief       Restore an object from the newest complete save. The object is
+ *              made of parts, each read from the newest record of its key
+ *              in that save or an earlier one. The first byte of part 0 is
+ *              the object version. Nothing is copied unless every part is
+ *              found with its current length and the version matches, and
+ *              the version byte itself is not written.
+ *
+ * input parameters
+ * @param   num   - number of parts
+ * @param   part  - returns the address and length of each part
+ *
+ * output parameters
+ *
+ * @return   Non-zero if the object was restored, otherwise 0.
+ */
+uint8_t nwk_persistLoad(uint8_t num, persistPart_t part)
+{
+  uint16_t bank = bankSize(num, part);
+  uint16_t off;
+  uint8_t *rec, *end, *p, len, k, found = 0;
+
+  sCommitRec = 0;
+  sNext      = 0;
+
+  if (!bank)
+  {
+    return 0;
+  }
+
+  /* Find the newest commit and the highest sequence number. The next record
+   * goes after the last one in the bank of the newest commit.
+   */
+  for (off=0; off+bank<=REGION_SIZE; off+=bank)
+  {
+    end = REGION_PTR + off + bank;
+    for (rec=REGION_PTR+off; isValid(rec, end, 1); rec+=REC_OVERHEAD+rec[REC_LEN_OS])
+    {
+      if (!found || ((int16_t)(REC_SEQ(rec) - sSeq) > 0))
+      {
+        sSeq  = REC_SEQ(rec);
+        found = 1;
+      }
+      if ((REC_COMMIT == rec[REC_MARKER_OS]) &&
+          (!sCommitRec || ((int16_t)(REC_SEQ(rec) - sCommit) > 0)))
+      {
+        sCommitRec = rec;
+        sCommit    = REC_SEQ(rec);
+      }
+    }
+    if (sCommitRec && (sCommitRec >= end - bank) && (sCommitRec < end))
+    {
+      sNext = rec;
+    }
+  }
+
+  if (!sCommitRec)
+  {
+    return 0;
+  }
+
+  /* Records of a save that did not complete may be newer than the commit.
+   * Start the next save in a fresh bank so they can never be taken for part
+   * of it.
+   */
+  if (sSeq != sCommit)
+  {
+    sNext = 0;
+  }
+
+  for (k=0; k<num; ++k)
+  {
+    p = part(k, &len, 0);
+    if (!(rec = findPart(k, len, bank, 1)) || (!k && (rec[REC_PAYLOAD_OS] != *p)))
+    {
+      return 0;
+    }
+  }
+
+  for (k=0; k<num; ++k)
+  {
+    p   = part(k, &len, 0);
+    rec = findPart(k, len, bank, 1);
+    off = k ? 0 : 1;
+    memcpy(p+off, rec+REC_PAYLOAD_OS+off, len-off);
+  }
+
+  return 1;
+}
+
+/******************************************************************************
+ * @fn          nwk_persistSave
+ *
+ * @brief       Save the parts of an object that differ from flash. When the
+ *              current bank has no room the next bank is erased and every
+ *              part is written to it, so the older bank is free to be erased
+ *              later. nwk_persistLoad() must have been called once first.
+ *              Blocks while flash is written: up to one bank erase plus the
+ *              records. Do not call from an ISR.
+ *
+ * input parameters
+ * @param   num   - number of parts
+ * @param   part  - returns the address and length of each part
+ *
+ * output parameters
+ *
+ * @return   Non-zero if flash holds the object, 0 if it cannot fit twice in
+ *           the region or the write failed.
+ */
+uint8_t nwk_persistSave(uint8_t num, persistPart_t part)
+{
+  uint16_t bank = bankSize(num, part);
+  uint16_t need = 0, off;
+  uint8_t *rec  = sNext;
+  uint8_t *end, *p, len, k, last = 0, all = 0;
+
+  if (!bank)
+  {
+    return 0;
+  }
+
+  for (k=0; k<num; ++k)
+  {
+    p = part(k, &len, 1);
+    if (!isSame(k, p, len, bank))
+    {
+      need += REC_OVERHEAD + len;
+      last  = k;
+    }
+  }
+
+  if (!need)
+  {
+    return 1;
+  }
+
+  end = sCommitRec ? bankEnd(sCommitRec, bank) : 0;
+  if (!rec || (rec + need > end) || !isBlank(rec, need))
+  {
+    /* Start the bank after the one with the newest commit. */
+    off = sCommitRec ? (uint16_t)(end - REGION_PTR) : 0;
+    if (off + bank > REGION_SIZE)
+    {
+      off = 0;
+    }
+    rec = REGION_PTR + off;
+    end = rec + bank;
+    for (off=0; off<bank; off+=NWK_PERSIST_SEG_SIZE)
+    {
+      BSP_FlashEraseSegment(rec + off);
+    }
+    all  = 1;
+    last = num - 1;
+  }
+
+  /* Parts changed by an ISR since they were compared are written too when
+   * there is room; any that are not are picked up by the next save.
+   */
+  ++sSeq;
+  for (k=0; k<=last; ++k)
+  {
+    p = part(k, &len, 1);
+    if (all || (k == last) || !isSame(k, p, len, bank))
+    {
+      if ((rec + REC_OVERHEAD + len > end) ||
+          !(p = writeRec(rec, k, (k == last) ? REC_COMMIT : REC_MARKER, p, len)))
+      {
+        sNext = 0;
+        return 0;
+      }
+      if (k == last)
+      {
+        sCommitRec = rec;
+        sCommit    = sSeq;
+      }
+      rec = p;
+    }
+  }
+  sNext = rec;
+
+  return 1;
+}
+
+/******************************************************************************
+ * @fn          nwk_persistErase
+ *
+ * @brief       Erase the whole region. Nothing is restored at the next reset.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return   void
+ */
+void nwk_persistErase(void)
+{
+  uint16_t off;
+
+  for (off=0; off<REGION_SIZE; off+=NWK_PERSIST_SEG_SIZE)
+  {
+    BSP_FlashEraseSegment(REGION_PTR + off);
+  }
+  sCommitRec = 0;
+  sNext      = 0;
+
+  return;
+}
+
+/******************************************************************************
+ * @fn          bankSize
+ *
+ * @brief       Bank size for an object: whole segments holding one record of
+ *              every part. Two banks must fit so that starting a bank never
+ *              erases the newest complete save.
+ *
+ * input parameters
+ * @param   num   - number of parts
+ * @param   part  - returns the address and length of each part
+ *
+ * output parameters
+ *
+ * @return   Bank size in bytes, 0 if the region is too small.
+ */
+static uint16_t bankSize(uint8_t num, persistPart_t part)
+{
+  uint16_t size = 0;
+  uint8_t  len, k;
+
+  for (k=0; k<num; ++k)
+  {
+    part(k, &len, 0);
+    size += REC_OVERHEAD + len;
+  }
+  size = ((size + NWK_PERSIST_SEG_SIZE - 1) / NWK_PERSIST_SEG_SIZE) * NWK_PERSIST_SEG_SIZE;
+
+  return (num && (2 * size <= REGION_SIZE)) ? size : 0;
+}
+
+/******************************************************************************
+ * @fn          bankEnd
+ *
+ * @brief       End of the bank holding a record.
+ *
+ * input parameters
+ * @param   rec   - the record
+ * @param   bank  - bank size
+ *
+ * output parameters
+ *
+ * @return   First byte after the bank.
+ */
+static uint8_t *bankEnd(const uint8_t *rec, uint16_t bank)
+{
+  return REGION_PTR + ((rec - REGION_PTR) / bank + 1) * bank;
+}
+
+/******************************************************************************
+ * @fn          findPart
+ *
+ * @brief       Find the newest record of a part that belongs to the newest
+ *              complete save or an earlier one.
+ *
+ * input parameters
+ * @param   key    - part key
+ * @param   len    - expected payload length
+ * @param   bank   - bank size
+ * @param   check  - check the CRC of every record on the way. Records
+ *                   written since the load were checked when written.
+ *
+ * output parameters
+ *
+ * @return   The record, 0 if there is none.
+ */
+static uint8_t *findPart(uint8_t key, uint8_t len, uint16_t bank, uint8_t check)
+{
+  uint16_t off;
+  uint8_t *rec, *end, *best = 0;
+
+  for (off=0; off+bank<=REGION_SIZE; off+=bank)
+  {
+    end = REGION_PTR + off + bank;
+    for (rec=REGION_PTR+off; isValid(rec, end, check); rec+=REC_OVERHEAD+rec[REC_LEN_OS])
+    {
+      if ((key == rec[REC_KEY_OS]) && (len == rec[REC_LEN_OS]) &&
+          ((int16_t)(REC_SEQ(rec) - sCommit) <= 0) &&
+          (!best || ((int16_t)(REC_SEQ(rec) - REC_SEQ(best)) > 0)))
+      {
+        best = rec;
+      }
+    }
+  }
+
+  return best;
+}
+
+/******************************************************************************
+ * @fn          isSame
+ *
+ * @brief       Does flash already hold this value of a part?
+ *
+ * input parameters
+ * @param   key   - part key
+ * @param   p     - part value
+ * @param   len   - part length
+ * @param   bank  - bank size
+ *
+ * output parameters
+ *
+ * @return   Non-zero if the part need not be written, otherwise 0.
+ */
+static uint8_t isSame(uint8_t key, const uint8_t *p, uint8_t len, uint16_t bank)
+{
+  uint8_t *rec = findPart(key, len, bank, 0);
+
+  return rec && !memcmp(rec+REC_PAYLOAD_OS, p, len);
+}
+
+/******************************************************************************
+ * @fn          writeRec
+ *
+ * @brief       Write one record to erased flash and check it.
+ *
+ * input parameters
+ * @param   rec     - where the record goes
+ * @param   key     - part key
+ * @param   marker  - REC_MARKER, or REC_COMMIT for the last record of a save
+ * @param   p       - part value
+ * @param   len     - part length
+ *
+ * output parameters
+ *
+ * @return   First byte after the record, 0 if it did not read back valid.
+ */
+static uint8_t *writeRec(uint8_t *rec, uint8_t key, uint8_t marker, const uint8_t *p, uint8_t len)
+{
+  uint16_t crc;
+  uint8_t  hdr[REC_PAYLOAD_OS];
+
+  hdr[REC_SEQ_OS]   = sSeq & 0xFF;
+  hdr[REC_SEQ_OS+1] = sSeq >> 8;
+  hdr[REC_KEY_OS]   = key;
+  hdr[REC_LEN_OS]   = len;
+  BSP_FlashWrite(rec+REC_SEQ_OS, hdr+REC_SEQ_OS, REC_PAYLOAD_OS-REC_SEQ_OS);
+  BSP_FlashWrite(rec+REC_PAYLOAD_OS, p, len);
+
+  /* CRC what reached flash. The receive ISR may change the part while it is
+   * written and the record must still check.
+   */
+  crc    = crc16(rec+REC_SEQ_OS, len+REC_PAYLOAD_OS-REC_SEQ_OS);
+  hdr[0] = crc & 0xFF;
+  hdr[1] = crc >> 8;
+  BSP_FlashWrite(rec+REC_PAYLOAD_OS+len, hdr, 2);
+  BSP_FlashWrite(rec+REC_MARKER_OS, &marker, 1);
+
+  return isValid(rec, rec+REC_OVERHEAD+len, 1) ? rec+REC_OVERHEAD+len : 0;
+}
+
+/******************************************************************************
+ * @fn          isValid
+ *
+ * @brief       Does a complete record start here?
+ *
+ * input parameters
+ * @param   rec    - start of the record
+ * @param   end    - end of the bank
+ * @param   check  - check the CRC too
+ *
+ * output parameters
+ *
+ * @return   Non-zero if the marker, length and CRC check, otherwise 0.
+ */
+static uint8_t isValid(const uint8_t *rec, const uint8_t *end, uint8_t check)
+{
+  uint8_t len;
+
+  if ((rec + REC_OVERHEAD > end) ||
+      ((REC_MARKER != rec[REC_MARKER_OS]) && (REC_COMMIT != rec[REC_MARKER_OS])))
+  {
+    return 0;
+  }
+
+  len = rec[REC_LEN_OS];
+  if (rec + REC_OVERHEAD + len > end)
+  {
+    return 0;
+  }
+
+  return !check ||
+         (crc16(rec+REC_SEQ_OS, len+REC_PAYLOAD_OS-REC_SEQ_OS) ==
+          (rec[REC_PAYLOAD_OS+len] | ((uint16_t)rec[REC_PAYLOAD_OS+len+1] << 8)));
+}
+
+/******************************************************************************
+ * @fn          isBlank
+ *
+ * @brief       Is the flash erased?
+ *
+ * input parameters
+ * @param   p    - start of the area
+ * @param   len  - length of the area
+ *
+ * output parameters
+ *
+ * @return   Non-zero if every byte is erased, otherwise 0.
+ */
+static uint8_t isBlank(const uint8_t *p, uint16_t len)
+{
+  while (len--)
+  {
+    if (BSP_FLASH_ERASED_BYTE != *p++)
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/******************************************************************************
+ * @fn          crc16
+ *
+ * @brief       CRC-16 CCITT (polynomial 0x1021, initial value 0xFFFF).
+ *
+ * input parameters
+ * @param   p    - data
+ * @param   len  - length of data
+ *
+ * output parameters
+ *
+ * @return   The CRC.
+ */
+static uint16_t crc16(const uint8_t *p, uint16_t len)
+{
+  uint16_t crc = 0xFFFF;
+  uint8_t  i;
+
+  while (len--)
+  {
+    crc ^= (uint16_t)*p++ << 8;
+    for (i=0; i<8; ++i)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+
+  return crc;
+}
@@ -0,0 +1,60 @@
+/**************************************************************************************************
+  Filename:       nwk_persist.h
+  Created:        2026-10-19
+  Author:         eZ430-RF2500 project contributors
+
+  Description:    This header file supports saving the SimpliciTI connection
+                  context in flash so it survives a reset.
+
+  Written for this project; not part of the TI SimpliciTI or BSP release.
+**************************************************************************************************/
+
+#ifndef NWK_PERSIST_H
+#define NWK_PERSIST_H
+
+/* Flash region holding the saved context. The default is information memory
+ * segments D, C and B of the MSP430F2xx. Segment A holds the calibration
+ * constants and the device address and is never used. A context that does
+ * not fit twice in the region (an Access Point with more than one
+ * connection) needs a region in main flash that the linker keeps free of
+ * code. The sensor demo AP links with lnk430F2274_persist.xcl, which keeps
+ * 0xF800-0xFBFF free for this (see smpl_config_AP.dat).
+ */
+#ifndef NWK_PERSIST_ADDR
+#define NWK_PERSIST_ADDR      0x1000
+#endif
+
+#ifndef NWK_PERSIST_SEG_SIZE
+#define NWK_PERSIST_SEG_SIZE  64
+#endif
+
+#ifndef NWK_PERSIST_NUM_SEGS
+#define NWK_PERSIST_NUM_SEGS  3
+#endif
+
+/* Flash taken by one bank holding an object of 'bytes' bytes in 'parts'
+ * parts, and whether two banks fit in the region. Each record adds
+ * NWK_PERSIST_REC_OVERHEAD bytes and a bank is whole segments. For
+ * compile-time checks of the saved object.
+ */
+#define NWK_PERSIST_REC_OVERHEAD  7
+#define NWK_PERSIST_BANK(bytes, parts) \
+  ((((bytes) + (parts) * NWK_PERSIST_REC_OVERHEAD + NWK_PERSIST_SEG_SIZE - 1) \
+    / NWK_PERSIST_SEG_SIZE) * NWK_PERSIST_SEG_SIZE)
+#define NWK_PERSIST_FITS(bytes, parts) \
+  (2 * NWK_PERSIST_BANK(bytes, parts) <= (unsigned long)NWK_PERSIST_SEG_SIZE * NWK_PERSIST_NUM_SEGS)
+
+/* The saved object is made of parts, keyed 0 to num-1. The callback returns
+ * the address of a part and sets its length. With 'save' non-zero the address
+ * may be a scratch copy holding only what should be saved, otherwise it is
+ * where a restored part is copied to. The first byte of part 0 is the object
+ * version.
+ */
+typedef uint8_t *(*persistPart_t)(uint8_t key, uint8_t *len, uint8_t save);
+
+/* prototypes */
+uint8_t nwk_persistLoad(uint8_t, persistPart_t);
+uint8_t nwk_persistSave(uint8_t, persistPart_t);
+void    nwk_persistErase(void);
+
+#endif  /* NWK_PERSIST_H */
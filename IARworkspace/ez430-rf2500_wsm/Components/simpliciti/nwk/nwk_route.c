@@ -0,0 +1,276 @@
+/**************************************************************************************************
+  Filename:       nwk_route.c
+  Created:        2026-10-19
+  Author:         eZ430-RF2500 project contributors
+
+  Description:    This file supports the SimpliciTI route table. Range Extenders
+                  and Access Points learn how far away each device is from
+                  Join and Link traffic and use it to trim the hop count of
+                  replayed frames.
+
+  Written for this project; not part of the TI SimpliciTI or BSP release.
+**************************************************************************************************/
+
+/******************************************************************************
+ * INCLUDES
+ */
+#include <string.h>
+#include "bsp.h"
+#include "mrfi.h"
+#include "nwk_types.h"
+#include "nwk.h"
+#include "nwk_frame.h"
+#include "nwk_globals.h"
+#include "nwk_route.h"
+
+#if defined(NWK_ROUTING) && !defined(END_DEVICE)
+
+/******************************************************************************
+ * MACROS
+ */
+
+/******************************************************************************
+ * CONSTANTS AND DEFINES
+ */
+
+/******************************************************************************
+ * TYPEDEFS
+ */
+
+/* One destination. 'hops' is the number of replays between us and the device,
+ * so 0 means we hear it directly. 'rssi' is the link to the last transmitter.
+ */
+typedef struct
+{
+  uint8_t  addr[NET_ADDR_SIZE];
+  uint8_t  hops;
+  rssi_t   rssi;
+  uint8_t  age;
+} route_t;
+
+/******************************************************************************
+ * LOCAL VARIABLES
+ */
+
+static route_t sRoute[NUM_ROUTES];
+
+/******************************************************************************
+ * LOCAL FUNCTIONS
+ */
+
+static route_t *findRoute(uint8_t *);
+
+/******************************************************************************
+ * GLOBAL VARIABLES
+ */
+
+/******************************************************************************
+ * GLOBAL FUNCTIONS
+ */
+
+/******************************************************************************
+ * @fn          nwk_routeInit
+ *
+ * @brief       Initialize the route table. All entries are empty.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return      void
+ */
+void nwk_routeInit(void)
+{
+  uint8_t i;
+
+  memset(sRoute, 0x0, sizeof(sRoute));
+  for (i=0; i<NUM_ROUTES; ++i)
+  {
+    sRoute[i].hops = NWK_ROUTE_NONE;
+  }
+
+  return;
+}
+
+/******************************************************************************
+ * @fn          nwk_routeLearn
+ *
+ * @brief       Learn the distance to the source of a received frame. End
+ *              Devices never replay and there is only one AP, so a frame
+ *              sent by an ED or by the AP on its own behalf came straight
+ *              from the source. Join and Link frames start out with a known
+ *              hop count so the number of replays already done can be
+ *              worked out. Link replies start lower than MAX_HOPS so they
+ *              can only overstate the distance, which is the safe direction.
+ *              Anything else replayed by an RE is at least one hop away.
+ *              Fewer hops win; at equal hops the latest signal strength is
+ *              kept.
+ *
+ * input parameters
+ * @param   frame   - pointer to received frame
+ *
+ * output parameters
+ *
+ * @return      void
+ */
+void nwk_routeLearn(mrfiPacket_t *frame)
+{
+  uint8_t        port   = GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_PORT_OS);
+  uint8_t        hc     = GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_HOP_COUNT);
+  uint8_t        tx     = GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_TX_DEVICE);
+  rssi_t         rssi   = (rssi_t)frame->rxMetrics[MRFI_RX_METRICS_RSSI_OFS];
+  addr_t const  *apAddr = nwk_getAPAddress();
+  route_t       *pRoute;
+  uint8_t        hops, i;
+
+  if ((F_TX_DEVICE_ED == tx) ||
+      ((F_TX_DEVICE_AP == tx) && apAddr && !memcmp(MRFI_P_SRC_ADDR(frame), apAddr, NET_ADDR_SIZE)))
+  {
+    hops = 0;
+  }
+  else if ((SMPL_PORT_JOIN == port) && (hc <= MAX_HOPS_FROM_AP))
+  {
+    hops = MAX_HOPS_FROM_AP - hc;
+  }
+  else if ((SMPL_PORT_LINK == port) && (hc <= MAX_HOPS))
+  {
+    hops = MAX_HOPS - hc;
+  }
+  else if (F_TX_DEVICE_RE == tx)
+  {
+    hops = 1;
+  }
+  else
+  {
+    return;
+  }
+
+  /* everyone gets older. saturate so stale entries stay stale. */
+  for (i=0; i<NUM_ROUTES; ++i)
+  {
+    if (sRoute[i].age < 0xFF)
+    {
+      sRoute[i].age++;
+    }
+  }
+
+  pRoute = findRoute(MRFI_P_SRC_ADDR(frame));
+  if (pRoute)
+  {
+    /* a longer route only replaces one we have not confirmed lately */
+    if ((hops > pRoute->hops) && (pRoute->age <= NWK_ROUTE_MAX_AGE))
+    {
+      return;
+    }
+  }
+  else
+  {
+    /* use an empty entry or else the oldest one */
+    pRoute = sRoute;
+    for (i=0; i<NUM_ROUTES; ++i)
+    {
+      if (NWK_ROUTE_NONE == sRoute[i].hops)
+      {
+        pRoute = &sRoute[i];
+        break;
+      }
+      if (sRoute[i].age > pRoute->age)
+      {
+        pRoute = &sRoute[i];
+      }
+    }
+    memcpy(pRoute->addr, MRFI_P_SRC_ADDR(frame), NET_ADDR_SIZE);
+  }
+
+  pRoute->hops = hops;
+  pRoute->rssi = rssi;
+  pRoute->age  = 0;
+
+  return;
+}
+
+/******************************************************************************
+ * @fn          nwk_routeHops
+ *
+ * @brief       Look up the distance to a destination. Unknown, stale and
+ *              weak direct routes are reported as NWK_ROUTE_NONE so the
+ *              caller falls back to flooding.
+ *
+ * input parameters
+ * @param   addr   - pointer to destination address
+ *
+ * output parameters
+ *
+ * @return      Number of replays needed after ours, or NWK_ROUTE_NONE.
+ */
+uint8_t nwk_routeHops(uint8_t *addr)
+{
+  route_t *pRoute = findRoute(addr);
+
+  if (!pRoute || (pRoute->age > NWK_ROUTE_MAX_AGE))
+  {
+    return NWK_ROUTE_NONE;
+  }
+  if (!pRoute->hops && (pRoute->rssi < NWK_ROUTE_MIN_RSSI))
+  {
+    return NWK_ROUTE_NONE;
+  }
+
+  return pRoute->hops;
+}
+
+/******************************************************************************
+ * @fn          nwk_routeTrim
+ *
+ * @brief       Lower the hop count of an outgoing frame to the known distance
+ *              of its target. A target we hear directly gets a hop count of
+ *              zero so no one else replays the frame. Frames to unknown
+ *              targets and broadcasts are left alone.
+ *
+ * input parameters
+ * @param   frame   - pointer to frame about to be sent
+ *
+ * output parameters
+ *
+ * @return      void
+ */
+void nwk_routeTrim(mrfiPacket_t *frame)
+{
+  uint8_t route = nwk_routeHops(MRFI_P_DST_ADDR(frame));
+
+  if (route < GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_HOP_COUNT))
+  {
+    PUT_INTO_FRAME(MRFI_P_PAYLOAD(frame), F_HOP_COUNT, route);
+  }
+
+  return;
+}
+
+/******************************************************************************
+ * @fn          findRoute
+ *
+ * @brief       Find the route table entry for an address.
+ *
+ * input parameters
+ * @param   addr   - pointer to address
+ *
+ * output parameters
+ *
+ * @return      Pointer to entry or NULL if there is none.
+ */
+static route_t *findRoute(uint8_t *addr)
+{
+  uint8_t i;
+
+  for (i=0; i<NUM_ROUTES; ++i)
+  {
+    if ((NWK_ROUTE_NONE != sRoute[i].hops) && !memcmp(sRoute[i].addr, addr, NET_ADDR_SIZE))
+    {
+      return &sRoute[i];
+    }
+  }
+
+  return (route_t *)0;
+}
+
+#endif  /* NWK_ROUTING && !END_DEVICE */
@@ -0,0 +1,42 @@
+/**************************************************************************************************
+  Filename:       nwk_route.h
+  Created:        2026-10-19
+  Author:         eZ430-RF2500 project contributors
+
+  Description:    This header file supports the SimpliciTI route table used by
+                  Range Extenders and Access Points to limit frame replay.
+
+  Written for this project; not part of the TI SimpliciTI or BSP release.
+**************************************************************************************************/
+
+#ifndef NWK_ROUTE_H
+#define NWK_ROUTE_H
+
+/* Number of destinations remembered by a Range Extender or Access Point */
+#ifndef NUM_ROUTES
+#define NUM_ROUTES  8
+#endif
+
+/* Direct neighbours weaker than this (dBm) are treated as unknown so the
+ * frame is still flooded.
+ */
+#ifndef NWK_ROUTE_MIN_RSSI
+#define NWK_ROUTE_MIN_RSSI  (-85)
+#endif
+
+/* Number of learned frames after which an entry may be replaced by a longer
+ * route. Stale entries are also ignored on lookup.
+ */
+#ifndef NWK_ROUTE_MAX_AGE
+#define NWK_ROUTE_MAX_AGE   200
+#endif
+
+#define NWK_ROUTE_NONE  0xFF
+
+/* prototypes */
+void    nwk_routeInit(void);
+void    nwk_routeLearn(mrfiPacket_t *);
+uint8_t nwk_routeHops(uint8_t *);
+void    nwk_routeTrim(mrfiPacket_t *);
+
+#endif  /* NWK_ROUTE_H */
@@ -73,7 +73,13 @@ enum ioctlObject  {
   IOCTL_OBJ_FWVER,
   IOCTL_OBJ_PROTOVER,
   IOCTL_OBJ_NVOBJ,
-  IOCTL_OBJ_TOKEN
+  IOCTL_OBJ_TOKEN,
+  IOCTL_OBJ_TDMA,
+  IOCTL_OBJ_DUPCACHE,
+  IOCTL_OBJ_KEYSTREAM,
+  IOCTL_OBJ_RETRY,
+  IOCTL_OBJ_TIME,
+  IOCTL_OBJ_DOWNLINK
 };
 
 enum ioctlAction  {
@@ -179,10 +185,109 @@ typedef struct
   freqEntry_t *freq;
 } ioctlScanChan_t;
 
+/*
+ * TDMA beacon schedule support
+ */
+#define NWK_TDMA_NO_SLOT   (0xFF)   /* link has no uplink slot assigned */
+
+typedef struct
+{
+  linkID_t  lid;          /* input: Link ID for which slot desired */
+  uint16_t  superframe;   /* superframe number carried in the last beacon */
+  uint8_t   numSlots;     /* uplink slots per superframe */
+  uint8_t   slotMs;       /* slot width in milliseconds */
+  uint8_t   slot;         /* slot assigned to this link at link time */
+  uint8_t   beaconRcvd;   /* non-zero if a beacon arrived since the last GET */
+} ioctlTDMA_t;
+
+/*
+ * Duplicate frame cache support
+ */
+typedef struct
+{
+  uint16_t  hits;         /* frames dropped because they were seen already */
+  uint16_t  misses;       /* frames not found in the cache */
+  uint8_t   size;         /* number of cache entries */
+  uint8_t   window;       /* received frames an entry stays valid for */
+} ioctlDupCache_t;
+
+/*
+ * Join/Link retry schedule support
+ */
+typedef struct
+{
+  uint8_t   maxExp;       /* after n failures in a row skip up to 2^min(n,maxExp)-1 calls */
+  uint16_t  jitterMs;     /* random wait of up to this before a retry, slept by the application. 0 is none */
+  uint8_t   joinFails;    /* GET only: SMPL_Init() failures in a row */
+  uint8_t   linkFails;    /* GET only: SMPL_Link() failures in a row */
+} ioctlRetry_t;
+
+/*
+ * Network time support
+ */
+/* Seconds between time sync frames from the AP */
+#ifndef NWK_TIME_SYNC_SECS
+#define NWK_TIME_SYNC_SECS   10
+#endif
+
+/* Compact sample timestamp: network time in 16 ms units. Wraps every 17.5
+ * minutes; the receiver unwraps it against its own clock.
+ */
+#define NWK_TIME_STAMP(ms)   ((uint16_t)((ms) >> 4))
+
+typedef struct
+{
+  uint32_t  netMs;        /* network time now, in milliseconds */
+  uint32_t  syncMs;       /* network time carried by the last sync frame */
+  uint32_t  syncTicks;    /* local clock (BSP_ClockTicks()) when it arrived */
+  uint16_t  ticksPerSec;  /* local clock rate in use; calibration for SET */
+  uint8_t   synced;       /* non-zero once a sync frame has been heard */
+  uint8_t   syncRcvd;     /* non-zero if a sync arrived since the last GET */
+} ioctlTime_t;
+
+/*
+ * Downlink support
+ */
+#if defined(NWK_DOWNLINK) && !defined(APP_AUTO_ACK)
+#error ERROR: NWK_DOWNLINK needs APP_AUTO_ACK. Downlink messages ride on acks.
+#endif
+
+/* Number of links that can have a downlink message waiting on the AP */
+#ifndef NWK_DOWNLINK_SLOTS
+#define NWK_DOWNLINK_SLOTS   2
+#endif
+
+typedef struct
+{
+  linkID_t  lid;          /* link to the End Device */
+  uint8_t  *msg;          /* WRITE: message, up to MAX_APP_PAYLOAD bytes */
+  uint8_t   len;          /* WRITE: length. GET: length still waiting, 0 if none */
+} ioctlDownlink_t;
+
 /* Security typedefs to make things easier if they change types */
 typedef uint8_t  secMAC_t;
 typedef uint8_t  secFCS_t;
 
+/* cipher block size in bytes */
+#define SEC_BLOCK_SIZE  8
+
+/* Keystream cache. Each connection can hold this many CTR keystream blocks
+ * computed ahead of time for the counter values it will use next, so that
+ * securing a frame is only an XOR. Zero removes the cache.
+ */
+#ifndef NWK_KS_BLOCKS
+#define NWK_KS_BLOCKS   0
+#endif
+
+#if NWK_KS_BLOCKS > 0
+typedef struct
+{
+  uint32_t  ctr;                                /* counter value of ks[0] */
+  uint8_t   num;                                /* number of valid blocks */
+  uint8_t   ks[NWK_KS_BLOCKS][SEC_BLOCK_SIZE];
+} ksCache_t;
+#endif
+
 /***************************************************************************************
  *                                 ** NV Object support **
  *
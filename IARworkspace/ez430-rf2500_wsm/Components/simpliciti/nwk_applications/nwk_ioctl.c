@@ -52,6 +52,9 @@
 #ifdef ACCESS_POINT
 #include "nwk_join.h"
 #endif
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+#include "nwk_api.h"
+#endif
 
 /******************************************************************************
  * MACROS
@@ -64,10 +67,24 @@
 /******************************************************************************
  * TYPEDEFS
  */
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+typedef struct
+{
+  linkID_t lid;                   /* 0 if the slot is free */
+  uint8_t  len;
+  uint8_t  msg[MAX_APP_PAYLOAD];
+} downlink_t;
+#endif
 
 /******************************************************************************
  * LOCAL VARIABLES
  */
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+/* Downlink messages waiting for an End Device to ask for an ack. Written in
+ * the user thread, read in the Rx ISR thread when the ack goes out.
+ */
+static downlink_t sDownlink[NWK_DOWNLINK_SLOTS];
+#endif
 
 /******************************************************************************
  * LOCAL FUNCTIONS
@@ -313,25 +330,44 @@ smplStatus_t nwk_deviceAddress(ioctlAction_t action, addr_t *addr)
 /******************************************************************************
  * @fn          nwk_connectionControl
  *
- * @brief       Access to connection table. Currently supports only deleting
- *              a connection from the table.
+ * @brief       Access to connection table. Supports deleting a connection
+ *              from the table and, with NWK_PERSIST, reading the Link IDs of
+ *              the connections restored from flash at SMPL_Init().
  *
  * input parameters
- * @param   action  - Connection control action (only delete is curently valid).
+ * @param   action  - Connection control action (delete or read).
  * @param   val     - pointer to Link ID of connection on which to operate.
  *
  * output parameters
+ * @param   val     - (READ) next restored Link ID. Each is returned once, in
+ *                    Connection Table order, and SMPL_Link() draws on the
+ *                    same list.
  *
  * @return   SMPL_SUCCESS
- *           SMPL_BAD_PARAM  Action is not delete
+ *           SMPL_BAD_PARAM  Action is not delete or read
  *                           Link ID is the UUD Link ID
  *                           No connection table info for Link ID
+ *           SMPL_NO_LINK    (READ) No more restored connections
  */
 smplStatus_t nwk_connectionControl(ioctlAction_t action, void *val)
 {
   connInfo_t *pCInfo;
   linkID_t    lid = *((linkID_t *)val);
 
+#if defined(NWK_PERSIST)
+  if (IOCTL_ACT_READ == action)
+  {
+    lid = nwk_NVRestoredLink();
+    if (!lid)
+    {
+      return SMPL_NO_LINK;
+    }
+    *((linkID_t *)val) = lid;
+
+    return SMPL_SUCCESS;
+  }
+#endif
+
   if (IOCTL_ACT_DELETE != action)
   {
     return SMPL_BAD_PARAM;
@@ -347,3 +383,124 @@ smplStatus_t nwk_connectionControl(ioctlAction_t action, void *val)
 
   return SMPL_SUCCESS;
 }
+
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+/******************************************************************************
+ * @fn          nwk_downlinkControl
+ *
+ * @brief       Queue a message for an End Device. A device that polls gets it
+ *              through its store-and-forward queue. Any other device gets it
+ *              in the reply to each frame it sends with an ack request, until
+ *              the message is deleted or replaced. The application decides
+ *              when it has arrived, usually from what the device reports
+ *              next.
+ *
+ * input parameters
+ * @param   action  - IOCTL_ACT_WRITE, IOCTL_ACT_GET or IOCTL_ACT_DELETE
+ * @param   val     - Link ID, and message and length for WRITE.
+ *
+ * output parameters
+ * @param   val     - (GET) length of the message still waiting, 0 if none.
+ *
+ * @return   SMPL_SUCCESS
+ *           SMPL_BAD_PARAM  Unknown action, Link ID or bad length
+ *           SMPL_NOMEM      (WRITE) No free slot
+ *           Status of the send for a polling device
+ */
+smplStatus_t nwk_downlinkControl(ioctlAction_t action, ioctlDownlink_t *val)
+{
+  connInfo_t *pCInfo = nwk_getConnInfo(val->lid);
+  downlink_t *pDL    = 0;
+  bspIState_t intState;
+  uint8_t     i, loc;
+
+  if (!pCInfo || (SMPL_LINKID_USER_UUD == val->lid))
+  {
+    return SMPL_BAD_PARAM;
+  }
+
+  /* the link's slot, else a free one */
+  for (i=0; i<NWK_DOWNLINK_SLOTS; ++i)
+  {
+    if (sDownlink[i].lid == val->lid)
+    {
+      pDL = &sDownlink[i];
+      break;
+    }
+    if (!pDL && !sDownlink[i].lid)
+    {
+      pDL = &sDownlink[i];
+    }
+  }
+
+  switch (action)
+  {
+    case IOCTL_ACT_WRITE:
+      if (!val->len || (val->len > MAX_APP_PAYLOAD))
+      {
+        return SMPL_BAD_PARAM;
+      }
+      if (nwk_isSandFClient(pCInfo->peerAddr, &loc))
+      {
+        return SMPL_SendOpt(val->lid, val->msg, val->len, SMPL_TXOPTION_NONE);
+      }
+      if (!pDL)
+      {
+        return SMPL_NOMEM;
+      }
+      BSP_ENTER_CRITICAL_SECTION(intState);
+      memcpy(pDL->msg, val->msg, val->len);
+      pDL->len = val->len;
+      pDL->lid = val->lid;
+      BSP_EXIT_CRITICAL_SECTION(intState);
+      break;
+
+    case IOCTL_ACT_GET:
+      val->len = (pDL && (pDL->lid == val->lid)) ? pDL->len : 0;
+      break;
+
+    case IOCTL_ACT_DELETE:
+      if (pDL && (pDL->lid == val->lid))
+      {
+        pDL->lid = 0;
+      }
+      break;
+
+    default:
+      return SMPL_BAD_PARAM;
+  }
+
+  return SMPL_SUCCESS;
+}
+
+/******************************************************************************
+ * @fn          nwk_getDownlink
+ *
+ * @brief       Copy out the message waiting for a link, if any. Called from
+ *              the Rx ISR thread while building an ack reply. The message
+ *              stays queued.
+ *
+ * input parameters
+ * @param   lid  - Link ID of the connection being acked
+ *
+ * output parameters
+ * @param   msg  - message, MAX_APP_PAYLOAD bytes of room
+ *
+ * @return   Message length, 0 if none is waiting.
+ */
+uint8_t nwk_getDownlink(linkID_t lid, uint8_t *msg)
+{
+  uint8_t i;
+
+  for (i=0; i<NWK_DOWNLINK_SLOTS; ++i)
+  {
+    if (lid && (sDownlink[i].lid == lid))
+    {
+      memcpy(msg, sDownlink[i].msg, sDownlink[i].len);
+      return sDownlink[i].len;
+    }
+  }
+
+  return 0;
+}
+#endif  /* NWK_DOWNLINK && ACCESS_POINT */
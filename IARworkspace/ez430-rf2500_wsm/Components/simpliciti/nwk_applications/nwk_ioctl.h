@@ -49,5 +49,9 @@ smplStatus_t nwk_connectionControl(ioctlAction_t, void *);
 #ifdef ACCESS_POINT
 smplStatus_t nwk_joinContext(ioctlAction_t);
 #endif
+#if defined(NWK_DOWNLINK) && defined(ACCESS_POINT)
+smplStatus_t nwk_downlinkControl(ioctlAction_t, ioctlDownlink_t *);
+uint8_t      nwk_getDownlink(linkID_t, uint8_t *);
+#endif
 
 #endif
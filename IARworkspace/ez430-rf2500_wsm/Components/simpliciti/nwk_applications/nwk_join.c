@@ -73,6 +73,9 @@ static volatile uint8_t  sTid = 0;
 #ifdef ACCESS_POINT
 static sfInfo_t *spSandFContext = NULL;
 static uint8_t   sJoinOK = 0;
+#elif defined(NWK_JOIN_LINK)
+/* join+link requests gone unanswered since the last join */
+static uint8_t   sJoinLinkMisses = 0;
 #endif /* ACCESS_POINT */
 
 /******************************************************************************
@@ -82,6 +85,11 @@ static uint8_t   sJoinOK = 0;
 static void     smpl_send_join_reply(mrfiPacket_t *frame);
 static uint32_t generateLinkToken(void);
 static void     handleJoinRequest(mrfiPacket_t *);
+static uint8_t  isJoinValid(mrfiPacket_t *);
+static uint8_t  addSandFClient(mrfiPacket_t *);
+#if defined(NWK_JOIN_LINK) && defined(AP_IS_DATA_HUB)
+static void     smpl_send_join_link_reply(mrfiPacket_t *);
+#endif
 #endif  /*  ACCESS_POINT */
 
 /******************************************************************************
@@ -197,24 +205,19 @@ static uint32_t generateLinkToken(void)
 }
 
 /******************************************************************************
- * @fn          smpl_send_join_reply
+ * @fn          isJoinValid
  *
- * @brief       Send the Join reply. Include the Link token. If the device is
- *              a polling sleeper put it into the list of store-and-forward
- *              clients.
+ * @brief       Check the protocol version and join token of a Join frame.
  *
  * input parameters
- * @param   frame     - join frame for which a reply is needed...maybe
+ * @param   frame     - join frame
  *
  * output parameters
  *
- * @return   void
+ * @return   Non-zero if the device may join, otherwise 0.
  */
-static void smpl_send_join_reply(mrfiPacket_t *frame)
+static uint8_t isJoinValid(mrfiPacket_t *frame)
 {
-  frameInfo_t *pOutFrame;
-  uint8_t      msg[JOIN_REPLY_FRAME_SIZE];
-
   /* Is this a legacy frame? If so continue. Otherwise check verion.*/
   if ((MRFI_GET_PAYLOAD_LEN(frame) - F_APP_PAYLOAD_OS) > JOIN_LEGACY_MSG_LENGTH)
   {
@@ -224,7 +227,7 @@ static void smpl_send_join_reply(mrfiPacket_t *frame)
       /* Accommodation of protocol version differences can be noted or accomplished here.
        * Otherwise, no match and the board goes back
        */
-      return;
+      return 0;
     }
   }
 
@@ -236,10 +239,90 @@ static void smpl_send_join_reply(mrfiPacket_t *frame)
     nwk_getNumObjectFromMsg(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+J_JOIN_TOKEN_OS, &jt, sizeof(jt));
     if (jt != sJoinToken)
     {
-      return;
+      return 0;
     }
   }
 
+  return 1;
+}
+
+/******************************************************************************
+ * @fn          addSandFClient
+ *
+ * @brief       If the joining device polls put it into the list of
+ *              store-and-forward clients.
+ *
+ * input parameters
+ * @param   frame     - join frame
+ *
+ * output parameters
+ *
+ * @return   0 if the device polls and there is no room for it, otherwise
+ *           non-zero.
+ */
+static uint8_t addSandFClient(mrfiPacket_t *frame)
+{
+  /* If this device polls we need to provide store-and-forward support */
+  if (GET_FROM_FRAME(MRFI_P_PAYLOAD(frame),F_RX_TYPE) == F_RX_TYPE_POLLS)
+  {
+    uint8_t loc;
+
+    /* Check duplicate status */
+    if (!nwk_isSandFClient(MRFI_P_SRC_ADDR(frame), &loc))
+    {
+      uint8_t        *pNumc   = &spSandFContext->curNumSFClients;
+      sfClientInfo_t *pClient = &spSandFContext->sfClients[*pNumc];
+
+      /* It's not a duplicate. Save it if there's room */
+      if (*pNumc < NUM_STORE_AND_FWD_CLIENTS)
+      {
+        memcpy(pClient->clientAddr.addr, MRFI_P_SRC_ADDR(frame), NET_ADDR_SIZE);
+        *pNumc = *pNumc + 1;
+      }
+      else
+      {
+        /* No room left. */
+        return 0;
+      }
+    }
+    else
+    {
+      /* We get here if it's a duplicate. We drop through and send reply.
+       * Reset the S&F marker in the Management application -- we should
+       * assume that the Client reset so the TID will be random. If this is
+       * simply a duplicate frame it causes no harm.
+       */
+      nwk_resetSFMarker(loc);
+    }
+  }
+
+  return 1;
+}
+
+/******************************************************************************
+ * @fn          smpl_send_join_reply
+ *
+ * @brief       Send the Join reply. Include the Link token. If the device is
+ *              a polling sleeper put it into the list of store-and-forward
+ *              clients.
+ *
+ * input parameters
+ * @param   frame     - join frame for which a reply is needed...maybe
+ *
+ * output parameters
+ *
+ * @return   void
+ */
+static void smpl_send_join_reply(mrfiPacket_t *frame)
+{
+  frameInfo_t *pOutFrame;
+  uint8_t      msg[JOIN_REPLY_FRAME_SIZE];
+
+  if (!isJoinValid(frame))
+  {
+    return;
+  }
+
   /* send reply with tid, the link token, and the encryption context */
   {
     uint32_t linkToken;
@@ -274,38 +357,12 @@ static void smpl_send_join_reply(mrfiPacket_t *frame)
     return;
   }
 
-  /* If this device polls we need to provide store-and-forward support */
-  if (GET_FROM_FRAME(MRFI_P_PAYLOAD(frame),F_RX_TYPE) == F_RX_TYPE_POLLS)
+  /* If this device polls we need to provide store-and-forward support.
+   * No room left: just return and don't send reply.
+   */
+  if (!addSandFClient(frame))
   {
-    uint8_t loc;
-
-    /* Check duplicate status */
-    if (!nwk_isSandFClient(MRFI_P_SRC_ADDR(frame), &loc))
-    {
-      uint8_t        *pNumc   = &spSandFContext->curNumSFClients;
-      sfClientInfo_t *pClient = &spSandFContext->sfClients[*pNumc];
-
-      /* It's not a duplicate. Save it if there's room */
-      if (*pNumc < NUM_STORE_AND_FWD_CLIENTS)
-      {
-        memcpy(pClient->clientAddr.addr, MRFI_P_SRC_ADDR(frame), NET_ADDR_SIZE);
-        *pNumc = *pNumc + 1;
-      }
-      else
-      {
-        /* No room left. Just return and don't send reply. */
-        return;
-      }
-    }
-    else
-    {
-      /* We get here if it's a duplicate. We drop through and send reply.
-       * Reset the S&F marker in the Management application -- we should
-       * assume that the Client reset so the TID will be random. If this is
-       * simply a duplicate frame it causes no harm.
-       */
-      nwk_resetSFMarker(loc);
-    }
+    return;
   }
 
 #ifdef SMPL_SECURE
@@ -318,6 +375,77 @@ static void smpl_send_join_reply(mrfiPacket_t *frame)
   return;
 }
 
+#if defined(NWK_JOIN_LINK) && defined(AP_IS_DATA_HUB)
+/******************************************************************************
+ * @fn          smpl_send_join_link_reply
+ *
+ * @brief       Answer a join+link frame. The device is joined and linked to
+ *              the AP's End Device object in one exchange: the connection is
+ *              set up here and the application is told through the callback
+ *              as for a plain join. Its SMPL_LinkListen() then returns the new
+ *              Link ID without waiting. If there is no room for a connection
+ *              a plain Join reply is sent and the device links as usual.
+ *
+ * input parameters
+ * @param   frame     - join+link frame
+ *
+ * output parameters
+ *
+ * @return   void
+ */
+static void smpl_send_join_link_reply(mrfiPacket_t *frame)
+{
+  frameInfo_t *pOutFrame;
+  uint8_t      msg[JOIN_LINK_REPLY_FRAME_SIZE];
+  uint8_t      result;
+
+  if (!isJoinValid(frame))
+  {
+    return;
+  }
+
+  /* A poller needs store-and-forward room before it gets a connection. */
+  if (!addSandFClient(frame))
+  {
+    return;
+  }
+
+  if (JOIN_LINK_NONE == (result=nwk_joinLinkAccept(frame, msg)))
+  {
+    smpl_send_join_reply(frame);
+    return;
+  }
+
+  {
+    uint32_t linkToken;
+
+    nwk_getLinkToken(&linkToken);
+    nwk_putNumObjectIntoMsg((void *)&linkToken, msg+JLR_LINK_TOKEN_OS, sizeof(linkToken));
+  }
+  msg[JB_REQ_OS] = JOIN_REQ_JOIN_LINK | NWK_APP_REPLY_BIT;
+  msg[JB_TID_OS] = *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+JB_TID_OS);
+
+  if (pOutFrame = nwk_buildFrame(SMPL_PORT_JOIN, msg, sizeof(msg), MAX_HOPS_FROM_AP))
+  {
+    memcpy(MRFI_P_DST_ADDR(&pOutFrame->mrfiPkt), MRFI_P_SRC_ADDR(frame), NET_ADDR_SIZE);
+#ifdef SMPL_SECURE
+    nwk_setSecureFrame(&pOutFrame->mrfiPkt, sizeof(msg), 0);
+#endif  /* SMPL_SECURE */
+    nwk_sendFrame(pOutFrame, MRFI_TX_TYPE_FORCED);
+  }
+
+  /* A lost reply is answered again from the connection when the device
+   * retries, so the new link is announced whether or not this one went out.
+   */
+  if ((JOIN_LINK_NEW == result) && spCallback)
+  {
+    spCallback(0);
+  }
+
+  return;
+}
+#endif  /* NWK_JOIN_LINK && AP_IS_DATA_HUB */
+
 /******************************************************************************
  * @fn          nwk_join
  *
@@ -414,6 +542,15 @@ static void handleJoinRequest(mrfiPacket_t *frame)
       smpl_send_join_reply(frame);
       break;
 
+    case JOIN_REQ_JOIN_LINK:
+#if defined(NWK_JOIN_LINK) && defined(AP_IS_DATA_HUB)
+      smpl_send_join_link_reply(frame);
+#else
+      /* Not a data hub. Join only; the device links as usual. */
+      smpl_send_join_reply(frame);
+#endif
+      break;
+
     default:
       break;
   }
@@ -437,7 +574,13 @@ static void handleJoinRequest(mrfiPacket_t *frame)
  */
 smplStatus_t nwk_join(void)
 {
+#if defined(NWK_JOIN_LINK)
+  /* the reply lands in the same buffer */
+  uint8_t      msg[JOIN_LINK_FRAME_SIZE > JOIN_LINK_REPLY_FRAME_SIZE ? JOIN_LINK_FRAME_SIZE : JOIN_LINK_REPLY_FRAME_SIZE];
+  uint8_t      joinLink;
+#else
   uint8_t      msg[JOIN_FRAME_SIZE];
+#endif
   uint32_t     linkToken;
   addr_t       apAddr;
   uint8_t      radioState = MRFI_GetRadioState();
@@ -466,13 +609,34 @@ smplStatus_t nwk_join(void)
 
     ioctl_info.send.addr = (addr_t *)nwk_getBCastAddress();
     ioctl_info.send.msg  = msg;
-    ioctl_info.send.len  = sizeof(msg);
+    ioctl_info.send.len  = JOIN_FRAME_SIZE;
     ioctl_info.send.port = SMPL_PORT_JOIN;
 
     /* Put join token in */
     nwk_putNumObjectIntoMsg((void *)&sJoinToken, msg+J_JOIN_TOKEN_OS, sizeof(sJoinToken));
     /* set app info byte */
     msg[JB_REQ_OS] = JOIN_REQ_JOIN;
+#if defined(NWK_JOIN_LINK)
+    /* Ask to be linked to the AP as well if there is a connection free.
+     * Filled on every pass: the previous reply overwrote the buffer. An AP
+     * older than join+link never answers, so after NWK_JOIN_LINK_TRIES
+     * misses send a plain join and give the connection back.
+     */
+    joinLink = 0;
+    if (sJoinLinkMisses < NWK_JOIN_LINK_TRIES)
+    {
+      joinLink = nwk_joinLinkRequest(msg);
+    }
+    else
+    {
+      nwk_joinLinkReply(0, 0, 0);
+    }
+    if (joinLink)
+    {
+      msg[JB_REQ_OS]       = JOIN_REQ_JOIN_LINK;
+      ioctl_info.send.len  = JOIN_LINK_FRAME_SIZE;
+    }
+#endif
     msg[JB_TID_OS] = sTid;
     /* Set number of connections supported. Used only by AP if it is
      * a data hub.
@@ -508,13 +672,45 @@ smplStatus_t nwk_join(void)
         nwk_setLinkToken(linkToken);
         /* save AP address */
         nwk_setAPAddress(&apAddr);
+#if defined(NWK_JOIN_LINK)
+        /* AP joined us but did not link. Give the connection back. */
+        if (joinLink)
+        {
+          nwk_joinLinkReply(0, 0, 0);
+        }
+        sJoinLinkMisses = 0;
+#endif
         sTid++;   /* guard against duplicates */
         rc = SMPL_SUCCESS;
 #if defined( FREQUENCY_AGILITY )
         break;
 #endif
       }
+#if defined(NWK_JOIN_LINK)
+      else if (joinLink && (firstByte == JOIN_REQ_JOIN_LINK))
+      {
+        /* join+link reply returns link token and the connection */
+        memcpy(&linkToken, msg+JLR_LINK_TOKEN_OS, sizeof(linkToken));
+
+        nwk_setLinkToken(linkToken);
+        /* AP address first: the connection peer is taken from it */
+        nwk_setAPAddress(&apAddr);
+        nwk_joinLinkReply(msg, ioctl_info.recv.len, ioctl_info.recv.hopCount);
+        sJoinLinkMisses = 0;
+        sTid++;   /* guard against duplicates */
+        rc = SMPL_SUCCESS;
+#if defined( FREQUENCY_AGILITY )
+        break;
+#endif
+      }
+#endif  /* NWK_JOIN_LINK */
     }
+#if defined(NWK_JOIN_LINK)
+    else if (joinLink)
+    {
+      sJoinLinkMisses++;
+    }
+#endif
     /* TODO: process encryption stuff */
   }
 
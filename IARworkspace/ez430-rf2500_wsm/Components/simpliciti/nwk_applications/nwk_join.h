@@ -44,6 +44,13 @@
 #define JOIN_LEGACY_MSG_LENGTH        7
 #define JOIN_REPLY_LEGACY_MSG_LENGTH  6
 
+/* Unanswered join+link requests after which an End Device sends plain join
+ * requests and links as usual. An AP older than join+link ignores them.
+ */
+#ifndef NWK_JOIN_LINK_TRIES
+#define NWK_JOIN_LINK_TRIES  3
+#endif
+
 /* place holder... */
 #define SEC_CRYPT_KEY_SIZE  0
 
@@ -60,12 +67,35 @@
 #define JR_CRYPTKEY_SIZE_OS      6
 #define JR_CRYPTKEY_OS           7
 
+/*    join+link frame. Join frame fields followed by the link fields. The
+ *    Rx type is taken from the frame header.
+ */
+#define JL_RMT_PORT_OS           8
+#define JL_CTR_OS                9
+/*    join+link reply frame */
+#define JLR_LINK_TOKEN_OS        2
+#define JLR_RMT_PORT_OS          6
+#define JLR_MY_RXTYPE_OS         7
+#define JLR_CTR_OS               8
+#ifndef SMPL_SECURE
+#define JLR_TDMA_SLOT_OS         8
+#else
+#define JLR_TDMA_SLOT_OS         12
+#endif
+
 /* change the following as protocol developed */
 #define MAX_JOIN_APP_FRAME    (JR_CRYPTKEY_OS + SEC_CRYPT_KEY_SIZE)
 
 /* set out frame size */
 #define JOIN_FRAME_SIZE         8
 #define JOIN_REPLY_FRAME_SIZE   MAX_JOIN_APP_FRAME
+#ifndef SMPL_SECURE
+#define JOIN_LINK_FRAME_SIZE        9
+#define JOIN_LINK_REPLY_FRAME_SIZE  (8 + LINK_REPLY_TDMA_SIZE)
+#else
+#define JOIN_LINK_FRAME_SIZE        13
+#define JOIN_LINK_REPLY_FRAME_SIZE  (12 + LINK_REPLY_TDMA_SIZE)
+#endif
 
 /* join requests
  * NOTE: If aditional command codes are required do _not_ use the
@@ -74,6 +104,7 @@
  *       1.0.6) work correctly. Don't ask.
  */
 #define JOIN_REQ_JOIN       1
+#define JOIN_REQ_JOIN_LINK  2    /* join and link to the AP in one exchange */
 
 /* prototypes */
 void            nwk_joinInit(uint8_t (*)(linkID_t));
@@ -46,6 +46,7 @@
 #include "nwk_frame.h"
 #include "nwk.h"
 #include "nwk_link.h"
+#include "nwk_join.h"
 #include "nwk_globals.h"
 #include "nwk_security.h"
 
@@ -71,6 +72,13 @@ static volatile linkID_t sServiceLinkID[NUM_CONNECTIONS];
 #endif
 static volatile uint8_t  sNumLinkers = 0;
 static volatile uint8_t  sTid = 0;
+#if defined(NWK_JOIN_LINK) && !defined(ACCESS_POINT)
+/* Connection offered in a join+link request and the Link ID it got when
+ * the reply arrived. The Link ID is handed out by the next SMPL_Link().
+ */
+static connInfo_t       *spJoinLinkConn = NULL;
+static linkID_t          sJoinLinkID = 0;
+#endif
 
 /******************************************************************************
  * LOCAL FUNCTIONS
@@ -277,9 +285,20 @@ smplStatus_t nwk_unlink(linkID_t lid)
 smplStatus_t nwk_link(linkID_t *lid)
 {
   uint8_t       msg[LINK_FRAME_SIZE];
-  connInfo_t   *pCInfo = nwk_getNextConnection();
+  connInfo_t   *pCInfo;
   smplStatus_t  rc;
 
+#if defined(NWK_JOIN_LINK) && !defined(ACCESS_POINT)
+  /* Already linked to the AP by the join+link exchange? */
+  if (sJoinLinkID)
+  {
+    *lid        = sJoinLinkID;
+    sJoinLinkID = 0;
+    return SMPL_SUCCESS;
+  }
+#endif
+
+  pCInfo = nwk_getNextConnection();
   if (pCInfo)
   {
     addr_t              addr;
@@ -397,6 +416,10 @@ smplStatus_t nwk_link(linkID_t *lid)
 
 #if defined(SMPL_SECURE)
       nwk_getNumObjectFromMsg((void *)&msg[LR_CTR_OS], (void *)&pCInfo->connRxCTR, 4);
+#endif
+#if defined(NWK_TDMA)
+      /* The peer assigns the uplink slot. Our own table index means nothing to it. */
+      pCInfo->tdmaSlot = (ioctl_info.recv.len > LR_TDMA_SLOT_OS) ? msg[LR_TDMA_SLOT_OS] : NWK_TDMA_NO_SLOT;
 #endif
     }
 
@@ -536,6 +559,9 @@ static uint8_t smpl_send_link_reply(mrfiPacket_t *frame)
     nwk_putNumObjectIntoMsg((void *)&pCInfo->connTxCTR, (void *)&msg[LR_CTR_OS], 4);
     /* We also need to save the newly generated Rx counter value. */
     nwk_getNumObjectFromMsg((void *)(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+L_CTR_OS), (void *)&pCInfo->connRxCTR, 4);
+#endif
+#if defined(NWK_TDMA)
+    msg[LR_TDMA_SLOT_OS] = pCInfo->tdmaSlot;
 #endif
     if (pOutFrame = nwk_buildFrame(SMPL_PORT_LINK, msg, sizeof(msg), MAX_HOPS-(GET_FROM_FRAME(MRFI_P_PAYLOAD(frame),F_HOP_COUNT))))
     {
@@ -642,6 +668,10 @@ static uint8_t smpl_send_link_reply(mrfiPacket_t *frame)
                         ((uint32_t)(MRFI_RandomByte())<<24);
 
     nwk_putNumObjectIntoMsg((void *)&pCInfo->connTxCTR, (void *)&msg[LR_CTR_OS], 4);
+#endif
+#if defined(NWK_TDMA)
+    /* tell the peer which uplink slot it owns */
+    msg[LR_TDMA_SLOT_OS] = pCInfo->tdmaSlot;
 #endif
     if (pOutFrame = nwk_buildFrame(SMPL_PORT_LINK, msg, sizeof(msg), MAX_HOPS-(GET_FROM_FRAME(MRFI_P_PAYLOAD(frame),F_HOP_COUNT))))
     {
@@ -795,6 +825,212 @@ void nwk_setListenContext(uint8_t context)
   sListenActive = (context == LINK_LISTEN_ON) ? 1 : 0;
 }
 
+#if defined(NWK_JOIN_LINK)
+#if defined(ACCESS_POINT)
+#if defined(AP_IS_DATA_HUB)
+/******************************************************************************
+ * @fn          nwk_joinLinkAccept
+ *
+ * @brief       Set up the connection asked for in a join+link frame and fill
+ *              in the link part of the reply. The join part has already been
+ *              validated. A new Link ID is stacked exactly as if a Link frame
+ *              had been answered during a Link Listen so the application's
+ *              next SMPL_LinkListen() returns it at once. Runs in the ISR
+ *              thread.
+ *
+ * input parameters
+ * @param   frame   - join+link frame received
+ *
+ * output parameters
+ * @param   msg     - join+link reply message. Link fields are filled in.
+ *
+ * @return   JOIN_LINK_NEW if a connection was set up, JOIN_LINK_DUP if the
+ *           frame is a duplicate of one already answered, JOIN_LINK_NONE if
+ *           there is no room.
+ */
+uint8_t nwk_joinLinkAccept(mrfiPacket_t *frame, uint8_t *msg)
+{
+#if NUM_CONNECTIONS > 0
+  connInfo_t *pCInfo;
+  uint8_t     remotePort = *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+JL_RMT_PORT_OS);
+  uint8_t     rc = JOIN_LINK_DUP;
+
+  if (!(pCInfo=nwk_isLinkDuplicate(MRFI_P_SRC_ADDR(frame), remotePort)))
+  {
+    pCInfo = nwk_findAlreadyJoined(frame);
+    if (!pCInfo)
+    {
+      pCInfo = nwk_getNextConnection();
+    }
+    if (!pCInfo)
+    {
+      return JOIN_LINK_NONE;
+    }
+
+    memcpy(&pCInfo->peerAddr, MRFI_P_SRC_ADDR(frame), NET_ADDR_SIZE);
+    if (!nwk_allocateLocalRxPort(LINK_REPLY, pCInfo) || (NUM_CONNECTIONS == sNumLinkers))
+    {
+      nwk_freeConnection(pCInfo);
+      return JOIN_LINK_NONE;
+    }
+    sServiceLinkID[sNumLinkers++] = pCInfo->thisLinkID;
+
+    pCInfo->portTx    = remotePort;
+    pCInfo->connState = CONNSTATE_CONNECTED;
+
+    /* Same hop count rules as a Link frame. The Rx type is in the header. */
+    if (F_RX_TYPE_POLLS == GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_RX_TYPE))
+    {
+      pCInfo->hops2target = MAX_HOPS_FROM_AP;
+    }
+    else
+    {
+#if defined(DEVICE_DOES_NOT_MOVE)
+      pCInfo->hops2target = MAX_HOPS - GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_HOP_COUNT);
+#else
+      pCInfo->hops2target = MAX_HOPS;
+#endif
+    }
+#if defined(SMPL_SECURE)
+    pCInfo->connTxCTR = MRFI_RandomByte()                   | \
+                        ((uint32_t)(MRFI_RandomByte())<<8)  | \
+                        ((uint32_t)(MRFI_RandomByte())<<16) | \
+                        ((uint32_t)(MRFI_RandomByte())<<24);
+#endif
+    rc = JOIN_LINK_NEW;
+  }
+
+#if defined(SMPL_SECURE)
+  /* Peer's Tx counter is our Rx counter. A duplicate may carry a new one. */
+  nwk_getNumObjectFromMsg((void *)(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+JL_CTR_OS), (void *)&pCInfo->connRxCTR, 4);
+  nwk_putNumObjectIntoMsg((void *)&pCInfo->connTxCTR, (void *)&msg[JLR_CTR_OS], 4);
+#endif
+  msg[JLR_RMT_PORT_OS]  = pCInfo->portRx;
+  msg[JLR_MY_RXTYPE_OS] = nwk_getMyRxType();
+#if defined(NWK_TDMA)
+  msg[JLR_TDMA_SLOT_OS] = pCInfo->tdmaSlot;
+#endif
+
+  return rc;
+#else
+  return JOIN_LINK_NONE;
+#endif  /* NUM_CONNECTIONS */
+}
+#endif  /* AP_IS_DATA_HUB */
+
+#else  /* ACCESS_POINT */
+
+/******************************************************************************
+ * @fn          nwk_joinLinkRequest
+ *
+ * @brief       Fill in the link part of a join+link frame. The connection and
+ *              its local Rx port are set aside on the first call and kept
+ *              for retries so that the AP sees the same port and can spot a
+ *              duplicate.
+ *
+ * input parameters
+ *
+ * output parameters
+ * @param   msg     - join+link message. Link fields are filled in.
+ *
+ * @return   Non-zero if the link fields are valid. 0 if there is no room for
+ *           a connection, in which case a plain join should be sent.
+ */
+uint8_t nwk_joinLinkRequest(uint8_t *msg)
+{
+  if (!spJoinLinkConn)
+  {
+    if (!(spJoinLinkConn=nwk_getNextConnection()))
+    {
+      return 0;
+    }
+    if (!nwk_allocateLocalRxPort(LINK_SEND, spJoinLinkConn))
+    {
+      nwk_freeConnection(spJoinLinkConn);
+      spJoinLinkConn = NULL;
+      return 0;
+    }
+#if defined(SMPL_SECURE)
+    spJoinLinkConn->connTxCTR = MRFI_RandomByte()                   | \
+                                ((uint32_t)(MRFI_RandomByte())<<8)  | \
+                                ((uint32_t)(MRFI_RandomByte())<<16) | \
+                                ((uint32_t)(MRFI_RandomByte())<<24);
+#endif
+  }
+
+  msg[JL_RMT_PORT_OS] = spJoinLinkConn->portRx;
+#if defined(SMPL_SECURE)
+  nwk_putNumObjectIntoMsg((void *)&spJoinLinkConn->connTxCTR, (void *)&msg[JL_CTR_OS], 4);
+#endif
+
+  return 1;
+}
+
+/******************************************************************************
+ * @fn          nwk_joinLinkReply
+ *
+ * @brief       Complete the connection set aside by nwk_joinLinkRequest()
+ *              from a join+link reply, or release it if the AP answered with
+ *              a plain join reply.
+ *
+ * input parameters
+ * @param   msg      - join+link reply message, or NULL if the AP did not link
+ * @param   len      - length of reply message
+ * @param   hopCount - hop count remaining in the reply frame
+ *
+ * output parameters
+ *
+ * @return   void
+ */
+void nwk_joinLinkReply(uint8_t *msg, uint8_t len, uint8_t hopCount)
+{
+  connInfo_t *pCInfo = spJoinLinkConn;
+
+  spJoinLinkConn = NULL;
+  if (!pCInfo)
+  {
+    return;
+  }
+  if (!msg)
+  {
+    nwk_freeConnection(pCInfo);
+    return;
+  }
+
+  pCInfo->connState = CONNSTATE_CONNECTED;
+  pCInfo->portTx    = msg[JLR_RMT_PORT_OS];
+  /* the AP address is saved before we are called */
+  memcpy(pCInfo->peerAddr, nwk_getAPAddress(), NET_ADDR_SIZE);
+
+  if (F_RX_TYPE_POLLS == msg[JLR_MY_RXTYPE_OS])
+  {
+    pCInfo->hops2target = MAX_HOPS_FROM_AP;
+  }
+  else
+  {
+#if defined(DEVICE_DOES_NOT_MOVE)
+    pCInfo->hops2target = MAX_HOPS - hopCount;
+#else
+    pCInfo->hops2target = MAX_HOPS;
+#endif
+  }
+#if defined(SMPL_SECURE)
+  nwk_getNumObjectFromMsg((void *)&msg[JLR_CTR_OS], (void *)&pCInfo->connRxCTR, 4);
+#endif
+#if defined(NWK_TDMA)
+  pCInfo->tdmaSlot = (len > JLR_TDMA_SLOT_OS) ? msg[JLR_TDMA_SLOT_OS] : NWK_TDMA_NO_SLOT;
+#endif
+
+  sJoinLinkID = pCInfo->thisLinkID;
+
+  (void) len;       /* keep compiler happy */
+  (void) hopCount;
+
+  return;
+}
+#endif  /* ACCESS_POINT */
+#endif  /* NWK_JOIN_LINK */
+
 /******************************************************************************
  * @fn          handleLinkRequest
  *
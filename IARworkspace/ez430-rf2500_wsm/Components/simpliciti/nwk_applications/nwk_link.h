@@ -59,6 +59,11 @@
 #define LR_RMT_PORT_OS         2
 #define LR_MY_RXTYPE_OS        3
 #define LR_CTR_OS              4
+#ifndef SMPL_SECURE
+#define LR_TDMA_SLOT_OS        4
+#else
+#define LR_TDMA_SLOT_OS        8
+#endif
 
 /*    unlink frame */
 #define UL_RMT_PORT_OS        2
@@ -72,13 +77,22 @@
 #define MAX_LINK_APP_FRAME      13
 #endif
 
+/* The link reply carries the TDMA uplink slot as a trailing byte. A legacy
+ * peer that sends the shorter reply leaves the link without a slot.
+ */
+#ifdef NWK_TDMA
+#define LINK_REPLY_TDMA_SIZE    1
+#else
+#define LINK_REPLY_TDMA_SIZE    0
+#endif
+
 /* frame sizes */
 #ifndef SMPL_SECURE
 #define LINK_FRAME_SIZE         9
-#define LINK_REPLY_FRAME_SIZE   4
+#define LINK_REPLY_FRAME_SIZE   (4 + LINK_REPLY_TDMA_SIZE)
 #else
 #define LINK_FRAME_SIZE         13
-#define LINK_REPLY_FRAME_SIZE   8
+#define LINK_REPLY_FRAME_SIZE   (8 + LINK_REPLY_TDMA_SIZE)
 #endif
 #define UNLINK_FRAME_SIZE       3
 #define UNLINK_REPLY_FRAME_SIZE 3
@@ -93,6 +107,11 @@
 #define LINK_REQ_LINK       1
 #define LINK_REQ_UNLINK     2
 
+/* nwk_joinLinkAccept() results */
+#define JOIN_LINK_NONE      0
+#define JOIN_LINK_NEW       1
+#define JOIN_LINK_DUP       2
+
 /* prototypes */
 fhStatus_t   nwk_processLink(mrfiPacket_t *);
 linkID_t     nwk_getLocalLinkID(void);
@@ -102,5 +121,15 @@ smplStatus_t nwk_unlink(linkID_t);
 void         nwk_setLinkToken(uint32_t);
 void         nwk_getLinkToken(uint32_t *);
 void         nwk_setListenContext(uint8_t);
+#if defined(NWK_JOIN_LINK)
+#if defined(ACCESS_POINT)
+#if defined(AP_IS_DATA_HUB)
+uint8_t      nwk_joinLinkAccept(mrfiPacket_t *, uint8_t *);
+#endif
+#else
+uint8_t      nwk_joinLinkRequest(uint8_t *);
+void         nwk_joinLinkReply(uint8_t *, uint8_t, uint8_t);
+#endif
+#endif
 
 #endif
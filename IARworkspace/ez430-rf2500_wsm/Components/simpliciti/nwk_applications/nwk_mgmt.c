@@ -48,6 +48,10 @@
 #include "nwk_join.h"
 #include "nwk_globals.h"
 #include "nwk_QMgmt.h"
+#include "nwk_security.h"
+#ifdef NWK_TIME_SYNC
+#include "bsp_clock.h"
+#endif
 
 /******************************************************************************
  * MACROS
@@ -66,18 +70,77 @@
  */
 #ifndef ACCESS_POINT
 static addr_t const *sAPAddr = NULL;
+#if defined(RX_POLLS)
+/* state of the outstanding poll. written in the ISR thread. */
+static volatile uint8_t sPollTid     = 0;
+static volatile uint8_t sPollDone    = 0;
+static volatile uint8_t sPollPending = 0;
+/* non-zero while the AP is taken to be one without batched polls: polls
+ * left to send in the legacy format.
+ */
+static uint8_t          sPollLegacy  = 0;
+#endif
 #else
 static uint8_t sSFMarker[NUM_STORE_AND_FWD_CLIENTS] = {0};
 #endif
 
 static volatile uint8_t sTid = 0;
 
+#ifdef NWK_TDMA
+#ifdef ACCESS_POINT
+static uint16_t sSuperframe = 0;
+#else
+/* last beacon heard. written in the ISR thread. */
+static volatile uint16_t sBcnSuperframe = 0;
+static volatile uint8_t  sBcnNumSlots   = 0;
+static volatile uint8_t  sBcnSlotMs     = 0;
+static volatile uint8_t  sBcnRcvd       = 0;
+#endif
+#endif  /* NWK_TDMA */
+
+#ifdef NWK_TIME_SYNC
+/* Network time: milliseconds kept by accumulating local clock ticks at
+ * sTicksPerSec. The AP's clock defines the network time. An End Device or
+ * Range Extender restarts its count at every sync frame from its AP and
+ * measures its own clock rate from the interval between syncs. Written in
+ * the ISR thread.
+ */
+static volatile uint32_t sTimeMs      = 0;
+static volatile uint32_t sTimeTicks   = 0;
+static volatile uint16_t sTimeRem     = 0;
+static volatile uint16_t sTicksPerSec = BSP_CLOCK_TICKS_PER_SEC;
+static volatile uint32_t sSyncMs      = 0;
+static volatile uint32_t sSyncTicks   = 0;
+/* last local clock calibration handed in, 0 if none */
+static uint16_t          sCalTps      = 0;
+#ifndef ACCESS_POINT
+static volatile uint8_t  sSynced      = 0;
+static volatile uint8_t  sSyncRcvd    = 0;
+/* sTicksPerSec has been measured against the network time */
+static volatile uint8_t  sRateValid   = 0;
+#endif
+#endif  /* NWK_TIME_SYNC */
+
 /******************************************************************************
  * LOCAL FUNCTIONS
  */
 static void  smpl_send_mgmt_reply(mrfiPacket_t *);
 #ifdef ACCESS_POINT
 static void  send_poll_reply(mrfiPacket_t *);
+static void  send_poll_done(mrfiPacket_t *, uint8_t, uint8_t);
+#endif
+#ifdef NWK_TDMA
+static fhStatus_t process_beacon(mrfiPacket_t *);
+#ifdef ACCESS_POINT
+static smplStatus_t send_beacon(void);
+#endif
+#endif
+#ifdef NWK_TIME_SYNC
+static uint32_t   net_time(void);
+static fhStatus_t process_time(mrfiPacket_t *);
+#ifdef ACCESS_POINT
+static smplStatus_t send_time(void);
+#endif
 #endif
 
 /******************************************************************************
@@ -149,6 +212,33 @@ fhStatus_t nwk_processMgmt(mrfiPacket_t *frame)
     rc = FHS_REPLAY;
   }
 #endif  /* !END_DEVICE */
+#if defined(RX_POLLS)
+  else if (((MGMT_REQ_POLL | NWK_APP_REPLY_BIT) == *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+MB_APP_INFO_OS)) &&
+           (sPollTid == *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+MB_TID_OS)))
+  {
+    /* The AP is done streaming stored frames for our last poll. Note how
+     * many it still holds and cut the reply delay short.
+     */
+    sPollPending = *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+M_PDONE_PENDING_OS);
+    sPollDone    = 1;
+    MRFI_PostKillSem();
+    rc = FHS_RELEASE;
+  }
+#endif  /* RX_POLLS */
+#ifdef NWK_TDMA
+  else if (MGMT_REQ_BEACON == *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+MB_APP_INFO_OS))
+  {
+    /* beacons are broadcast and never get a reply */
+    rc = process_beacon(frame);
+  }
+#endif
+#ifdef NWK_TIME_SYNC
+  else if (MGMT_REQ_TIME == *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+MB_APP_INFO_OS))
+  {
+    /* time syncs are broadcast and never get a reply */
+    rc = process_time(frame);
+  }
+#endif
   else
   {
     /* no, we didn't send it. send reply if it's intended for us */
@@ -216,9 +306,10 @@ static void smpl_send_mgmt_reply(mrfiPacket_t *frame)
 static void send_poll_reply(mrfiPacket_t *frame)
 {
   uint8_t         msgtid = *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+MB_TID_OS);
+  uint8_t        *pMsg   = MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS;
   frameInfo_t    *pOutFrame;
   sfClientInfo_t *pClientInfo;
-  uint8_t         loc;
+  uint8_t         loc, maxFrames, sent = 0;
 
   /* Make sure this guy is really a client. We can tell from the source address. */
   if (!(pClientInfo=nwk_isSandFClient(MRFI_P_SRC_ADDR(frame), &loc)))
@@ -253,23 +344,36 @@ static void send_poll_reply(mrfiPacket_t *frame)
     return;
   }
 
-  if (pOutFrame = nwk_getSandFFrame(frame, M_POLL_PORT_OS))
+  /* A poll frame that carries the client's free input queue space asks for
+   * a batch: stream that many stored frames back-to-back while the client
+   * holds Rx open, then close with a single poll done frame. An older client
+   * sends the short poll frame and gets at most one frame per poll.
+   */
+  if ((MRFI_GET_PAYLOAD_LEN(frame) - F_APP_PAYLOAD_OS) >= MGMT_POLL_FRAME_SIZE)
   {
-    /* We need to adjust the order in the queue in this case. Currently
-     * we know it is in the input queue and that this adjustment is safe
-     * because we're in an ISR thread. This is a fragile fix, though, and
-     * should be revisited when time permits.
-     */
-    nwk_QadjustOrder(INQ, pOutFrame->orderStamp);
+    maxFrames = pMsg[M_POLL_MAX_OS];
+  }
+  else
+  {
+    maxFrames = 1;
+  }
 
+  while ((sent < maxFrames) && (pOutFrame = nwk_getSandFFrame(frame, M_POLL_PORT_OS, loc)))
+  {
     /* reset hop count... */
     PUT_INTO_FRAME(MRFI_P_PAYLOAD(&pOutFrame->mrfiPkt), F_HOP_COUNT, MAX_HOPS_FROM_AP);
     /* It's gonna be a forwarded frame. */
     PUT_INTO_FRAME(MRFI_P_PAYLOAD(&pOutFrame->mrfiPkt), F_FWD_FRAME, 0x80);
 
     nwk_sendFrame(pOutFrame, MRFI_TX_TYPE_FORCED);
+    sent++;
   }
-  else
+
+  if ((MRFI_GET_PAYLOAD_LEN(frame) - F_APP_PAYLOAD_OS) >= MGMT_POLL_FRAME_SIZE)
+  {
+    send_poll_done(frame, sent, nwk_QSandFPending(loc, pMsg[M_POLL_PORT_OS], pMsg+M_POLL_ADDR_OS));
+  }
+  else if (!sent)
   {
     nwk_SendEmptyPollRspFrame(frame);
   }
@@ -277,6 +381,44 @@ static void send_poll_reply(mrfiPacket_t *frame)
   return;
 }
 
+/******************************************************************************
+ * @fn          send_poll_done
+ *
+ * @brief       Close a batched poll reply. Tells the client how many frames
+ *              were just sent and how many are still waiting.
+ *
+ * input parameters
+ * @param  frame    - Pointer to poll frame being answered.
+ * @param  sent     - Number of stored frames sent in this batch.
+ * @param  pending  - Number of stored frames still waiting for the client.
+ *
+ * output parameters
+ *
+ * @return   void
+ */
+static void send_poll_done(mrfiPacket_t *frame, uint8_t sent, uint8_t pending)
+{
+  uint8_t      msg[MGMT_POLL_DONE_FRAME_SIZE];
+  frameInfo_t *pOutFrame;
+
+  msg[MB_APP_INFO_OS]     = MGMT_REQ_POLL | NWK_APP_REPLY_BIT;
+  msg[MB_TID_OS]          = *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+MB_TID_OS);
+  msg[M_PDONE_PORT_OS]    = *(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS+M_POLL_PORT_OS);
+  msg[M_PDONE_SENT_OS]    = sent;
+  msg[M_PDONE_PENDING_OS] = pending;
+
+  if (pOutFrame = nwk_buildFrame(SMPL_PORT_MGMT, msg, sizeof(msg), MAX_HOPS_FROM_AP))
+  {
+    memcpy(MRFI_P_DST_ADDR(&pOutFrame->mrfiPkt), MRFI_P_SRC_ADDR(frame), NET_ADDR_SIZE);
+#if defined(SMPL_SECURE)
+    nwk_setSecureFrame(&pOutFrame->mrfiPkt, sizeof(msg), 0);
+#endif
+    nwk_sendFrame(pOutFrame, MRFI_TX_TYPE_FORCED);
+  }
+
+  return;
+}
+
 /******************************************************************************
  * @fn          nwk_resetSFMarker
  *
@@ -318,16 +460,36 @@ smplStatus_t nwk_poll(uint8_t port, uint8_t *addr)
 {
   uint8_t        msg[MGMT_POLL_FRAME_SIZE];
   ioctlRawSend_t send;
+  frameInfo_t   *pFI = nwk_getQ(INQ);
+  uint8_t        i, room = 0;
+
+  /* Ask for no more frames than we have room for. Anything more would cast
+   * out frames already waiting for the application. The poll done frame
+   * that closes the batch takes a slot too.
+   */
+  for (i=0; i<SIZE_INFRAME_Q; ++i, ++pFI)
+  {
+    if (FI_AVAILABLE == pFI->fi_usage)
+    {
+      room++;
+    }
+  }
+  room = (room > 1) ? room - 1 : 1;
 
   msg[MB_APP_INFO_OS] = MGMT_REQ_POLL;
   msg[MB_TID_OS]      = sTid;
   msg[M_POLL_PORT_OS] = port;
   memcpy(msg+M_POLL_ADDR_OS, addr, NET_ADDR_SIZE);
+  msg[M_POLL_MAX_OS]  = room;
 
-  /* it's OK to increment the TID here because the reply will not be
-   * matched based on this number. The reply to the poll comes back
-   * to the client port, not the Management port.
+  /* it's OK to increment the TID here because the frames themselves will
+   * not be matched based on this number. They come back to the client port,
+   * not the Management port. Only the poll done frame echoes the TID.
    */
+#if defined(RX_POLLS)
+  sPollTid  = sTid;
+  sPollDone = 0;
+#endif
   sTid++;
 
   if (!sAPAddr)
@@ -342,8 +504,452 @@ smplStatus_t nwk_poll(uint8_t port, uint8_t *addr)
   send.msg  = msg;
   send.len  = sizeof(msg);
   send.port = SMPL_PORT_MGMT;
+#if defined(RX_POLLS)
+  if (sPollLegacy)
+  {
+    sPollLegacy--;
+    send.len = MGMT_POLL_LEGACY_FRAME_SIZE;
+  }
+#endif
 
   return SMPL_Ioctl(IOCTL_OBJ_RAW_IO, IOCTL_ACT_WRITE, &send);
 }
 
+/******************************************************************************
+ * @fn          nwk_pollDone
+ *
+ * @brief       Has the AP closed the batched reply to our last poll?
+ *
+ * input parameters
+ *
+ * output parameters
+ * @param  pending  - Number of frames the AP still holds for us. Valid only
+ *                    if the poll is done. May be null.
+ *
+ * @return   Non-zero if the poll done frame has been received, otherwise 0.
+ */
+uint8_t nwk_pollDone(uint8_t *pending)
+{
+#if defined(RX_POLLS)
+  if (pending)
+  {
+    *pending = sPollPending;
+  }
+  return sPollDone;
+#else
+  (void) pending;
+
+  return 0;
+#endif
+}
+
+/******************************************************************************
+ * @fn          nwk_pollWaits
+ *
+ * @brief       How many reply delays to hold Rx open for the answer to the
+ *              poll just sent. A batch may take one per input queue slot; a
+ *              legacy AP sends one frame.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return   Number of NWK_REPLY_DELAY()s to wait at most.
+ */
+uint8_t nwk_pollWaits(void)
+{
+#if defined(RX_POLLS)
+  if (sPollLegacy)
+  {
+    return 1;
+  }
+#endif
+  return SIZE_INFRAME_Q + 1;
+}
+
+/******************************************************************************
+ * @fn          nwk_pollReplied
+ *
+ * @brief       Note the outcome of the poll just sent. A frame without a
+ *              poll done frame means the AP does not batch: send the legacy
+ *              poll frame for the next NWK_POLL_LEGACY_POLLS polls, then try
+ *              a batched one again in case the poll done frame was only lost.
+ *
+ * input parameters
+ * @param  gotFrame  - Non-zero if a frame came back for the polled port.
+ *
+ * output parameters
+ *
+ * @return   void
+ */
+void nwk_pollReplied(uint8_t gotFrame)
+{
+#if defined(RX_POLLS)
+  if (sPollDone)
+  {
+    sPollLegacy = 0;
+  }
+  else if (gotFrame && !sPollLegacy)
+  {
+    sPollLegacy = NWK_POLL_LEGACY_POLLS;
+  }
+#else
+  (void) gotFrame;
+#endif
+
+  return;
+}
+
 #endif /* ACCESS_POINT */
+
+#ifdef NWK_TDMA
+/******************************************************************************
+ * @fn          process_beacon
+ *
+ * @brief       Handle a received TDMA beacon. An End Device latches the
+ *              schedule if the beacon came from its own AP. A Range Extender
+ *              passes the beacon on so Devices out of range of the AP stay
+ *              synchronised.
+ *
+ * input parameters
+ * @param  frame  - Pointer to beacon frame.
+ *
+ * output parameters
+ *
+ * @return   Release frame or replay frame.
+ */
+static fhStatus_t process_beacon(mrfiPacket_t *frame)
+{
+#if defined(END_DEVICE)
+  uint8_t      *pMsg = MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS;
+  addr_t const *apAddr = nwk_getAPAddress();
+
+  if (apAddr && !memcmp(MRFI_P_SRC_ADDR(frame), apAddr, NET_ADDR_SIZE))
+  {
+    nwk_getNumObjectFromMsg((void *)(pMsg+M_BCN_SUPERFRAME_OS), (void *)&sBcnSuperframe, sizeof(sBcnSuperframe));
+    sBcnNumSlots = pMsg[M_BCN_NUM_SLOTS_OS];
+    sBcnSlotMs   = pMsg[M_BCN_SLOT_MS_OS];
+    sBcnRcvd     = 1;
+  }
+
+  return FHS_RELEASE;
+#elif defined(RANGE_EXTENDER)
+  (void) frame;
+
+  return FHS_REPLAY;
+#else
+  (void) frame;
+
+  return FHS_RELEASE;
+#endif
+}
+
+#ifdef ACCESS_POINT
+/******************************************************************************
+ * @fn          send_beacon
+ *
+ * @brief       Broadcast the TDMA beacon that starts the next superframe.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return   Status of the raw send.
+ */
+static smplStatus_t send_beacon(void)
+{
+  uint8_t        msg[MGMT_BEACON_FRAME_SIZE];
+  ioctlRawSend_t send;
+
+  msg[MB_APP_INFO_OS]     = MGMT_REQ_BEACON;
+  msg[MB_TID_OS]          = sTid;
+  nwk_putNumObjectIntoMsg((void *)&sSuperframe, (void *)&msg[M_BCN_SUPERFRAME_OS], sizeof(sSuperframe));
+  msg[M_BCN_NUM_SLOTS_OS] = NUM_CONNECTIONS;
+  msg[M_BCN_SLOT_MS_OS]   = NWK_TDMA_SLOT_MS;
+
+  sSuperframe++;
+
+  send.addr = (addr_t *)nwk_getBCastAddress();
+  send.msg  = msg;
+  send.len  = sizeof(msg);
+  send.port = SMPL_PORT_MGMT;
+
+  return SMPL_Ioctl(IOCTL_OBJ_RAW_IO, IOCTL_ACT_WRITE, &send);
+}
+#endif  /* ACCESS_POINT */
+
+/******************************************************************************
+ * @fn          nwk_tdmaControl
+ *
+ * @brief       TDMA schedule control. The AP writes to send a beacon. Any
+ *              device can read the schedule and the slot owned by a link.
+ *
+ * input parameters
+ * @param  action  - IOCTL_ACT_WRITE (AP only) or IOCTL_ACT_GET
+ * @param  val     - Schedule object. May be null for IOCTL_ACT_WRITE.
+ *
+ * output parameters
+ * @param  val     - Schedule information for IOCTL_ACT_GET. beaconRcvd is
+ *                   cleared by the read.
+ *
+ * @return   SMPL_SUCCESS
+ *           SMPL_BAD_PARAM   - action not supported on this device
+ *           status of raw send for IOCTL_ACT_WRITE
+ */
+smplStatus_t nwk_tdmaControl(ioctlAction_t action, ioctlTDMA_t *val)
+{
+  connInfo_t *pCInfo;
+
+#ifdef ACCESS_POINT
+  if (IOCTL_ACT_WRITE == action)
+  {
+    return send_beacon();
+  }
+#endif
+
+  if (IOCTL_ACT_GET != action)
+  {
+    return SMPL_BAD_PARAM;
+  }
+
+#ifdef ACCESS_POINT
+  val->superframe = sSuperframe;
+  val->numSlots   = NUM_CONNECTIONS;
+  val->slotMs     = NWK_TDMA_SLOT_MS;
+  val->beaconRcvd = 0;
+#else
+  {
+    bspIState_t intState;
+
+    BSP_ENTER_CRITICAL_SECTION(intState);
+    val->superframe = sBcnSuperframe;
+    val->numSlots   = sBcnNumSlots;
+    val->slotMs     = sBcnSlotMs;
+    val->beaconRcvd = sBcnRcvd;
+    sBcnRcvd        = 0;
+    BSP_EXIT_CRITICAL_SECTION(intState);
+  }
+#endif
+
+  pCInfo    = nwk_getConnInfo(val->lid);
+  val->slot = pCInfo ? pCInfo->tdmaSlot : NWK_TDMA_NO_SLOT;
+
+  return SMPL_SUCCESS;
+}
+#endif  /* NWK_TDMA */
+
+#ifdef NWK_TIME_SYNC
+/******************************************************************************
+ * @fn          net_time
+ *
+ * @brief       Bring the network time up to date with the local clock and
+ *              return it. The tick remainder is carried so no time is lost
+ *              between calls. Must be called at least once per 2^32 ticks
+ *              and with interrupts off.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return   Network time in milliseconds.
+ */
+static uint32_t net_time(void)
+{
+  uint32_t now = BSP_ClockTicks();
+  uint32_t d   = now - sTimeTicks;
+  uint32_t r;
+
+  sTimeTicks = now;
+  r          = (d % sTicksPerSec) * 1000 + sTimeRem;
+  sTimeMs   += (d / sTicksPerSec) * 1000 + r / sTicksPerSec;
+  sTimeRem   = r % sTicksPerSec;
+
+  return sTimeMs;
+}
+
+/******************************************************************************
+ * @fn          process_time
+ *
+ * @brief       Handle a received time sync frame. An End Device takes the
+ *              network time from its own AP and updates its estimate of the
+ *              local clock rate. A Range Extender passes the frame on.
+ *
+ * input parameters
+ * @param  frame  - Pointer to time sync frame.
+ *
+ * output parameters
+ *
+ * @return   Release frame or replay frame.
+ */
+static fhStatus_t process_time(mrfiPacket_t *frame)
+{
+#if defined(END_DEVICE)
+  uint8_t      *pMsg   = MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS;
+  addr_t const *apAddr = nwk_getAPAddress();
+  uint32_t      now, ms, dt, dn, rate;
+
+  if (apAddr && !memcmp(MRFI_P_SRC_ADDR(frame), apAddr, NET_ADDR_SIZE))
+  {
+    now = BSP_ClockTicks();
+    nwk_getNumObjectFromMsg((void *)(pMsg+M_TIME_MS_OS), (void *)&ms, sizeof(ms));
+
+    /* Rate from the interval since the last sync. Short intervals say
+     * little and long ones would overflow.
+     */
+    if (sSynced)
+    {
+      dt = now - sSyncTicks;
+      dn = ms - sSyncMs;
+      if ((dn >= 1000) && (dn <= NWK_TIME_RATE_MAX_MS))
+      {
+        rate = dt * 1000 / dn;
+        if ((rate >= NWK_TIME_MIN_TICKS_PER_SEC) && (rate <= NWK_TIME_MAX_TICKS_PER_SEC))
+        {
+          sTicksPerSec = (3 * (uint32_t)sTicksPerSec + rate + 2) / 4;
+          sRateValid   = 1;
+        }
+      }
+    }
+
+    sSyncTicks = sTimeTicks = now;
+    sSyncMs    = sTimeMs    = ms;
+    sTimeRem   = 0;
+    sSynced    = 1;
+    sSyncRcvd  = 1;
+  }
+
+  return FHS_RELEASE;
+#elif defined(RANGE_EXTENDER)
+  (void) frame;
+
+  return FHS_REPLAY;
+#else
+  (void) frame;
+
+  return FHS_RELEASE;
+#endif
+}
+
+#ifdef ACCESS_POINT
+/******************************************************************************
+ * @fn          send_time
+ *
+ * @brief       Broadcast the network time. It is read just before the send,
+ *              so only the CCA backoff and the air time are not accounted
+ *              for.
+ *
+ * input parameters
+ *
+ * output parameters
+ *
+ * @return   Status of the raw send.
+ */
+static smplStatus_t send_time(void)
+{
+  uint8_t        msg[MGMT_TIME_FRAME_SIZE];
+  ioctlRawSend_t send;
+  bspIState_t    intState;
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  sSyncMs    = net_time();
+  sSyncTicks = sTimeTicks;
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  msg[MB_APP_INFO_OS] = MGMT_REQ_TIME;
+  msg[MB_TID_OS]      = sTid;
+  nwk_putNumObjectIntoMsg((void *)&sSyncMs, (void *)&msg[M_TIME_MS_OS], sizeof(sSyncMs));
+
+  send.addr = (addr_t *)nwk_getBCastAddress();
+  send.msg  = msg;
+  send.len  = sizeof(msg);
+  send.port = SMPL_PORT_MGMT;
+
+  return SMPL_Ioctl(IOCTL_OBJ_RAW_IO, IOCTL_ACT_WRITE, &send);
+}
+#endif  /* ACCESS_POINT */
+
+/******************************************************************************
+ * @fn          nwk_timeControl
+ *
+ * @brief       Network time control. The AP writes to broadcast a time sync.
+ *              Any device can read the network time, and set the local clock
+ *              rate from a calibration (ticksPerSec). The AP's rate defines
+ *              the network's. Once an End Device has measured its rate
+ *              against the network it only applies the change from one
+ *              calibration to the next.
+ *
+ * input parameters
+ * @param  action  - IOCTL_ACT_WRITE (AP only), IOCTL_ACT_SET or IOCTL_ACT_GET
+ * @param  val     - Time object. May be null for IOCTL_ACT_WRITE.
+ *
+ * output parameters
+ * @param  val     - Time information for IOCTL_ACT_GET. syncRcvd is cleared
+ *                   by the read. Until the first sync an End Device counts
+ *                   from its own reset.
+ *
+ * @return   SMPL_SUCCESS
+ *           SMPL_BAD_PARAM   - action not supported on this device
+ *           status of raw send for IOCTL_ACT_WRITE
+ */
+smplStatus_t nwk_timeControl(ioctlAction_t action, ioctlTime_t *val)
+{
+  bspIState_t intState;
+  uint32_t    tps;
+
+#ifdef ACCESS_POINT
+  if (IOCTL_ACT_WRITE == action)
+  {
+    return send_time();
+  }
+#endif
+
+  if (IOCTL_ACT_SET == action)
+  {
+    if (!val->ticksPerSec)
+    {
+      return SMPL_BAD_PARAM;
+    }
+
+    BSP_ENTER_CRITICAL_SECTION(intState);
+    /* time so far counts at the old rate */
+    net_time();
+    tps = val->ticksPerSec;
+#ifndef ACCESS_POINT
+    if (sRateValid && sCalTps)
+    {
+      tps = (uint32_t)sTicksPerSec * val->ticksPerSec / sCalTps;
+    }
+#endif
+    if ((tps >= NWK_TIME_MIN_TICKS_PER_SEC) && (tps <= NWK_TIME_MAX_TICKS_PER_SEC))
+    {
+      sTicksPerSec = tps;
+    }
+    sCalTps = val->ticksPerSec;
+    BSP_EXIT_CRITICAL_SECTION(intState);
+
+    return SMPL_SUCCESS;
+  }
+
+  if (IOCTL_ACT_GET != action)
+  {
+    return SMPL_BAD_PARAM;
+  }
+
+  BSP_ENTER_CRITICAL_SECTION(intState);
+  val->netMs       = net_time();
+  val->syncMs      = sSyncMs;
+  val->syncTicks   = sSyncTicks;
+  val->ticksPerSec = sTicksPerSec;
+#ifdef ACCESS_POINT
+  val->synced      = 1;
+  val->syncRcvd    = 0;
+#else
+  val->synced      = sSynced;
+  val->syncRcvd    = sSyncRcvd;
+  sSyncRcvd        = 0;
+#endif
+  BSP_EXIT_CRITICAL_SECTION(intState);
+
+  return SMPL_SUCCESS;
+}
+#endif  /* NWK_TIME_SYNC */
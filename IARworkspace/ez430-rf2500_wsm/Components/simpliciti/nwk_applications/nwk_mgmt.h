@@ -39,9 +39,11 @@
 
 /* MGMT frame application requests */
 #define  MGMT_REQ_POLL        0x01
+#define  MGMT_REQ_BEACON      0x02
+#define  MGMT_REQ_TIME        0x03
 
 /* change the following as protocol developed */
-#define MAX_MGMT_APP_FRAME    7
+#define MAX_MGMT_APP_FRAME    8
 
 /* application payload offsets */
 /*    both */
@@ -51,17 +53,79 @@
 /*    Poll frame */
 #define M_POLL_PORT_OS          2
 #define M_POLL_ADDR_OS          3
+#define M_POLL_MAX_OS           7
+
+/*    Poll done frame. Sent by the AP after a batch of stored frames. */
+#define M_PDONE_PORT_OS         2
+#define M_PDONE_SENT_OS         3
+#define M_PDONE_PENDING_OS      4
+
+/*    Beacon frame */
+#define M_BCN_SUPERFRAME_OS     2
+#define M_BCN_NUM_SLOTS_OS      4
+#define M_BCN_SLOT_MS_OS        5
+
+/*    Time sync frame */
+#define M_TIME_MS_OS            2
+
+/* Bounds on the local clock rate an End Device accepts from its measurement
+ * (the VLO is specified at 4 to 20 kHz), and the longest sync interval it
+ * measures over: longer ones overflow 32 bits at the top rate.
+ */
+#define NWK_TIME_MIN_TICKS_PER_SEC   4000
+#define NWK_TIME_MAX_TICKS_PER_SEC   20000
+#define NWK_TIME_RATE_MAX_MS         120000
+
+/* TDMA uplink slot width in milliseconds */
+#ifndef NWK_TDMA_SLOT_MS
+#define NWK_TDMA_SLOT_MS      100
+#endif
+
+/* The superframe is the one second tick of the sensor demo. An End Device
+ * wakes NWK_TDMA_GUARD_MS ahead of the beacon and slot 0 starts one slot
+ * width after it, so the last of the NUM_CONNECTIONS slots has to end
+ * before the next wakeup.
+ */
+#define NWK_TDMA_SUPERFRAME_MS  1000
+#define NWK_TDMA_GUARD_MS       10
+
+#if defined(NWK_TDMA) && defined(ACCESS_POINT) && \
+    (NWK_TDMA_GUARD_MS + (NUM_CONNECTIONS+1) * NWK_TDMA_SLOT_MS >= NWK_TDMA_SUPERFRAME_MS)
+#error ERROR: NUM_CONNECTIONS TDMA slots of NWK_TDMA_SLOT_MS do not fit in the superframe.
+#endif
+
+/* Polls an End Device sends in the legacy format once its AP has answered
+ * without a poll done frame, before it tries a batched poll again.
+ */
+#ifndef NWK_POLL_LEGACY_POLLS
+#define NWK_POLL_LEGACY_POLLS 16
+#endif
 
 /* change the following as protocol developed */
-#define MAX_MGMT_APP_FRAME    7
+#define MAX_MGMT_APP_FRAME    8
 
-/* frame sizes */
-#define MGMT_POLL_FRAME_SIZE  7
+/* frame sizes. An AP older than batched polls answers the legacy poll frame
+ * (no M_POLL_MAX_OS byte) with one frame and no poll done frame.
+ */
+#define MGMT_POLL_FRAME_SIZE  8
+#define MGMT_POLL_LEGACY_FRAME_SIZE  7
+#define MGMT_POLL_DONE_FRAME_SIZE    5
+#define MGMT_BEACON_FRAME_SIZE  6
+#define MGMT_TIME_FRAME_SIZE    6
 
 /* prototypes */
 void         nwk_mgmtInit(void);
 fhStatus_t   nwk_processMgmt(mrfiPacket_t *);
 smplStatus_t nwk_poll(uint8_t, uint8_t *);
+uint8_t      nwk_pollDone(uint8_t *);
+uint8_t      nwk_pollWaits(void);
+void         nwk_pollReplied(uint8_t);
 void         nwk_resetSFMarker(uint8_t);
+#ifdef NWK_TDMA
+smplStatus_t nwk_tdmaControl(ioctlAction_t, ioctlTDMA_t *);
+#endif
+#ifdef NWK_TIME_SYNC
+smplStatus_t nwk_timeControl(ioctlAction_t, ioctlTime_t *);
+#endif
 
 #endif
@@ -59,6 +59,14 @@
  * longer than 64 bits we encipher the next block (incrementing the counter) and
  * continue until the message is exhausted. If the last cipher block is longer
  * than the message we simply discard the remaining cipher block.
+ *
+ * If SMPL_SECURE_MAC_SIZE is non-zero the constant MAC and XOR check byte are
+ * replaced by a truncated CBC-MAC computed with the same XTEA key over the
+ * enciphered payload. The first MAC block carries the payload length, port,
+ * folded addresses and the full counter. Its first word never has the top
+ * bit set so it can not match a CTR block (IV in the first word). Since the
+ * tag covers the ciphertext a receiver checks it before deciphering anything.
+ * The tag itself is sent in the clear.
  */
 
 
@@ -85,10 +93,21 @@
  */
 #define NUM_ROUNDS  32
 
+#if NUM_ROUNDS & 1
+#error ERROR: NUM_ROUNDS must be even. The cipher loop does two rounds per pass.
+#endif
+
+/* XTEA round constant */
+#define XTEA_DELTA  0x9E3779B9
+
 /* Key and cipher block size constants */
 #define SMPL_KEYSIZE_BYTES    16
 #define SMPL_KEYSIZE_LONGS     4
 
+#ifndef SMPL_SECURE_MAC_SIZE
+#define SMPL_SECURE_MAC_SIZE   0
+#endif
+
 /******************************************************************************
  * TYPEDEFS
  */
@@ -117,6 +136,7 @@ static uint32_t const sIV = 0x87654321;
  */
 static key_t sKey = {"SimpliciTI's Key"};
 
+#if SMPL_SECURE_MAC_SIZE == 0
 /* Constant set as an authentication code. Note that since it is a
  * fixed value as opposed to a hash of the message it does not provide
  * an integrity check. It will only differentiate two message encryptions
@@ -124,19 +144,47 @@ static key_t sKey = {"SimpliciTI's Key"};
  * against replays.
  */
 static secMAC_t const sMAC = 0xA5;
+#endif
+
+#if defined(SMPL_XTEA_SCHEDULE)
+/* Round-key schedule built from the key at initialization. Each entry is the
+ * (sum + key word) term of one half round so the cipher loop does not need
+ * the running sum or the key lookups.
+ */
+static uint32_t sRoundKey[2*NUM_ROUNDS];
+#else
+/* Key word indices for each round. The round sums do not depend on the key so
+ * the indices are fixed: the low 2 bits are (sum & 3) for the first half
+ * round and bits 2-3 are ((sum>>11) & 3) for the second half round with the
+ * sum already advanced. Kept in flash.
+ */
+static uint8_t const sKeyIdx[NUM_ROUNDS] = {
+  0x0C, 0x09, 0x06, 0x03, 0x00, 0x0D, 0x0A, 0x07,
+  0x00, 0x01, 0x0E, 0x0B, 0x04, 0x05, 0x02, 0x0F,
+  0x08, 0x05, 0x06, 0x03, 0x0C, 0x09, 0x06, 0x07,
+  0x00, 0x0D, 0x0A, 0x0B, 0x04, 0x01, 0x0E, 0x0B
+};
+#endif
 
-/* This is the 64-bit cipher block target. It is this 64-bit block that
- * is XOR'ed with the actual message to be encrypted.
+#if NWK_KS_BLOCKS > 0
+/* Keystream cache consulted by msg_encipher(). Set only while a connection
+ * frame is being secured or checked. A cached block depends only on the
+ * counter so it is right for any caller using the same counter value.
  */
-static uint32_t sMsg[2] = {0, 0};
+static ksCache_t *spKs = NULL;
+#endif
 
 /******************************************************************************
  * LOCAL FUNCTIONS
  */
+#if SMPL_SECURE_MAC_SIZE > 0
+static void     calcMAC(mrfiPacket_t *, uint8_t, uint32_t, uint8_t *);
+#else
 static secFCS_t calcFCS(uint8_t *, uint8_t);
+#endif
 static void     msg_encipher(uint8_t *, uint8_t, uint32_t *);
 static void     msg_decipher(uint8_t *, uint8_t, uint32_t *);
-static void     xtea_encipher(void);
+static void     xtea_encipher(uint32_t *);
 
 #endif  /* SMPL_SECURE */
 
@@ -166,6 +214,22 @@ void nwk_securityInit(void)
     sKey.keyL[i] = ntohl(sKey.keyL[i]);
   }
 
+#if defined(SMPL_XTEA_SCHEDULE)
+  /* Fold the running sum and the key word of every half round into one
+   * value so the cipher does a single lookup per half round.
+   */
+  {
+    uint32_t sum = 0;
+
+    for (i=0; i<NUM_ROUNDS; ++i)
+    {
+      sRoundKey[2*i] = sum + sKey.keyL[sum & 3];
+      sum += XTEA_DELTA;
+      sRoundKey[2*i+1] = sum + sKey.keyL[(sum>>11) & 3];
+    }
+  }
+#endif
+
 #endif  /* SMPL_SECURE */
   return;
 }
@@ -207,8 +271,12 @@ fhStatus_t nwk_processSecurity(mrfiPacket_t *frame)
 static void msg_encipher(uint8_t *msg, uint8_t len, uint32_t *cntStart)
 {
   uint8_t  i, idx, done;
-  uint8_t *mptr = (uint8_t *)&sMsg[0];
+  uint8_t *mptr;
   uint32_t ctr;
+  /* 64-bit cipher block target. It is this block that is XOR'ed with the
+   * actual message. Local so the user and Rx ISR threads never share it.
+   */
+  uint32_t blk[2];
 
   if ((NULL == msg) || !len)
   {
@@ -222,20 +290,31 @@ static void msg_encipher(uint8_t *msg, uint8_t len, uint32_t *cntStart)
   done = 0;
   do
   {
-    /* Set block to be enciphered. 1st 32 bits are the IV. The second
-     * 32 bits are the current CTR value.
-     */
-    sMsg[0] = sIV;
-    sMsg[1] = ctr;
-    /* encrypt */
-    xtea_encipher();
+#if NWK_KS_BLOCKS > 0
+    /* Use the precomputed block if there is one for this counter value. */
+    if (spKs && ((ctr - spKs->ctr) < spKs->num))
+    {
+      mptr = spKs->ks[ctr - spKs->ctr];
+    }
+    else
+#endif
+    {
+      /* Set block to be enciphered. 1st 32 bits are the IV. The second
+       * 32 bits are the current CTR value.
+       */
+      blk[0] = sIV;
+      blk[1] = ctr;
+      /* encrypt */
+      xtea_encipher(blk);
+      mptr = (uint8_t *)blk;
+    }
     /* increment counter for next time. */
     ctr++;
     /* XOR ciphered block with message to be sent. Only operate
      * up to and including the last message byte which may not
      * be on a cipher block boundary (64 bits == 8 bytes).
      */
-    for (i=0; i<sizeof(sMsg) && idx<len; ++i, ++idx)
+    for (i=0; i<sizeof(blk) && idx<len; ++i, ++idx)
     {
       msg[idx] ^= mptr[i];
     }
@@ -279,30 +358,52 @@ static void msg_decipher(uint8_t *msg, uint8_t len, uint32_t *cntStart)
 /******************************************************************************
  * @fn          xtea_encipher
  *
- * @brief       XTEA encipher algorithm. Calling arguments removed from public
- *              domain code and static-scope values used instead.
+ * @brief       XTEA encipher algorithm. Number of rounds and key removed from
+ *              the public domain calling arguments and static-scope values
+ *              used instead. Two rounds are done per pass with the block
+ *              held in locals. The round keys come from the schedule built
+ *              at initialization if SMPL_XTEA_SCHEDULE is defined, otherwise
+ *              from the key through the fixed key index table.
  *
  * input parameters
+ * @param   v   - 64-bit block to encipher
  *
  * output parameters
+ * @param   v   - enciphered block
  *
  * @return      void
  */
-void xtea_encipher(void)
+void xtea_encipher(uint32_t *v)
 {
-  uint32_t v0=sMsg[0], v1=sMsg[1];
-  uint16_t i;
-  uint32_t sum=0, delta=0x9E3779B9;
+  uint32_t v0=v[0], v1=v[1];
+  uint8_t  i;
+#if defined(SMPL_XTEA_SCHEDULE)
+  uint32_t const *rk = sRoundKey;
 
-  for(i=0; i<NUM_ROUNDS; i++)
+  for (i=0; i<NUM_ROUNDS; i+=2, rk+=4)
   {
-    v0  += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + sKey.keyL[sum & 3]);
-    sum += delta;
-    v1  += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + sKey.keyL[(sum>>11) & 3]);
+    v0 += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ rk[0];
+    v1 += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ rk[1];
+    v0 += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ rk[2];
+    v1 += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ rk[3];
   }
+#else
+  uint8_t const *ki = sKeyIdx;
+  uint32_t sum = 0;
 
-  sMsg[0]=v0;
-  sMsg[1]=v1;
+  for (i=0; i<NUM_ROUNDS; i+=2, ki+=2)
+  {
+    v0  += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + sKey.keyL[ki[0] & 3]);
+    sum += XTEA_DELTA;
+    v1  += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + sKey.keyL[ki[0] >> 2]);
+    v0  += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + sKey.keyL[ki[1] & 3]);
+    sum += XTEA_DELTA;
+    v1  += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + sKey.keyL[ki[1] >> 2]);
+  }
+#endif
+
+  v[0]=v0;
+  v[1]=v1;
 }
 
 /******************************************************************************
@@ -320,7 +421,7 @@ void xtea_encipher(void)
  *                    is used.
  *
  * output parameters
- * @param   cntStart - counter is updated during encryption.
+ * @param   ctr     - advanced past the counter values used by this frame.
  *
  * @return      void
  */
@@ -328,16 +429,49 @@ void nwk_setSecureFrame(mrfiPacket_t *frame, uint8_t msglen, uint32_t *ctr)
 {
   uint32_t locCnt;
 
-  /* If an encrypted frame is to be sent to a non-connection based port use a
-   * random number as the lsb counter value. In this case only the lsb is used
-   * for a counter value during decryption. Not as secure but there are still
-   * the 32 bits in the IV.
-   */
-  locCnt = ctr ? *ctr : MRFI_RandomByte();
+  if (ctr)
+  {
+    bspIState_t intState;
+#if SMPL_SECURE_MAC_SIZE > 0
+    /* an empty frame still uses up a counter value */
+    uint8_t     len = msglen ? msglen : 1;
+#else
+    uint8_t     len = msglen + sizeof(secMAC_t) + sizeof(secFCS_t);
+#endif
+
+    /* Claim the counter values for this frame in one step. The application
+     * and an ack reply sent from the Rx ISR thread share the connection
+     * counter, and a value used twice would repeat the keystream.
+     */
+    BSP_ENTER_CRITICAL_SECTION(intState);
+    locCnt = *ctr;
+    *ctr  += (len + SEC_BLOCK_SIZE - 1) / SEC_BLOCK_SIZE;
+    BSP_EXIT_CRITICAL_SECTION(intState);
+  }
+  else
+  {
+    /* If an encrypted frame is to be sent to a non-connection based port use
+     * a random number as the lsb counter value. In this case only the lsb is
+     * used for a counter value during decryption. Not as secure but there
+     * are still the 32 bits in the IV.
+     */
+    locCnt = MRFI_RandomByte();
+  }
 
   /* place counter value into frame */
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(frame), F_SEC_CTR_OS, (uint8_t)(locCnt & 0xFF));
 
+#if SMPL_SECURE_MAC_SIZE > 0
+  {
+    uint32_t macCnt = locCnt;
+
+    /* Encrypt payload */
+    msg_encipher(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS, msglen, &locCnt);
+
+    /* Tag the ciphertext */
+    calcMAC(frame, msglen, macCnt, MRFI_P_PAYLOAD(frame)+F_SEC_TAG_OS);
+  }
+#else
   /* Put MAC value in */
   nwk_putNumObjectIntoMsg((void *)&sMAC, (void *)(MRFI_P_PAYLOAD(frame)+F_SEC_MAC_OS), sizeof(secMAC_t));
 
@@ -350,19 +484,69 @@ void nwk_setSecureFrame(mrfiPacket_t *frame, uint8_t msglen, uint32_t *ctr)
 
   /* Encrypt frame */
   msg_encipher(MRFI_P_PAYLOAD(frame)+F_SEC_ICHK_OS, msglen+sizeof(secMAC_t)+sizeof(secFCS_t), &locCnt);
+#endif
 
   /* Set the Encryption bit */
   PUT_INTO_FRAME(MRFI_P_PAYLOAD(frame), F_ENCRYPT_OS, F_ENCRYPT_OS_MSK);
 
-  /* Update the counter if it was a "real" counter. */
-  if (ctr)
+  return;
+}
+
+#if SMPL_SECURE_MAC_SIZE > 0
+/******************************************************************************
+ * @fn          calcMAC
+ *
+ * @brief       Calculate the truncated CBC-MAC of an enciphered frame. The
+ *              first block is the payload length, port and folded source and
+ *              destination addresses followed by the full counter value the
+ *              payload was enciphered with. The enciphered payload follows,
+ *              zero padded to a whole block. Hop count, Tx device and the
+ *              forward bit are left out since Range Extenders and the AP
+ *              change them in transit.
+ *
+ * input parameters
+ * @param   frame    - pointer to frame with enciphered payload
+ * @param   msglen   - length of payload
+ * @param   ctr      - counter value of the first payload cipher block
+ *
+ * output parameters
+ * @param   tag      - SMPL_SECURE_MAC_SIZE bytes of MAC
+ *
+ * @return      void
+ */
+static void calcMAC(mrfiPacket_t *frame, uint8_t msglen, uint32_t ctr, uint8_t *tag)
+{
+  uint8_t *src = MRFI_P_SRC_ADDR(frame);
+  uint8_t *dst = MRFI_P_DST_ADDR(frame);
+  uint8_t *msg = MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS;
+  uint8_t  i, idx;
+  uint32_t blk[2];
+
+  /* msglen is always less than 0x80 so the top bit of the first word is
+   * clear, unlike sIV in every CTR block.
+   */
+  blk[0] = ((uint32_t)msglen << 24) |
+           ((uint32_t)(GET_FROM_FRAME(MRFI_P_PAYLOAD(frame), F_PORT_OS) & F_PORT_OS_MSK) << 16) |
+           ((uint32_t)(src[0] ^ src[1] ^ src[2] ^ src[3]) << 8) |
+            (uint32_t)(dst[0] ^ dst[1] ^ dst[2] ^ dst[3]);
+  blk[1] = ctr;
+  xtea_encipher(blk);
+
+  for (idx=0; idx<msglen; )
   {
-    *ctr = locCnt;
+    for (i=0; i<sizeof(blk) && idx<msglen; ++i, ++idx)
+    {
+      ((uint8_t *)blk)[i] ^= msg[idx];
+    }
+    xtea_encipher(blk);
   }
 
+  memcpy(tag, blk, SMPL_SECURE_MAC_SIZE);
+
   return;
 }
 
+#else
 /******************************************************************************
  * @fn          calcFCS
  *
@@ -391,6 +575,7 @@ static secFCS_t calcFCS(uint8_t *msg, uint8_t len)
 
   return result;
 }
+#endif  /* SMPL_SECURE_MAC_SIZE > 0 */
 
 /******************************************************************************
  * @fn          nwk_getSecureFrame
@@ -441,6 +626,42 @@ uint8_t nwk_getSecureFrame(mrfiPacket_t *frame, uint8_t msglen, uint32_t *ctr)
        * There is no recovery attempt if the counters match but the MAC or FCS do
        * not. It is considered a rogue message.
        */
+#if SMPL_SECURE_MAC_SIZE > 0
+      /* Check the tag first. The payload is only deciphered if the frame is
+       * authentic so a forged or replayed frame costs just the MAC.
+       */
+      {
+        uint8_t  tag[SMPL_SECURE_MAC_SIZE];
+        uint8_t  i, diff = 0;
+        uint8_t  paylen = msglen-1-SMPL_SECURE_MAC_SIZE;
+
+        if (msglen < 1+SMPL_SECURE_MAC_SIZE)
+        {
+          /* too short to hold a tag */
+          diff = 1;
+        }
+        else
+        {
+          calcMAC(frame, paylen, locCnt, tag);
+          for (i=0; i<SMPL_SECURE_MAC_SIZE; ++i)
+          {
+            diff |= tag[i] ^ *(MRFI_P_PAYLOAD(frame)+F_SEC_TAG_OS+i);
+          }
+        }
+        if (diff)
+        {
+          rc = 0;
+        }
+        else
+        {
+          msg_decipher(MRFI_P_PAYLOAD(frame)+F_APP_PAYLOAD_OS, paylen, &locCnt);
+          if (!paylen)
+          {
+            locCnt++;
+          }
+        }
+      }
+#else
       msg_decipher(MRFI_P_PAYLOAD(frame)+F_SEC_ICHK_OS, msglen-1, &locCnt);
 
       /* Get MAC and make sure it matches. A failure can occur if a replayed frame happens
@@ -467,6 +688,7 @@ uint8_t nwk_getSecureFrame(mrfiPacket_t *frame, uint8_t msglen, uint32_t *ctr)
           rc = 0;
         }
       }
+#endif  /* SMPL_SECURE_MAC_SIZE > 0 */
 
       /* we're done. */
       done = 1;
@@ -546,4 +768,107 @@ uint8_t nwk_getSecureFrame(mrfiPacket_t *frame, uint8_t msglen, uint32_t *ctr)
   return rc;
 }
 
+#if NWK_KS_BLOCKS > 0
+/******************************************************************************
+ * @fn          nwk_setSecureConnFrame
+ *
+ * @brief       Secure a connection frame using the connection's keystream
+ *              cache. Blocks not in the cache are computed as usual.
+ *
+ * input parameters
+ * @param   frame   - pointer to frame to secure
+ * @param   msglen  - length of message
+ * @param   ctr     - pointer to the connection Tx counter
+ * @param   ks      - pointer to the connection Tx keystream cache
+ *
+ * output parameters
+ * @param   ctr     - counter is updated during encryption.
+ *
+ * @return      void
+ */
+void nwk_setSecureConnFrame(mrfiPacket_t *frame, uint8_t msglen, uint32_t *ctr, ksCache_t *ks)
+{
+  spKs = ks;
+  nwk_setSecureFrame(frame, msglen, ctr);
+  spKs = NULL;
+
+  return;
+}
+
+/******************************************************************************
+ * @fn          nwk_getSecureConnFrame
+ *
+ * @brief       Decrypt a connection frame using the connection's keystream
+ *              cache. Blocks not in the cache are computed as usual.
+ *
+ * input parameters
+ * @param   frame   - pointer to frame containing encrypted message
+ * @param   msglen  - length of message
+ * @param   ctr     - pointer to the connection Rx counter
+ * @param   ks      - pointer to the connection Rx keystream cache
+ *
+ * output parameters
+ * @param   ctr     - counter is updated if decryption succeeds.
+ *
+ * @return      Returns non-zero if frame decryption is valid, otherwise returns 0.
+ */
+uint8_t nwk_getSecureConnFrame(mrfiPacket_t *frame, uint8_t msglen, uint32_t *ctr, ksCache_t *ks)
+{
+  uint8_t rc;
+
+  spKs = ks;
+  rc   = nwk_getSecureFrame(frame, msglen, ctr);
+  spKs = NULL;
+
+  return rc;
+}
+
+/******************************************************************************
+ * @fn          nwk_fillKeystream
+ *
+ * @brief       Make the cache hold the keystream blocks for the next
+ *              NWK_KS_BLOCKS counter values starting at 'ctr'. Blocks already
+ *              computed for those values are kept. Meant to be called when
+ *              the device is otherwise idle, never from the Rx ISR thread.
+ *
+ * input parameters
+ * @param   ks      - pointer to keystream cache
+ * @param   ctr     - counter value of the next block to be used
+ *
+ * output parameters
+ *
+ * @return      void
+ */
+void nwk_fillKeystream(ksCache_t *ks, uint32_t ctr)
+{
+  uint32_t skip = ctr - ks->ctr;
+  uint32_t blk[2];
+  uint8_t  i, keep = 0;
+
+  if (!skip && (NWK_KS_BLOCKS == ks->num))
+  {
+    /* nothing used since the last fill */
+    return;
+  }
+
+  if (skip < ks->num)
+  {
+    keep = ks->num - (uint8_t)skip;
+    memmove(ks->ks[0], ks->ks[skip], keep * SEC_BLOCK_SIZE);
+  }
+  ks->ctr = ctr;
+
+  for (i=keep; i<NWK_KS_BLOCKS; ++i)
+  {
+    blk[0] = sIV;
+    blk[1] = ctr + i;
+    xtea_encipher(blk);
+    memcpy(ks->ks[i], blk, SEC_BLOCK_SIZE);
+  }
+  ks->num = NWK_KS_BLOCKS;
+
+  return;
+}
+#endif  /* NWK_KS_BLOCKS > 0 */
+
 #endif  /* SMPL_SECURE */
@@ -45,4 +45,9 @@ void       nwk_securityInit(void);
 fhStatus_t nwk_processSecurity(mrfiPacket_t *);
 void       nwk_setSecureFrame(mrfiPacket_t *, uint8_t, uint32_t *);
 uint8_t    nwk_getSecureFrame(mrfiPacket_t *, uint8_t, uint32_t *);
+#if defined(SMPL_SECURE) && NWK_KS_BLOCKS > 0
+void       nwk_setSecureConnFrame(mrfiPacket_t *, uint8_t, uint32_t *, ksCache_t *);
+uint8_t    nwk_getSecureConnFrame(mrfiPacket_t *, uint8_t, uint32_t *, ksCache_t *);
+void       nwk_fillKeystream(ksCache_t *, uint32_t);
+#endif
 #endif